@@ -0,0 +1,279 @@
+/**
+ * @file benchConv.c
+ * @author luwangguerde@163.com
+ * @brief Compare the im2col + gemm convolution with the per-element one it replaced, and with Winograd and FFT
+ * @version 0.1
+ * @date 2024-12-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#endif
+
+#include "benchUtil.h"
+#include "cnn.h"
+#include "conv.h"
+#include <math.h>
+#include <stdio.h>
+
+#define MIN_SECONDS .2 // keep repeating a case until it has run at least this long
+
+// the old forwardCVL loop, one convolution call per channel through matrix views
+static double timeElementwise(Mts *inputs, Mts *outputs, Mts *kernels)
+{
+    Mat input, output, kernel;
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        for (size_t c = 0; c < inputs->channel; c++)
+        {
+            mtsSliceMat(inputs, &input, c);
+            mtsSliceMat(outputs, &output, c);
+            mtsSliceMat(kernels, &kernel, c);
+            convolution(&input, &output, &kernel);
+        }
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static double timeGemm(struct CVL *cvl)
+{
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        forwardCVL(cvl);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+// the kernel and input gradients, forwardCVL has left the columns it needs
+static double timeBackward(struct CVL *cvl)
+{
+    int repeat = 0;
+    forwardCVL(cvl);
+    double start = benchNow(), elapsed;
+    do
+    {
+        backwardCVL(cvl, 0);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+/*
+The old path needs an even kernel, divides by the kernel sum and writes every cell shifted by kernelSize / 2,
+so its output is lined up with the new one before comparing.
+*/
+static double maxDifference(struct CVL *cvl, Mts *old)
+{
+    size_t k = cvl->kernelSize, area = k * k, half = k / 2;
+    size_t rowOut = cvl->outputs.height, colOut = cvl->outputs.width;
+    double diff = 0;
+    for (size_t c = 0; c < cvl->outputs.channel; c++)
+    {
+        double total = 0;
+        for (size_t i = 0; i < area; i++)
+            total += cvl->kernels.array.doubelMatrixStack[c * area + i];
+
+        for (size_t y = 0; y + half < rowOut; y++)
+            for (size_t x = 0; x + half < colOut; x++)
+            {
+                double got = cvl->outputs.array.doubelMatrixStack[(c * rowOut + y) * colOut + x] / total;
+                double expect = old->array.doubelMatrixStack[(c * rowOut + y + half) * colOut + x + half];
+                diff = fabs(got - expect) > diff ? fabs(got - expect) : diff;
+            }
+    }
+
+    return diff;
+}
+
+static void runCase(size_t channel, size_t size, size_t kernelSize)
+{
+    struct CVL cvl;
+    Mts old;
+    if (initCVL(&cvl, channel, size, size, kernelSize) ||
+        initDoubleMts(&old, channel, cvl.outputs.height, cvl.outputs.width, 0))
+    {
+        printf("init failed for %zu x %zu x %zu\n", channel, size, size);
+        return;
+    }
+    benchFillRandom(cvl.inputs.array.doubelMatrixStack, channel * size * size);
+    for (size_t i = 0; i < channel * kernelSize * kernelSize; i++) // keep the kernel sum away from 0
+        cvl.kernels.array.doubelMatrixStack[i] = 0.5 + 0.5 * rand() / RAND_MAX;
+
+    double flop = 2.0 * channel * cvl.outputs.height * cvl.outputs.width * kernelSize * kernelSize;
+    double elementwise = timeElementwise(&cvl.inputs, &old, &cvl.kernels);
+    double gemm = timeGemm(&cvl);
+
+    printf("%zu x %3zu x %3zu  k %zu  per-element %8.3f GFLOP/s  im2col+gemm %8.3f GFLOP/s  speedup %6.2fx  "
+           "max|diff| %.2e\n",
+           channel, size, size, kernelSize, flop / elementwise * 1e-9, flop / gemm * 1e-9, elementwise / gemm,
+           maxDifference(&cvl, &old));
+
+    free(old.array.doubelMatrixStack);
+    free(cvl.inputs.array.doubelMatrixStack);
+    free(cvl.outputs.array.doubelMatrixStack);
+    free(cvl.kernels.array.doubelMatrixStack);
+    free(cvl.dervsFromLastLayer.array.doubelMatrixStack);
+    free(cvl.dervsToPreviousLayer.array.doubelMatrixStack);
+    free(cvl.dervsOfKernels.array.doubelMatrixStack);
+    free(cvl.columns.array.doubleArray);
+}
+
+// the multiplier and stride only the new engine supports, reported on their own with the backward pass
+static void runStridedCase(size_t channel, size_t size, size_t kernelSize, size_t multiplier, size_t stride,
+                           size_t padding)
+{
+    struct CVL cvl;
+    if (initStridedCVL(&cvl, channel, size, size, kernelSize, multiplier, stride, padding, DOUBLE_TYPE))
+        return;
+    benchFillRandom(cvl.inputs.array.doubelMatrixStack, channel * size * size);
+
+    double flop = 2.0 * cvl.outputs.channel * cvl.outputs.height * cvl.outputs.width * kernelSize * kernelSize;
+    double gemm = timeGemm(&cvl);
+    double backward = timeBackward(&cvl); // two products of the forward size
+
+    printf("%zu x %3zu x %3zu  k %zu  multiplier %2zu  stride %zu  padding %zu  forward %8.3f GFLOP/s  "
+           "backward %8.3f GFLOP/s\n",
+           channel, size, size, kernelSize, multiplier, stride, padding, flop / gemm * 1e-9,
+           2 * flop / backward * 1e-9);
+
+    free(cvl.inputs.array.doubelMatrixStack);
+    free(cvl.outputs.array.doubelMatrixStack);
+    free(cvl.kernels.array.doubelMatrixStack);
+    free(cvl.dervsFromLastLayer.array.doubelMatrixStack);
+    free(cvl.dervsToPreviousLayer.array.doubelMatrixStack);
+    free(cvl.dervsOfKernels.array.doubelMatrixStack);
+    free(cvl.columns.array.doubleArray);
+}
+
+static double timeConvolve(Cva algorithm, Dtp dtype, const void *input, size_t channel, size_t size,
+                           const void *kernels, size_t multiplier, size_t kernelSize, size_t padding, void *workspace,
+                           void *output)
+{
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        if (dtype == FLOAT_TYPE)
+            convolveFloat(algorithm, input, channel, size, size, kernels, multiplier, kernelSize, 1, padding,
+                          workspace, output);
+        else
+            convolveDouble(algorithm, input, channel, size, size, kernels, multiplier, kernelSize, 1, padding,
+                           workspace, output);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+/*
+Every algorithm taking a shape of stride 1 on the same input, the error the largest against im2col relative to
+the largest output, the one convChooseAlgorithm picks for inference marked and the one it picks for training
+named at the end, it pays for unfolding the input again.
+*/
+static void runAlgorithms(Dtp dtype, size_t channel, size_t size, size_t kernelSize, size_t multiplier,
+                          size_t padding)
+{
+    static const char *names[] = {"im2col", "winograd", "fft"};
+    size_t cell = sizeOfDataType(dtype), outSize = convOutSize(size, kernelSize, 1, padding);
+    size_t inLength = channel * size * size, kernelLength = channel * multiplier * kernelSize * kernelSize;
+    size_t outLength = channel * multiplier * outSize * outSize;
+    Cva chosen = convChooseAlgorithm(channel, size, size, multiplier, kernelSize, 1, padding, dtype, 1);
+    Cva training = convChooseAlgorithm(channel, size, size, multiplier, kernelSize, 1, padding, dtype, 0);
+    double *input = (double *)malloc(inLength * sizeof(double)), *kernels = malloc(kernelLength * sizeof(double));
+    char *in = (char *)malloc(inLength * cell), *k = (char *)malloc(kernelLength * cell);
+    char *reference = (char *)malloc(outLength * cell), *output = (char *)malloc(outLength * cell);
+    if (!input || !kernels || !in || !k || !reference || !output)
+        goto done;
+
+    benchFillRandom(input, inLength);
+    benchFillRandom(kernels, kernelLength);
+    for (size_t i = 0; i < inLength; i++)
+        if (dtype == FLOAT_TYPE)
+            ((float *)in)[i] = (float)input[i];
+        else
+            ((double *)in)[i] = input[i];
+    for (size_t i = 0; i < kernelLength; i++)
+        if (dtype == FLOAT_TYPE)
+            ((float *)k)[i] = (float)kernels[i];
+        else
+            ((double *)k)[i] = kernels[i];
+
+    printf("%s %2zu x %3zu x %3zu  k %2zu  multiplier %2zu ", dtype == FLOAT_TYPE ? "f32" : "f64", channel, size,
+           size, kernelSize, multiplier);
+    double flop = 2.0 * outLength * kernelSize * kernelSize, im2col = 0;
+    for (Cva algorithm = CONV_IM2COL; algorithm <= CONV_FFT; algorithm++)
+    {
+        size_t length = convWorkspaceLength(algorithm, channel, size, size, multiplier, kernelSize, 1, padding);
+        void *workspace = length ? malloc(length * cell) : NULL;
+        if (!workspace)
+            continue;
+
+        char *out = algorithm == CONV_IM2COL ? reference : output;
+        double seconds = timeConvolve(algorithm, dtype, in, channel, size, k, multiplier, kernelSize, padding,
+                                      workspace, out);
+        im2col = algorithm == CONV_IM2COL ? seconds : im2col;
+        double error = 0, scale = 0;
+        for (size_t i = 0; i < outLength; i++)
+        {
+            double got = dtype == FLOAT_TYPE ? ((float *)out)[i] : ((double *)out)[i];
+            double expect = dtype == FLOAT_TYPE ? ((float *)reference)[i] : ((double *)reference)[i];
+            error = fabs(got - expect) > error ? fabs(got - expect) : error;
+            scale = fabs(expect) > scale ? fabs(expect) : scale;
+        }
+        printf(" %c%s %7.3f GFLOP/s %5.2fx err %.1e", algorithm == chosen ? '*' : ' ', names[algorithm],
+               flop / seconds * 1e-9, im2col / seconds, scale > 0 ? error / scale : error);
+        free(workspace);
+    }
+    printf("  training %s\n", names[training]);
+
+done:
+    free(input);
+    free(kernels);
+    free(in);
+    free(k);
+    free(reference);
+    free(output);
+}
+
+int main(void)
+{
+    // the old path only takes even kernels
+    runCase(1, 28, 4);
+    runCase(3, 28, 4);
+    runCase(3, 224, 4);
+
+    runStridedCase(1, 28, 3, 8, 1, 1);
+    runStridedCase(3, 224, 3, 16, 1, 1);
+    runStridedCase(3, 224, 3, 16, 2, 1);
+
+    // im2col against the algorithms of stride 1, * the one an inference layer of the shape picks
+    for (int f = 0; f < 2; f++)
+    {
+        Dtp dtype = f ? FLOAT_TYPE : DOUBLE_TYPE;
+        runAlgorithms(dtype, 8, 28, 3, 1, 1);
+        runAlgorithms(dtype, 1, 28, 3, 8, 1);
+        runAlgorithms(dtype, 16, 56, 3, 4, 1);
+        runAlgorithms(dtype, 3, 224, 3, 16, 1);
+        runAlgorithms(dtype, 8, 28, 5, 4, 2);
+        runAlgorithms(dtype, 8, 32, 7, 4, 3);
+        runAlgorithms(dtype, 4, 64, 11, 2, 5);
+        runAlgorithms(dtype, 2, 128, 15, 8, 7);
+    }
+
+    return 0;
+}
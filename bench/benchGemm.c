@@ -0,0 +1,175 @@
+/**
+ * @file benchGemm.c
+ * @author luwangguerde@163.com
+ * @brief Compare the blocked gemm with the naive triple loop it replaced, and the fused epilogue with separate passes
+ * @version 0.1
+ * @date 2024-12-02
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#endif
+
+#include "benchUtil.h"
+#include "cnn.h"
+#include "gemm.h"
+#include "simd.h"
+#include <stdio.h>
+
+#define MIN_SECONDS .2 // keep repeating a case until it has run at least this long
+
+// the i-j-k loop that used to live in crossProductDoubleMatrix, kept as the baseline
+static void naiveProduct(size_t row, size_t col, size_t mid, const double *a, const double *b, double *c)
+{
+    for (size_t i = 0; i < row; i++)
+        for (size_t j = 0; j < col; j++)
+        {
+            double cell = 0;
+            for (size_t k = 0; k < mid; k++)
+                cell += a[i * mid + k] * b[k * col + j];
+            c[i * col + j] = cell;
+        }
+}
+
+static double timeNaive(size_t m, size_t n, size_t k, const double *a, const double *b, double *c)
+{
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        naiveProduct(m, n, k, a, b, c);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static double timeGemm(Trs transA, Trs transB, size_t m, size_t n, size_t k, const double *a, const double *b,
+                       double *c)
+{
+    size_t lda = transA == TRANSPOSE ? m : k, ldb = transB == TRANSPOSE ? k : n;
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        gemmDouble(transA, transB, m, n, k, 1, a, lda, b, ldb, 0, c, n);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static double maxDifference(const double *x, const double *y, size_t length)
+{
+    double diff = 0;
+    for (size_t i = 0; i < length; i++)
+        diff = fabs(x[i] - y[i]) > diff ? fabs(x[i] - y[i]) : diff;
+
+    return diff;
+}
+
+// a x b in the given layout, where the transposed operands are stored already transposed
+static void runCase(const char *name, Trs transA, Trs transB, size_t m, size_t n, size_t k)
+{
+    double *a = (double *)malloc(sizeof(double) * m * k), *at = (double *)malloc(sizeof(double) * m * k);
+    double *b = (double *)malloc(sizeof(double) * k * n), *bt = (double *)malloc(sizeof(double) * k * n);
+    double *expect = (double *)malloc(sizeof(double) * m * n), *got = (double *)malloc(sizeof(double) * m * n);
+
+    benchFillRandom(a, m * k);
+    benchFillRandom(b, k * n);
+    for (size_t i = 0; i < m; i++)
+        for (size_t p = 0; p < k; p++)
+            at[p * m + i] = a[i * k + p];
+    for (size_t p = 0; p < k; p++)
+        for (size_t j = 0; j < n; j++)
+            bt[j * k + p] = b[p * n + j];
+
+    double flop = 2.0 * m * n * k;
+    double naive = timeNaive(m, n, k, a, b, expect);
+    double blocked = timeGemm(transA, transB, m, n, k, transA == TRANSPOSE ? at : a, transB == TRANSPOSE ? bt : b, got);
+
+    printf("%-6s %5zu x %5zu x %5zu  naive %8.3f GFLOP/s  gemm %8.3f GFLOP/s  speedup %6.2fx  max|diff| %.2e\n",
+           name, m, n, k, flop / naive * 1e-9, flop / blocked * 1e-9, naive / blocked,
+           maxDifference(expect, got, m * n));
+
+    free(a);
+    free(at);
+    free(b);
+    free(bt);
+    free(expect);
+    free(got);
+}
+
+// X x W^T + b then ReLU, as three passes over Y the way forwardFCL used to, or folded into the product
+static double timeLayer(int fused, size_t m, size_t n, size_t k, const double *x, const double *w, const double *bias,
+                        double *y)
+{
+    const Simd *simd = simdKernels();
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        if (fused)
+            gemmDoubleBiasAct(NO_TRANSPOSE, TRANSPOSE, m, n, k, x, k, w, k, bias, ACTIVATION_RELU, y, n, y, n);
+        else
+        {
+            gemmDouble(NO_TRANSPOSE, TRANSPOSE, m, n, k, 1, x, k, w, k, 0, y, n);
+            for (size_t i = 0; i < m; i++)
+                simd->addDouble(y + i * n, bias, y + i * n, n);
+            simd->reluDouble(y, 0, y, m * n);
+        }
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static void runEpilogueCase(size_t m, size_t n, size_t k)
+{
+    double *x = (double *)malloc(sizeof(double) * m * k), *w = (double *)malloc(sizeof(double) * n * k);
+    double *bias = (double *)malloc(sizeof(double) * n);
+    double *expect = (double *)malloc(sizeof(double) * m * n), *got = (double *)malloc(sizeof(double) * m * n);
+
+    benchFillRandom(x, m * k);
+    benchFillRandom(w, n * k);
+    benchFillRandom(bias, n);
+
+    double separate = timeLayer(0, m, n, k, x, w, bias, expect);
+    double fused = timeLayer(1, m, n, k, x, w, bias, got);
+
+    printf("relu   %5zu x %5zu x %5zu  separate %8.3f us  fused %8.3f us  speedup %6.2fx  max|diff| %.2e\n", m, n, k,
+           separate * 1e6, fused * 1e6, separate / fused, maxDifference(expect, got, m * n));
+
+    free(x);
+    free(w);
+    free(bias);
+    free(expect);
+    free(got);
+}
+
+int main(void)
+{
+    size_t squares[] = {64, 128, 256, 512, 1024};
+
+    for (size_t i = 0; i < sizeof(squares) / sizeof(squares[0]); i++)
+        runCase("NN", NO_TRANSPOSE, NO_TRANSPOSE, squares[i], squares[i], squares[i]);
+
+    // the shapes a batched fully connected layer of 100 neurons produces
+    runCase("NT", NO_TRANSPOSE, TRANSPOSE, 256, 100, 100); // forward, X x W^T
+    runCase("TN", TRANSPOSE, NO_TRANSPOSE, 100, 100, 256); // weight gradient, dY^T x X
+    runCase("NN", NO_TRANSPOSE, NO_TRANSPOSE, 256, 100, 100); // input gradient, dY x W
+    runCase("NN", NO_TRANSPOSE, NO_TRANSPOSE, 100, 1, 100);   // single sample, W x x
+    runCase("TN", TRANSPOSE, NO_TRANSPOSE, 100, 1, 100);      // single sample, W^T x dy
+
+    // a layer's forward with bias and activation, wide enough that Y no longer fits in L1
+    runEpilogueCase(256, 100, 100);
+    runEpilogueCase(256, 1024, 256);
+    runEpilogueCase(1024, 1024, 64);
+
+    return 0;
+}
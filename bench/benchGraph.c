@@ -0,0 +1,245 @@
+/**
+ * @file benchGraph.c
+ * @author luwangguerde@163.com
+ * @brief Inference latency per sample of the layer path against a compiled plan, and with prepared weights
+ * @version 0.1
+ * @date 2024-12-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#endif
+
+#include "benchUtil.h"
+#include "cnn.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MIN_SECONDS .04 // keep repeating a path in a round until it has run at least this long
+#define ROUNDS 5         // the paths take turns, each keeps its fastest round
+
+/*
+The model and the plans share the model's buffers and an inference model may write over its input, so every run
+gets the input again, the same copy for all of them.
+*/
+static double timeRound(Model *model, Plan *plan, const char *input, size_t bytes)
+{
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        memcpy(model->input.array.charArray, input, bytes);
+        if (plan)
+            runPlan(plan);
+        else
+            forwardModel(model);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static double timeModel(Model *model) // for runPrepared, the input left as it is
+{
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        forwardModel(model);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < 5 * MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static double valueAt(const Vec *vec, size_t i)
+{
+    return vec->dtype == FLOAT_TYPE ? vec->array.floatArray[i] : vec->array.doubleArray[i];
+}
+
+static double maxDifference(const Vec *x, const Vec *y)
+{
+    double diff = x->length == y->length ? 0 : INFINITY;
+    for (size_t i = 0; i < x->length && i < y->length; i++)
+        diff = fabs(valueAt(x, i) - valueAt(y, i)) > diff ? fabs(valueAt(x, i) - valueAt(y, i)) : diff;
+
+    return diff;
+}
+
+// the same random input through the layers and both plans, then the three paths timed and compared
+static void runCase(const char *name, Model *model, int print)
+{
+    Graph graph;
+    Plan raw, fused;
+    if (graphOfModel(&graph, model) || compilePlan(&raw, &graph))
+    {
+        printf("%s: can't compile the graph\n", name);
+        freeGraph(&graph);
+        return;
+    }
+    size_t rawNodes = graph.nodeNum;
+    if (optimizeGraph(&graph) || compilePlan(&fused, &graph))
+    {
+        printf("%s: can't compile the optimized graph\n", name);
+        freePlan(&raw);
+        freeGraph(&graph);
+        return;
+    }
+    if (print)
+        printGraph(&graph, stdout);
+
+    size_t bytes = model->input.length * sizeOfDataType(model->dtype);
+    size_t outputBytes = model->output.length * sizeOfDataType(model->dtype);
+    char *input = (char *)malloc(bytes), *output = (char *)malloc(outputBytes);
+    if (!input || !output)
+    {
+        free(input);
+        free(output);
+        freePlan(&raw);
+        freePlan(&fused);
+        freeGraph(&graph);
+        return;
+    }
+    for (size_t i = 0; i < model->input.length; i++)
+    {
+        double x = 2.0 * rand() / RAND_MAX - 1.0;
+        if (model->dtype == FLOAT_TYPE)
+            ((float *)input)[i] = (float)x;
+        else
+            ((double *)input)[i] = x;
+    }
+
+    // one run of each to warm the caches, then rounds taking turns so drift hits the three alike
+    double layers = INFINITY, unfused = INFINITY, planned = INFINITY;
+    for (int round = 0; round <= ROUNDS; round++)
+    {
+        double t[3] = {timeRound(model, NULL, input, bytes), timeRound(model, &raw, input, bytes),
+                       timeRound(model, &fused, input, bytes)};
+        if (round == 0)
+            continue;
+        layers = t[0] < layers ? t[0] : layers;
+        unfused = t[1] < unfused ? t[1] : unfused;
+        planned = t[2] < planned ? t[2] : planned;
+    }
+
+    // the plan's output is the model's, so the layers' is kept aside to compare
+    memcpy(model->input.array.charArray, input, bytes);
+    forwardModel(model);
+    memcpy(output, model->output.array.charArray, outputBytes);
+    Vec expected = {.array.charArray = output, .length = model->output.length, .dtype = model->dtype};
+    memcpy(model->input.array.charArray, input, bytes);
+    runPlan(&raw);
+    double rawDiff = maxDifference(&expected, &raw.output);
+    memcpy(model->input.array.charArray, input, bytes);
+    runPlan(&fused);
+    double fusedDiff = maxDifference(&expected, &fused.output);
+
+    double perSample = 1e6 / model->batchSize;
+    printf("%-26s layers %9.2f us  plan of %2zu ops %9.2f us  fused to %2zu ops %9.2f us  speedup %5.2fx  "
+           "max|diff| %.2e %.2e  buffers %zu KiB, plan %zu B\n",
+           name, layers * perSample, rawNodes, unfused * perSample, graph.nodeNum, planned * perSample,
+           layers / planned, rawDiff, fusedDiff, model->bufferBytes / 1024, planFootprint(&fused));
+
+    free(output);
+    free(input);
+    freePlan(&raw);
+    freePlan(&fused);
+    freeGraph(&graph);
+}
+
+// forwardModel before and after prepareModel, the same weights and input
+static void runPrepared(const char *name, Model *model)
+{
+    size_t bytes = model->input.length * sizeOfDataType(model->dtype);
+    char *input = (char *)malloc(bytes), *output = (char *)malloc(model->output.length * sizeOfDataType(model->dtype));
+    if (!input || !output)
+    {
+        free(input);
+        free(output);
+        return;
+    }
+    for (size_t i = 0; i < model->input.length; i++)
+    {
+        double x = 2.0 * rand() / RAND_MAX - 1.0;
+        if (model->dtype == FLOAT_TYPE)
+            ((float *)input)[i] = (float)x;
+        else
+            ((double *)input)[i] = x;
+    }
+
+    memcpy(model->input.array.charArray, input, bytes);
+    double unpacked = timeModel(model);
+    memcpy(model->input.array.charArray, input, bytes);
+    forwardModel(model);
+    memcpy(output, model->output.array.charArray, model->output.length * sizeOfDataType(model->dtype));
+    Vec before = {.array.charArray = output, .length = model->output.length, .dtype = model->dtype};
+
+    double start = benchNow();
+    Sts rcode = prepareModel(model);
+    double prepare = benchNow() - start;
+    double packed = timeModel(model);
+    memcpy(model->input.array.charArray, input, bytes);
+    forwardModel(model);
+
+    double perSample = 1e6 / model->batchSize;
+    printf("%-26s layers %9.2f us  prepared %9.2f us  speedup %5.2fx  max|diff| %.2e  prepareModel %.2f ms%s\n",
+           name, unpacked * perSample, packed * perSample, unpacked / packed,
+           maxDifference(&model->output, &before), prepare * 1e3, rcode == OK ? "" : " (failed)");
+    free(input);
+    free(output);
+}
+
+static void runMLP(size_t batchSize, Dtp dtype)
+{
+    Model model;
+    char name[64];
+    snprintf(name, sizeof(name), "mlp 784-512-256-10 %s x%zu", dtype == FLOAT_TYPE ? "f32" : "f64", batchSize);
+    initInferenceModel(&model, batchSize, dtype);
+    modelAddFCL(&model, 784, 512, ReLU, ReLU_derivative);
+    modelAddFCL(&model, 512, 256, ReLU, ReLU_derivative);
+    modelAddFCL(&model, 256, 10, noActivation, noActivation_derivative);
+    if (compileModel(&model) == OK)
+    {
+        runCase(name, &model, 0);
+        runPrepared(name, &model);
+    }
+    freeModel(&model);
+}
+
+// conv -> max pool -> conv -> max pool -> two fully connected, the layers of demo-sized images
+static void runCNN(Dtp dtype, int print)
+{
+    Model model;
+    char name[64];
+    snprintf(name, sizeof(name), "cnn 1x28x28 %s x1", dtype == FLOAT_TYPE ? "f32" : "f64");
+    initInferenceModel(&model, 1, dtype);
+    modelAddCVL(&model, 1, 28, 28, 3, 8, 1, 1);
+    modelAddPL(&model, 8, 28, 28, 2, 2, 0, POOLING_MAX);
+    modelAddCVL(&model, 8, 14, 14, 3, 2, 1, 1);
+    modelAddPL(&model, 16, 14, 14, 2, 2, 0, POOLING_MAX);
+    modelAddFCL(&model, 16 * 7 * 7, 128, ReLU, ReLU_derivative);
+    modelAddFCL(&model, 128, 10, noActivation, noActivation_derivative);
+    if (compileModel(&model) == OK)
+        runCase(name, &model, print);
+    freeModel(&model);
+}
+
+int main(int argc, char const *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    runCNN(FLOAT_TYPE, 1);
+    runCNN(DOUBLE_TYPE, 0);
+    runMLP(1, DOUBLE_TYPE);
+    runMLP(1, FLOAT_TYPE);
+    runMLP(64, DOUBLE_TYPE);
+    runMLP(64, FLOAT_TYPE);
+
+    return 0;
+}
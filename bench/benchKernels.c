@@ -0,0 +1,561 @@
+/**
+ * @file benchKernels.c
+ * @author luwangguerde@163.com
+ * @brief Sweep the sizes of every kernel of base.c, functions.c and layers.c, and keep the results as JSON
+ * @version 0.1
+ * @date 2024-12-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#endif
+
+#include "benchUtil.h"
+#include "cnn.h"
+#include "simd.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MIN_SECONDS .2 // of every case, split into SAMPLES runs of which the median is reported
+#define SAMPLES 5
+#define MAX_RESULTS 128
+#define DEFAULT_TOLERANCE .1 // slower than the baseline by more than this fraction is a regression
+
+/*
+flop and bytes are what the kernel has to do, not what one implementation happens to spend:
+useful arithmetic, a compare or an exp counted as one, and every operand read once, every result written once.
+So the numbers of two commits compare even when one of them does the work differently.
+*/
+struct RESULT
+{
+    char kernel[32];
+    char shape[48];
+    double seconds; // per op, the median of the samples
+    double flop;    // per op
+    double bytes;   // per op
+    long repeat;    // ops timed, over every sample
+};
+
+static struct RESULT results[MAX_RESULTS];
+static size_t resultNum;
+static double minSeconds = MIN_SECONDS;
+static const char *filter; // only the kernels whose name holds it
+static FILE *table;        // the human readable report, stderr when the JSON goes to stdout
+
+typedef void (*BenchOp)(void *args);
+
+static int wanted(const char *kernel)
+{
+    return !filter || strstr(kernel, filter);
+}
+
+static void fillRandom(char *array, size_t length, Dtp dtype)
+{
+    for (size_t i = 0; i < length; i++)
+        if (dtype == FLOAT_TYPE)
+            ((float *)array)[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        else
+            ((double *)array)[i] = 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+static double timeOp(BenchOp op, void *args, long *repeat)
+{
+    double samples[SAMPLES];
+    op(args); // warm the caches and the thread pool
+    *repeat = 0;
+    for (int s = 0; s < SAMPLES; s++)
+    {
+        long count = 0;
+        double start = benchNow(), elapsed;
+        do
+        {
+            op(args);
+            count++;
+            elapsed = benchNow() - start;
+        } while (elapsed < minSeconds / SAMPLES);
+        samples[s] = elapsed / count;
+        *repeat += count;
+    }
+
+    for (int i = 1; i < SAMPLES; i++) // the median is robust to the odd sample a context switch lands in
+        for (int j = i; j > 0 && samples[j] < samples[j - 1]; j--)
+        {
+            double swap = samples[j];
+            samples[j] = samples[j - 1];
+            samples[j - 1] = swap;
+        }
+
+    return samples[SAMPLES / 2];
+}
+
+static void record(const char *kernel, const char *shape, BenchOp op, void *args, double flop, double bytes)
+{
+    if (resultNum == MAX_RESULTS)
+        return;
+
+    struct RESULT *result = &results[resultNum++];
+    snprintf(result->kernel, sizeof(result->kernel), "%s", kernel);
+    snprintf(result->shape, sizeof(result->shape), "%s", shape);
+    result->seconds = timeOp(op, args, &result->repeat);
+    result->flop = flop;
+    result->bytes = bytes;
+
+    fprintf(table, "%-26s %-30s %14.1f ns/op %9.3f GFLOP/s %9.3f GB/s\n", kernel, shape, result->seconds * 1e9,
+            flop / result->seconds * 1e-9, bytes / result->seconds * 1e-9);
+    fflush(table);
+}
+
+struct MATRIX_ARGS
+{
+    Mat *a;
+    Mat *b;
+    Mat *c;
+    int size; // the kernel size of poolingMax
+};
+
+struct VECTOR_ARGS
+{
+    Vec *a;
+    Vec *b;
+    Vec *c;
+};
+
+static void productOp(void *args)
+{
+    struct MATRIX_ARGS *m = (struct MATRIX_ARGS *)args;
+    crossProductDoubleMatrix(m->a, m->b, m->c);
+}
+
+static void addOp(void *args)
+{
+    struct VECTOR_ARGS *v = (struct VECTOR_ARGS *)args;
+    addDoubleVector(v->a, v->b, v->c);
+}
+
+static void softmaxOp(void *args)
+{
+    struct VECTOR_ARGS *v = (struct VECTOR_ARGS *)args;
+    softmax(v->a, v->c);
+}
+
+static void convolutionOp(void *args)
+{
+    struct MATRIX_ARGS *m = (struct MATRIX_ARGS *)args;
+    convolution(m->a, m->c, m->b);
+}
+
+static void poolingOp(void *args)
+{
+    struct MATRIX_ARGS *m = (struct MATRIX_ARGS *)args;
+    poolingMax(m->a, m->c, m->size);
+}
+
+static void forwardFCLOp(void *args)
+{
+    forwardFCL((struct FCL *)args);
+}
+
+static void backwardFCLOp(void *args)
+{
+    backwardFCL((struct FCL *)args, 0); // a step of 0 keeps the weights of every repeat the same
+}
+
+static void forwardCVLOp(void *args)
+{
+    forwardCVL((struct CVL *)args);
+}
+
+struct LOSS_ARGS
+{
+    struct OL *ol;
+    Label *labels;
+    double loss;
+};
+
+static void lossOLOp(void *args)
+{
+    struct LOSS_ARGS *l = (struct LOSS_ARGS *)args;
+    lossOL(l->ol, l->labels, &l->loss);
+}
+
+static void forwardPLOp(void *args)
+{
+    forwardPL((struct PL *)args);
+}
+
+static void gradPLOp(void *args)
+{
+    gradPL((struct PL *)args);
+}
+
+static void productCase(size_t m, size_t k, size_t n)
+{
+    if (!wanted("crossProductDoubleMatrix"))
+        return;
+
+    struct MATRIX_ARGS args = {.a = genDoubleMat(m, k, 0), .b = genDoubleMat(k, n, 0), .c = genDoubleMat(m, n, 0)};
+    benchFillRandom(args.a->array.doubleMatrix, m * k);
+    benchFillRandom(args.b->array.doubleMatrix, k * n);
+
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zux%zu", m, k, n);
+    record("crossProductDoubleMatrix", shape, productOp, &args, 2.0 * m * n * k,
+           sizeof(double) * (m * k + k * n + m * n));
+
+    freeMat(args.a);
+    freeMat(args.b);
+    freeMat(args.c);
+}
+
+static void addCase(size_t length)
+{
+    if (!wanted("addDoubleVector"))
+        return;
+
+    struct VECTOR_ARGS args = {genDoubleVec(length, 0), genDoubleVec(length, 0), genDoubleVec(length, 0)};
+    benchFillRandom(args.a->array.doubleArray, length);
+    benchFillRandom(args.b->array.doubleArray, length);
+
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zu", length);
+    record("addDoubleVector", shape, addOp, &args, length, 3.0 * sizeof(double) * length);
+
+    freeVec(args.a);
+    freeVec(args.b);
+    freeVec(args.c);
+}
+
+static void softmaxCase(size_t length)
+{
+    if (!wanted("softmax"))
+        return;
+
+    struct VECTOR_ARGS args = {genDoubleVec(length, 0), NULL, genDoubleVec(length, 0)};
+    benchFillRandom(args.a->array.doubleArray, length);
+
+    // the max, the shift, the exp, the sum and the scale of every element
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zu", length);
+    record("softmax", shape, softmaxOp, &args, 5.0 * length, 2.0 * sizeof(double) * length);
+
+    freeVec(args.a);
+    freeVec(args.c);
+}
+
+static void convolutionCase(size_t size, size_t kernelSize)
+{
+    if (!wanted("convolution"))
+        return;
+
+    size_t sizeOut = size - kernelSize + 1;
+    struct MATRIX_ARGS args = {.a = genDoubleMat(size, size, 0), .b = genDoubleMat(kernelSize, kernelSize, 0),
+                               .c = genDoubleMat(sizeOut, sizeOut, 0)};
+    benchFillRandom(args.a->array.doubleMatrix, size * size);
+    for (size_t i = 0; i < kernelSize * kernelSize; i++) // keep the kernel sum away from 0
+        args.b->array.doubleMatrix[i] = 0.5 + 0.5 * rand() / RAND_MAX;
+
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zu k%zu", size, size, kernelSize);
+    record("convolution", shape, convolutionOp, &args, 2.0 * sizeOut * sizeOut * kernelSize * kernelSize,
+           sizeof(double) * (size * size + kernelSize * kernelSize + sizeOut * sizeOut));
+
+    freeMat(args.a);
+    freeMat(args.b);
+    freeMat(args.c);
+}
+
+static void poolingCase(size_t size, int kernelSize)
+{
+    if (!wanted("poolingMax"))
+        return;
+
+    size_t sizeOut = size / kernelSize;
+    struct MATRIX_ARGS args = {genDoubleMat(size, size, 0), NULL, genDoubleMat(sizeOut, sizeOut, 0), kernelSize};
+    benchFillRandom(args.a->array.doubleMatrix, size * size);
+
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zu k%d", size, size, kernelSize);
+    record("poolingMax", shape, poolingOp, &args, (double)size * size,
+           sizeof(double) * (size * size + sizeOut * sizeOut));
+
+    freeMat(args.a);
+    freeMat(args.c);
+}
+
+static void fclCase(size_t neuronNumIn, size_t neuronNumOut, size_t batchSize, Dtp dtype)
+{
+    int forward = wanted("forwardFCL"), backward = wanted("backwardFCL");
+    if (!forward && !backward)
+        return;
+
+    Arena arena;
+    struct FCL fcl;
+    if (initArena(&arena, sizeofFCL(neuronNumIn, neuronNumOut, batchSize, dtype)) ||
+        initArenaFCL(&fcl, &arena, neuronNumIn, neuronNumOut, batchSize, dtype, ReLU, ReLU_derivative))
+    {
+        fprintf(stderr, "init failed for the FCL %zu x %zu\n", neuronNumIn, neuronNumOut);
+        return;
+    }
+    fillRandom(fcl.input.array.charArray, batchSize * neuronNumIn, dtype);
+    fillRandom(fcl.weight.array.charArray, neuronNumOut * neuronNumIn, dtype);
+    fillRandom(fcl.bias.array.charArray, neuronNumOut, dtype);
+    fillRandom(fcl.dervFromLastLayer.array.charArray, batchSize * neuronNumOut, dtype);
+
+    double size = sizeOfDataType(dtype), in = neuronNumIn, out = neuronNumOut, batch = batchSize;
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zu batch %zu %s", neuronNumIn, neuronNumOut, batchSize,
+             dtype == FLOAT_TYPE ? "float" : "double");
+    // the product, then the bias and the activation of every output
+    if (forward)
+        record("forwardFCL", shape, forwardFCLOp, &fcl, 2 * batch * in * out + 2 * batch * out,
+               size * (batch * in + out * in + out + batch * out));
+    // the gradient of the weight and of the input, then the step over the weight
+    if (backward)
+    {
+        forwardFCL(&fcl);
+        record("backwardFCL", shape, backwardFCLOp, &fcl, 4 * batch * in * out + 2 * out * in,
+               size * (2 * batch * in + batch * out + 2 * out * in));
+    }
+
+    freeArena(&arena);
+}
+
+static void cvlCase(size_t channelIn, size_t size, size_t kernelSize, size_t multiplier, size_t stride, size_t padding,
+                    Dtp dtype)
+{
+    if (!wanted("forwardCVL"))
+        return;
+
+    Arena arena;
+    struct CVL cvl;
+    if (initArena(&arena, sizeofCVL(channelIn, size, size, kernelSize, multiplier, stride, padding, dtype)) ||
+        initArenaCVL(&cvl, &arena, channelIn, size, size, kernelSize, multiplier, stride, padding, dtype))
+    {
+        fprintf(stderr, "init failed for the CVL %zu x %zu x %zu\n", channelIn, size, size);
+        return;
+    }
+    size_t channelOut = cvl.outputs.channel, area = cvl.outputs.height * cvl.outputs.width;
+    fillRandom(cvl.inputs.array.charArray, channelIn * size * size, dtype);
+    fillRandom(cvl.kernels.array.charArray, channelOut * kernelSize * kernelSize, dtype);
+
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zux%zu k%zu m%zu s%zu p%zu %s", channelIn, size, size, kernelSize, multiplier,
+             stride, padding, dtype == FLOAT_TYPE ? "float" : "double");
+    record("forwardCVL", shape, forwardCVLOp, &cvl, 2.0 * channelOut * area * kernelSize * kernelSize,
+           (double)sizeOfDataType(dtype) *
+               (channelIn * size * size + channelOut * kernelSize * kernelSize + channelOut * area));
+
+    freeArena(&arena);
+}
+
+static void olCase(size_t classNum, size_t batchSize, Dtp dtype)
+{
+    if (!wanted("lossOL"))
+        return;
+
+    Arena arena;
+    struct OL ol;
+    Vec labels;
+    if (initArena(&arena, sizeofOL(classNum, batchSize, dtype) + arenaAlignedSize(sizeof(int) * batchSize)) ||
+        initOL(&ol, &arena, classNum, batchSize, dtype) || initArenaVec(&arena, &labels, batchSize, INT_TYPE, 0))
+    {
+        fprintf(stderr, "init failed for the OL %zu x %zu\n", batchSize, classNum);
+        return;
+    }
+    fillRandom(ol.input.array.charArray, batchSize * classNum, dtype);
+    for (size_t i = 0; i < batchSize; i++)
+        labels.array.intArray[i] = (int)(i % classNum);
+
+    // the max, the exp, the sum and the scale of every logit, read twice and the gradient written
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zu %s", batchSize, classNum, dtype == FLOAT_TYPE ? "float" : "double");
+    struct LOSS_ARGS args = {&ol, &labels, 0};
+    record("lossOL", shape, lossOLOp, &args, 4.0 * batchSize * classNum,
+           3.0 * sizeOfDataType(dtype) * batchSize * classNum);
+
+    freeArena(&arena);
+}
+
+static void plCase(size_t channel, size_t size, size_t kernelSize, size_t stride, size_t padding, Plm mode, Dtp dtype)
+{
+    if (!wanted("forwardPL") && !wanted("gradPL"))
+        return;
+
+    Arena arena;
+    struct PL pl;
+    if (initArena(&arena, sizeofPL(channel, size, size, kernelSize, stride, padding, mode, dtype)) ||
+        initArenaPL(&pl, &arena, channel, size, size, kernelSize, stride, padding, mode, dtype))
+    {
+        fprintf(stderr, "init failed for the PL %zu x %zu x %zu\n", channel, size, size);
+        return;
+    }
+    size_t outSize = channel * pl.outputs.height * pl.outputs.width, inSize = channel * size * size;
+    fillRandom(pl.inputs.array.charArray, inSize, dtype);
+    fillRandom(pl.dervsFromLastLayer.array.charArray, outSize, dtype);
+
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zux%zu k%zu s%zu p%zu %s %s", channel, size, size, kernelSize, stride, padding,
+             mode == POOLING_MAX ? "max" : "avg", dtype == FLOAT_TYPE ? "float" : "double");
+    // a compare or an add per window cell, the backward of max pooling adds once per output
+    double cells = (double)outSize * kernelSize * kernelSize;
+    double bytes = (double)sizeOfDataType(dtype) * (inSize + outSize) + (mode == POOLING_MAX ? outSize : 0);
+    if (wanted("forwardPL"))
+        record("forwardPL", shape, forwardPLOp, &pl, cells, bytes);
+    if (wanted("gradPL"))
+    {
+        forwardPL(&pl); // the argmax gradPL scatters through
+        record("gradPL", shape, gradPLOp, &pl, mode == POOLING_MAX ? (double)outSize : cells, bytes);
+    }
+
+    freeArena(&arena);
+}
+
+// one result per line, so a run is diffed line by line and read back as a baseline without a JSON parser
+static Sts writeJson(const char *path)
+{
+    FILE *stream = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!stream)
+        return ERROR;
+
+    fprintf(stream, "{\n  \"suite\": \"benchKernels\",\n  \"simd\": \"%s\",\n  \"threads\": %zu,\n",
+            simdKernels()->name, threadPoolSize());
+    fprintf(stream, "  \"min_seconds\": %g,\n  \"results\": [\n", minSeconds);
+    for (size_t i = 0; i < resultNum; i++)
+    {
+        struct RESULT *result = &results[i];
+        fprintf(stream,
+                "    {\"kernel\": \"%s\", \"shape\": \"%s\", \"ns_per_op\": %.6g, \"gflops\": %.6g, "
+                "\"bytes_per_second\": %.6g, \"repeat\": %ld}%s\n",
+                result->kernel, result->shape, result->seconds * 1e9, result->flop / result->seconds * 1e-9,
+                result->bytes / result->seconds, result->repeat, i + 1 < resultNum ? "," : "");
+    }
+    fprintf(stream, "  ]\n}\n");
+
+    return stream == stdout || fclose(stream) == 0 ? OK : ERROR;
+}
+
+// the regressions against a file writeJson wrote, the cases missing from either side are skipped
+static size_t compareBaseline(const char *path, double tolerance)
+{
+    FILE *stream = fopen(path, "r");
+    if (!stream)
+    {
+        fprintf(stderr, "can't read the baseline %s\n", path);
+        return 1;
+    }
+
+    size_t regressions = 0;
+    char line[512], kernel[32], shape[48];
+    double before;
+    fprintf(table, "\nagainst %s, tolerance %.0f%%\n", path, tolerance * 100);
+    while (fgets(line, sizeof(line), stream))
+    {
+        if (sscanf(line, " {\"kernel\": \"%31[^\"]\", \"shape\": \"%47[^\"]\", \"ns_per_op\": %lf", kernel, shape,
+                   &before) != 3)
+            continue;
+
+        for (size_t i = 0; i < resultNum; i++)
+            if (!strcmp(results[i].kernel, kernel) && !strcmp(results[i].shape, shape))
+            {
+                double ratio = results[i].seconds * 1e9 / before;
+                const char *verdict = ratio > 1 + tolerance ? "REGRESSION" : ratio < 1 - tolerance ? "faster" : "";
+                regressions += ratio > 1 + tolerance;
+                fprintf(table, "%-26s %-30s %14.1f -> %14.1f ns/op %7.2fx %s\n", kernel, shape, before,
+                        results[i].seconds * 1e9, ratio, verdict);
+            }
+    }
+    fclose(stream);
+
+    return regressions;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [--json FILE|-] [--baseline FILE] [--tolerance FRACTION] [--filter KERNEL] [--seconds S]\n"
+            "  --json      write the results as JSON, - for stdout\n"
+            "  --baseline  compare with an earlier --json run, exit 1 on a case slower by more than the tolerance\n"
+            "  --tolerance %.2f by default\n"
+            "  --filter    only the kernels whose name holds KERNEL\n"
+            "  --seconds   of every case, %.2f by default\n",
+            program, DEFAULT_TOLERANCE, MIN_SECONDS);
+}
+
+int main(int argc, char const *argv[])
+{
+    const char *json = NULL, *baseline = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && !strcmp(argv[i], "--json"))
+            json = argv[++i];
+        else if (i + 1 < argc && !strcmp(argv[i], "--baseline"))
+            baseline = argv[++i];
+        else if (i + 1 < argc && !strcmp(argv[i], "--tolerance"))
+            tolerance = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--filter"))
+            filter = argv[++i];
+        else if (i + 1 < argc && !strcmp(argv[i], "--seconds"))
+            minSeconds = atof(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    table = json && !strcmp(json, "-") ? stderr : stdout;
+    srand(1); // the same data every run
+
+    fprintf(table, "%s kernels, %zu threads\n", simdKernels()->name, threadPoolSize());
+    for (size_t size = 32; size <= 512; size *= 2)
+        productCase(size, size, size);
+    productCase(64, 784, 128);
+
+    for (size_t length = 1 << 10; length <= 1 << 22; length <<= 4)
+        addCase(length);
+
+    softmaxCase(10);
+    for (size_t length = 1 << 10; length <= 1 << 22; length <<= 4)
+        softmaxCase(length);
+
+    olCase(10, 64, DOUBLE_TYPE);
+    olCase(10, 64, FLOAT_TYPE);
+    olCase(1000, 64, FLOAT_TYPE);
+
+    convolutionCase(28, 2);
+    convolutionCase(128, 2);
+    convolutionCase(128, 4);
+    convolutionCase(512, 4);
+
+    poolingCase(28, 2);
+    poolingCase(256, 2);
+    poolingCase(1024, 2);
+    poolingCase(1024, 4);
+
+    fclCase(784, 128, 1, DOUBLE_TYPE);
+    fclCase(784, 128, 64, DOUBLE_TYPE);
+    fclCase(784, 128, 64, FLOAT_TYPE);
+    fclCase(1024, 1024, 256, DOUBLE_TYPE);
+    fclCase(1024, 1024, 256, FLOAT_TYPE);
+
+    cvlCase(1, 28, 3, 8, 1, 1, DOUBLE_TYPE);
+    cvlCase(8, 28, 3, 2, 1, 1, DOUBLE_TYPE);
+    cvlCase(16, 56, 3, 1, 1, 1, DOUBLE_TYPE);
+    cvlCase(16, 56, 3, 1, 1, 1, FLOAT_TYPE);
+    cvlCase(3, 224, 5, 4, 2, 2, FLOAT_TYPE);
+
+    plCase(16, 56, 2, 2, 0, POOLING_MAX, DOUBLE_TYPE);
+    plCase(16, 56, 2, 2, 0, POOLING_MAX, FLOAT_TYPE);
+    plCase(64, 112, 3, 2, 1, POOLING_MAX, FLOAT_TYPE);
+    plCase(64, 56, 3, 1, 1, POOLING_AVERAGE, FLOAT_TYPE);
+
+    if (json && writeJson(json) == ERROR)
+    {
+        fprintf(stderr, "can't write %s\n", json);
+        return 1;
+    }
+
+    return baseline && compareBaseline(baseline, tolerance) ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file benchQuant.c
+ * @author luwangguerde@163.com
+ * @brief The accuracy of an int8 quantized MLP against the double one it came from, and the throughput of both
+ * @version 0.1
+ * @date 2024-12-17
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#endif
+
+#include "benchUtil.h"
+#include "cnn.h"
+#include "simd.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MIN_SECONDS .2 // keep repeating a case until it has run at least this long
+#define CALIBRATION_BATCHES 8
+#define TEST_BATCHES 8
+
+// a batch of inputs of model, in the model's type
+static Vec randomBatch(Model *model)
+{
+    Vec batch = {.length = model->input.length, .dtype = model->dtype};
+    batch.array.charArray = (char *)malloc(batch.length * sizeOfDataType(model->dtype));
+    for (size_t i = 0; i < batch.length; i++)
+        if (model->dtype == FLOAT_TYPE)
+            batch.array.floatArray[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        else
+            batch.array.doubleArray[i] = 2.0 * rand() / RAND_MAX - 1.0;
+
+    return batch;
+}
+
+static void buildMlp(Model *model, size_t batchSize, Dtp dtype, const size_t *widths, size_t depth)
+{
+    initInferenceModel(model, batchSize, dtype);
+    for (size_t i = 0; i + 1 < depth; i++)
+        if (i + 2 < depth)
+            modelAddFCL(model, widths[i], widths[i + 1], ReLU, ReLU_derivative);
+        else
+            modelAddFCL(model, widths[i], widths[i + 1], noActivation, noActivation_derivative);
+    compileModel(model);
+}
+
+static double modelValue(Model *model, size_t i)
+{
+    return model->dtype == FLOAT_TYPE ? model->output.array.floatArray[i] : model->output.array.doubleArray[i];
+}
+
+// max|diff|, the RMS of the difference relative to the RMS of the output, and how often the top class agrees
+static void reportAccuracy(Model *model, QModel *qmodel, const Vec *batches, size_t batchNum)
+{
+    size_t classes = model->output.length / model->batchSize, agree = 0, rows = 0;
+    double maxDiff = 0, squaredDiff = 0, squaredRef = 0;
+    for (size_t k = 0; k < batchNum; k++)
+    {
+        memcpy(model->input.array.charArray, batches[k].array.charArray,
+               batches[k].length * sizeOfDataType(model->dtype));
+        forwardModel(model);
+        for (size_t i = 0; i < qmodel->input.length; i++)
+            qmodel->input.array.floatArray[i] = (float)batches[k].array.doubleArray[i];
+        forwardQModel(qmodel);
+
+        const float *quantized = qmodel->output.array.floatArray;
+        for (size_t row = 0; row < model->batchSize; row++, rows++)
+        {
+            size_t best = 0, bestQuantized = 0;
+            for (size_t j = 0; j < classes; j++)
+            {
+                size_t i = row * classes + j;
+                double diff = fabs(modelValue(model, i) - quantized[i]);
+                maxDiff = diff > maxDiff ? diff : maxDiff;
+                squaredDiff += diff * diff;
+                squaredRef += modelValue(model, i) * modelValue(model, i);
+                best = modelValue(model, i) > modelValue(model, row * classes + best) ? j : best;
+                bestQuantized = quantized[i] > quantized[row * classes + bestQuantized] ? j : bestQuantized;
+            }
+            agree += best == bestQuantized;
+        }
+    }
+
+    printf("accuracy  max|diff| %.2e  relative RMS %.2e  top-1 agreement %zu / %zu\n", maxDiff,
+           sqrt(squaredDiff / squaredRef), agree, rows);
+}
+
+static double timeModel(Model *model)
+{
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        forwardModel(model);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static double timeQModel(QModel *qmodel)
+{
+    int repeat = 0;
+    double start = benchNow(), elapsed;
+    do
+    {
+        forwardQModel(qmodel);
+        repeat++;
+        elapsed = benchNow() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    return elapsed / repeat;
+}
+
+static void runCase(size_t batchSize, const size_t *widths, size_t depth)
+{
+    Model model, floatModel;
+    buildMlp(&model, batchSize, DOUBLE_TYPE, widths, depth);
+    buildMlp(&floatModel, batchSize, FLOAT_TYPE, widths, depth);
+
+    // random weights of a trained-like scale, the float model gets the same so all three compute the same function
+    for (size_t l = 0; l < model.layerNum; l++)
+    {
+        struct FCL *from = &model.layers[l].layer.fcl, *to = &floatModel.layers[l].layer.fcl;
+        benchFillRandom(from->weight.array.doubleMatrix, from->neuronNumOut * from->neuronNumIn);
+        benchFillRandom(from->bias.array.doubleArray, from->neuronNumOut);
+        for (size_t i = 0; i < from->neuronNumOut * from->neuronNumIn; i++)
+            from->weight.array.doubleMatrix[i] *= sqrt(3.0 / from->neuronNumIn);
+        for (size_t i = 0; i < from->neuronNumOut; i++)
+            from->bias.array.doubleArray[i] *= .1;
+        for (size_t i = 0; i < from->neuronNumOut * from->neuronNumIn; i++)
+            to->weight.array.floatArray[i] = (float)from->weight.array.doubleMatrix[i];
+        for (size_t i = 0; i < from->neuronNumOut; i++)
+            to->bias.array.floatArray[i] = (float)from->bias.array.doubleArray[i];
+    }
+
+    Vec batches[CALIBRATION_BATCHES + TEST_BATCHES];
+    for (size_t k = 0; k < CALIBRATION_BATCHES + TEST_BATCHES; k++)
+        batches[k] = randomBatch(&model);
+
+    QModel qmodel;
+    if (quantizeModel(&qmodel, &model, batches, CALIBRATION_BATCHES) == ERROR)
+    {
+        printf("quantizeModel failed\n");
+        return;
+    }
+
+    printf("mlp");
+    for (size_t i = 0; i < depth; i++)
+        printf("%c%zu", i ? '-' : ' ', widths[i]);
+    printf(", batch %zu, %s kernels\n", batchSize, simdKernels()->name);
+    reportAccuracy(&model, &qmodel, batches + CALIBRATION_BATCHES, TEST_BATCHES);
+
+    double timeDouble = timeModel(&model), timeFloat = timeModel(&floatModel), timeInt8 = timeQModel(&qmodel);
+    printf("samples/s double %10.0f  float %10.0f  int8 %10.0f  int8 speedup %5.2fx over double %5.2fx over float\n",
+           batchSize / timeDouble, batchSize / timeFloat, batchSize / timeInt8, timeDouble / timeInt8,
+           timeFloat / timeInt8);
+    printf("footprint double %zu  float %zu  int8 %zu bytes\n\n", modelFootprint(&model),
+           modelFootprint(&floatModel), qmodelFootprint(&qmodel));
+
+    for (size_t k = 0; k < CALIBRATION_BATCHES + TEST_BATCHES; k++)
+        free(batches[k].array.charArray);
+    freeQModel(&qmodel);
+    freeModel(&model);
+    freeModel(&floatModel);
+}
+
+int main(void)
+{
+    size_t small[] = {64, 256, 256, 10}, mnist[] = {784, 512, 256, 10};
+
+    runCase(1, small, 4);
+    runCase(64, small, 4);
+    runCase(1, mnist, 4);
+    runCase(256, mnist, 4);
+
+    return 0;
+}
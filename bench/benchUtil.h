@@ -0,0 +1,41 @@
+/**
+ * @file benchUtil.h
+ * @author luwangguerde@163.com
+ * @brief Timing helpers shared by the benchmarks
+ * @version 0.1
+ * @date 2024-12-02
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static inline double benchNow(void) // seconds from an arbitrary monotonic origin
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static inline void benchFillRandom(double *array, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        array[i] = 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+#endif
@@ -9,8 +9,8 @@
  *
  */
 #include "cnn.h"
+#include "demoUtil.h" // to best demonstrate, using `demoSleep` to slow down convergence
 #include <stdio.h>
-#include <windows.h> // to best demonstrate, using `Sleep` to slow down convergence
 
 /**
  * To fit a line is really simple, only one input and one output can deal with it.
@@ -41,7 +41,7 @@ int main_demo1(int argc, char const *argv[])
         printf("\tnow\ttarget\t\n");
         printf("weight\t%.4f\t%d \nbias\t%.4f\t%d \nloss\t%.4f\t%d", fcl.weight.array.doubleMatrix[0], 3,
                fcl.bias.array.doubleArray[0], 1, lossValue, 0);
-        Sleep(100);
+        demoSleep(100);
         printf("\033[H\033[J"); // clear screen
 
         fcl.dervFromLastLayer.array.doubleArray[0] = MSE_single_derivative(real, output); // put the MSE_single in to the layer
@@ -55,7 +55,7 @@ int main_demo1(int argc, char const *argv[])
     printDoubleVector(&fcl.bias);
     printf("loss=%f\n", lossValue);
 
-    system("pause");
+    demoPause();
 
     return 0;
 }
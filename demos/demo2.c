@@ -9,8 +9,8 @@
  * 
  */
 #include "cnn.h"
+#include "demoUtil.h"
 #include <stdio.h>
-#include <windows.h>
 
 double fitFunc_demo2(double x);
 
@@ -45,7 +45,7 @@ int main_demo2(int argc, char const *argv[])
         printf("input = %f\n", input);
         printf("output = %f\n", output);
         printf("lossValue=%f\n", lossValue);
-        Sleep(100);
+        demoSleep(100);
 
         fcl2.dervFromLastLayer.array.doubleArray[0] = // examine if is legal
             doubleaThreshold(MSE_single_derivative(fitFunc_demo2(input), output));
@@ -60,7 +60,7 @@ int main_demo2(int argc, char const *argv[])
     printDoubleMatrix(&fcl2.weight);
     printDoubleVector(&fcl2.bias);
 
-    system("pause");
+    demoPause();
     return 0;
 }
 
@@ -9,14 +9,14 @@
  *
  */
 #include "cnn.h"
+#include "demoUtil.h"
 #include <stdio.h>
-#include <windows.h>
 
 #define HIDEN_NEUROS_1 100 // neuron numbers of first layer output
 #define HIDEN_NEUROS_2 100 // neuron numbers of last layer input
 #define LOSS_MAX 1e-3      // value where loss will convergence
 #define TRAIN_RANGE .5     // the train dataset range
-#define LR .05             // learning rate
+#define LR .001            // learning rate of adam
 
 /**
  * To fit a function like y = x ^ 2 + x + 1 seems to be more difficult, because it
@@ -30,16 +30,16 @@ float fitFunc_demo3(float x); // the func that we attempt to fit, here is y = x
 
 int main_demo3(int argc, char const *argv[])
 {
-    struct FCL fcl1, fcl2, fcl3;
+    Model model;
+    Optimizer adam; // converges in far fewer samples than plain SGD, try OPTIMIZER_SGD with LR .05
 
-    initFCL(&fcl1, 1, HIDEN_NEUROS_1, leakyReLU, leakyReLU_derivative);
-    initFCL(&fcl2, HIDEN_NEUROS_1, HIDEN_NEUROS_2, leakyReLU, leakyReLU_derivative);
-    initFCL(&fcl3, HIDEN_NEUROS_2, 1, noActivation, noActivation_derivative);
-
-    fcl2.input.array.doubleArray = fcl1.output.array.doubleArray; // connect two layers
-    fcl3.input.array.doubleArray = fcl2.output.array.doubleArray;
-    fcl2.dervFromLastLayer.array.doubleArray = fcl3.dervToPreviousLayer.array.doubleArray;
-    fcl1.dervFromLastLayer.array.doubleArray = fcl2.dervToPreviousLayer.array.doubleArray;
+    initModel(&model, 1, DOUBLE_TYPE);
+    initOptimizer(&adam, OPTIMIZER_ADAM, LR);
+    modelSetOptimizer(&model, &adam);
+    modelAddFCL(&model, 1, HIDEN_NEUROS_1, leakyReLU, leakyReLU_derivative);
+    modelAddFCL(&model, HIDEN_NEUROS_1, HIDEN_NEUROS_2, leakyReLU, leakyReLU_derivative);
+    modelAddFCL(&model, HIDEN_NEUROS_2, 1, noActivation, noActivation_derivative);
+    compileModel(&model); // connect the layers
 
     double lossValue = 1;
     int loss_hit_times = 0;
@@ -48,28 +48,26 @@ int main_demo3(int argc, char const *argv[])
         double input = (2.0 * (double)rand() / RAND_MAX - 1.0) * TRAIN_RANGE; // generate numbers between [-5, 5]
         double output, real;
 
-        fcl1.input.array.doubleArray[0] = input;
-        forwardFCL(&fcl1);
-        forwardFCL(&fcl2);
-        forwardFCL(&fcl3);
-        output = fcl3.output.array.doubleArray[0];
+        model.input.array.doubleArray[0] = input;
+        forwardModel(&model);
+        output = model.output.array.doubleArray[0];
         real = fitFunc_demo3(input);
         lossValue = MSE_single(real, output);
 
         printf("\033[H\033[J"); // clear screen
         printf("input=%.5f, output=%.5f, real=%.5f\n", input, output, real);
         printf("lossValue: %.5f\n", lossValue);
-        Sleep(10);
+        demoSleep(10);
 
-        fcl3.dervFromLastLayer.array.doubleArray[0] = doubleaThreshold(MSE_single_derivative(real, output));
-        backwardFCL(&fcl3, LR);
-        backwardFCL(&fcl2, LR);
-        backwardFCL(&fcl1, LR);
+        model.dervOfOutput.array.doubleArray[0] = doubleaThreshold(MSE_single_derivative(real, output));
+        backwardModel(&model);
+        stepModel(&model);
 
         loss_hit_times += lossValue < LOSS_MAX ? 1 : -loss_hit_times;
     }
 
-    system("pause");
+    freeModel(&model);
+    demoPause();
     return 0;
 }
 
@@ -9,8 +9,8 @@
  *
  */
 #include "cnn.h"
+#include "demoUtil.h"
 #include <stdio.h>
-#include <windows.h>
 
 /**
  * Now we are going to fit a vector function, we need to put a vector into the model
@@ -26,18 +26,20 @@ void loss_derivative(Vec *output, Vec *real, Vec *derv);
 
 int main_demo4(int argc, char const *argv[])
 {
-    struct FCL fcl1, fcl2;
+    Model model;
+    Optimizer sgd;
     Vec *input, *output, real;
 
-    initFCL(&fcl1, 2, 50, leakyReLU, leakyReLU_derivative);
-    initFCL(&fcl2, 50, 2, noActivation, noActivation_derivative);
+    initModel(&model, 1, DOUBLE_TYPE);
+    initOptimizer(&sgd, OPTIMIZER_SGD, .01);
+    modelSetOptimizer(&model, &sgd);
+    modelAddFCL(&model, 2, 50, leakyReLU, leakyReLU_derivative);
+    modelAddFCL(&model, 50, 2, noActivation, noActivation_derivative);
+    compileModel(&model);
     initDoubleVec(&real, 2, 0);
 
-    fcl2.input.array.doubleArray = fcl1.output.array.doubleArray;
-    fcl1.dervFromLastLayer.array.doubleArray = fcl2.dervToPreviousLayer.array.doubleArray;
-
-    input = &fcl1.input;
-    output = &fcl2.output;
+    input = &model.input;
+    output = &model.output;
 
     double lossValue = 1;
     int loss_hit_times = 0;
@@ -46,12 +48,11 @@ int main_demo4(int argc, char const *argv[])
     {
         input->array.doubleArray[0] = (2.0 * (double)rand() / RAND_MAX - 1.0) * .1; // [-.1, .1]
         input->array.doubleArray[1] = (2.0 * (double)rand() / RAND_MAX - 1.0) * .1;
-        forwardFCL(&fcl1);
-        forwardFCL(&fcl2);
+        forwardModel(&model);
 
         fitFunc_demo4(input, &real);
         lossValue = loss(output, &real);
-        loss_derivative(output, &real, &fcl2.dervFromLastLayer);
+        loss_derivative(output, &real, &model.dervOfOutput);
 
         printf("\033[H\033[J"); // clear screen
         printf("input: \n");
@@ -66,16 +67,18 @@ int main_demo4(int argc, char const *argv[])
         if (time > 0) // observe the first 100 times
         {
             time--;
-            Sleep(100);
+            demoSleep(100);
         }
 
-        backwardFCL(&fcl2, .01);
-        backwardFCL(&fcl1, .01);
+        backwardModel(&model);
+        stepModel(&model);
 
         loss_hit_times += lossValue < 1e-3 ? 1 : -loss_hit_times;
     }
 
-    system("pause");
+    freeModel(&model);
+    free(real.array.doubleArray);
+    demoPause();
     return 0;
 }
 
@@ -0,0 +1,98 @@
+/**
+ * @file demo5.c
+ * @author luwangguerde@163.com
+ * @brief Profile the training steps of a small classifier, as a table and a timeline
+ * @version 0.1
+ * @date 2024-12-22
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "cnn.h"
+#include "demoUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BATCH 64
+#define FEATURES 256
+#define HIDDEN 512
+#define CLASSES 10
+#define STEPS 50
+#define EVENTS 65536 // per thread, plenty for STEPS steps
+
+/**
+ * Where does the time of a training step go? Build with the profile preset
+ * (cmake --preset profile, or -DCNN_PROFILE=ON) and every layer, kernel and model pass
+ * is timed. The table below sums them up, the slowest first, and the trace file opens in
+ * chrome://tracing or ui.perfetto.dev with one track per thread, so the gemms the workers
+ * run inside a layer show up under it.
+ *
+ * Usage: demos 5 [trace.json]
+ */
+
+int main_demo5(int argc, char const *argv[])
+{
+    const char *tracePath = argc > 1 ? argv[1] : "profile.json";
+    if (profileStart(EVENTS, 1) == ERROR)
+    {
+        fprintf(stderr, "built without CNN_PROFILE, configure with -DCNN_PROFILE=ON or the profile preset\n");
+        return 1;
+    }
+
+    Model model;
+    Optimizer adam;
+    initModel(&model, BATCH, FLOAT_TYPE);
+    initOptimizer(&adam, OPTIMIZER_ADAM, .001);
+    modelSetOptimizer(&model, &adam);
+    modelAddFCL(&model, FEATURES, HIDDEN, ReLU, ReLU_derivative);
+    modelAddFCL(&model, HIDDEN, HIDDEN, ReLU, ReLU_derivative);
+    modelAddFCL(&model, HIDDEN, CLASSES, noActivation, noActivation_derivative);
+    if (compileModel(&model) == ERROR)
+    {
+        profileFree();
+        return 1;
+    }
+
+    // the loss works on the buffers of the model, the labels are the only thing it owns
+    struct OL ol;
+    Label labels;
+    Arena arena;
+    initArena(&arena, arenaAlignedSize(BATCH * sizeof(int)));
+    initArenaVec(&arena, &labels, BATCH, INT_TYPE, 0);
+    bindOL(&ol, &model.output, &model.dervOfOutput, CLASSES);
+
+    // every class is a bump on its own stretch of the features, so the loss has something to go down to
+    double loss = 0;
+    for (int step = 0; step < STEPS; step++)
+    {
+        for (size_t i = 0; i < BATCH; i++)
+        {
+            int label = rand() % CLASSES;
+            float *features = model.input.array.floatArray + i * FEATURES;
+            for (size_t j = 0; j < FEATURES; j++)
+                features[j] = (float)rand() / RAND_MAX - .5f + (j * CLASSES / FEATURES == (size_t)label ? 1 : 0);
+            labels.array.intArray[i] = label;
+        }
+
+        forwardModel(&model);
+        lossOL(&ol, &labels, &loss);
+        backwardModel(&model);
+        stepModel(&model);
+        if (step % 10 == 0)
+            printf("step %d, loss = %f\n", step, loss);
+    }
+    profileStop();
+
+    printf("\n");
+    profilePrint(stdout);
+    if (profileWriteTrace(tracePath) == OK)
+        printf("\ntrace of %d steps written to %s\n", STEPS, tracePath);
+    else
+        fprintf(stderr, "\ncan't write %s\n", tracePath);
+
+    profileFree();
+    freeModel(&model);
+    freeArena(&arena);
+    demoPause();
+    return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file demo6.c
+ * @author luwangguerde@163.com
+ * @brief Train a small convolutional classifier whose gradients come from the tape
+ * @version 0.1
+ * @date 2024-12-24
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "cnn.h"
+#include "demoUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BATCH 16
+#define SIDE 12
+#define MULTIPLIER 4
+#define HIDDEN 32
+#define CLASSES 4
+#define STEPS 200
+#define PARAMS 5
+
+/**
+ * No layer here has a backward function of its own: the forward pass is recorded once on a tape,
+ * conv -> relu -> max pool -> flatten -> linear -> linear -> softmax cross-entropy, and every step
+ * replays it on the next batch and then replays the vector-Jacobian products of its ops in reverse.
+ * After the first step nothing is allocated. The images are noise with a bright square in one
+ * quadrant, the quadrant is the class.
+ */
+
+int main_demo6(int argc, char const *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    size_t pooled = MULTIPLIER * (SIDE / 2) * (SIDE / 2);
+    size_t lengths[PARAMS] = {MULTIPLIER * 9, HIDDEN * pooled, HIDDEN, CLASSES * HIDDEN, CLASSES};
+
+    // parameters, their gradients and adam's moments, one arena for all
+    Optimizer adam;
+    initOptimizer(&adam, OPTIMIZER_ADAM, .003);
+    size_t bytes = arenaAlignedSize(BATCH * SIDE * SIDE * sizeof(float)) + arenaAlignedSize(BATCH * sizeof(int));
+    for (size_t i = 0; i < PARAMS; i++)
+        bytes += 2 * arenaAlignedSize(lengths[i] * sizeof(float)) + sizeofOptimizerState(&adam, lengths[i], FLOAT_TYPE);
+
+    Arena arena;
+    Vec images, params[PARAMS], grads[PARAMS], states[PARAMS][OPTIMIZER_STATE_MAX];
+    Label labels;
+    Sts rcode = initArena(&arena, bytes);
+    rcode = initArenaVec(&arena, &images, BATCH * SIDE * SIDE, FLOAT_TYPE, 0) || rcode;
+    rcode = initArenaVec(&arena, &labels, BATCH, INT_TYPE, 0) || rcode;
+    for (size_t i = 0; i < PARAMS; i++)
+    {
+        rcode = initArenaVec(&arena, &params[i], lengths[i], FLOAT_TYPE, 0) || rcode;
+        rcode = initArenaVec(&arena, &grads[i], lengths[i], FLOAT_TYPE, 0) || rcode;
+        rcode = initOptimizerState(&adam, &arena, states[i], lengths[i], FLOAT_TYPE) || rcode;
+    }
+    if (rcode == ERROR)
+    {
+        freeArena(&arena);
+        return 1;
+    }
+
+    // uniform in +-sqrt(6 / fan), the biases stay 0
+    size_t fans[PARAMS] = {9, pooled, 0, HIDDEN, 0};
+    for (size_t i = 0; i < PARAMS; i++)
+        for (size_t j = 0; fans[i] && j < lengths[i]; j++)
+            params[i].array.floatArray[j] = (float)((2.0 * rand() / RAND_MAX - 1) * sqrt(6.0 / fans[i]));
+
+    // the graph, recorded once over the storage every step refills
+    Tape tape;
+    Var x, p[PARAMS], conv, relu, pool, flat, hidden, logits, loss;
+    rcode = initTape(&tape, 16, 1 << 20, FLOAT_TYPE);
+    rcode = rcode == OK ? tapeInput(&tape, &images, BATCH, 1, SIDE, SIDE, &x) : ERROR;
+    for (size_t i = 0; i < PARAMS; i++)
+        rcode = rcode == OK ? tapeParam(&tape, &params[i], &grads[i], &p[i]) : ERROR;
+    rcode = rcode == OK ? tapeConv(&tape, x, p[0], MULTIPLIER, 3, 1, 1, &conv) : ERROR;
+    rcode = rcode == OK ? tapeActivate(&tape, conv, ACTIVATION_RELU, &relu) : ERROR;
+    rcode = rcode == OK ? tapePool(&tape, relu, 2, 2, 0, POOLING_MAX, &pool) : ERROR;
+    rcode = rcode == OK ? tapeFlatten(&tape, pool, &flat) : ERROR;
+    rcode = rcode == OK ? tapeLinear(&tape, flat, p[1], p[2], ACTIVATION_RELU, &hidden) : ERROR;
+    rcode = rcode == OK ? tapeLinear(&tape, hidden, p[3], p[4], ACTIVATION_NONE, &logits) : ERROR;
+    rcode = rcode == OK ? tapeSoftmaxCrossEntropy(&tape, logits, &labels, &loss) : ERROR;
+    if (rcode == ERROR)
+    {
+        fprintf(stderr, "can't record the graph\n");
+        freeTape(&tape);
+        freeArena(&arena);
+        return 1;
+    }
+
+    for (int step = 0; step < STEPS; step++)
+    {
+        for (size_t i = 0; i < BATCH; i++)
+        {
+            int label = rand() % CLASSES;
+            size_t top = label / 2 * (SIDE / 2) + 1, left = label % 2 * (SIDE / 2) + 1;
+            float *image = images.array.floatArray + i * SIDE * SIDE;
+            for (size_t j = 0; j < SIDE * SIDE; j++)
+                image[j] = (float)rand() / RAND_MAX * .5f;
+            for (size_t r = top; r < top + 3; r++)
+                for (size_t c = left; c < left + 3; c++)
+                    image[r * SIDE + c] += 1;
+            labels.array.intArray[i] = label;
+        }
+
+        tapeForward(&tape); // the recording ran on images not filled yet, every step replays it on its batch
+        tapeBackward(&tape, loss);
+        optimizerNextStep(&adam);
+        for (size_t i = 0; i < PARAMS; i++)
+            optimizerUpdate(&adam, &params[i], &grads[i], states[i], 1); // the tape's gradients are the means
+        if (step % 20 == 0)
+            printf("step %d, loss = %f\n", step, tapeValue(&tape, loss)->array.floatArray[0]);
+    }
+    printf("the tape holds %zu bytes of values and gradients\n", tapeFootprint(&tape));
+
+    freeTape(&tape);
+    freeArena(&arena);
+    demoPause();
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // nanosleep
+#endif
+
+#include "demoUtil.h"
+#include <stdlib.h>
+#ifdef _WIN32
+#include "demoUtil.h"
+#else
+#include <time.h>
+#endif
+
+void demoSleep(unsigned milliseconds)
+{
+#ifdef _WIN32
+    demoSleep(milliseconds);
+#else
+    struct timespec ts = {.tv_sec = milliseconds / 1000, .tv_nsec = milliseconds % 1000 * 1000000L};
+    nanosleep(&ts, NULL);
+#endif
+}
+
+void demoPause(void)
+{
+#ifdef _WIN32
+    demoPause();
+#endif
+}
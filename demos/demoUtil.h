@@ -0,0 +1,24 @@
+/**
+ * @file demoUtil.h
+ * @author luwangguerde@163.com
+ * @brief What the demos need from the system, the same on Windows and on POSIX
+ * @version 0.1
+ * @date 2024-12-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DEMO_UTIL_H
+#define DEMO_UTIL_H
+
+void demoSleep(unsigned milliseconds); // slow a demo down enough to watch it converge
+void demoPause(void);                  // keep the console a demo was started in open on Windows, nothing elsewhere
+
+int main_demo1(int argc, char const *argv[]);
+int main_demo2(int argc, char const *argv[]);
+int main_demo3(int argc, char const *argv[]);
+int main_demo4(int argc, char const *argv[]);
+int main_demo5(int argc, char const *argv[]);
+int main_demo6(int argc, char const *argv[]);
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * @file demos.c
+ * @author luwangguerde@163.com
+ * @brief Run one of the demos by its number, the rest of the arguments go to it
+ * @version 0.1
+ * @date 2024-12-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "demoUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const struct
+{
+    int (*run)(int argc, char const *argv[]);
+    const char *brief;
+} demos[] = {
+    {main_demo1, "a single FCL fits y = 3x + 1"},
+    {main_demo2, "two FCLs fit y = x"},
+    {main_demo3, "a model with activations fits y = x^2 + x + 1"},
+    {main_demo4, "a model fits a vector function"},
+    {main_demo5, "profile the training steps of a classifier, needs CNN_PROFILE"},
+    {main_demo6, "a small convolutional classifier trained through the autodiff tape"},
+};
+
+int main(int argc, char const *argv[])
+{
+    size_t demoNum = sizeof(demos) / sizeof(demos[0]);
+    int which = argc > 1 ? atoi(argv[1]) : 0;
+    if (which < 1 || (size_t)which > demoNum)
+    {
+        fprintf(stderr, "usage: %s N [args...]\n", argv[0]);
+        for (size_t i = 0; i < demoNum; i++)
+            fprintf(stderr, "  %zu  %s\n", i + 1, demos[i].brief);
+        return 1;
+    }
+
+    return demos[which - 1].run(argc - 1, argv + 1);
+}
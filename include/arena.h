@@ -0,0 +1,59 @@
+/**
+ * @file arena.h
+ * @author luwangguerde@163.com
+ * @brief One aligned allocation carved into the buffers of a whole model
+ * @version 0.1
+ * @date 2024-12-09
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "base.h"
+
+#define ARENA_ALIGNMENT 64 // every buffer starts on its own cache line, which is also the widest SIMD register
+
+struct ARENA // a bump allocator, buffers are never freed one by one, only all together
+{
+    char *base;
+    size_t capacity; // bytes owned
+    size_t offset;   // bytes handed out so far
+};
+
+typedef struct ARENA Arena;
+
+Sts initArena(Arena *arena, size_t capacity);    // one 64-byte aligned allocation of capacity bytes
+void *arenaAlloc(Arena *arena, size_t bytes);    // the next aligned buffer, NULL when the arena is full
+Sts resetArena(Arena *arena);                    // hand out the same memory again, every buffer becomes invalid
+Sts freeArena(Arena *arena);
+size_t arenaFootprint(Arena *arena);             // bytes handed out so far, padding included
+size_t arenaAlignedSize(size_t bytes);           // what arenaAlloc(bytes) really consumes
+
+/*
+A buffer of a plan, live from the step writing it to the last step reading it, both ends included.
+Buffers never live together may share bytes, arenaPlanBuffers decides where each one goes.
+*/
+struct PLANNED_BUFFER
+{
+    size_t bytes; // 0 for a buffer nobody needs, it's left out
+    size_t first;
+    size_t last;
+    size_t offset; // set by arenaPlanBuffers
+};
+
+typedef struct PLANNED_BUFFER PlannedBuffer;
+
+/*
+Greedy offset assignment: the biggest buffer first, each at the lowest offset clear of every placed buffer
+it's live together with. Returns the bytes the plan needs, 0 when out of memory.
+*/
+size_t arenaPlanBuffers(PlannedBuffer *plan, size_t num);
+
+// the arena versions of the init functions, the storage comes from the arena and follows the same init rules
+Sts initArenaVec(Arena *arena, Vec *vec, size_t length, Dtp dtype, double cell);
+Sts initArenaMat(Arena *arena, Mat *mat, size_t row, size_t col, Dtp dtype, double cell);
+Sts initArenaMts(Arena *arena, Mts *mts, size_t channel, size_t height, size_t width, Dtp dtype, double cell);
+
+#endif
@@ -13,11 +13,20 @@
 #define MATRIX_H
 
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 #define DOUBLE_THRESHOLD 0xf
 #define DOUBLE_DEFAULT 0x0
 
+enum DataType // which member of the array union is live, double is the zero value so {0} structs stay double
+{
+    DOUBLE_TYPE,
+    FLOAT_TYPE,
+    INT_TYPE,
+    CHAR_TYPE
+};
+
 struct VEC // vector with lenth dimention
 {
     union {
@@ -28,6 +37,7 @@ struct VEC // vector with lenth dimention
     } array;
 
     size_t length;
+    enum DataType dtype;
 };
 
 struct MAT // matrix with shape in row col
@@ -41,6 +51,7 @@ struct MAT // matrix with shape in row col
 
     size_t row;
     size_t col;
+    enum DataType dtype;
 };
 
 struct MTS // matrix stack
@@ -55,6 +66,7 @@ struct MTS // matrix stack
     size_t channel;
     size_t height;
     size_t width;
+    enum DataType dtype;
 };
 
 enum Status
@@ -63,28 +75,51 @@ enum Status
     ERROR
 };
 
+enum Transpose // whether an operand of a product is used as it is or transposed
+{
+    NO_TRANSPOSE,
+    TRANSPOSE
+};
+
 typedef struct MAT Mat;
 typedef struct VEC Vec;
 typedef struct MTS Mts;
 typedef enum Status Sts;
+typedef enum Transpose Trs;
+typedef enum DataType Dtp;
 
 Mat *genDoubleMat(int row, int col, double cell); // create and init
 Vec *genDoubleVec(int length, double cell);
 Mts *genDoubleMts(int channel, int height, int width, double cell);
+Mat *genFloatMat(int row, int col, float cell);
+Vec *genFloatVec(int length, float cell);
+Mts *genFloatMts(int channel, int height, int width, float cell);
 Sts freeMat(Mat *mat);
 Sts freeVec(Vec *vec);
 Sts initDoubleMat(Mat *mat, int row, int col, double cell); // only init the array
 Sts initDoubleVec(Vec *vec, int length, double cell);
 Sts initDoubleMts(Mts *mts, int channel, int height, int width, double cell);
+Sts initFloatMat(Mat *mat, int row, int col, float cell); // float32 storage, same init rules as the double ones
+Sts initFloatVec(Vec *vec, int length, float cell);
+Sts initFloatMts(Mts *mts, int channel, int height, int width, float cell);
+Sts resetMatValue(Mat *mat, double cell); // re-run the init rule over the existing storage
+Sts resetVecValue(Vec *vec, double cell);
+Sts resetMtsValue(Mts *mts, double cell);
+size_t sizeOfDataType(Dtp dtype);
 Sts vecTransMat(Vec *vec, Mat *mat, int row, int col); // trans function will not copy data
 Sts matTransVec(Mat *mat, Vec *vec);
 Sts vecTransMts(Vec *vec, Mts *mts, int channel, int height, int width);
 Sts mtsTransVec(Mts *mts, Vec *vec);
 Sts mtsSliceMat(Mts *mts, Mat *mat, int channel);
 Sts crossProductDoubleMatrix(Mat *m1, Mat *m2, Mat *result); // the result shouldn't be one of m1 or m2
+Sts crossProductDoubleMatrixTrans(Mat *m1, Trs trans1, Mat *m2, Trs trans2, Mat *result); // result = op(m1) x op(m2)
+Sts crossProductFloatMatrix(Mat *m1, Mat *m2, Mat *result);
+Sts crossProductFloatMatrixTrans(Mat *m1, Trs trans1, Mat *m2, Trs trans2, Mat *result);
 Sts addDoubleMatrix(Mat *m1, Mat *m2, Mat *result);          // the result could be one of m1 or m2
 Sts addDoubleVector(Vec *v1, Vec *v2, Vec *result);
 Sts mulDoubleVector(Vec *v1, Vec *v2, Vec *result);
+Sts addFloatVector(Vec *v1, Vec *v2, Vec *result);
+Sts mulFloatVector(Vec *v1, Vec *v2, Vec *result);
 Sts setDoubleMatrixValue(Mat *m, int row, int col, double cell);
 Sts setDoubleMatrixStackValue(Mts *mts, int channel, int height, int width, double cell);
 double getDoubleMatrixValue(Mat *m, int row, int col);
@@ -92,5 +127,7 @@ double getDoubleMatrixStackValue(Mts *mts, int channel, int height, int width);
 Sts printDoubleMatrix(Mat *m);
 Sts printDoubleVector(Vec *v);
 double doubleaThreshold(double x); // examine whether the number is inf or nan
+void *alignedMalloc(size_t bytes, size_t alignment); // alignment must be a power of two multiple of sizeof(void *)
+void alignedFree(void *ptr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+/**
+ * @file checkpoint.h
+ * @author luwangguerde@163.com
+ * @brief The binary checkpoint of a trained model, and loading it back with or without a copy
+ * @version 0.1
+ * @date 2024-12-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "model.h"
+#include <stdint.h>
+
+#define CHECKPOINT_MAGIC "CNNCKPT" // with its terminating zero, the first 8 bytes of the file
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ENDIAN 0x01020304 // reads back differently on a machine of the other byte order
+#define CHECKPOINT_ALIGNMENT 64      // of every blob, so a mapped blob is a valid SIMD operand as it is
+
+/*
+A checkpoint is the header, one record per layer in model order, then the blobs.
+Every field is little-endian on the machines we run on and checked with the endian field when read.
+A blob is the raw array of a weight matrix (neuronNumOut x neuronNumIn, row-major), a bias vector
+or a kernel stack (channelOut x kernelSize x kernelSize), each starting on its own 64-byte boundary.
+*/
+struct CHECKPOINT_HEADER
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t dtype;     // of every blob, DOUBLE_TYPE or FLOAT_TYPE
+    uint32_t layerNum;
+    uint64_t fileBytes; // the whole file, a truncated copy fails to load
+    uint8_t reserved[32];
+};
+
+struct CHECKPOINT_LAYER
+{
+    uint32_t type;       // enum LayerType
+    uint32_t activation; // enum Activation of an FCL, never ACTIVATION_CUSTOM
+    // FCL: neuronNumIn, neuronNumOut; CVL: channelIn, rowIn, colIn, kernelSize, multiplier, stride, padding;
+    // PL: channel, rowIn, colIn, kernelSize, mode, stride, padding
+    uint64_t shape[7];
+    uint64_t weightOffset; // weight or kernels, from the start of the file, 0 and 0 for a PL
+    uint64_t weightBytes;
+    uint64_t biasOffset; // 0 and 0 for a CVL
+    uint64_t biasBytes;
+    uint8_t reserved[32];
+};
+
+_Static_assert(sizeof(struct CHECKPOINT_HEADER) == 64, "the checkpoint header is 64 bytes");
+_Static_assert(sizeof(struct CHECKPOINT_LAYER) == 128, "a checkpoint layer record is 128 bytes");
+
+Sts saveModel(Model *model, const char *path); // a compiled model whose activations are not custom
+
+/*
+Both rebuild and compile the model into an uninitialized Model, with batchSize samples per batch.
+loadModel copies the parameters into memory the model owns, mapModel points the weights, biases
+and kernels straight into the mapped file: no copy, no parse, and the pages are shared with every
+other process mapping the same checkpoint until one of them writes to them.
+mapModel builds an inference model (initInferenceModel): forward only, nothing to train.
+*/
+Sts loadModel(Model *model, const char *path, size_t batchSize);
+Sts mapModel(Model *model, const char *path, size_t batchSize);
+
+#endif
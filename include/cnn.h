@@ -1 +1,11 @@
-#include "layers.h"
\ No newline at end of file
+#include "checkpoint.h"
+#include "dataset.h"
+#include "graph.h"
+#include "layers.h"
+#include "model.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "quant.h"
+#include "tape.h"
+#include "threadpool.h"
+#include "view.h"
\ No newline at end of file
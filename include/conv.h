@@ -0,0 +1,91 @@
+/**
+ * @file conv.h
+ * @author luwangguerde@163.com
+ * @brief Convolution lowered to gemm through im2col, or computed by Winograd or FFT where they are cheaper
+ * @version 0.1
+ * @date 2024-12-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef CONV_H
+#define CONV_H
+
+#include "base.h"
+
+size_t convOutSize(size_t in, size_t kernelSize, size_t stride, size_t padding); // 0 if the kernel doesn't fit
+
+enum ConvAlgorithm // how a forward pass is computed, all give the im2col output up to rounding
+{
+    CONV_IM2COL,   // unfold then gemm, any shape, and the only one leaving the columns the backward pass reads
+    CONV_WINOGRAD, // F(2x2, 3x3), 16 multiplies per 2 x 2 outputs instead of 36; 3x3 kernels of stride 1
+    CONV_FFT       // the spectra of the padded image and kernels multiplied, a cost free of kernelSize; stride 1
+};
+
+typedef enum ConvAlgorithm Cva;
+
+int convSupports(Cva algorithm, size_t kernelSize, size_t stride);
+
+/*
+The algorithm the forward pass of the shape runs fastest with on this machine. The ones an estimate from counts
+of their operations doesn't rule out are timed on data of the shape the first time it's asked for, and the
+answer is kept for the rest of the process, so everything sized from it agrees. Unless inference, an algorithm
+other than CONV_IM2COL is charged the unfolding gradCVL does again after it.
+*/
+Cva convChooseAlgorithm(size_t channel, size_t height, size_t width, size_t multiplier, size_t kernelSize,
+                        size_t stride, size_t padding, Dtp dtype, int inference);
+
+// elements of the workspace convolve takes, the columns for CONV_IM2COL, 0 when algorithm doesn't take the shape
+size_t convWorkspaceLength(Cva algorithm, size_t channel, size_t height, size_t width, size_t multiplier,
+                           size_t kernelSize, size_t stride, size_t padding);
+
+/*
+Unfold one channel of height x width into kernelSize^2 rows of outH * outW cols,
+row p * kernelSize + q holds the pixel under kernel cell (p, q) for every output position,
+cells falling into the padding are 0.
+*/
+Sts im2colDouble(const double *image, size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding,
+                 double *columns);
+Sts im2colFloat(const float *image, size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding,
+                float *columns);
+
+// the adjoint of im2col, every column cell is added back onto its pixel, image has to be zeroed by the caller
+Sts col2imDouble(const double *columns, size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding,
+                 double *image);
+Sts col2imFloat(const float *columns, size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding,
+                float *image);
+
+/*
+Depthwise convolution with a channel multiplier: input channel c is correlated with the kernels
+c * multiplier ... c * multiplier + multiplier - 1 and gives the output channels with the same indices.
+columns takes channel * kernelSize^2 * outH * outW elements and keeps the unfolded input for the backward pass.
+*/
+Sts convolutionGemmDouble(const double *input, size_t channel, size_t height, size_t width, const double *kernels,
+                          size_t multiplier, size_t kernelSize, size_t stride, size_t padding, double *columns,
+                          double *output);
+Sts convolutionGemmFloat(const float *input, size_t channel, size_t height, size_t width, const float *kernels,
+                         size_t multiplier, size_t kernelSize, size_t stride, size_t padding, float *columns,
+                         float *output);
+
+/*
+convolutionGemm through algorithm, workspace takes convWorkspaceLength elements of it.
+Only CONV_IM2COL leaves the unfolded input the backward pass reads in it.
+*/
+Sts convolveDouble(Cva algorithm, const double *input, size_t channel, size_t height, size_t width,
+                   const double *kernels, size_t multiplier, size_t kernelSize, size_t stride, size_t padding,
+                   double *workspace, double *output);
+Sts convolveFloat(Cva algorithm, const float *input, size_t channel, size_t height, size_t width, const float *kernels,
+                  size_t multiplier, size_t kernelSize, size_t stride, size_t padding, float *workspace, float *output);
+
+/*
+The gradients of convolutionGemm from the gradient of its output, columns must still hold the forward unfolding
+and is overwritten by the unfolded input gradient. dKernels and dInput are overwritten.
+*/
+Sts convolutionGemmBackwardDouble(const double *dOutput, size_t channel, size_t height, size_t width,
+                                  const double *kernels, size_t multiplier, size_t kernelSize, size_t stride,
+                                  size_t padding, double *columns, double *dKernels, double *dInput);
+Sts convolutionGemmBackwardFloat(const float *dOutput, size_t channel, size_t height, size_t width,
+                                 const float *kernels, size_t multiplier, size_t kernelSize, size_t stride,
+                                 size_t padding, float *columns, float *dKernels, float *dInput);
+
+#endif
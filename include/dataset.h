@@ -0,0 +1,104 @@
+/**
+ * @file dataset.h
+ * @author luwangguerde@163.com
+ * @brief Datasets streamed from mapped files, and mini-batches assembled ahead of training on a thread of their own
+ * @version 0.1
+ * @date 2024-12-20
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DATASET_H
+#define DATASET_H
+
+#include "arena.h"
+#include "mapfile.h"
+#include <stdint.h>
+
+#define LOADER_BUFFERS 2 // batches in flight, one trained on while the other is filled
+
+enum ElementType // how a value is stored in a dataset file, the IDX type codes
+{
+    ELEMENT_UBYTE = 0x08,
+    ELEMENT_BYTE = 0x09,
+    ELEMENT_SHORT = 0x0B,  // big-endian like every multi-byte IDX value
+    ELEMENT_INT = 0x0C,
+    ELEMENT_FLOAT = 0x0D,
+    ELEMENT_DOUBLE = 0x0E,
+    ELEMENT_NATIVE_FLOAT = 0x100 // a float of this machine, the flat records
+};
+
+typedef enum ElementType Elt;
+
+/*
+sampleNum samples of featureNum values and labelNum values each, read straight from the mapped files.
+Value i of sample s is at data + s * stride + i * sizeof(element), converted to the batch type on the way out.
+A one-hot label stores a class index per sample and comes out as labelNum values with a 1 at it.
+*/
+struct DATASET
+{
+    MappedFile featureFile;
+    MappedFile labelFile; // unmapped when the labels share the file with the features
+
+    size_t sampleNum;
+    size_t featureNum;
+    size_t labelNum;
+
+    const char *features; // the first value of sample 0
+    size_t featureStride; // bytes from one sample to the next
+    Elt featureType;
+    double featureScale; // every feature is multiplied by it, 1 / 255 for ubyte images unless changed
+
+    const char *labels;
+    size_t labelStride;
+    Elt labelType;
+    int oneHot;
+};
+
+typedef struct DATASET Dataset;
+
+/*
+An IDX pair, such as the MNIST train-images-idx3-ubyte and train-labels-idx1-ubyte: the first dimension
+counts the samples and the others make up a sample. A label file of one dimension holds class indexes,
+one-hot encoded over as many classes as the largest index plus one. labelPath may be NULL for features only.
+*/
+Sts openIdxDataset(Dataset *dataset, const char *featurePath, const char *labelPath);
+// a file of float records, featureNum features then labelNum labels each, in the byte order of this machine
+Sts openRecordDataset(Dataset *dataset, const char *path, size_t featureNum, size_t labelNum);
+Sts closeDataset(Dataset *dataset);
+
+/*
+Batches of batchSize samples, an epoch after the other without end and freshly shuffled each time.
+The shuffle streams: window sample indexes are held at once, a random one of them is taken
+and the next sample of the file takes its place, so the file is still read roughly in order
+and a window of sampleNum or more is a full shuffle. The samples an epoch has left over,
+fewer than a batch, are skipped. A thread of the loader converts the samples into the buffer
+not handed out, so the next batch is usually waiting by the time the model asks for it.
+*/
+struct DATA_LOADER
+{
+    const Dataset *dataset;
+    size_t batchSize;
+    Dtp dtype; // of the batches, DOUBLE_TYPE or FLOAT_TYPE
+    size_t batchesPerEpoch;
+
+    // set by nextBatch, valid until the next call
+    Mat *input; // batchSize x featureNum, one sample per row like the input of a model
+    Mat *label; // batchSize x labelNum
+    size_t epoch; // of that batch, from 0
+
+    Arena memory; // the buffers
+    Mat inputs[LOADER_BUFFERS];
+    Mat labels[LOADER_BUFFERS];
+    struct LOADER_STATE *state; // the thread, the shuffle and which buffer is where
+};
+
+typedef struct DATA_LOADER DataLoader;
+
+// the same seed gives the same batches, the dataset must outlive the loader
+Sts initDataLoader(DataLoader *loader, const Dataset *dataset, size_t batchSize, Dtp dtype, size_t window,
+                   uint64_t seed);
+Sts nextBatch(DataLoader *loader); // the batch handed out before is given back to be filled again
+Sts freeDataLoader(DataLoader *loader);
+
+#endif
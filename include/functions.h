@@ -14,8 +14,8 @@
 #include "base.h"
 
 typedef struct VEC Label;   // one-hot use intArray
-typedef struct VEC Output;  // model-output use doubleArray
-typedef struct VEC Input;   // model-input use doubleArray
+typedef struct VEC Output;  // model-output use doubleArray, or floatArray when dtype is FLOAT_TYPE
+typedef struct VEC Input;   // model-input use doubleArray, or floatArray when dtype is FLOAT_TYPE
 typedef struct VEC Bias;    // the bias vector of lineartransform use doubleArray
 typedef struct VEC Derv;   // partial derivatives use doubleArray
 typedef struct MAT MOutput; // model-output using double matrix
@@ -29,6 +29,19 @@ typedef struct MTS SKernel;
 typedef struct MTS SDerv;
 typedef enum Status Sts;    // ok when the functions acts well
 
+enum Activation // the activations layers fuse into their kernels, any other pair of functions is ACTIVATION_CUSTOM
+{
+    ACTIVATION_NONE,       // noActivation
+    ACTIVATION_RELU,       // ReLU
+    ACTIVATION_LEAKY_RELU, // leakyReLU
+    ACTIVATION_SIGMOID,    // sigmoid
+    ACTIVATION_CUSTOM      // called through the function pointers
+};
+
+typedef enum Activation Act;
+
+#define LEAKY_RELU_SLOPE .01 // of leakyReLU below 0, what every fused forward and backward takes
+
 Sts ReLU(Input *input, Output *output);
 Sts leakyReLU(Input *input, Output *output);
 Sts lossCrossEntropy(Label *label, Input *input, Output *output);
@@ -38,13 +51,18 @@ Sts lossCrossEntropy_derivative(Label *label, Input *input, Derv *derv);
 Sts softmax(Input *input, Output *output);
 Sts softmax_derivative(Input *input, Derv *derv);
 Sts sigmoid(Input *input, Derv *derv);
+Sts sigmoid_derivative(Input *input, Derv *derv);
 Sts optimizeDoubleVec(Vec *args, Derv *derv, double lr);
 Sts optimizeDoubleMat(Mat *args, MDerv *derv, double lr);
+Sts optimizeFloatVec(Vec *args, Derv *derv, float lr);
+Sts optimizeFloatMat(Mat *args, MDerv *derv, float lr);
 Sts noActivation(Input *input, Output *output);
 Sts noActivation_derivative(Input *input, Derv *derv);
 Sts convolution(MInput *origin, MOutput *dst, Kernel *kernel);
+Sts convolutionFloat(MInput *origin, MOutput *dst, Kernel *kernel);
 Sts poolingMax(MInput *origin, MOutput *dst, int kernelSize);
 Sts flatten(Mts *matrxStack, Vec *dst);
+Act activationOf(Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *));
 
 double MSE_single(double label, double output); // loss function for test
 double MSE_single_derivative(double label, double output);
@@ -0,0 +1,80 @@
+/**
+ * @file gemm.h
+ * @author luwangguerde@163.com
+ * @brief Blocked general matrix multiplication
+ * @version 0.1
+ * @date 2024-12-02
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "base.h"
+#include "functions.h"
+#include "view.h"
+
+#define GEMM_MR 4        // rows of the register tile
+#define GEMM_NR 8        // cols of the register tile
+#define GEMM_NR_FLOAT 16 // cols of the float register tile, the same registers hold twice the lanes
+#define GEMM_MC 96       // rows of a packed block of A, sized for L2
+#define GEMM_KC 256      // depth of a packed panel, sized so an MR x KC and KC x NR sliver stays in L1
+#define GEMM_NC 4096     // cols of a packed block of B, sized for L3
+
+/*
+C = alpha * op(A) x op(B) + beta * C, all matrices are row-major,
+op(X) is X or X^T depending on the transpose flag, lda/ldb/ldc are the row strides.
+When beta is 0, C is never read, so it may hold garbage.
+*/
+Sts gemmDouble(Trs transA, Trs transB, size_t m, size_t n, size_t k, double alpha, const double *a, size_t lda,
+               const double *b, size_t ldb, double beta, double *c, size_t ldc);
+
+// the same product with an explicit row stride and col stride for every operand
+Sts gemmDoubleStrided(size_t m, size_t n, size_t k, double alpha, const double *a, ptrdiff_t rsa, ptrdiff_t csa,
+                      const double *b, ptrdiff_t rsb, ptrdiff_t csb, double beta, double *c, ptrdiff_t rsc,
+                      ptrdiff_t csc);
+
+// the float32 versions of the two above
+Sts gemmFloat(Trs transA, Trs transB, size_t m, size_t n, size_t k, float alpha, const float *a, size_t lda,
+              const float *b, size_t ldb, float beta, float *c, size_t ldc);
+Sts gemmFloatStrided(size_t m, size_t n, size_t k, float alpha, const float *a, ptrdiff_t rsa, ptrdiff_t csa,
+                     const float *b, ptrdiff_t rsb, ptrdiff_t csb, float beta, float *c, ptrdiff_t rsc, ptrdiff_t csc);
+
+/*
+C = op(A) x op(B) + bias, then out = act(C), both folded into the store of every finished tile of C.
+bias holds one value per col of C and may be NULL, out has the row stride ldo and may be C itself,
+ACTIVATION_CUSTOM only adds the bias and leaves out alone.
+*/
+Sts gemmDoubleBiasAct(Trs transA, Trs transB, size_t m, size_t n, size_t k, const double *a, size_t lda,
+                      const double *b, size_t ldb, const double *bias, Act activation, double *c, size_t ldc,
+                      double *out, size_t ldo);
+Sts gemmFloatBiasAct(Trs transA, Trs transB, size_t m, size_t n, size_t k, const float *a, size_t lda, const float *b,
+                     size_t ldb, const float *bias, Act activation, float *c, size_t ldc, float *out, size_t ldo);
+
+/*
+op(B) of k x n laid out once the way the micro-kernel reads it, for the products that keep multiplying by it:
+slivers of NR cols (GEMM_NR, or GEMM_NR_FLOAT for float) over the whole depth, each k-major and zero padded.
+gemmPackedLength is the elements it takes, packed starts on a cache line best.
+*/
+size_t gemmPackedLength(size_t k, size_t n, Dtp dtype);
+Sts gemmDoublePackB(Trs transB, size_t k, size_t n, const double *b, size_t ldb, double *packed);
+Sts gemmFloatPackB(Trs transB, size_t k, size_t n, const float *b, size_t ldb, float *packed);
+
+/*
+gemm*BiasAct with op(B) from gemm*PackB, nothing of it is packed again. Fewer rows than GEMM_MR, a batch of
+one sample above all, go through a kernel streaming the slivers once for all the rows.
+*/
+Sts gemmDoublePackedBiasAct(Trs transA, size_t m, size_t n, size_t k, const double *a, size_t lda,
+                            const double *packed, const double *bias, Act activation, double *c, size_t ldc,
+                            double *out, size_t ldo);
+Sts gemmFloatPackedBiasAct(Trs transA, size_t m, size_t n, size_t k, const float *a, size_t lda, const float *packed,
+                           const float *bias, Act activation, float *c, size_t ldc, float *out, size_t ldo);
+
+/*
+c = alpha * a x b + beta * c over two-dimensional views of one dtype, double or float, whatever their strides:
+a transposed view is read in place and a broadcast operand, stride 0, is fine. c can't be a broadcast.
+*/
+Sts gemmView(double alpha, const View *a, const View *b, double beta, View *c);
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file graph.h
+ * @author luwangguerde@163.com
+ * @brief The forward pass of a model as a graph of ops, fused ahead of time and compiled into a flat plan
+ * @version 0.1
+ * @date 2024-12-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "model.h"
+#include <stdio.h>
+
+enum GraphOp
+{
+    GRAPH_GEMM,     // rows x numOut = (rows x numIn) weight^T, plus the bias and activation folded into it, if any
+    GRAPH_BIAS,     // every row plus bias, then the activation merged into it, if any
+    GRAPH_ACTIVATE, // element-wise, ACTIVATION_CUSTOM through the function of the layer
+    GRAPH_CONV,
+    GRAPH_POOL,
+    GRAPH_FLATTEN // between a layer of rows and one of channel stacks, either way, the same elements
+};
+
+struct GRAPH_NODE
+{
+    enum GraphOp op;
+    size_t input; // tensors
+    size_t output;
+
+    Act activation;
+    Sts (*activateFunction)(Input *, Output *); // ACTIVATION_CUSTOM only
+    const void *weight;                        // GEMM: numOut x numIn, CONV: the kernels
+    const void *bias;                          // numOut, NULL for a GEMM without one
+    struct FCL *layer;                         // GEMM of a layer prepareFCL packed, its packed weights are read
+    char *scratch;                             // CONV: the columns of the layer, POOL: its rows
+    size_t rows, numIn, numOut;                // the batch, the elements of one sample in and out, every op
+    size_t channel, height, width;             // the input of CONV and POOL, one sample
+    size_t multiplier, kernelSize, stride, padding;
+    Plm mode;
+    Cva algorithm; // CONV, the layer's
+};
+
+/*
+Tensors are the values between the ops, every one written by a single node, the whole batch each. Each lives
+in the buffer compileModel planned for the layer it comes from, its output, or linearTrans for the product
+before a custom activation, so the lifetimes the model planned already overlap them and a plan adds no buffers.
+The parameters and buffers are the model's: the model has to outlive the graph and every plan of it, a plan
+computes with what the parameters hold when it runs, and runPlan and forwardModel write the same buffers.
+prepareModel before graphOfModel, and the gemms read the packed weights, packed again like forwardFCL does
+when they are stale.
+*/
+struct GRAPH
+{
+    Dtp dtype;
+    size_t batchSize;
+
+    struct GRAPH_NODE *nodes; // in the order they run
+    size_t nodeNum;
+    size_t *tensorLengths; // elements
+    char **tensorData;     // the model's buffer every tensor lives in
+    size_t tensorNum;
+    size_t input; // tensors, the input is written by no node
+    size_t output;
+};
+
+typedef struct GRAPH Graph;
+
+// one node per op of every layer, gemm, bias and activation apart, nothing fused; the model must be compiled
+Sts graphOfModel(Graph *graph, Model *model);
+/*
+The fusion passes, in order: flattens and ACTIVATION_NONE are dropped, a bias and then an activation directly
+after a gemm become its epilogue, and an activation directly after a bias that's left is merged into it,
+one sweep over the tensor instead of two.
+*/
+Sts optimizeGraph(Graph *graph);
+Sts printGraph(const Graph *graph, FILE *file); // one line per node
+Sts freeGraph(Graph *graph);
+
+struct PLAN_STEP // a node with its buffers resolved
+{
+    struct GRAPH_NODE node;
+    char *input;
+    char *output; // input itself for the element-wise ops working in place
+};
+
+/*
+A graph compiled: the steps run in order by one switch, every buffer resolved ahead to the model's.
+runPlan allocates nothing and calls through a function pointer only for a custom activation.
+*/
+struct PLAN
+{
+    Dtp dtype;
+    size_t batchSize;
+
+    struct PLAN_STEP *steps;
+    size_t stepNum;
+
+    Vec input;  // the model's, filled by the caller before runPlan, which may write over it like forwardModel
+    Vec output; // the model's, valid until the next runPlan or forwardModel
+};
+
+typedef struct PLAN Plan;
+
+Sts compilePlan(Plan *plan, const Graph *graph); // of an optimized graph or not, the plan doesn't need it after
+Sts runPlan(Plan *plan);
+size_t planFootprint(const Plan *plan); // bytes of the steps, the buffers are the model's
+Sts freePlan(Plan *plan);
+
+#endif
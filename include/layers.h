@@ -1,34 +1,57 @@
 #ifndef LAYERS_H
 #define LAYERS_H
 
+#include "arena.h"
 #include "base.h"
+#include "conv.h"
 #include "functions.h"
+#include "optimizer.h"
+#include "pool.h"
 
 struct FCL // fully connected layer, taking charge of three operations (cross weights, add bias, activate)
 {
+    /*
+    Every activation and gradient buffer holds batchSize rows, one sample per row,
+    so input is a batchSize x neuronNumIn matrix stored row-major in the vector.
+    */
+    size_t batchSize;
+    size_t neuronNumIn;
+    size_t neuronNumOut;
+
     Input input;               // input vector
     Output linearTrans;        // the middle layer after linear trans, keeping the value of (Wx + b)
     Output output;             // output vector, σ(Wx + b)
     Weights weight;            // the weights matrix
     Bias bias;                 // the bias vector
-    Derv dervOfBias;          // the derivatives of the bias vector
-    MDerv dervOfWeight;        // the derivatives of the weight matrix
+    Derv dervOfBias;          // the derivatives of the bias vector, summed over the batch
+    MDerv dervOfWeight;        // the derivatives of the weight matrix, summed over the batch
     Derv dervFromLastLayer;   // the derivatives from last layer, normally from ouput layer
     Derv dervToPreviousLayer; // the derivatives to previous layer during the backward
-    Derv dervOfActivateFunc;  // the derivatives of the activation function
+    Derv dervOfActivateFunc;  // the derivatives of the activation function, then the derivatives of linearTrans
+    Vec stateOfWeight[OPTIMIZER_STATE_MAX]; // the optimizer's moments of every weight, from initOptimizerFCL
+    Vec stateOfBias[OPTIMIZER_STATE_MAX];
 
-    /*
-    This two matrix is only for matrix computes,
-    it sholdn't be operated manually (with out using functions).
-    */
-    Mat m1; // broadcast a vector to a matrix to execute matrix operations
-    Mat m2;
     Sts (*activateFunction)(Input *, Output *);           // the pointer of the activate function
     Sts (*activateFunction_derivative)(Input *, Derv *); // the pointer of the derivative function
+    Act activation; // fused into the forward product unless custom, then linearTrans is left unused
+    int inference;  // built by initInferenceFCL, only input, output, parameters and linearTrans if custom exist
+
+    Vec packedWeight;     // weight in the slivers gemm reads, from prepareFCL, empty otherwise
+    size_t weightVersion; // one more after every write of weight, see weightWrittenFCL
+    size_t packedVersion; // the weightVersion packedWeight was packed from, forwardFCL packs again when they differ
 };
 
 struct CVL // convolutional layer
 {
+    /*
+    Every input channel owns multiplier kernels and gives multiplier output channels,
+    output channel c * multiplier + j is input channel c correlated with kernel c * multiplier + j.
+    */
+    size_t multiplier;
+    size_t kernelSize;
+    size_t stride;
+    size_t padding;
+
     SInput inputs;
     SOutput outputs;
     SKernel kernels;
@@ -37,25 +60,126 @@ struct CVL // convolutional layer
     SDerv dervsFromLastLayer;
     SDerv dervsToPreviousLayer;
 
-    Mat m1;
-    Mat m2;
-    Mat m3;
+    Vec columns; // the im2col unfolding of every input channel, reused by the backward pass, and the workspace
+    Vec stateOfKernels[OPTIMIZER_STATE_MAX]; // the optimizer's moments, from initOptimizerCVL
+    int inference; // built by initInferenceCVL, only inputs, outputs, kernels and columns exist
+    Cva algorithm; // of forwardCVL, convChooseAlgorithm's for the shape
+};
+
+struct PL // pooling layer, no parameters
+{
+    // every channel pooled on its own, outputs has the channels of inputs
+    Plm mode;
+    size_t kernelSize;
+    size_t stride;
+    size_t padding;
+
+    SInput inputs;
+    SOutput outputs;
+
+    SDerv dervsFromLastLayer;
+    SDerv dervsToPreviousLayer;
+
+    Vec argmax; // CHAR_TYPE, the window cell of every max output, what gradPL scatters through; max pooling only
+    Vec rows;   // the padded rows split by stride phases, empty for stride 1 without padding
+    int inference; // built by initInferencePL, only inputs, outputs and rows exist
 };
 
-struct OL // output layer
+/*
+Output layer, softmax and cross-entropy fused over integer class labels. The loss of a sample is
+log(sum(exp(x - max))) + max - x[label], the log-softmax taken apart so no probability is ever 0 inside a log,
+and its gradient p - y comes out of the same sweeps as the probabilities, no Jacobian in between.
+*/
+struct OL
 {
-    Input input;
-    Output output;
+    size_t batchSize;
+    size_t classNum;
+
+    Input input;              // batchSize x classNum logits, one sample per row
+    Output output;            // the probabilities of forwardOL, empty for an OL made by bindOL
+    Derv dervToPreviousLayer; // p - y of every sample, the mean over the batch is left to the step like every dL/dy
 };
 
 // all struct does not provide create operations
 Sts initFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, Sts (*activateFunction)(Input *, Output *),
             Sts (*activateFunction_derivative)(Input *, Derv *));
-Sts forwardFCL(struct FCL *fcl);
-Sts backwardFCL(struct FCL *fcl, double lr);
+Sts initBatchFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize,
+                 Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *));
+Sts initFloatFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize,
+                 Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *));
+Sts initArenaFCL(struct FCL *fcl, Arena *arena, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize, Dtp dtype,
+                 Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *));
+size_t sizeofFCL(size_t neuronNumIn, size_t neuronNumOut, size_t batchSize, Dtp dtype); // bytes initArenaFCL takes
+// forward only, from the arena or the heap when it's NULL, gradFCL and the optimizer refuse it
+Sts initInferenceFCL(struct FCL *fcl, Arena *arena, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize,
+                     Dtp dtype, Sts (*activateFunction)(Input *, Output *),
+                     Sts (*activateFunction_derivative)(Input *, Derv *));
+size_t sizeofInferenceFCL(size_t neuronNumIn, size_t neuronNumOut, size_t batchSize, Act activation, Dtp dtype);
+/*
+Pack weight once for every forwardFCL after, from the arena or the heap when it's NULL; a layer prepared before
+keeps its buffer. The product then reads the slivers as they are, and a batch of one goes through a kernel made
+for a single row instead of the matrix x vector loop. A write of weight since the packing, by optimizeFCL,
+setWeightFCL, loadModel or declared with weightWrittenFCL, has the next forward pack it again.
+*/
+Sts prepareFCL(struct FCL *fcl, Arena *arena);
+size_t sizeofPreparedFCL(size_t neuronNumIn, size_t neuronNumOut, Dtp dtype);
+const void *packedWeightFCL(struct FCL *fcl); // packed again first if it's stale, NULL when fcl isn't prepared
+Sts setWeightFCL(struct FCL *fcl, const Mat *weight); // copy in a weight of the same shape and dtype
+Sts weightWrittenFCL(struct FCL *fcl);                 // after writing weight some other way, e.g. through a view
+Sts forwardFCL(struct FCL *fcl);              // the whole batch in one matrix product
+Sts gradFCL(struct FCL *fcl);                 // the gradients of the batch, the parameters stay as they are
+Sts stepFCL(struct FCL *fcl, double lr);      // one SGD step with the gradient averaged over the batch
+Sts initOptimizerFCL(struct FCL *fcl, Arena *arena, const Optimizer *optimizer); // the state optimizeFCL needs
+size_t sizeofOptimizerFCL(size_t neuronNumIn, size_t neuronNumOut, const Optimizer *optimizer, Dtp dtype);
+Sts optimizeFCL(struct FCL *fcl, const Optimizer *optimizer); // one update with the gradient averaged over the batch
+Sts backwardFCL(struct FCL *fcl, double lr);  // gradFCL then stepFCL
 
 Sts initCVL(struct CVL *cvl, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize);
+Sts initFloatCVL(struct CVL *cvl, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize);
+Sts initArenaCVL(struct CVL *cvl, Arena *arena, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize,
+                 size_t multiplier, size_t stride, size_t padding, Dtp dtype);
+Sts initStridedCVL(struct CVL *cvl, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                   size_t stride, size_t padding, Dtp dtype);
+size_t sizeofCVL(size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier, size_t stride,
+                 size_t padding, Dtp dtype);
+Sts initInferenceCVL(struct CVL *cvl, Arena *arena, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize,
+                     size_t multiplier, size_t stride, size_t padding, Dtp dtype);
+size_t sizeofInferenceCVL(size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                          size_t stride, size_t padding, Dtp dtype);
+/*
+Elements of columns: the workspace of the algorithm the shape picks, and the unfolding gradCVL reads unless
+inference, at least as long since it's the workspace of im2col.
+*/
+size_t columnsLengthCVL(size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                        size_t stride, size_t padding, Dtp dtype, int inference);
 Sts forwardCVL(struct CVL *cvl);
-Sts backwardCVL(struct CVL *cvl, double lr);
+// right after the forwardCVL of the same inputs, it reuses the columns, or unfolds them if it took another algorithm
+Sts gradCVL(struct CVL *cvl);
+Sts stepCVL(struct CVL *cvl, double lr);
+Sts initOptimizerCVL(struct CVL *cvl, Arena *arena, const Optimizer *optimizer);
+size_t sizeofOptimizerCVL(size_t channelOut, size_t kernelSize, const Optimizer *optimizer, Dtp dtype);
+Sts optimizeCVL(struct CVL *cvl, const Optimizer *optimizer);
+Sts backwardCVL(struct CVL *cvl, double lr); // gradCVL then stepCVL
+
+Sts initPL(struct PL *pl, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride, size_t padding,
+           Plm mode, Dtp dtype);
+Sts initArenaPL(struct PL *pl, Arena *arena, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize,
+                size_t stride, size_t padding, Plm mode, Dtp dtype);
+size_t sizeofPL(size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride, size_t padding, Plm mode,
+                Dtp dtype);
+Sts initInferencePL(struct PL *pl, Arena *arena, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize,
+                    size_t stride, size_t padding, Plm mode, Dtp dtype);
+size_t sizeofInferencePL(size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride, size_t padding,
+                         Dtp dtype);
+Sts forwardPL(struct PL *pl);
+Sts gradPL(struct PL *pl); // right after the forwardPL of the same inputs when it's max pooling, it reads the argmax
+
+Sts initOL(struct OL *ol, Arena *arena, size_t classNum, size_t batchSize, Dtp dtype); // the heap when arena is NULL
+size_t sizeofOL(size_t classNum, size_t batchSize, Dtp dtype);
+// over buffers someone else owns, e.g. bindOL(&ol, &model.output, &model.dervOfOutput, classNum), lossOL only
+Sts bindOL(struct OL *ol, Vec *logits, Vec *dervOfLogits, size_t classNum);
+Sts forwardOL(struct OL *ol); // the probabilities of every sample, for predictions
+// labels holds batchSize class indexes in intArray, loss gets the mean over the batch
+Sts lossOL(struct OL *ol, const Label *labels, double *loss);
 
 #endif
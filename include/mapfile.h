@@ -0,0 +1,34 @@
+/**
+ * @file mapfile.h
+ * @author luwangguerde@163.com
+ * @brief Read-only views of whole files, memory mapped where the system allows it
+ * @version 0.1
+ * @date 2024-12-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include "base.h"
+
+/*
+On POSIX systems the file is mapped copy-on-write: its pages come from the page cache, shared with every
+other process mapping the same file, and only the pages written to get a private copy.
+Elsewhere, or when mmap fails, the file is read into one 64-byte aligned allocation.
+Either way data is aligned to at least 64 bytes.
+*/
+struct MAPPED_FILE
+{
+    char *data;
+    size_t bytes;
+    int mapped; // 1 for a mapping, 0 for a heap copy
+};
+
+typedef struct MAPPED_FILE MappedFile;
+
+Sts mapFile(MappedFile *file, const char *path);
+Sts unmapFile(MappedFile *file);
+
+#endif
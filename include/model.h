@@ -0,0 +1,91 @@
+/**
+ * @file model.h
+ * @author luwangguerde@163.com
+ * @brief A sequential model owning its layers and the buffers between them
+ * @version 0.1
+ * @date 2024-12-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef MODEL_H
+#define MODEL_H
+
+#include "arena.h"
+#include "layers.h"
+#include "mapfile.h"
+#include "optimizer.h"
+
+enum LayerType
+{
+    FULLY_CONNECTED_LAYER,
+    CONVOLUTIONAL_LAYER,
+    POOLING_LAYER
+};
+
+struct LAYER
+{
+    enum LayerType type;
+    union {
+        struct FCL fcl;
+        struct CVL cvl;
+        struct PL pl;
+    } layer;
+};
+
+/*
+Layers are added in order and connected at compileModel: the output of a layer is the input
+of the next and the gradient it sends back is the gradient the previous one receives, one buffer each.
+Buffers whose lifetimes never overlap inside a training step share storage.
+*/
+struct MODEL
+{
+    size_t batchSize;
+    Dtp dtype;
+    int inference; // forward only, from initInferenceModel
+
+    struct LAYER *layers;
+    size_t layerNum;
+    size_t layerCapacity;
+
+    Arena parameters; // weights, kernels, biases, their gradients and optimizer state, alive as long as the model
+    Arena prepared;   // the weights prepareModel packed, empty otherwise
+    Optimizer optimizer; // SGD at .01 unless set, its hyperparameters may change between steps
+    MappedFile checkpoint; // the file mapModel reads the parameters from in place, empty otherwise
+    char *buffers;    // the planned activations and gradients
+    size_t bufferBytes;
+
+    // views over the ends of the chain, one sample per row
+    Vec input;         // filled by the caller before forwardModel
+    Vec output;        // the output of the last layer
+    Vec dervOfOutput;  // filled by the caller before backwardModel, dL/d(output)
+    Vec dervOfInput;   // dL/d(input) after backwardModel
+};
+
+typedef struct MODEL Model;
+
+Sts initModel(Model *model, size_t batchSize, Dtp dtype);
+// no gradients and no optimizer state, backwardModel and stepModel refuse it and dervOfOutput is NULL
+Sts initInferenceModel(Model *model, size_t batchSize, Dtp dtype);
+Sts modelAddFCL(Model *model, size_t neuronNumIn, size_t neuronNumOut, Sts (*activateFunction)(Input *, Output *),
+                Sts (*activateFunction_derivative)(Input *, Derv *));
+Sts modelAddCVL(Model *model, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                size_t stride, size_t padding); // only in models of batchSize 1
+Sts modelAddPL(Model *model, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride,
+               size_t padding, Plm mode); // only in models of batchSize 1
+Sts modelSetOptimizer(Model *model, const Optimizer *optimizer); // before compileModel, which allocates its state
+Sts compileModel(Model *model); // check the chain, plan and allocate every buffer, after the last add
+/*
+Pack the weights of every FCL once for the forward passes after, see prepareFCL, after compileModel or
+loading the model. Training can go on: a layer whose weights stepModel updated is packed again by its next forward,
+so is one written by setWeightFCL or declared written with weightWrittenFCL. Other models' writes repack nothing.
+*/
+Sts prepareModel(Model *model);
+Sts forwardModel(Model *model);
+Sts backwardModel(Model *model);           // the gradients of every layer, the parameters stay as they are
+Sts stepModel(Model *model);               // one update of every layer by the model's optimizer
+size_t modelFootprint(Model *model); // bytes owned by the model, parameters, planned buffers, packed weights, mapping
+size_t modelUnplannedBytes(Model *model);  // bytes the same layers would take with a buffer each
+Sts freeModel(Model *model);
+
+#endif
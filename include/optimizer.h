@@ -0,0 +1,55 @@
+/**
+ * @file optimizer.h
+ * @author luwangguerde@163.com
+ * @brief The update rules turning gradients into parameter steps, and the state they keep between steps
+ * @version 0.1
+ * @date 2024-12-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "arena.h"
+#include "base.h"
+
+#define OPTIMIZER_STATE_MAX 2 // moment buffers one parameter needs at most (adam)
+
+enum OptimizerType
+{
+    OPTIMIZER_SGD,
+    OPTIMIZER_MOMENTUM,
+    OPTIMIZER_NESTEROV,
+    OPTIMIZER_RMSPROP,
+    OPTIMIZER_ADAM,
+    OPTIMIZER_ADAMW // adam with the weight decay applied to the parameters instead of the gradient
+};
+
+struct OPTIMIZER
+{
+    enum OptimizerType type;
+    double lr;
+    double momentum;    // mu of momentum and nesterov, beta1 of adam
+    double decay;       // rho of rmsprop, beta2 of adam
+    double epsilon;     // keeps rmsprop and adam from dividing by zero
+    double weightDecay; // adamW only
+    size_t step;        // updates started, adam corrects its moments with it
+};
+
+typedef struct OPTIMIZER Optimizer;
+
+Sts initOptimizer(Optimizer *optimizer, enum OptimizerType type, double lr); // the usual defaults for the rest
+size_t optimizerStateNum(const Optimizer *optimizer);                         // moment buffers per parameter
+size_t sizeofOptimizerState(const Optimizer *optimizer, size_t length, Dtp dtype); // arena bytes of one parameter
+// state[0 .. optimizerStateNum) zeroed in the arena, length elements each
+Sts initOptimizerState(const Optimizer *optimizer, Arena *arena, Vec *state, size_t length, Dtp dtype);
+Sts optimizerNextStep(Optimizer *optimizer); // once per batch, before its updates
+
+/*
+One fused pass over the parameter, its gradient and its state. The gradient is multiplied by gradScale first,
+e.g. 1 / batchSize for a gradient summed over the batch, without a pass of its own.
+*/
+Sts optimizerUpdate(const Optimizer *optimizer, Vec *param, const Vec *grad, Vec *state, double gradScale);
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * @file pool.h
+ * @author luwangguerde@163.com
+ * @brief Max and average pooling over whole channel stacks, vectorized across the output row
+ * @version 0.1
+ * @date 2024-12-21
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include "base.h"
+
+#define POOL_MAX_KERNEL 15 // the window cell ky * kernelSize + kx of an argmax must fit in one byte
+
+enum PoolingMode
+{
+    POOLING_MAX,
+    POOLING_AVERAGE // the padding counts as zeros, every window is divided by kernelSize^2
+};
+
+typedef enum PoolingMode Plm;
+
+/*
+The output size is convOutSize of the same arguments. padding is at most kernelSize / 2,
+so every window holds at least one pixel of the image.
+*/
+Sts poolCheck(size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding);
+
+/*
+Elements of rows per channel: every image row padded and split into stride phases, phase r holding
+the padded pixels r, r + stride, ..., so a window cell reads the same phase for a whole output row.
+0 for stride 1 without padding, which reads the image itself.
+*/
+size_t poolRowsSize(size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding);
+
+/*
+channel independent images of height x width, rows takes channel * poolRowsSize elements.
+argmax takes one byte per output, the window cell of its max, and may be NULL; average pooling leaves it alone.
+*/
+Sts poolingDouble(const double *input, size_t channel, size_t height, size_t width, size_t kernelSize, size_t stride,
+                  size_t padding, Plm mode, double *rows, double *output, unsigned char *argmax);
+Sts poolingFloat(const float *input, size_t channel, size_t height, size_t width, size_t kernelSize, size_t stride,
+                 size_t padding, Plm mode, float *rows, float *output, unsigned char *argmax);
+
+// dInput is overwritten, max pooling sends every output gradient to the cell argmax recorded
+Sts poolingBackwardDouble(const double *dOutput, size_t channel, size_t height, size_t width, size_t kernelSize,
+                          size_t stride, size_t padding, Plm mode, const unsigned char *argmax, double *dInput);
+Sts poolingBackwardFloat(const float *dOutput, size_t channel, size_t height, size_t width, size_t kernelSize,
+                         size_t stride, size_t padding, Plm mode, const unsigned char *argmax, float *dInput);
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file profile.h
+ * @author luwangguerde@163.com
+ * @brief Opt-in timers and hardware counters around the layers and kernels, with a summary table and a Chrome trace
+ * @version 0.1
+ * @date 2024-12-22
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "base.h"
+#include <stdio.h>
+
+/*
+Built with CNN_PROFILE (cmake -DCNN_PROFILE=ON) every layer pass, model pass and kernel is a region:
+its wall time, calls, FLOPs and bytes go to a table per thread and, up to a cap, to a list of events.
+Without it PROFILE_BEGIN and PROFILE_END are nothing at all, not even the FLOP arithmetic,
+and the functions below return ERROR.
+*/
+enum ProfileKind
+{
+    PROFILE_MODEL,  // forwardModel, backwardModel, stepModel, forwardQModel
+    PROFILE_LAYER,  // forwardFCL, gradCVL ...
+    PROFILE_KERNEL, // gemm, convolution, pooling, the optimizer update
+    PROFILE_KINDS
+};
+
+typedef enum ProfileKind Pfk;
+
+struct PROFILE_MARK // an open region, from PROFILE_BEGIN to its PROFILE_END
+{
+    const char *name; // NULL when nothing is recording
+    Pfk kind;
+    size_t depth;
+    unsigned long long begin;       // the clock at the begin, in ns
+    unsigned long long counters[2]; // cycles and cache misses at the begin
+};
+
+typedef struct PROFILE_MARK ProfileMark;
+
+/*
+name has to outlive the profile, a string literal or __func__. A return between the two leaves the region
+unrecorded, which the error paths rely on instead of closing it themselves.
+*/
+#ifdef CNN_PROFILE
+#define PROFILE_BEGIN(mark, kind, name) ProfileMark mark = profileBegin((kind), (name))
+#define PROFILE_END(mark, flops, bytes) profileEnd(&(mark), (double)(flops), (double)(bytes))
+#else
+#define PROFILE_BEGIN(mark, kind, name)
+#define PROFILE_END(mark, flops, bytes)
+#endif
+
+ProfileMark profileBegin(Pfk kind, const char *name);
+void profileEnd(ProfileMark *mark, double flops, double bytes);
+
+/*
+Forget what was recorded and start again, between parallel loops. Every thread keeps at most eventCapacity
+events for the trace, 0 keeps none, the table counts every region anyway. counters reads the cycles
+and cache misses of the recording thread through perf_event_open, Linux only; where the kernel refuses
+they are left out, see profileCounters.
+*/
+Sts profileStart(size_t eventCapacity, int counters);
+Sts profileStop(void);
+int profileCounters(void); // 1 when the counters of the last profileStart are being read
+
+// after profileStop, or at least while no loop runs
+Sts profilePrint(FILE *file); // one row per region name over all threads, the slowest first
+// the events as Chrome trace-event JSON, for chrome://tracing or ui.perfetto.dev, one track per thread
+Sts profileWriteTrace(const char *path);
+Sts profileFree(void);
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @file quant.h
+ * @author luwangguerde@163.com
+ * @brief Int8 post-training quantization of fully connected models for inference
+ * @version 0.1
+ * @date 2024-12-17
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef QUANT_H
+#define QUANT_H
+
+#include "model.h"
+#include <stdint.h>
+
+#define QUANT_TILE_COLS 16   // output channels of one register tile, one int32 lane of a zmm each
+#define QUANT_DEPTH_ALIGN 16 // of every uint8 row, so a tile of outputs is stored whole as the next input
+
+/*
+Weights are symmetric per output channel: w = weightScale[j] * q with q in [-127, 127].
+Activations are uint8 with one scale and zero point per tensor: x = scale * (q - zero) with q in [0, 255],
+over the range seen while calibrating, widened to hold 0 so zero padding and the zeros of ReLU stay exact.
+*/
+struct QUANT_RANGE
+{
+    double min;
+    double max;
+};
+
+typedef struct QUANT_RANGE QRange;
+
+Sts initQuantRange(QRange *range);                   // empty, the first observed value sets both ends
+Sts observeQuantRange(QRange *range, const Vec *values); // widened to hold every value, double or float
+Sts quantRangeParams(const QRange *range, float *scale, int32_t *zero);
+
+/*
+The int8 copy of an FCL. A tile of int32 products is turned back into real values with scale, biased,
+activated and then either requantized into the uint8 input of the next layer or stored as float,
+in one pass while it is still in registers. The sum over the input zero point is folded into bias.
+The weight is packed for the tile: QUANT_TILE_COLS channels at a time, and inside those groups of
+4 consecutive inputs of every channel, so one 64-byte row of it meets 4 bytes of a sample broadcast
+and every lane of the product is one output channel, nothing is summed across lanes.
+*/
+struct QFCL
+{
+    size_t batchSize;
+    size_t neuronNumIn;
+    size_t neuronNumOut;
+    size_t depth;   // neuronNumIn padded to QUANT_DEPTH_ALIGN, the row stride of input
+    Act activation; // never ACTIVATION_CUSTOM
+
+    float inputScale;
+    int32_t inputZero;
+    float outputScale;  // of output, 0 when the layer writes outputFloat instead
+    int32_t outputZero;
+    size_t outputDepth; // row stride of output, the depth of the next layer
+
+    int8_t *weight; // neuronNumOut padded to QUANT_TILE_COLS x depth, packed
+    float *scale;   // inputScale * weightScale of every output channel, 0 over the padding
+    float *bias;    // as long as scale
+
+    // bound by the owner, input and output are the ones neighbours share
+    uint8_t *input;     // batchSize x depth
+    uint8_t *output;    // batchSize x outputDepth
+    float *outputFloat; // batchSize x neuronNumOut
+};
+
+/*
+Quantize the parameters of fcl from the arena, given the range of its input and of its output,
+outputRange is NULL for a layer that writes float. The activation buffers are left to the caller.
+*/
+Sts initQFCL(struct QFCL *qfcl, Arena *arena, const struct FCL *fcl, const QRange *inputRange,
+             const QRange *outputRange);
+size_t sizeofQFCL(size_t neuronNumIn, size_t neuronNumOut); // arena bytes initQFCL takes
+Sts forwardQFCL(struct QFCL *qfcl);
+
+/*
+A chain of QFCL over one arena, the output of a layer is the input of the next and stays uint8 in between.
+Only the ends are float: input is quantized on the way in and output comes out of the last epilogue.
+*/
+struct QMODEL
+{
+    size_t batchSize;
+    struct QFCL *layers;
+    size_t layerNum;
+    Arena memory; // parameters and activations
+
+    Vec input;  // float, filled by the caller before forwardQModel, one sample per row
+    Vec output; // float, the output of the last layer
+};
+
+typedef struct QMODEL QModel;
+
+/*
+Calibrate on sampleNum batches, each a Vec like model->input, by running the model forward on them
+and recording the range of the input of every layer, then quantize every layer with those ranges.
+The model must be compiled and made of FCL only, with activations that aren't custom.
+*/
+Sts quantizeModel(QModel *qmodel, Model *model, const Vec *samples, size_t sampleNum);
+Sts forwardQModel(QModel *qmodel);
+size_t qmodelFootprint(QModel *qmodel); // bytes of the arena, every parameter and activation
+Sts freeQModel(QModel *qmodel);
+
+#endif
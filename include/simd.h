@@ -0,0 +1,92 @@
+/**
+ * @file simd.h
+ * @author luwangguerde@163.com
+ * @brief Vectorized element-wise kernels with runtime CPU dispatch
+ * @version 0.1
+ * @date 2024-12-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "base.h"
+
+enum SimdLevel // instruction sets in increasing width, each level implies the ones before it
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,   // with FMA
+    SIMD_AVX512, // AVX-512F
+    SIMD_LEVELS
+};
+
+typedef enum SimdLevel Lvl;
+
+/*
+One table of kernels per instruction set. Every kernel takes raw arrays and a length,
+the input and output arrays may be the same array but must not partially overlap.
+*/
+struct SIMD_KERNELS
+{
+    const char *name;
+    void (*addDouble)(const double *x, const double *y, double *result, size_t n);    // result = x + y
+    void (*mulDouble)(const double *x, const double *y, double *result, size_t n);    // result = x * y
+    void (*axpyDouble)(double alpha, const double *x, double *y, size_t n);          // y += alpha * x
+    void (*scaleDouble)(double alpha, const double *x, double *result, size_t n);    // result = alpha * x
+    void (*reluDouble)(const double *x, double slope, double *result, size_t n);     // x > 0 ? x : slope * x
+    void (*reluDerivativeDouble)(const double *x, double slope, double *result, size_t n); // x > 0 ? 1 : slope
+    void (*reluBackwardDouble)(const double *x, double slope, const double *dy, double *result, size_t n); // dy * relu'
+    void (*sigmoidDouble)(const double *x, double *result, size_t n);
+    void (*sigmoidBackwardDouble)(const double *y, const double *dy, double *result, size_t n); // dy * y * (1 - y)
+    double (*expShiftSumDouble)(const double *x, double shift, double *result, size_t n); // exp(x - shift), sum
+    double (*maxDouble)(const double *x, size_t n);
+    double (*sumDouble)(const double *x, size_t n);
+
+    // the same kernels on float32, twice the lanes per register
+    void (*addFloat)(const float *x, const float *y, float *result, size_t n);
+    void (*mulFloat)(const float *x, const float *y, float *result, size_t n);
+    void (*axpyFloat)(float alpha, const float *x, float *y, size_t n);
+    void (*scaleFloat)(float alpha, const float *x, float *result, size_t n);
+    void (*reluFloat)(const float *x, float slope, float *result, size_t n);
+    void (*reluDerivativeFloat)(const float *x, float slope, float *result, size_t n);
+    void (*reluBackwardFloat)(const float *x, float slope, const float *dy, float *result, size_t n);
+    void (*sigmoidFloat)(const float *x, float *result, size_t n);
+    void (*sigmoidBackwardFloat)(const float *y, const float *dy, float *result, size_t n);
+    float (*expShiftSumFloat)(const float *x, float shift, float *result, size_t n);
+    float (*maxFloat)(const float *x, size_t n);
+    float (*sumFloat)(const float *x, size_t n);
+
+    /*
+    Pooling across a row: taps[t] is the t-th window cell of n neighbouring windows, one window per element.
+    poolMax keeps the max over the tapNum taps, and in argmax, unless NULL, the position of the first tap holding it.
+    poolAvg keeps their sum times scale. tapNum is at least 1.
+    */
+    void (*poolMaxDouble)(const double *const *taps, const unsigned char *positions, size_t tapNum, double *result,
+                          unsigned char *argmax, size_t n);
+    void (*poolAvgDouble)(const double *const *taps, size_t tapNum, double scale, double *result, size_t n);
+    void (*poolMaxFloat)(const float *const *taps, const unsigned char *positions, size_t tapNum, float *result,
+                         unsigned char *argmax, size_t n);
+    void (*poolAvgFloat)(const float *const *taps, size_t tapNum, float scale, float *result, size_t n);
+
+    // fused optimizer updates of the parameters p from the gradients g, one pass over p, g and the state
+    void (*momentumDouble)(double lr, double mu, int nesterov, const double *g, double *v, double *p, size_t n);
+    void (*rmspropDouble)(double lr, double rho, double eps, const double *g, double *s, double *p, size_t n);
+    void (*adamDouble)(double lr, double beta1, double beta2, double vScale, double eps, double decay, const double *g,
+                       double *m, double *v, double *p, size_t n);
+    void (*momentumFloat)(float lr, float mu, int nesterov, const float *g, float *v, float *p, size_t n);
+    void (*rmspropFloat)(float lr, float rho, float eps, const float *g, float *s, float *p, size_t n);
+    void (*adamFloat)(float lr, float beta1, float beta2, float vScale, float eps, float decay, const float *g,
+                      float *m, float *v, float *p, size_t n);
+};
+
+typedef struct SIMD_KERNELS Simd;
+
+const Simd *simdKernels(void);           // the table of the active level, probed from the CPU on first use
+const Simd *simdKernelsAt(Lvl level);    // a specific table, NULL if this build or CPU can't run it
+Lvl simdLevel(void);                     // the active level
+Lvl simdDetectLevel(void);               // the widest level the CPU supports
+Sts simdSetLevel(Lvl level);             // force a level, e.g. SIMD_SCALAR as the reference for tests
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file tape.h
+ * @author luwangguerde@163.com
+ * @brief Reverse-mode automatic differentiation, ops recorded on a tape and their gradients replayed backwards
+ * @version 0.1
+ * @date 2024-12-24
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef TAPE_H
+#define TAPE_H
+
+#include "arena.h"
+#include "base.h"
+#include "functions.h"
+#include "pool.h"
+
+#define TAPE_MAX_INPUTS 3
+
+enum TapeOp
+{
+    TAPE_INPUT,   // a leaf without a gradient, the batch the caller fills
+    TAPE_PARAM,   // a leaf whose gradient goes to a buffer of the caller
+    TAPE_LINEAR,  // act(x w^T + b), w holds one row of the features of x per output
+    TAPE_ACTIVATE,
+    TAPE_ADD,
+    TAPE_CONV,    // the depthwise convolution of conv.h on every sample
+    TAPE_POOL,
+    TAPE_FLATTEN, // channel x height x width of every sample as one row of features, the same storage
+    TAPE_SOFTMAX_CROSS_ENTROPY // the mean over the batch of the loss lossOL computes, a single value
+};
+
+typedef size_t Var; // a value on the tape, the index of the node computing it
+
+struct TAPE_NODE
+{
+    enum TapeOp op;
+    Var inputs[TAPE_MAX_INPUTS];
+    size_t inputNum;
+
+    size_t shape[4]; // batch, channel, height, width; a batch of feature rows is batch x features x 1 x 1
+    Vec value;
+    Vec grad;        // dL/d(value) during tapeBackward, from the gradient arena unless it's a parameter's
+    int needsGrad;   // a parameter or computed from one, the only nodes tapeBackward sends gradients to
+    int gradWritten; // the first gradient to arrive is written, the others are added to it
+
+    // what the op was recorded with
+    Act activation;
+    Plm mode;
+    size_t multiplier, kernelSize, stride, padding;
+    const Label *labels;
+    Vec saved; // what the backward of the op reads: conv columns, pool argmax, p - y of the loss
+    Vec rows;  // the pooling rows
+};
+
+/*
+Every op runs at once and appends a node, its output coming from the values arena. tapeBackward then
+goes over the nodes in reverse, each sending the vector-Jacobian product of its gradient to its inputs.
+Inputs, parameters and labels are recorded by address, so there are two ways to train:
+    - record the step, tapeBackward, tapeReset, and record the next step again, the graph may change;
+    - record once, then tapeForward and tapeBackward every step after refilling the inputs in place.
+Either way the gradients are carved from an arena handed out again by every tapeBackward, sized by the first,
+so after the first step a training step allocates nothing.
+*/
+struct TAPE
+{
+    Dtp dtype; // double or float, every value on the tape has it
+    struct TAPE_NODE *nodes;
+    size_t nodeNum;
+    size_t nodeCapacity;
+
+    Arena values;     // the outputs of the ops and what their backward reads, until tapeReset
+    Arena grads;      // the gradients of one backward pass
+    size_t gradBytes; // what a backward pass of the recorded nodes takes at most
+    size_t scratchLength; // elements of the scratch where a gradient is made before it's added to another
+};
+
+typedef struct TAPE Tape;
+
+// valueBytes for the outputs of every op recorded, tapeFootprint after a first recording tells what it took
+Sts initTape(Tape *tape, size_t nodeCapacity, size_t valueBytes, Dtp dtype);
+Sts tapeReset(Tape *tape); // forget the nodes and their values, the gradient arena is kept for the next recording
+Sts freeTape(Tape *tape);
+size_t tapeFootprint(const Tape *tape); // bytes of the values recorded and of the gradient arena
+
+/*
+The leaves. An input is a batch x channel x height x width block of the caller's storage, a parameter any
+Vec with a gradient buffer of the same length the backward pass overwrites. Neither is copied.
+*/
+Sts tapeInput(Tape *tape, Vec *value, size_t batch, size_t channel, size_t height, size_t width, Var *var);
+Sts tapeParam(Tape *tape, Vec *value, Vec *grad, Var *var);
+
+/*
+The ops, every one computed when recorded. x of tapeLinear is read as rows of features whatever its shape.
+tapeConv takes kernels of channel * multiplier * kernelSize^2 elements and tapePool padding of at most
+kernelSize / 2, like the layers. activation can't be ACTIVATION_CUSTOM.
+*/
+Sts tapeLinear(Tape *tape, Var x, Var w, Var b, Act activation, Var *y);
+Sts tapeActivate(Tape *tape, Var x, Act activation, Var *y);
+Sts tapeAdd(Tape *tape, Var x0, Var x1, Var *y);
+Sts tapeConv(Tape *tape, Var x, Var kernels, size_t multiplier, size_t kernelSize, size_t stride, size_t padding,
+             Var *y);
+Sts tapePool(Tape *tape, Var x, size_t kernelSize, size_t stride, size_t padding, Plm mode, Var *y);
+Sts tapeFlatten(Tape *tape, Var x, Var *y);
+// labels holds batch class indexes in intArray, logits batch rows of the class scores
+Sts tapeSoftmaxCrossEntropy(Tape *tape, Var logits, const Label *labels, Var *loss);
+
+Vec *tapeValue(Tape *tape, Var var);
+Vec *tapeGrad(Tape *tape, Var var); // after tapeBackward, NULL if no gradient reached var
+
+Sts tapeForward(Tape *tape); // every recorded op again, from what its inputs and parameters hold now
+/*
+dL/d(every parameter) for the single value loss, written to the gradient buffers of the parameters.
+These are the gradients of the recorded loss, already the mean over the batch, so an optimizerUpdate takes
+a gradScale of 1.
+*/
+Sts tapeBackward(Tape *tape, Var loss);
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file threadpool.h
+ * @author luwangguerde@163.com
+ * @brief The persistent worker pool every parallel loop of the library runs on
+ * @version 0.1
+ * @date 2024-12-11
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "base.h"
+
+/*
+One pool per process, started on the first parallel loop with a thread per online core unless
+initThreadPool was called before. The calling thread always works on its own loop too,
+and a loop started from inside a task runs inline on that thread.
+*/
+// threadNum counts the caller and 0 takes every core, pinned binds worker i to core i + 1 (Linux only)
+Sts initThreadPool(size_t threadNum, int pinned); // restarts the pool when it's running
+Sts freeThreadPool(void);
+size_t threadPoolSize(void); // threads running a loop, the caller included
+
+/*
+In deterministic mode every reduction splits its work at boundaries fixed by the problem size alone
+and adds the partial results in chunk order, so the sums are bitwise the same for any thread count
+and any run. Otherwise partials are added as they finish and reductions only split with more than one thread.
+*/
+Sts threadPoolSetDeterministic(int deterministic);
+int threadPoolDeterministic(void);
+
+// task(args, begin, end) for disjoint ranges covering [0, length), each at least grain long unless it's the last
+Sts parallelFor(size_t length, size_t grain, void (*task)(void *args, size_t begin, size_t end), void *args);
+
+/*
+task(args, begin, end) on the chunks [0, chunk), [chunk, 2 * chunk) ... writing their partial results,
+then combine(args, begin, end) once per chunk, one at a time, to fold every partial into the result.
+*/
+Sts parallelReduce(size_t length, size_t chunk, void (*task)(void *args, size_t begin, size_t end),
+                   void (*combine)(void *args, size_t begin, size_t end), void *args);
+
+#endif
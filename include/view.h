@@ -0,0 +1,71 @@
+/**
+ * @file view.h
+ * @author luwangguerde@163.com
+ * @brief Strided views over the storage of a Vec, Mat or Mts, transposed, sliced and broadcast without a copy
+ * @version 0.1
+ * @date 2024-12-23
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "base.h"
+
+#define VIEW_MAX_DIMS 4
+
+/*
+Element (i0, i1, ...) of a view is array[offset + i0 * strides[0] + i1 * strides[1] + ...], strides count
+elements. A view owns nothing, it lives as long as the storage it was taken from. A stride of 0 repeats
+the same element along its dimension, which is how a broadcast looks; no kernel writes through one.
+*/
+struct VIEW
+{
+    union {
+        int *intArray;
+        char *charArray;
+        float *floatArray;
+        double *doubleArray;
+    } array;
+
+    size_t offset;
+    size_t dimNum;
+    size_t shape[VIEW_MAX_DIMS];
+    ptrdiff_t strides[VIEW_MAX_DIMS];
+    enum DataType dtype;
+};
+
+typedef struct VIEW View;
+
+// a Vec read as dimNum dimensions of shape in row-major order, their product has to be its length
+Sts viewOfVec(const Vec *vec, size_t dimNum, const size_t *shape, View *view);
+Sts viewOfMat(const Mat *mat, View *view); // row x col
+Sts viewOfMts(const Mts *mts, View *view); // channel x height x width
+
+/*
+The results below may be written over the view they are taken from.
+Slicing keeps the dimension, [begin, end) of it, so two slices cut a block and one on the first
+dimension of an Mts is a range of channels. viewSelect drops the dimension at index.
+*/
+Sts viewTranspose(const View *view, size_t dim0, size_t dim1, View *result); // swaps two dimensions
+Sts viewSlice(const View *view, size_t dim, size_t begin, size_t end, View *result);
+Sts viewSelect(const View *view, size_t dim, size_t index, View *result);
+// the same elements in another shape, ERROR when the strides can't express it without a copy
+Sts viewReshape(const View *view, size_t dimNum, const size_t *shape, View *result);
+// the view repeated up to shape, matched from the last dimension on, every dimension of it 1 or the same
+Sts viewBroadcast(const View *view, size_t dimNum, const size_t *shape, View *result);
+
+size_t viewLength(const View *view);
+int viewIsContiguous(const View *view); // row-major without gaps, what a Vec of the same shape would be
+void *viewData(const View *view);       // the address of the first element
+
+/*
+Element-wise over the shape of result, x and y are broadcast to it. Rows with unit strides go through
+the Simd kernels, anything else element by element. result may be x or y but must not partially overlap them.
+*/
+Sts viewAdd(const View *x, const View *y, View *result); // double and float
+Sts viewMul(const View *x, const View *y, View *result);
+Sts viewCopy(const View *x, View *result); // any type, e.g. a transposed view into contiguous storage
+
+#endif
@@ -0,0 +1,157 @@
+#include "arena.h"
+
+Sts initArena(Arena *arena, size_t capacity)
+{
+    if (!arena)
+        return ERROR;
+
+    arena->capacity = arenaAlignedSize(capacity);
+    arena->offset = 0;
+    arena->base = (char *)alignedMalloc(arena->capacity, ARENA_ALIGNMENT);
+    if (!arena->base)
+    {
+        arena->capacity = 0;
+        return ERROR;
+    }
+
+    return OK;
+}
+
+void *arenaAlloc(Arena *arena, size_t bytes)
+{
+    if (!arena || !arena->base)
+        return NULL;
+
+    size_t size = arenaAlignedSize(bytes);
+    if (size > arena->capacity - arena->offset)
+        return NULL;
+
+    void *ptr = arena->base + arena->offset;
+    arena->offset += size;
+
+    return ptr;
+}
+
+Sts resetArena(Arena *arena)
+{
+    if (!arena)
+        return ERROR;
+
+    arena->offset = 0;
+
+    return OK;
+}
+
+Sts freeArena(Arena *arena)
+{
+    if (!arena)
+        return OK;
+
+    alignedFree(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->offset = 0;
+
+    return OK;
+}
+
+size_t arenaFootprint(Arena *arena)
+{
+    return arena ? arena->offset : 0;
+}
+
+size_t arenaAlignedSize(size_t bytes)
+{
+    return (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+static int compareBytes(const void *x, const void *y)
+{
+    const PlannedBuffer *a = *(PlannedBuffer *const *)x, *b = *(PlannedBuffer *const *)y;
+    return a->bytes < b->bytes ? 1 : a->bytes > b->bytes ? -1 : 0;
+}
+
+size_t arenaPlanBuffers(PlannedBuffer *plan, size_t num)
+{
+    PlannedBuffer **order = (PlannedBuffer **)malloc(sizeof(PlannedBuffer *) * num);
+    if (!order)
+        return 0;
+
+    for (size_t i = 0; i < num; i++)
+        order[i] = &plan[i];
+    qsort(order, num, sizeof(PlannedBuffer *), compareBytes);
+
+    size_t total = 0;
+    for (size_t i = 0; i < num && order[i]->bytes; i++)
+    {
+        PlannedBuffer *buffer = order[i];
+        size_t offset = 0;
+        int moved = 1;
+        while (moved) // every collision pushes it past the placed buffer, so this ends after num rounds at most
+        {
+            moved = 0;
+            for (size_t j = 0; j < i; j++)
+            {
+                PlannedBuffer *placed = order[j];
+                int liveTogether = placed->first <= buffer->last && buffer->first <= placed->last;
+                if (liveTogether && placed->offset < offset + buffer->bytes && offset < placed->offset + placed->bytes)
+                {
+                    offset = placed->offset + placed->bytes;
+                    moved = 1;
+                }
+            }
+        }
+
+        buffer->offset = offset;
+        total = offset + buffer->bytes > total ? offset + buffer->bytes : total;
+    }
+
+    free(order);
+
+    return total;
+}
+
+Sts initArenaVec(Arena *arena, Vec *vec, size_t length, Dtp dtype, double cell)
+{
+    if (!vec)
+        return ERROR;
+
+    vec->length = length;
+    vec->dtype = dtype;
+    vec->array.charArray = (char *)arenaAlloc(arena, length * sizeOfDataType(dtype));
+    if (!vec->array.charArray)
+        return ERROR;
+
+    return resetVecValue(vec, cell);
+}
+
+Sts initArenaMat(Arena *arena, Mat *mat, size_t row, size_t col, Dtp dtype, double cell)
+{
+    if (!mat)
+        return ERROR;
+
+    mat->row = row;
+    mat->col = col;
+    mat->dtype = dtype;
+    mat->array.charArray = (char *)arenaAlloc(arena, row * col * sizeOfDataType(dtype));
+    if (!mat->array.charArray)
+        return ERROR;
+
+    return resetMatValue(mat, cell);
+}
+
+Sts initArenaMts(Arena *arena, Mts *mts, size_t channel, size_t height, size_t width, Dtp dtype, double cell)
+{
+    if (!mts)
+        return ERROR;
+
+    mts->channel = channel;
+    mts->height = height;
+    mts->width = width;
+    mts->dtype = dtype;
+    mts->array.charArray = (char *)arenaAlloc(arena, channel * height * width * sizeOfDataType(dtype));
+    if (!mts->array.charArray)
+        return ERROR;
+
+    return resetMtsValue(mts, cell);
+}
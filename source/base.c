@@ -1,4 +1,10 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L // posix_memalign
+#endif
+
 #include "base.h"
+#include "gemm.h"
+#include "simd.h"
 #include <stdio.h>
 
 char colorMap[][10] = {
@@ -53,6 +59,54 @@ Mts *genDoubleMts(int channel, int height, int width, double cell)
     return matrixStack;
 }
 
+Mat *genFloatMat(int row, int col, float cell)
+{
+    Mat *matrix = (Mat *)malloc(sizeof(Mat));
+    if (!matrix)
+        return NULL;
+
+    Sts rcode = initFloatMat(matrix, row, col, cell);
+    if (rcode == ERROR)
+    {
+        free(matrix);
+        return NULL;
+    }
+
+    return matrix;
+}
+
+Vec *genFloatVec(int length, float cell)
+{
+    Vec *vector = (Vec *)malloc(sizeof(Vec));
+    if (!vector)
+        return NULL;
+
+    Sts rcode = initFloatVec(vector, length, cell);
+    if (rcode == ERROR)
+    {
+        free(vector);
+        return NULL;
+    }
+
+    return vector;
+}
+
+Mts *genFloatMts(int channel, int height, int width, float cell)
+{
+    Mts *matrixStack = (Mts *)malloc(sizeof(Mts));
+    if (!matrixStack)
+        return NULL;
+
+    Sts rcode = initFloatMts(matrixStack, channel, height, width, cell);
+    if (rcode == ERROR)
+    {
+        free(matrixStack);
+        return NULL;
+    }
+
+    return matrixStack;
+}
+
 Sts freeMat(Mat *mat)
 {
     if (!mat)
@@ -82,21 +136,13 @@ Sts initDoubleMat(Mat *mat, int row, int col, double cell)
 
     mat->row = row;
     mat->col = col;
+    mat->dtype = DOUBLE_TYPE;
 
     mat->array.doubleMatrix = (double *)malloc(sizeof(double) * row * col);
     if (!mat->array.doubleMatrix)
         return ERROR;
 
-    double bound = sqrt(6.0 / (row + col));
-
-    if (fabs(cell - 0) <= 1e-4)
-        for (size_t i = 0; i < row * col; i++)
-            mat->array.doubleMatrix[i] = 0;
-    else
-        for (size_t i = 0; i < row * col; i++)
-            mat->array.doubleMatrix[i] = (rand() / (double)RAND_MAX) * 2 * bound - bound;
-
-    return OK;
+    return resetMatValue(mat, cell);
 }
 
 Sts initDoubleVec(Vec *vec, int length, double cell)
@@ -105,18 +151,13 @@ Sts initDoubleVec(Vec *vec, int length, double cell)
         return ERROR;
 
     vec->length = length;
+    vec->dtype = DOUBLE_TYPE;
 
     vec->array.doubleArray = (double *)malloc(sizeof(double) * length);
     if (!vec->array.doubleArray)
-    {
-        free(vec);
         return ERROR;
-    }
-
-    for (int i = 0; i < length; i++)
-        vec->array.doubleArray[i] = cell;
 
-    return OK;
+    return resetVecValue(vec, cell);
 }
 
 Sts initDoubleMts(Mts *mts, int channel, int height, int width, double cell)
@@ -127,25 +168,142 @@ Sts initDoubleMts(Mts *mts, int channel, int height, int width, double cell)
     mts->channel = channel;
     mts->height = height;
     mts->width = width;
+    mts->dtype = DOUBLE_TYPE;
 
     size_t total = channel * height * width;
     mts->array.doubelMatrixStack = (double *)malloc(sizeof(double) * total);
     if (!mts->array.doubelMatrixStack)
-    {
-        free(mts);
         return ERROR;
-    }
 
-    double bound = sqrt(6.0 / (total));
+    return resetMtsValue(mts, cell);
+}
+
+Sts initFloatMat(Mat *mat, int row, int col, float cell)
+{
+    if (!mat)
+        return ERROR;
+
+    mat->row = row;
+    mat->col = col;
+    mat->dtype = FLOAT_TYPE;
+
+    mat->array.floatArray = (float *)malloc(sizeof(float) * row * col);
+    if (!mat->array.floatArray)
+        return ERROR;
+
+    return resetMatValue(mat, cell);
+}
+
+Sts initFloatVec(Vec *vec, int length, float cell)
+{
+    if (!vec)
+        return ERROR;
+
+    vec->length = length;
+    vec->dtype = FLOAT_TYPE;
+
+    vec->array.floatArray = (float *)malloc(sizeof(float) * length);
+    if (!vec->array.floatArray)
+        return ERROR;
+
+    return resetVecValue(vec, cell);
+}
+
+Sts initFloatMts(Mts *mts, int channel, int height, int width, float cell)
+{
+    if (!mts)
+        return ERROR;
+
+    mts->channel = channel;
+    mts->height = height;
+    mts->width = width;
+    mts->dtype = FLOAT_TYPE;
+
+    size_t total = channel * height * width;
+    mts->array.floatArray = (float *)malloc(sizeof(float) * total);
+    if (!mts->array.floatArray)
+        return ERROR;
+
+    return resetMtsValue(mts, cell);
+}
 
-    if (fabs(cell - 0) <= 1e-4)
+// zero when cell is (nearly) zero, otherwise uniform in [-bound, bound], the xavier range of the shape
+static Sts fillInitValue(char *array, Dtp dtype, size_t total, double bound, double cell)
+{
+    int zero = fabs(cell - 0) <= 1e-4;
+
+    switch (dtype)
+    {
+    case DOUBLE_TYPE:
         for (size_t i = 0; i < total; i++)
-            mts->array.doubelMatrixStack[i] = 0;
-    else
+            ((double *)array)[i] = zero ? 0 : (rand() / (double)RAND_MAX) * 2 * bound - bound;
+        return OK;
+    case FLOAT_TYPE:
         for (size_t i = 0; i < total; i++)
-            mts->array.doubelMatrixStack[i] = (rand() / (double)RAND_MAX) * 2 * bound - bound;
+            ((float *)array)[i] = zero ? 0 : (float)((rand() / (double)RAND_MAX) * 2 * bound - bound);
+        return OK;
+    default:
+        return ERROR;
+    }
+}
 
-    return OK;
+Sts resetMatValue(Mat *mat, double cell)
+{
+    if (!mat)
+        return ERROR;
+
+    return fillInitValue(mat->array.charArray, mat->dtype, mat->row * mat->col, sqrt(6.0 / (mat->row + mat->col)),
+                         cell);
+}
+
+Sts resetMtsValue(Mts *mts, double cell)
+{
+    if (!mts)
+        return ERROR;
+
+    size_t total = mts->channel * mts->height * mts->width;
+    return fillInitValue(mts->array.charArray, mts->dtype, total, sqrt(6.0 / (total)), cell);
+}
+
+Sts resetVecValue(Vec *vec, double cell)
+{
+    if (!vec)
+        return ERROR;
+
+    switch (vec->dtype)
+    {
+    case DOUBLE_TYPE:
+        for (size_t i = 0; i < vec->length; i++)
+            vec->array.doubleArray[i] = cell;
+        return OK;
+    case FLOAT_TYPE:
+        for (size_t i = 0; i < vec->length; i++)
+            vec->array.floatArray[i] = cell;
+        return OK;
+    case INT_TYPE:
+        for (size_t i = 0; i < vec->length; i++)
+            vec->array.intArray[i] = cell;
+        return OK;
+    default:
+        for (size_t i = 0; i < vec->length; i++)
+            vec->array.charArray[i] = cell;
+        return OK;
+    }
+}
+
+size_t sizeOfDataType(Dtp dtype)
+{
+    switch (dtype)
+    {
+    case FLOAT_TYPE:
+        return sizeof(float);
+    case INT_TYPE:
+        return sizeof(int);
+    case CHAR_TYPE:
+        return sizeof(char);
+    default:
+        return sizeof(double);
+    }
 }
 
 Sts vecTransMat(Vec *vec, Mat *mat, int row, int col)
@@ -155,6 +313,7 @@ Sts vecTransMat(Vec *vec, Mat *mat, int row, int col)
 
     mat->row = row;
     mat->col = col;
+    mat->dtype = vec->dtype;
     mat->array.doubleMatrix = vec->array.doubleArray;
 
     return OK;
@@ -166,6 +325,7 @@ Sts matTransVec(Mat *mat, Vec *vec)
         return ERROR;
 
     vec->length = mat->row * mat->col;
+    vec->dtype = mat->dtype;
     vec->array.doubleArray = mat->array.doubleMatrix;
 
     return OK;
@@ -179,6 +339,7 @@ Sts vecTransMts(Vec *vec, Mts *mts, int channel, int height, int width)
     mts->channel = channel;
     mts->height = height;
     mts->width = width;
+    mts->dtype = vec->dtype;
     mts->array.doubelMatrixStack = vec->array.doubleArray;
 
     return OK;
@@ -190,6 +351,7 @@ Sts mtsTransVec(Mts *mts, Vec *vec)
         return ERROR;
 
     vec->length = mts->channel * mts->height * mts->width;
+    vec->dtype = mts->dtype;
     vec->array.doubleArray = mts->array.doubelMatrixStack;
 
     return OK;
@@ -205,31 +367,50 @@ Sts mtsSliceMat(Mts *mts, Mat *mat, int channel)
 
     mat->row = mts->height;
     mat->col = mts->width;
-    mat->array.doubleMatrix = &mts->array.doubelMatrixStack[start_index];
+    mat->dtype = mts->dtype;
+    mat->array.charArray = mts->array.charArray + start_index * sizeOfDataType(mts->dtype);
 
     return OK;
 }
 
 Sts crossProductDoubleMatrix(Mat *m1, Mat *m2, Mat *result)
 {
-    if ((m1->col != m2->row) || (result->row != m1->row) || (result->col != m2->col))
+    return crossProductDoubleMatrixTrans(m1, NO_TRANSPOSE, m2, NO_TRANSPOSE, result);
+}
+
+Sts crossProductDoubleMatrixTrans(Mat *m1, Trs trans1, Mat *m2, Trs trans2, Mat *result)
+{
+    if (!m1 || !m2 || !result || m1->dtype != DOUBLE_TYPE || m2->dtype != DOUBLE_TYPE || result->dtype != DOUBLE_TYPE)
         return ERROR;
 
-    int row = m1->row, col = m2->col, mid = m1->col;
-    double(*matrix1)[mid] = (double(*)[mid])m1->array.doubleMatrix;
-    double(*matrix2)[col] = (double(*)[col])m2->array.doubleMatrix;
-    double(*resultMatrix)[col] = (double(*)[col])result->array.doubleMatrix;
+    size_t row = trans1 == TRANSPOSE ? m1->col : m1->row, mid = trans1 == TRANSPOSE ? m1->row : m1->col;
+    size_t mid2 = trans2 == TRANSPOSE ? m2->col : m2->row, col = trans2 == TRANSPOSE ? m2->row : m2->col;
 
-    for (int i = 0; i < row; i++)
-        for (int j = 0; j < col; j++)
-        {
-            double cell = 0;
-            for (int k = 0; k < mid; k++)
-                cell += matrix1[i][k] * matrix2[k][j];
-            resultMatrix[i][j] = cell;
-        }
+    if ((mid != mid2) || (result->row != row) || (result->col != col))
+        return ERROR;
 
-    return OK;
+    return gemmDouble(trans1, trans2, row, col, mid, 1, m1->array.doubleMatrix, m1->col, m2->array.doubleMatrix,
+                      m2->col, 0, result->array.doubleMatrix, result->col);
+}
+
+Sts crossProductFloatMatrix(Mat *m1, Mat *m2, Mat *result)
+{
+    return crossProductFloatMatrixTrans(m1, NO_TRANSPOSE, m2, NO_TRANSPOSE, result);
+}
+
+Sts crossProductFloatMatrixTrans(Mat *m1, Trs trans1, Mat *m2, Trs trans2, Mat *result)
+{
+    if (!m1 || !m2 || !result || m1->dtype != FLOAT_TYPE || m2->dtype != FLOAT_TYPE || result->dtype != FLOAT_TYPE)
+        return ERROR;
+
+    size_t row = trans1 == TRANSPOSE ? m1->col : m1->row, mid = trans1 == TRANSPOSE ? m1->row : m1->col;
+    size_t mid2 = trans2 == TRANSPOSE ? m2->col : m2->row, col = trans2 == TRANSPOSE ? m2->row : m2->col;
+
+    if ((mid != mid2) || (result->row != row) || (result->col != col))
+        return ERROR;
+
+    return gemmFloat(trans1, trans2, row, col, mid, 1, m1->array.floatArray, m1->col, m2->array.floatArray, m2->col,
+                     0, result->array.floatArray, result->col);
 }
 
 Sts addDoubleMatrix(Mat *m1, Mat *m2, Mat *result)
@@ -251,22 +432,44 @@ Sts addDoubleMatrix(Mat *m1, Mat *m2, Mat *result)
 
 Sts addDoubleVector(Vec *v1, Vec *v2, Vec *result)
 {
-    if (!v1 || !v2 || v1->length != v2->length)
+    if (!v1 || !v2 || !result || v1->length != v2->length || v1->length != result->length ||
+        v1->dtype != DOUBLE_TYPE || v2->dtype != DOUBLE_TYPE || result->dtype != DOUBLE_TYPE)
         return ERROR;
 
-    for (size_t i = 0; i < v1->length; i++)
-        result->array.doubleArray[i] = v1->array.doubleArray[i] + v2->array.doubleArray[i];
+    simdKernels()->addDouble(v1->array.doubleArray, v2->array.doubleArray, result->array.doubleArray, v1->length);
 
     return OK;
 }
 
 Sts mulDoubleVector(Vec *v1, Vec *v2, Vec *result)
 {
-    if (!v1 || !v2 || !result || (v1->length != v2->length) || (v1->length != result->length))
+    if (!v1 || !v2 || !result || (v1->length != v2->length) || (v1->length != result->length) ||
+        v1->dtype != DOUBLE_TYPE || v2->dtype != DOUBLE_TYPE || result->dtype != DOUBLE_TYPE)
         return ERROR;
 
-    for (size_t i = 0; i < v1->length; i++)
-        result->array.doubleArray[i] = v1->array.doubleArray[i] * v2->array.doubleArray[i];
+    simdKernels()->mulDouble(v1->array.doubleArray, v2->array.doubleArray, result->array.doubleArray, v1->length);
+
+    return OK;
+}
+
+Sts addFloatVector(Vec *v1, Vec *v2, Vec *result)
+{
+    if (!v1 || !v2 || !result || v1->length != v2->length || v1->length != result->length ||
+        v1->dtype != FLOAT_TYPE || v2->dtype != FLOAT_TYPE || result->dtype != FLOAT_TYPE)
+        return ERROR;
+
+    simdKernels()->addFloat(v1->array.floatArray, v2->array.floatArray, result->array.floatArray, v1->length);
+
+    return OK;
+}
+
+Sts mulFloatVector(Vec *v1, Vec *v2, Vec *result)
+{
+    if (!v1 || !v2 || !result || (v1->length != v2->length) || (v1->length != result->length) ||
+        v1->dtype != FLOAT_TYPE || v2->dtype != FLOAT_TYPE || result->dtype != FLOAT_TYPE)
+        return ERROR;
+
+    simdKernels()->mulFloat(v1->array.floatArray, v2->array.floatArray, result->array.floatArray, v1->length);
 
     return OK;
 }
@@ -377,3 +580,27 @@ double doubleaThreshold(double x)
 
     return x;
 }
+
+void *alignedMalloc(size_t bytes, size_t alignment)
+{
+    if (bytes == 0)
+        bytes = alignment;
+
+#ifdef _WIN32
+    return _aligned_malloc(bytes, alignment);
+#else
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, alignment, bytes))
+        return NULL;
+    return ptr;
+#endif
+}
+
+void alignedFree(void *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
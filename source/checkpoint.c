@@ -0,0 +1,303 @@
+#include "checkpoint.h"
+#include <stdio.h>
+#include <string.h>
+
+static size_t alignBlob(size_t offset)
+{
+    return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+// the function pointers of an activation a layer can fuse, the ones activationOf recognizes
+static Sts activationFunctions(Act activation, Sts (**activateFunction)(Input *, Output *),
+                               Sts (**activateFunction_derivative)(Input *, Derv *))
+{
+    switch (activation)
+    {
+    case ACTIVATION_NONE:
+        *activateFunction = noActivation;
+        *activateFunction_derivative = noActivation_derivative;
+        return OK;
+    case ACTIVATION_RELU:
+        *activateFunction = ReLU;
+        *activateFunction_derivative = ReLU_derivative;
+        return OK;
+    case ACTIVATION_LEAKY_RELU:
+        *activateFunction = leakyReLU;
+        *activateFunction_derivative = leakyReLU_derivative;
+        return OK;
+    case ACTIVATION_SIGMOID:
+        *activateFunction = sigmoid;
+        *activateFunction_derivative = sigmoid_derivative;
+        return OK;
+    default:
+        return ERROR;
+    }
+}
+
+// the record of one layer, its blobs placed from *cursor on
+static Sts describeLayer(struct LAYER *layer, size_t size, size_t *cursor, struct CHECKPOINT_LAYER *record)
+{
+    memset(record, 0, sizeof(struct CHECKPOINT_LAYER));
+    record->type = layer->type;
+    if (layer->type == FULLY_CONNECTED_LAYER)
+    {
+        struct FCL *fcl = &layer->layer.fcl;
+        if (fcl->activation == ACTIVATION_CUSTOM) // a function pointer means nothing in another process
+            return ERROR;
+
+        record->activation = fcl->activation;
+        record->shape[0] = fcl->neuronNumIn;
+        record->shape[1] = fcl->neuronNumOut;
+        record->weightBytes = fcl->neuronNumOut * fcl->neuronNumIn * size;
+        record->biasBytes = fcl->neuronNumOut * size;
+    }
+    else if (layer->type == POOLING_LAYER) // nothing to store but the shape
+    {
+        struct PL *pl = &layer->layer.pl;
+        record->shape[0] = pl->inputs.channel;
+        record->shape[1] = pl->inputs.height;
+        record->shape[2] = pl->inputs.width;
+        record->shape[3] = pl->kernelSize;
+        record->shape[4] = pl->mode;
+        record->shape[5] = pl->stride;
+        record->shape[6] = pl->padding;
+        return OK;
+    }
+    else
+    {
+        struct CVL *cvl = &layer->layer.cvl;
+        record->shape[0] = cvl->inputs.channel;
+        record->shape[1] = cvl->inputs.height;
+        record->shape[2] = cvl->inputs.width;
+        record->shape[3] = cvl->kernelSize;
+        record->shape[4] = cvl->multiplier;
+        record->shape[5] = cvl->stride;
+        record->shape[6] = cvl->padding;
+        record->weightBytes = cvl->kernels.channel * cvl->kernelSize * cvl->kernelSize * size;
+    }
+
+    record->weightOffset = alignBlob(*cursor);
+    *cursor = record->weightOffset + record->weightBytes;
+    if (record->biasBytes)
+    {
+        record->biasOffset = alignBlob(*cursor);
+        *cursor = record->biasOffset + record->biasBytes;
+    }
+
+    return OK;
+}
+
+static Sts writeBlob(FILE *stream, size_t *written, size_t offset, const void *blob, size_t bytes)
+{
+    static const char zeros[CHECKPOINT_ALIGNMENT] = {0};
+    if (fwrite(zeros, 1, offset - *written, stream) != offset - *written || fwrite(blob, 1, bytes, stream) != bytes)
+        return ERROR;
+
+    *written = offset + bytes;
+
+    return OK;
+}
+
+static Sts writeCheckpoint(Model *model, FILE *stream)
+{
+    size_t layerNum = model->layerNum, size = sizeOfDataType(model->dtype);
+    struct CHECKPOINT_LAYER *records = (struct CHECKPOINT_LAYER *)calloc(layerNum, sizeof(struct CHECKPOINT_LAYER));
+    if (!records)
+        return ERROR;
+
+    Sts rcode = OK;
+    size_t cursor = sizeof(struct CHECKPOINT_HEADER) + layerNum * sizeof(struct CHECKPOINT_LAYER);
+    for (size_t i = 0; i < layerNum; i++)
+        rcode = describeLayer(&model->layers[i], size, &cursor, &records[i]) || rcode;
+
+    struct CHECKPOINT_HEADER header = {.version = CHECKPOINT_VERSION, .endian = CHECKPOINT_ENDIAN,
+                                       .dtype = model->dtype, .layerNum = (uint32_t)layerNum, .fileBytes = cursor};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+
+    size_t written = sizeof(struct CHECKPOINT_HEADER) + layerNum * sizeof(struct CHECKPOINT_LAYER);
+    if (rcode == OK && (fwrite(&header, sizeof(header), 1, stream) != 1 ||
+                        fwrite(records, sizeof(struct CHECKPOINT_LAYER), layerNum, stream) != layerNum))
+        rcode = ERROR;
+
+    for (size_t i = 0; i < layerNum && rcode == OK; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            struct FCL *fcl = &layer->layer.fcl;
+            rcode = writeBlob(stream, &written, records[i].weightOffset, fcl->weight.array.charArray,
+                              records[i].weightBytes) ||
+                    rcode;
+            rcode = writeBlob(stream, &written, records[i].biasOffset, fcl->bias.array.charArray,
+                              records[i].biasBytes) ||
+                    rcode;
+        }
+        else if (layer->type == CONVOLUTIONAL_LAYER)
+            rcode = writeBlob(stream, &written, records[i].weightOffset, layer->layer.cvl.kernels.array.charArray,
+                              records[i].weightBytes) ||
+                    rcode;
+    }
+    free(records);
+
+    return rcode;
+}
+
+Sts saveModel(Model *model, const char *path)
+{
+    if (!model || !model->buffers || !path || model->layerNum > UINT32_MAX)
+        return ERROR;
+
+    // written aside and renamed over the old file, so a worker mapping the path never sees half a checkpoint
+    size_t length = strlen(path);
+    char *temporary = (char *)malloc(length + 5);
+    if (!temporary)
+        return ERROR;
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", 5);
+
+    FILE *stream = fopen(temporary, "wb");
+    Sts rcode = stream ? writeCheckpoint(model, stream) : ERROR;
+    if (stream && fclose(stream) != 0)
+        rcode = ERROR;
+
+#ifdef _WIN32
+    if (rcode == OK)
+        remove(path); // rename doesn't replace an existing file there
+#endif
+    if (rcode == OK && rename(temporary, path) != 0)
+        rcode = ERROR;
+    if (rcode == ERROR)
+        remove(temporary);
+    free(temporary);
+
+    return rcode;
+}
+
+// a blob of exactly bytes inside the file, after the records and on its boundary
+static int validBlob(const struct CHECKPOINT_HEADER *header, uint64_t offset, uint64_t bytes, uint64_t expected)
+{
+    uint64_t start = sizeof(struct CHECKPOINT_HEADER) + (uint64_t)header->layerNum * sizeof(struct CHECKPOINT_LAYER);
+    return bytes == expected && offset % CHECKPOINT_ALIGNMENT == 0 && offset >= start && offset <= header->fileBytes &&
+           bytes <= header->fileBytes - offset;
+}
+
+// the layers of the checkpoint added to a fresh model, their parameters bound into the file when bind is set
+static Sts buildModel(Model *model, const MappedFile *file, size_t batchSize, int bind)
+{
+    memset(model, 0, sizeof(Model)); // freeModel is safe on it from here on
+
+    const struct CHECKPOINT_HEADER *header = (const struct CHECKPOINT_HEADER *)file->data;
+    if (file->bytes < sizeof(struct CHECKPOINT_HEADER) || memcmp(header->magic, CHECKPOINT_MAGIC, 8) != 0 ||
+        header->version != CHECKPOINT_VERSION || header->endian != CHECKPOINT_ENDIAN ||
+        header->fileBytes != file->bytes || header->layerNum == 0 ||
+        (file->bytes - sizeof(struct CHECKPOINT_HEADER)) / sizeof(struct CHECKPOINT_LAYER) < header->layerNum)
+        return ERROR;
+
+    Dtp dtype = (Dtp)header->dtype;
+    // weights in a read-only page cache have no use for gradients, a mapped model is built forward only
+    if ((dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE) ||
+        (bind ? initInferenceModel(model, batchSize, dtype) : initModel(model, batchSize, dtype)) == ERROR)
+        return ERROR;
+
+    const struct CHECKPOINT_LAYER *records = (const struct CHECKPOINT_LAYER *)(header + 1);
+    size_t size = sizeOfDataType(dtype);
+    for (uint32_t i = 0; i < header->layerNum; i++)
+    {
+        const struct CHECKPOINT_LAYER *record = &records[i];
+        const uint64_t *shape = record->shape;
+        if (record->type == FULLY_CONNECTED_LAYER)
+        {
+            Sts (*activateFunction)(Input *, Output *);
+            Sts (*activateFunction_derivative)(Input *, Derv *);
+            if (activationFunctions((Act)record->activation, &activateFunction, &activateFunction_derivative) ||
+                !validBlob(header, record->weightOffset, record->weightBytes, shape[1] * shape[0] * size) ||
+                !validBlob(header, record->biasOffset, record->biasBytes, shape[1] * size) ||
+                modelAddFCL(model, shape[0], shape[1], activateFunction, activateFunction_derivative))
+                return ERROR;
+
+            if (bind)
+            {
+                struct FCL *fcl = &model->layers[model->layerNum - 1].layer.fcl;
+                fcl->weight = (Mat){.array.charArray = file->data + record->weightOffset, .row = shape[1],
+                                    .col = shape[0], .dtype = dtype};
+                fcl->bias = (Vec){.array.charArray = file->data + record->biasOffset, .length = shape[1],
+                                  .dtype = dtype};
+            }
+        }
+        else if (record->type == CONVOLUTIONAL_LAYER)
+        {
+            size_t channelOut = shape[0] * shape[4], kernelSize = shape[3];
+            if (!validBlob(header, record->weightOffset, record->weightBytes,
+                           channelOut * kernelSize * kernelSize * size) ||
+                modelAddCVL(model, shape[0], shape[1], shape[2], kernelSize, shape[4], shape[5], shape[6]))
+                return ERROR;
+
+            if (bind)
+            {
+                struct CVL *cvl = &model->layers[model->layerNum - 1].layer.cvl;
+                cvl->kernels = (Mts){.array.charArray = file->data + record->weightOffset, .channel = channelOut,
+                                     .height = kernelSize, .width = kernelSize, .dtype = dtype};
+            }
+        }
+        else if (record->type == POOLING_LAYER)
+        {
+            if (record->weightBytes || record->biasBytes ||
+                modelAddPL(model, shape[0], shape[1], shape[2], shape[3], shape[5], shape[6], (Plm)shape[4]))
+                return ERROR;
+        }
+        else
+            return ERROR;
+    }
+
+    return compileModel(model);
+}
+
+Sts loadModel(Model *model, const char *path, size_t batchSize)
+{
+    MappedFile file;
+    if (!model || mapFile(&file, path) == ERROR)
+        return ERROR;
+
+    Sts rcode = buildModel(model, &file, batchSize, 0);
+
+    // the blobs were validated by buildModel, every one matches the parameter it goes to
+    const struct CHECKPOINT_LAYER *records =
+        (const struct CHECKPOINT_LAYER *)(file.data + sizeof(struct CHECKPOINT_HEADER));
+    for (size_t i = 0; i < model->layerNum && rcode == OK; i++)
+    {
+        const struct CHECKPOINT_LAYER *record = &records[i];
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            struct FCL *fcl = &layer->layer.fcl;
+            memcpy(fcl->weight.array.charArray, file.data + record->weightOffset, record->weightBytes);
+            memcpy(fcl->bias.array.charArray, file.data + record->biasOffset, record->biasBytes);
+            weightWrittenFCL(fcl);
+        }
+        else if (layer->type == CONVOLUTIONAL_LAYER)
+            memcpy(layer->layer.cvl.kernels.array.charArray, file.data + record->weightOffset, record->weightBytes);
+    }
+    unmapFile(&file);
+
+    if (rcode == ERROR)
+        freeModel(model);
+
+    return rcode;
+}
+
+Sts mapModel(Model *model, const char *path, size_t batchSize)
+{
+    MappedFile file;
+    if (!model || mapFile(&file, path) == ERROR)
+        return ERROR;
+
+    if (buildModel(model, &file, batchSize, 1) == ERROR)
+    {
+        unmapFile(&file);
+        freeModel(model);
+        return ERROR;
+    }
+    model->checkpoint = file; // unmapped by freeModel
+
+    return OK;
+}
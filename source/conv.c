@@ -0,0 +1,331 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#endif
+
+#include "conv.h"
+#include "gemm.h"
+#include "profile.h"
+#include "threadpool.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define CONV_PI 3.14159265358979323846 // M_PI isn't standard C
+
+size_t convOutSize(size_t in, size_t kernelSize, size_t stride, size_t padding)
+{
+    if (kernelSize == 0 || stride == 0 || in + 2 * padding < kernelSize)
+        return 0;
+
+    return (in + 2 * padding - kernelSize) / stride + 1;
+}
+
+static size_t convFFTLength(size_t n) // the power of two a transform of n points takes
+{
+    size_t length = 1;
+    while (length < n)
+        length <<= 1;
+
+    return length;
+}
+
+int convSupports(Cva algorithm, size_t kernelSize, size_t stride)
+{
+    switch (algorithm)
+    {
+    case CONV_IM2COL:
+        return 1;
+    case CONV_WINOGRAD:
+        return kernelSize == 3 && stride == 1;
+    case CONV_FFT:
+        return stride == 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+The estimates are in the time of one multiply-add of the gemm of im2col with a single kernel, fitted to the
+timings of benchConv over kernels of 3 to 13 and images of 16 to 128: a column element costs 1 + multiplier / 3
+of them while the columns of a channel stay in cache and three times that once they don't. A Winograd tile costs
+35 for its transforms and 6 per kernel, FFT 1.15 per butterfly point, points log2 points for the image and three
+times that per pair of kernels: their transform, the inverse, and the products between.
+They only rule out what can't win, how fast each algorithm really is differs between machines and dtypes by more
+than the estimates could follow, so what's left is timed.
+*/
+#define CONV_CACHED_BYTES 2097152 // of the columns of one channel, beyond that they come from memory
+#define CONV_UNCACHED 3.0
+#define CONV_WINOGRAD_TILE 35.0
+#define CONV_WINOGRAD_KERNEL 6.0
+#define CONV_FFT_POINT 1.15
+#define CONV_FFT_PAIR 3.0
+#define CONV_TUNE_MARGIN 4.0   // an algorithm estimated this many times slower than the best one isn't timed
+#define CONV_TUNE_SECONDS 1e-3 // every algorithm timed runs at least this long, its fastest call counts
+#define CONV_TUNE_CALLS 3      // and at least this many times, after one call warming up
+
+// the estimated time of the forward pass, INFINITY for an algorithm that doesn't take the shape
+static double convEstimate(Cva algorithm, size_t channel, size_t height, size_t width, size_t multiplier,
+                           size_t kernelSize, size_t stride, size_t padding, Dtp dtype)
+{
+    size_t outH = convOutSize(height, kernelSize, stride, padding);
+    size_t outW = convOutSize(width, kernelSize, stride, padding);
+    if (outH == 0 || outW == 0 || !convSupports(algorithm, kernelSize, stride))
+        return INFINITY;
+
+    if (algorithm == CONV_WINOGRAD)
+        return channel * (double)((outH + 1) / 2) * ((outW + 1) / 2) *
+               (CONV_WINOGRAD_TILE + CONV_WINOGRAD_KERNEL * multiplier);
+    if (algorithm == CONV_FFT)
+    {
+        double points = (double)convFFTLength(height + 2 * padding) * convFFTLength(width + 2 * padding);
+        return CONV_FFT_POINT * channel * points * log2(points) * (1 + CONV_FFT_PAIR * ((multiplier + 1) / 2));
+    }
+
+    double columns = (double)kernelSize * kernelSize * outH * outW;
+    int cached = columns * sizeOfDataType(dtype) <= CONV_CACHED_BYTES;
+    return channel * columns * (1 + multiplier / 3.0) * (cached ? 1 : CONV_UNCACHED);
+}
+
+static double convClock(void) // seconds from an arbitrary monotonic origin
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+struct CONV_SHAPE // the arguments convChooseAlgorithm answers for, and the buffers it times them on
+{
+    size_t channel, height, width, multiplier, kernelSize, stride, padding;
+    Dtp dtype;
+    int inference;
+    char *input, *kernels, *workspace, *output;
+};
+
+/*
+Seconds of the fastest call of algorithm on the shape, or with algorithm CONV_IM2COL and unfold set,
+of unfolding every channel one after the other the way gradCVL does. INFINITY when a call fails.
+*/
+static double convTime(const struct CONV_SHAPE *shape, Cva algorithm, int unfold)
+{
+    size_t imageSize = shape->height * shape->width;
+    size_t unfolded = shape->kernelSize * shape->kernelSize *
+                      convOutSize(shape->height, shape->kernelSize, shape->stride, shape->padding) *
+                      convOutSize(shape->width, shape->kernelSize, shape->stride, shape->padding);
+    int isFloat = shape->dtype == FLOAT_TYPE;
+    double fastest = INFINITY, spent = 0;
+    for (size_t call = 0; call <= CONV_TUNE_CALLS || spent < CONV_TUNE_SECONDS; call++)
+    {
+        double start = convClock();
+        Sts rcode = OK;
+        for (size_t c = 0; unfold && c < shape->channel; c++)
+            rcode = (isFloat ? im2colFloat((const float *)shape->input + c * imageSize, shape->height, shape->width,
+                                           shape->kernelSize, shape->stride, shape->padding,
+                                           (float *)shape->workspace + c * unfolded)
+                             : im2colDouble((const double *)shape->input + c * imageSize, shape->height,
+                                            shape->width, shape->kernelSize, shape->stride, shape->padding,
+                                            (double *)shape->workspace + c * unfolded)) ||
+                    rcode;
+        if (!unfold && isFloat)
+            rcode = convolveFloat(algorithm, (const float *)shape->input, shape->channel, shape->height,
+                                  shape->width, (const float *)shape->kernels, shape->multiplier, shape->kernelSize,
+                                  shape->stride, shape->padding, (float *)shape->workspace, (float *)shape->output);
+        else if (!unfold)
+            rcode = convolveDouble(algorithm, (const double *)shape->input, shape->channel, shape->height,
+                                   shape->width, (const double *)shape->kernels, shape->multiplier,
+                                   shape->kernelSize, shape->stride, shape->padding, (double *)shape->workspace,
+                                   (double *)shape->output);
+        double elapsed = convClock() - start;
+        if (rcode == ERROR)
+            return INFINITY;
+        if (call > 0) // the first call warms the caches and the thread pool up
+        {
+            spent += elapsed;
+            fastest = elapsed < fastest ? elapsed : fastest;
+        }
+    }
+
+    return fastest;
+}
+
+// the algorithms left by the estimates timed on data of the shape, the estimated best when there's no memory
+static Cva convTune(struct CONV_SHAPE *shape)
+{
+    Cva candidates[] = {CONV_IM2COL, CONV_WINOGRAD, CONV_FFT}, best = CONV_IM2COL;
+    size_t candidateNum = sizeof(candidates) / sizeof(candidates[0]), workspace = 0, timed = 0;
+    double estimates[sizeof(candidates) / sizeof(candidates[0])], least = INFINITY;
+    for (size_t i = 0; i < candidateNum; i++)
+    {
+        estimates[i] = convEstimate(candidates[i], shape->channel, shape->height, shape->width, shape->multiplier,
+                                    shape->kernelSize, shape->stride, shape->padding, shape->dtype);
+        if (estimates[i] < least)
+        {
+            least = estimates[i];
+            best = candidates[i];
+        }
+    }
+    for (size_t i = 0; i < candidateNum; i++)
+    {
+        size_t length = convWorkspaceLength(candidates[i], shape->channel, shape->height, shape->width,
+                                            shape->multiplier, shape->kernelSize, shape->stride, shape->padding);
+        if (estimates[i] <= least * CONV_TUNE_MARGIN)
+        {
+            timed++;
+            workspace = length > workspace ? length : workspace;
+        }
+    }
+    if (timed < 2)
+        return best;
+
+    // the values don't change the time, nothing is drawn from rand, the caller's sequence stays as it was
+    size_t size = sizeOfDataType(shape->dtype), inputLength = shape->channel * shape->height * shape->width;
+    size_t outH = convOutSize(shape->height, shape->kernelSize, shape->stride, shape->padding);
+    size_t outW = convOutSize(shape->width, shape->kernelSize, shape->stride, shape->padding);
+    size_t kernelsLength = shape->channel * shape->multiplier * shape->kernelSize * shape->kernelSize;
+    size_t unfolded = shape->channel * shape->kernelSize * shape->kernelSize * outH * outW;
+    workspace = unfolded > workspace ? unfolded : workspace;
+    shape->input = (char *)malloc(inputLength * size);
+    shape->kernels = (char *)malloc(kernelsLength * size);
+    shape->workspace = (char *)malloc(workspace * size);
+    shape->output = (char *)malloc(shape->channel * shape->multiplier * outH * outW * size);
+    if (shape->input && shape->kernels && shape->workspace && shape->output)
+    {
+        for (size_t i = 0; i < inputLength + kernelsLength; i++)
+        {
+            double x = (double)(i % 17) / 8 - 1;
+            char *array = i < inputLength ? shape->input : shape->kernels;
+            size_t j = i < inputLength ? i : i - inputLength;
+            if (shape->dtype == FLOAT_TYPE)
+                ((float *)array)[j] = (float)x;
+            else
+                ((double *)array)[j] = x;
+        }
+
+        // a layer that trains unfolds its input once more for the backward pass after any other algorithm
+        double unfold = shape->inference ? 0 : convTime(shape, CONV_IM2COL, 1), fastest = INFINITY;
+        for (size_t i = 0; i < candidateNum; i++)
+        {
+            if (estimates[i] > least * CONV_TUNE_MARGIN)
+                continue;
+            double seconds = convTime(shape, candidates[i], 0) + (candidates[i] == CONV_IM2COL ? 0 : unfold);
+            if (seconds < fastest)
+            {
+                fastest = seconds;
+                best = candidates[i];
+            }
+        }
+    }
+    free(shape->input);
+    free(shape->kernels);
+    free(shape->workspace);
+    free(shape->output);
+
+    return best;
+}
+
+// every shape answered so far, a model asks for the same shape at init, at sizing and at planning
+static struct
+{
+    pthread_mutex_t lock;
+    struct CONV_SHAPE *shapes; // without buffers
+    Cva *algorithms;
+    size_t num;
+    size_t capacity;
+} tuned = {PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0};
+
+static int convSameShape(const struct CONV_SHAPE *a, const struct CONV_SHAPE *b)
+{
+    return a->channel == b->channel && a->height == b->height && a->width == b->width &&
+           a->multiplier == b->multiplier && a->kernelSize == b->kernelSize && a->stride == b->stride &&
+           a->padding == b->padding && a->dtype == b->dtype && a->inference == b->inference;
+}
+
+Cva convChooseAlgorithm(size_t channel, size_t height, size_t width, size_t multiplier, size_t kernelSize,
+                        size_t stride, size_t padding, Dtp dtype, int inference)
+{
+    size_t outH = convOutSize(height, kernelSize, stride, padding);
+    size_t outW = convOutSize(width, kernelSize, stride, padding);
+    if (outH == 0 || outW == 0 || multiplier == 0 || stride != 1 || (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
+        return CONV_IM2COL;
+
+    struct CONV_SHAPE shape = {channel, height, width, multiplier, kernelSize, stride, padding, dtype, !!inference,
+                               NULL, NULL, NULL, NULL};
+    pthread_mutex_lock(&tuned.lock);
+    for (size_t i = 0; i < tuned.num; i++)
+        if (convSameShape(&tuned.shapes[i], &shape))
+        {
+            Cva algorithm = tuned.algorithms[i];
+            pthread_mutex_unlock(&tuned.lock);
+            return algorithm;
+        }
+
+    // timed under the lock, a second caller of the same shape waits for the answer instead of timing it too
+    Cva algorithm = convTune(&shape);
+    if (tuned.num == tuned.capacity)
+    {
+        size_t capacity = tuned.capacity ? 2 * tuned.capacity : 16;
+        struct CONV_SHAPE *shapes = (struct CONV_SHAPE *)realloc(tuned.shapes, capacity * sizeof(struct CONV_SHAPE));
+        if (shapes)
+            tuned.shapes = shapes;
+        Cva *algorithms = (Cva *)realloc(tuned.algorithms, capacity * sizeof(Cva));
+        if (algorithms)
+            tuned.algorithms = algorithms;
+        if (shapes && algorithms)
+            tuned.capacity = capacity;
+    }
+    if (tuned.num < tuned.capacity) // kept, or the layer's sizes could disagree with a second answer
+    {
+        shape.input = shape.kernels = shape.workspace = shape.output = NULL;
+        tuned.shapes[tuned.num] = shape;
+        tuned.algorithms[tuned.num++] = algorithm;
+    }
+    else
+        algorithm = CONV_IM2COL; // every size agrees on it when nothing can be kept
+    pthread_mutex_unlock(&tuned.lock);
+
+    return algorithm;
+}
+
+size_t convWorkspaceLength(Cva algorithm, size_t channel, size_t height, size_t width, size_t multiplier,
+                           size_t kernelSize, size_t stride, size_t padding)
+{
+    size_t outH = convOutSize(height, kernelSize, stride, padding);
+    size_t outW = convOutSize(width, kernelSize, stride, padding);
+    if (outH == 0 || outW == 0 || !convSupports(algorithm, kernelSize, stride))
+        return 0;
+
+    if (algorithm == CONV_WINOGRAD) // the transformed kernels, then a band, its tiles and two rows out per channel
+    {
+        size_t tileW = (outW + 1) / 2;
+        return channel * multiplier * 16 + channel * (4 * (2 * tileW + 2) + 20 * tileW);
+    }
+    if (algorithm == CONV_FFT) // the twiddles of both sizes, then two complex grids per channel
+    {
+        size_t fftH = convFFTLength(height + 2 * padding), fftW = convFFTLength(width + 2 * padding);
+        return fftH + fftW + channel * 4 * fftH * fftW;
+    }
+
+    return channel * kernelSize * kernelSize * outH * outW;
+}
+
+#define T double
+#define CONV_NAME(name) name##Double
+#define CONV_GEMM gemmDouble
+#include "convKernels.inc"
+
+#define T float
+#define CONV_NAME(name) name##Float
+#define CONV_GEMM gemmFloat
+#include "convKernels.inc"
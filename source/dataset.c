@@ -0,0 +1,444 @@
+#include "dataset.h"
+#include <pthread.h>
+#include <string.h>
+
+#define MAX_CLASSES 65536 // of a one-hot label, a larger index is taken for a file that isn't labels
+
+struct LOADER_STATE
+{
+    pthread_t thread;
+    pthread_mutex_t lock;    // guards everything down to stop
+    pthread_cond_t filled;   // a buffer was filled
+    pthread_cond_t emptied;  // a buffer was given back, or the loader stops
+    int full[LOADER_BUFFERS];
+    size_t epochOf[LOADER_BUFFERS];
+    size_t handedOut; // the buffer the caller holds, LOADER_BUFFERS before the first batch
+    size_t next;      // the buffer the caller gets next
+    int stop;
+
+    // only the thread touches the shuffle
+    size_t *window;     // sample indexes waiting to be taken
+    size_t windowSize;  // of them in use
+    size_t windowLimit;
+    size_t cursor;      // the next sample of the file to enter the window
+    size_t taken;       // samples of the epoch taken out
+    size_t epoch;
+    uint64_t random;
+};
+
+static size_t elementSize(Elt type)
+{
+    switch (type)
+    {
+    case ELEMENT_UBYTE:
+    case ELEMENT_BYTE:
+        return 1;
+    case ELEMENT_SHORT:
+        return 2;
+    case ELEMENT_INT:
+    case ELEMENT_FLOAT:
+    case ELEMENT_NATIVE_FLOAT:
+        return 4;
+    case ELEMENT_DOUBLE:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t bigEndian32(const unsigned char *bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static double elementValue(const unsigned char *bytes, Elt type)
+{
+    switch (type)
+    {
+    case ELEMENT_UBYTE:
+        return bytes[0];
+    case ELEMENT_BYTE:
+        return (int8_t)bytes[0];
+    case ELEMENT_SHORT:
+        return (int16_t)((uint16_t)bytes[0] << 8 | bytes[1]);
+    case ELEMENT_INT:
+        return (int32_t)bigEndian32(bytes);
+    case ELEMENT_FLOAT:
+    {
+        uint32_t bits = bigEndian32(bytes);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    case ELEMENT_DOUBLE:
+    {
+        uint64_t bits = (uint64_t)bigEndian32(bytes) << 32 | bigEndian32(bytes + 4);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    default:
+    {
+        float value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+    }
+}
+
+// count values of one sample into a row of the batch, the ubyte images and the raw floats without a switch per value
+static void convertValues(const char *source, Elt type, size_t count, double scale, char *row, Dtp dtype)
+{
+    const unsigned char *bytes = (const unsigned char *)source;
+    size_t size = elementSize(type);
+    if (dtype == FLOAT_TYPE)
+    {
+        float *values = (float *)row, factor = (float)scale;
+        if (type == ELEMENT_UBYTE)
+            for (size_t i = 0; i < count; i++)
+                values[i] = bytes[i] * factor;
+        else if (type == ELEMENT_NATIVE_FLOAT && scale == 1)
+            memcpy(values, source, count * sizeof(float));
+        else
+            for (size_t i = 0; i < count; i++)
+                values[i] = (float)(elementValue(bytes + i * size, type) * scale);
+    }
+    else
+    {
+        double *values = (double *)row;
+        if (type == ELEMENT_UBYTE)
+            for (size_t i = 0; i < count; i++)
+                values[i] = bytes[i] * scale;
+        else
+            for (size_t i = 0; i < count; i++)
+                values[i] = elementValue(bytes + i * size, type) * scale;
+    }
+}
+
+// the samples of an IDX file: how many, the values of one, and where the first one starts
+static Sts parseIdx(const MappedFile *file, size_t *sampleNum, size_t *valueNum, Elt *type, const char **data)
+{
+    const unsigned char *bytes = (const unsigned char *)file->data;
+    if (file->bytes < 4 || bytes[0] || bytes[1])
+        return ERROR;
+
+    size_t dims = bytes[3], header = 4 + 4 * dims, size = elementSize((Elt)bytes[2]);
+    if (!size || dims == 0 || file->bytes < header)
+        return ERROR;
+
+    size_t values = 1;
+    for (size_t d = 1; d < dims; d++)
+    {
+        size_t extent = bigEndian32(bytes + 4 + 4 * d);
+        if (extent == 0 || values > (file->bytes - header) / extent)
+            return ERROR;
+        values *= extent;
+    }
+
+    *sampleNum = bigEndian32(bytes + 4);
+    if (*sampleNum == 0 || (file->bytes - header) / size / values < *sampleNum)
+        return ERROR;
+
+    *valueNum = values;
+    *type = (Elt)bytes[2];
+    *data = file->data + header;
+
+    return OK;
+}
+
+Sts openIdxDataset(Dataset *dataset, const char *featurePath, const char *labelPath)
+{
+    if (!dataset || !featurePath)
+        return ERROR;
+
+    memset(dataset, 0, sizeof(Dataset)); // closeDataset is safe on it from here on
+    if (mapFile(&dataset->featureFile, featurePath) ||
+        parseIdx(&dataset->featureFile, &dataset->sampleNum, &dataset->featureNum, &dataset->featureType,
+                 &dataset->features))
+    {
+        closeDataset(dataset);
+        return ERROR;
+    }
+    dataset->featureStride = dataset->featureNum * elementSize(dataset->featureType);
+    dataset->featureScale = dataset->featureType == ELEMENT_UBYTE ? 1.0 / 255 : 1;
+    if (!labelPath)
+        return OK;
+
+    size_t labelSamples;
+    if (mapFile(&dataset->labelFile, labelPath) ||
+        parseIdx(&dataset->labelFile, &labelSamples, &dataset->labelNum, &dataset->labelType, &dataset->labels) ||
+        labelSamples != dataset->sampleNum)
+    {
+        closeDataset(dataset);
+        return ERROR;
+    }
+    size_t size = elementSize(dataset->labelType);
+    dataset->labelStride = dataset->labelNum * size;
+
+    // a single integer per sample is a class index, its classes found by one pass over the file
+    if (dataset->labelNum == 1 && dataset->labelType != ELEMENT_FLOAT && dataset->labelType != ELEMENT_DOUBLE)
+    {
+        double largest = 0;
+        for (size_t s = 0; s < dataset->sampleNum; s++)
+        {
+            double index = elementValue((const unsigned char *)dataset->labels + s * size, dataset->labelType);
+            if (index < 0 || index >= MAX_CLASSES)
+            {
+                closeDataset(dataset);
+                return ERROR;
+            }
+            largest = index > largest ? index : largest;
+        }
+        dataset->labelNum = (size_t)largest + 1;
+        dataset->oneHot = 1;
+    }
+
+    return OK;
+}
+
+Sts openRecordDataset(Dataset *dataset, const char *path, size_t featureNum, size_t labelNum)
+{
+    if (!dataset || !path || featureNum == 0)
+        return ERROR;
+
+    memset(dataset, 0, sizeof(Dataset));
+    size_t stride = (featureNum + labelNum) * sizeof(float);
+    if (mapFile(&dataset->featureFile, path) || dataset->featureFile.bytes % stride)
+    {
+        closeDataset(dataset);
+        return ERROR;
+    }
+
+    dataset->sampleNum = dataset->featureFile.bytes / stride;
+    dataset->featureNum = featureNum;
+    dataset->labelNum = labelNum;
+    dataset->features = dataset->featureFile.data;
+    dataset->featureStride = stride;
+    dataset->featureType = ELEMENT_NATIVE_FLOAT;
+    dataset->featureScale = 1;
+    dataset->labels = dataset->featureFile.data + featureNum * sizeof(float);
+    dataset->labelStride = stride;
+    dataset->labelType = ELEMENT_NATIVE_FLOAT;
+
+    return OK;
+}
+
+Sts closeDataset(Dataset *dataset)
+{
+    if (!dataset)
+        return OK;
+
+    unmapFile(&dataset->featureFile);
+    unmapFile(&dataset->labelFile);
+    memset(dataset, 0, sizeof(Dataset));
+
+    return OK;
+}
+
+static uint64_t nextRandom(uint64_t *state) // xorshift64*, the loader's own so rand() of the caller is untouched
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void startEpoch(struct LOADER_STATE *state, size_t sampleNum)
+{
+    state->windowSize = state->windowLimit < sampleNum ? state->windowLimit : sampleNum;
+    for (size_t i = 0; i < state->windowSize; i++)
+        state->window[i] = i;
+    state->cursor = state->windowSize;
+    state->taken = 0;
+}
+
+static size_t takeSample(struct LOADER_STATE *state, size_t sampleNum)
+{
+    size_t slot = nextRandom(&state->random) % state->windowSize, sample = state->window[slot];
+    if (state->cursor < sampleNum)
+        state->window[slot] = state->cursor++;
+    else // the file is used up, the window drains
+        state->window[slot] = state->window[--state->windowSize];
+    state->taken++;
+
+    return sample;
+}
+
+static void fillBatch(DataLoader *loader, size_t buffer)
+{
+    struct LOADER_STATE *state = loader->state;
+    const Dataset *dataset = loader->dataset;
+    if (state->taken == loader->batchesPerEpoch * loader->batchSize)
+    {
+        startEpoch(state, dataset->sampleNum);
+        state->epoch++;
+    }
+    state->epochOf[buffer] = state->epoch;
+
+    size_t size = sizeOfDataType(loader->dtype);
+    char *inputs = loader->inputs[buffer].array.charArray, *labels = loader->labels[buffer].array.charArray;
+    for (size_t row = 0; row < loader->batchSize; row++)
+    {
+        size_t sample = takeSample(state, dataset->sampleNum);
+        convertValues(dataset->features + sample * dataset->featureStride, dataset->featureType,
+                      dataset->featureNum, dataset->featureScale, inputs + row * dataset->featureNum * size,
+                      loader->dtype);
+        if (dataset->labelNum == 0)
+            continue;
+
+        char *label = labels + row * dataset->labelNum * size;
+        const char *stored = dataset->labels + sample * dataset->labelStride;
+        if (dataset->oneHot)
+        {
+            size_t index = (size_t)elementValue((const unsigned char *)stored, dataset->labelType);
+            memset(label, 0, dataset->labelNum * size);
+            if (loader->dtype == FLOAT_TYPE)
+                ((float *)label)[index] = 1;
+            else
+                ((double *)label)[index] = 1;
+        }
+        else
+            convertValues(stored, dataset->labelType, dataset->labelNum, 1, label, loader->dtype);
+    }
+}
+
+static void *loaderMain(void *args)
+{
+    DataLoader *loader = (DataLoader *)args;
+    struct LOADER_STATE *state = loader->state;
+    size_t buffer = 0;
+
+    pthread_mutex_lock(&state->lock);
+    while (1)
+    {
+        while (!state->stop && state->full[buffer])
+            pthread_cond_wait(&state->emptied, &state->lock);
+        if (state->stop)
+            break;
+
+        pthread_mutex_unlock(&state->lock);
+        fillBatch(loader, buffer);
+        pthread_mutex_lock(&state->lock);
+
+        state->full[buffer] = 1;
+        pthread_cond_signal(&state->filled);
+        buffer = (buffer + 1) % LOADER_BUFFERS;
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    return NULL;
+}
+
+Sts initDataLoader(DataLoader *loader, const Dataset *dataset, size_t batchSize, Dtp dtype, size_t window,
+                   uint64_t seed)
+{
+    if (!loader || !dataset || !dataset->features || batchSize == 0 || batchSize > dataset->sampleNum ||
+        (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
+        return ERROR;
+
+    memset(loader, 0, sizeof(DataLoader));
+    loader->dataset = dataset;
+    loader->batchSize = batchSize;
+    loader->dtype = dtype;
+    loader->batchesPerEpoch = dataset->sampleNum / batchSize;
+
+    size_t size = sizeOfDataType(dtype), inputBytes = batchSize * dataset->featureNum * size;
+    size_t labelBytes = batchSize * dataset->labelNum * size;
+    size_t bufferBytes = arenaAlignedSize(inputBytes) + (labelBytes ? arenaAlignedSize(labelBytes) : 0);
+    Sts rcode = initArena(&loader->memory, LOADER_BUFFERS * bufferBytes);
+    for (size_t b = 0; b < LOADER_BUFFERS && rcode == OK; b++)
+    {
+        rcode = initArenaMat(&loader->memory, &loader->inputs[b], batchSize, dataset->featureNum, dtype, 0) || rcode;
+        if (labelBytes)
+            rcode = initArenaMat(&loader->memory, &loader->labels[b], batchSize, dataset->labelNum, dtype, 0) || rcode;
+        else
+            loader->labels[b] = (Mat){.row = batchSize, .dtype = dtype};
+    }
+
+    window = window ? window : 1; // a window of one is no shuffle at all
+    window = window < dataset->sampleNum ? window : dataset->sampleNum;
+    struct LOADER_STATE *state = rcode == OK ? (struct LOADER_STATE *)calloc(1, sizeof(struct LOADER_STATE)) : NULL;
+    if (state)
+        state->window = (size_t *)malloc(sizeof(size_t) * window);
+    if (!state || !state->window)
+    {
+        free(state);
+        freeArena(&loader->memory);
+        return ERROR;
+    }
+
+    state->windowLimit = window;
+    state->random = seed ^ 0x9E3779B97F4A7C15ULL;
+    state->random = state->random ? state->random : 1; // xorshift stays at 0 forever
+    state->handedOut = LOADER_BUFFERS;
+    startEpoch(state, dataset->sampleNum);
+    pthread_mutex_init(&state->lock, NULL);
+    pthread_cond_init(&state->filled, NULL);
+    pthread_cond_init(&state->emptied, NULL);
+    loader->state = state;
+
+    if (pthread_create(&state->thread, NULL, loaderMain, loader) != 0)
+    {
+        pthread_mutex_destroy(&state->lock);
+        pthread_cond_destroy(&state->filled);
+        pthread_cond_destroy(&state->emptied);
+        free(state->window);
+        free(state);
+        loader->state = NULL;
+        freeArena(&loader->memory);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+Sts nextBatch(DataLoader *loader)
+{
+    if (!loader || !loader->state)
+        return ERROR;
+
+    struct LOADER_STATE *state = loader->state;
+    pthread_mutex_lock(&state->lock);
+    if (state->handedOut < LOADER_BUFFERS)
+    {
+        state->full[state->handedOut] = 0;
+        pthread_cond_signal(&state->emptied);
+    }
+    while (!state->full[state->next])
+        pthread_cond_wait(&state->filled, &state->lock);
+
+    state->handedOut = state->next;
+    state->next = (state->next + 1) % LOADER_BUFFERS;
+    loader->epoch = state->epochOf[state->handedOut];
+    pthread_mutex_unlock(&state->lock);
+
+    loader->input = &loader->inputs[state->handedOut];
+    loader->label = &loader->labels[state->handedOut];
+
+    return OK;
+}
+
+Sts freeDataLoader(DataLoader *loader)
+{
+    if (!loader || !loader->state)
+        return OK;
+
+    struct LOADER_STATE *state = loader->state;
+    pthread_mutex_lock(&state->lock);
+    state->stop = 1;
+    pthread_cond_signal(&state->emptied);
+    pthread_mutex_unlock(&state->lock);
+    pthread_join(state->thread, NULL);
+
+    pthread_mutex_destroy(&state->lock);
+    pthread_cond_destroy(&state->filled);
+    pthread_cond_destroy(&state->emptied);
+    free(state->window);
+    free(state);
+    freeArena(&loader->memory);
+    memset(loader, 0, sizeof(DataLoader));
+
+    return OK;
+}
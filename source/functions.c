@@ -1,29 +1,34 @@
 #include "functions.h"
+#include "pool.h"
+#include "simd.h"
+#include <string.h>
 
 Sts ReLU(Input *input, Output *output)
 {
-    if (input->length != output->length)
+    if (input->length != output->length || input->dtype != output->dtype)
         return ERROR;
 
-    for (size_t i = 0; i < input->length; i++)
-    {
-        double x = input->array.doubleArray[i];
-        output->array.doubleArray[i] = x > 0 ? x : 0;
-    }
+    if (input->dtype == FLOAT_TYPE)
+        simdKernels()->reluFloat(input->array.floatArray, 0, output->array.floatArray, input->length);
+    else if (input->dtype == DOUBLE_TYPE)
+        simdKernels()->reluDouble(input->array.doubleArray, 0, output->array.doubleArray, input->length);
+    else
+        return ERROR;
 
     return OK;
 }
 
 Sts leakyReLU(Input *input, Output *output)
 {
-    if (input->length != output->length)
+    if (input->length != output->length || input->dtype != output->dtype)
         return ERROR;
 
-    for (size_t i = 0; i < input->length; i++)
-    {
-        double x = input->array.doubleArray[i];
-        output->array.doubleArray[i] = x > 0 ? x : .01 * x;
-    }
+    if (input->dtype == FLOAT_TYPE)
+        simdKernels()->reluFloat(input->array.floatArray, (float)LEAKY_RELU_SLOPE, output->array.floatArray, input->length);
+    else if (input->dtype == DOUBLE_TYPE)
+        simdKernels()->reluDouble(input->array.doubleArray, LEAKY_RELU_SLOPE, output->array.doubleArray, input->length);
+    else
+        return ERROR;
 
     return OK;
 }
@@ -53,28 +58,30 @@ Sts lossCrossEntropy(Label *label, Input *input, Output *output)
 
 Sts ReLU_derivative(Input *input, Derv *derv)
 {
-    if (input->length != derv->length)
+    if (input->length != derv->length || input->dtype != derv->dtype)
         return ERROR;
 
-    for (size_t i = 0; i < input->length; i++)
-    {
-        double x = input->array.doubleArray[i];
-        derv->array.doubleArray[i] = x > 0 ? 1 : 0;
-    }
+    if (input->dtype == FLOAT_TYPE)
+        simdKernels()->reluDerivativeFloat(input->array.floatArray, 0, derv->array.floatArray, input->length);
+    else if (input->dtype == DOUBLE_TYPE)
+        simdKernels()->reluDerivativeDouble(input->array.doubleArray, 0, derv->array.doubleArray, input->length);
+    else
+        return ERROR;
 
     return OK;
 }
 
 Sts leakyReLU_derivative(Input *input, Derv *derv)
 {
-    if (input->length != derv->length)
+    if (input->length != derv->length || input->dtype != derv->dtype)
         return ERROR;
 
-    for (size_t i = 0; i < input->length; i++)
-    {
-        double x = input->array.doubleArray[i];
-        derv->array.doubleArray[i] = x > 0 ? 1 : .01;
-    }
+    if (input->dtype == FLOAT_TYPE)
+        simdKernels()->reluDerivativeFloat(input->array.floatArray, (float)LEAKY_RELU_SLOPE, derv->array.floatArray, input->length);
+    else if (input->dtype == DOUBLE_TYPE)
+        simdKernels()->reluDerivativeDouble(input->array.doubleArray, LEAKY_RELU_SLOPE, derv->array.doubleArray, input->length);
+    else
+        return ERROR;
 
     return OK;
 }
@@ -97,7 +104,7 @@ Sts lossCrossEntropy_derivative(Label *label, Input *input, Derv *derv)
     {
         int y = label->array.intArray[i];
         double y1 = input->array.doubleArray[i];
-        derv->array.doubleArray[i] = -y / (y1 + 1e8);
+        derv->array.doubleArray[i] = -y / (y1 + 1e-8);
     }
 
     return OK;
@@ -105,46 +112,81 @@ Sts lossCrossEntropy_derivative(Label *label, Input *input, Derv *derv)
 
 Sts softmax(Input *input, Output *output)
 {
-    if (!input || !output || (input->length != output->length))
+    if (!input || !output || (input->length != output->length) || input->dtype != output->dtype)
         return ERROR;
 
-    // travel two times to compute the denominator
-    int max = 0;
-    for (size_t i = 0; i < input->length; i++)
-        max = max >= input->array.doubleArray[i] ? max : input->array.doubleArray[i];
-
-    long long int totalSum = 0;
-    for (size_t i = 0; i < input->length; i++)
+    // travel two times to compute the denominator, shifting by the max keeps exp from overflowing
+    const Simd *simd = simdKernels();
+    if (input->dtype == FLOAT_TYPE)
     {
-        long double x = exp(input->array.doubleArray[i] - max);
-        totalSum += x;
-        output->array.doubleArray[i] = x;
+        float max = simd->maxFloat(input->array.floatArray, input->length);
+        float totalSum = simd->expShiftSumFloat(input->array.floatArray, max, output->array.floatArray, input->length);
+        simd->scaleFloat(1 / totalSum, output->array.floatArray, output->array.floatArray, output->length);
     }
-
-    for (size_t i = 0; i < input->length; i++)
-        output->array.doubleArray[i] /= totalSum;
+    else if (input->dtype == DOUBLE_TYPE)
+    {
+        double max = simd->maxDouble(input->array.doubleArray, input->length);
+        double totalSum =
+            simd->expShiftSumDouble(input->array.doubleArray, max, output->array.doubleArray, input->length);
+        simd->scaleDouble(1 / totalSum, output->array.doubleArray, output->array.doubleArray, output->length);
+    }
+    else
+        return ERROR;
 
     return OK;
 }
 
 Sts sigmoid(Input *input, Derv *derv)
 {
-    if (!input || !derv || (input->length != derv->length))
+    if (!input || !derv || input->length != derv->length || input->dtype != derv->dtype)
+        return ERROR;
+
+    if (input->dtype == FLOAT_TYPE)
+        simdKernels()->sigmoidFloat(input->array.floatArray, derv->array.floatArray, input->length);
+    else if (input->dtype == DOUBLE_TYPE)
+        simdKernels()->sigmoidDouble(input->array.doubleArray, derv->array.doubleArray, input->length);
+    else
+        return ERROR;
+
+    return OK;
+}
+
+Sts sigmoid_derivative(Input *input, Derv *derv)
+{
+    if (sigmoid(input, derv) == ERROR)
         return ERROR;
 
-    for (size_t i = 0; i < input->length; i++)
-        derv->array.doubleArray[i] = 1 / (1 + exp(-input->array.doubleArray[i]));
+    // s * (1 - s) from the sigmoid just written
+    if (derv->dtype == FLOAT_TYPE)
+        for (size_t i = 0; i < derv->length; i++)
+            derv->array.floatArray[i] *= 1 - derv->array.floatArray[i];
+    else
+        for (size_t i = 0; i < derv->length; i++)
+            derv->array.doubleArray[i] *= 1 - derv->array.doubleArray[i];
 
     return OK;
 }
 
+Act activationOf(Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *))
+{
+    if (activateFunction == noActivation && activateFunction_derivative == noActivation_derivative)
+        return ACTIVATION_NONE;
+    if (activateFunction == ReLU && activateFunction_derivative == ReLU_derivative)
+        return ACTIVATION_RELU;
+    if (activateFunction == leakyReLU && activateFunction_derivative == leakyReLU_derivative)
+        return ACTIVATION_LEAKY_RELU;
+    if (activateFunction == sigmoid && activateFunction_derivative == sigmoid_derivative)
+        return ACTIVATION_SIGMOID;
+
+    return ACTIVATION_CUSTOM;
+}
+
 Sts optimizeDoubleVec(Vec *args, Derv *derv, double lr)
 {
-    if (!args || !derv || args->length != derv->length)
+    if (!args || !derv || args->length != derv->length || args->dtype != DOUBLE_TYPE || derv->dtype != DOUBLE_TYPE)
         return ERROR;
 
-    for (size_t i = 0; i < args->length; i++)
-        args->array.doubleArray[i] -= lr * derv->array.doubleArray[i];
+    simdKernels()->axpyDouble(-lr, derv->array.doubleArray, args->array.doubleArray, args->length);
 
     return OK;
 }
@@ -153,35 +195,60 @@ Sts optimizeDoubleMat(Mat *args, MDerv *derv, double lr)
 {
     Vec vargs, vderv;
     Sts rcode = OK;
-    rcode = matTransVet(args, &vargs) || rcode;
-    rcode = matTransVet(derv, &vderv) || rcode;
-
-    optimizeDoubleVec(&vargs, &vderv, lr);
+    rcode = matTransVec(args, &vargs) || rcode;
+    rcode = matTransVec(derv, &vderv) || rcode;
 
     if (rcode == ERROR)
         return ERROR;
 
+    return optimizeDoubleVec(&vargs, &vderv, lr);
+}
+
+Sts optimizeFloatVec(Vec *args, Derv *derv, float lr)
+{
+    if (!args || !derv || args->length != derv->length || args->dtype != FLOAT_TYPE || derv->dtype != FLOAT_TYPE)
+        return ERROR;
+
+    simdKernels()->axpyFloat(-lr, derv->array.floatArray, args->array.floatArray, args->length);
+
     return OK;
 }
 
+Sts optimizeFloatMat(Mat *args, MDerv *derv, float lr)
+{
+    Vec vargs, vderv;
+    Sts rcode = OK;
+    rcode = matTransVec(args, &vargs) || rcode;
+    rcode = matTransVec(derv, &vderv) || rcode;
+
+    if (rcode == ERROR)
+        return ERROR;
+
+    return optimizeFloatVec(&vargs, &vderv, lr);
+}
+
 Sts noActivation(Input *input, Output *output)
 {
-    if (!input || !output || input->length != output->length)
+    if (!input || !output || input->length != output->length || input->dtype != output->dtype)
         return ERROR;
 
-    for (size_t i = 0; i < input->length; i++)
-        output->array.doubleArray[i] = input->array.doubleArray[i];
+    if (input->array.doubleArray != output->array.doubleArray)
+        memcpy(output->array.doubleArray, input->array.doubleArray, input->length * sizeOfDataType(input->dtype));
 
     return OK;
 }
 
 Sts noActivation_derivative(Input *input, Derv *derv)
 {
-    if (!input || !derv || input->length != derv->length)
+    if (!input || !derv || input->length != derv->length || input->dtype != derv->dtype)
         return ERROR;
 
-    for (size_t i = 0; i < input->length; i++)
-        derv->array.doubleArray[i] = 1;
+    if (input->dtype == FLOAT_TYPE)
+        for (size_t i = 0; i < input->length; i++)
+            derv->array.floatArray[i] = 1;
+    else
+        for (size_t i = 0; i < input->length; i++)
+            derv->array.doubleArray[i] = 1;
 
     return OK;
 }
@@ -215,30 +282,80 @@ Sts convolution(MInput *origin, MOutput *dst, Kernel *kernel)
     return OK;
 }
 
+Sts convolutionFloat(MInput *origin, MOutput *dst, Kernel *kernel)
+{
+    int m = origin->row, n = origin->col, m1 = dst->row, n1 = dst->col, k1 = kernel->row, k2 = kernel->col;
+
+    if (k1 != k2 || k1 % 2 == 1 || ((m - k1 + 1) != m1) || ((n - k1 + 1) != n1))
+        return ERROR; // if the dimention of the kernel is not fitting the dst
+
+    if (origin->dtype != FLOAT_TYPE || dst->dtype != FLOAT_TYPE || kernel->dtype != FLOAT_TYPE)
+        return ERROR;
+
+    float(*input)[n] = (float(*)[n])origin->array.floatArray;
+    float(*output)[n1] = (float(*)[n1])dst->array.floatArray;
+    float(*weight)[k1] = (float(*)[k1])kernel->array.floatArray;
+
+    float total_weight = 0;
+    for (int p = 0; p < k1; p++)
+        for (int q = 0; q < k1; q++)
+            total_weight += weight[p][q];
+
+    if (total_weight == 0)
+        total_weight += 1e-8f;
+
+    // the same placement as the double version, cells falling outside dst are dropped
+    int start_index = k1 / 2;
+    for (int i = start_index; i < m - start_index && i < m1; i++)
+        for (int j = start_index; j < n - start_index && j < n1; j++)
+        {
+            int org_row = i - start_index, org_col = j - start_index;
+            float cell = 0;
+            for (int p = 0; p < k1; p++)
+                for (int q = 0; q < k1; q++)
+                    cell += weight[p][q] * input[org_row + p][org_col + q];
+
+            output[i][j] = cell / total_weight;
+        }
+
+    return OK;
+}
+
 Sts poolingMax(MInput *origin, MOutput *dst, int kernelSize)
 {
+    if (!origin || !dst || kernelSize <= 0 || origin->dtype != DOUBLE_TYPE || dst->dtype != DOUBLE_TYPE)
+        return ERROR;
+
     int m = origin->row, n = origin->col, m1 = dst->row, n1 = dst->col;
     if (!(m % kernelSize == 0 && n % kernelSize == 0 && m / kernelSize == m1 && n / kernelSize == n1))
         return ERROR;
 
-    for (int i = 0, p = 0; i < m1; i++, p += kernelSize) // i, j -> dst; p, q -> origin; s, t -> kernel
+    const double *image = origin->array.doubleMatrix;
+    double *pooled = dst->array.doubleMatrix;
+    if (kernelSize > POOL_MAX_KERNEL) // beyond what a window cell of pool.c can name, the plain walk
     {
-        for (int j = 0, q = 0; j < n1; j++, q += kernelSize)
+        for (int i = 0; i < m1 * n1; i++)
         {
-            double currentValue, maxValue = getDoubleMatrixValue(origin, p, q);
-            for (int s = 0; s < kernelSize; s++) // find the max in the kernel
-            {
+            const double *window = image + i / n1 * kernelSize * n + i % n1 * kernelSize;
+            double maxValue = window[0];
+            for (int s = 0; s < kernelSize; s++, window += n)
                 for (int t = 0; t < kernelSize; t++)
-                {
-                    currentValue = getDoubleMatrixValue(origin, p + s, q + t);
-                    maxValue = currentValue > maxValue ? currentValue : maxValue;
-                }
-            }
-            setDoubleMatrixValue(dst, i, j, maxValue);
+                    maxValue = window[t] > maxValue ? window[t] : maxValue;
+            pooled[i] = maxValue;
         }
+        return OK;
     }
 
-    return OK;
+    // one channel of the layer pooling with windows as wide as their stride, vectorized across the row
+    size_t rowsSize = poolRowsSize(m, n, kernelSize, kernelSize, 0);
+    double *rows = rowsSize ? (double *)malloc(sizeof(double) * rowsSize) : NULL;
+    if (rowsSize && !rows)
+        return ERROR;
+
+    Sts rcode = poolingDouble(image, 1, m, n, kernelSize, kernelSize, 0, POOLING_MAX, rows, pooled, NULL);
+    free(rows);
+
+    return rcode;
 }
 
 double MSE_single(double label, double output)
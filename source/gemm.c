@@ -0,0 +1,275 @@
+#include "gemm.h"
+#include "profile.h"
+#include "simd.h"
+#include "threadpool.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86
+#include <immintrin.h>
+#endif
+
+#define GEMM_SMALL 32768    // below this many multiply-adds packing costs more than it saves
+#define GEMM_SPLIT_MN 16384 // C at most this big is shared by cutting the depth instead of the tiles
+#define GEMM_SPLIT_K 1024   // depth of one cut, fixed so the partial sums don't depend on the thread count
+#define GEMM_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+enum GemmBuffer // the buffers a thread keeps between products
+{
+    GEMM_PACKED_A,
+    GEMM_PACKED_B,
+    GEMM_PARTIALS, // of the caller splitting the depth, its own tasks pack into the other two meanwhile
+    GEMM_BUFFERS
+};
+
+struct GEMM_WORKSPACE
+{
+    void *buffers[GEMM_BUFFERS];
+    size_t bytes[GEMM_BUFFERS];
+};
+
+static pthread_key_t workspaceKey;
+static pthread_once_t workspaceOnce = PTHREAD_ONCE_INIT;
+static int workspaceKeyMade = 0;
+
+static void freeWorkspace(void *workspace) // when its thread exits
+{
+    struct GEMM_WORKSPACE *w = (struct GEMM_WORKSPACE *)workspace;
+    for (size_t i = 0; i < GEMM_BUFFERS; i++)
+        alignedFree(w->buffers[i]);
+    free(w);
+}
+
+static void makeWorkspaceKey(void)
+{
+    workspaceKeyMade = pthread_key_create(&workspaceKey, freeWorkspace) == 0;
+}
+
+/*
+A buffer of the calling thread at least bytes long, kept and only ever grown, so the products of shapes a thread
+has run before allocate nothing. NULL when out of memory.
+*/
+static void *gemmBuffer(enum GemmBuffer which, size_t bytes)
+{
+    pthread_once(&workspaceOnce, makeWorkspaceKey);
+    if (!workspaceKeyMade)
+        return NULL;
+
+    struct GEMM_WORKSPACE *w = (struct GEMM_WORKSPACE *)pthread_getspecific(workspaceKey);
+    if (!w)
+    {
+        w = (struct GEMM_WORKSPACE *)calloc(1, sizeof(struct GEMM_WORKSPACE));
+        if (!w || pthread_setspecific(workspaceKey, w) != 0)
+        {
+            free(w);
+            return NULL;
+        }
+    }
+
+    if (w->bytes[which] < bytes)
+    {
+        alignedFree(w->buffers[which]);
+        w->buffers[which] = alignedMalloc(bytes, 64);
+        w->bytes[which] = w->buffers[which] ? bytes : 0;
+    }
+
+    return w->buffers[which];
+}
+
+#ifdef GEMM_X86
+// a 4 x 8 double tile held in eight ymm accumulators, two fma per broadcast element of A
+__attribute__((target("avx2,fma"))) static void microKernelAvx2Double(size_t kc, const double *pa, const double *pb,
+                                                                      double *ab)
+{
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+
+    for (size_t p = 0; p < kc; p++, pa += GEMM_MR, pb += GEMM_NR)
+    {
+        __m256d b0 = _mm256_loadu_pd(pb), b1 = _mm256_loadu_pd(pb + 4);
+        __m256d a;
+
+        a = _mm256_broadcast_sd(pa);
+        c00 = _mm256_fmadd_pd(a, b0, c00);
+        c01 = _mm256_fmadd_pd(a, b1, c01);
+        a = _mm256_broadcast_sd(pa + 1);
+        c10 = _mm256_fmadd_pd(a, b0, c10);
+        c11 = _mm256_fmadd_pd(a, b1, c11);
+        a = _mm256_broadcast_sd(pa + 2);
+        c20 = _mm256_fmadd_pd(a, b0, c20);
+        c21 = _mm256_fmadd_pd(a, b1, c21);
+        a = _mm256_broadcast_sd(pa + 3);
+        c30 = _mm256_fmadd_pd(a, b0, c30);
+        c31 = _mm256_fmadd_pd(a, b1, c31);
+    }
+
+    _mm256_storeu_pd(ab, c00);
+    _mm256_storeu_pd(ab + 4, c01);
+    _mm256_storeu_pd(ab + 8, c10);
+    _mm256_storeu_pd(ab + 12, c11);
+    _mm256_storeu_pd(ab + 16, c20);
+    _mm256_storeu_pd(ab + 20, c21);
+    _mm256_storeu_pd(ab + 24, c30);
+    _mm256_storeu_pd(ab + 28, c31);
+}
+
+// the float tile is twice as wide for the same eight accumulators
+__attribute__((target("avx2,fma"))) static void microKernelAvx2Float(size_t kc, const float *pa, const float *pb,
+                                                                     float *ab)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+
+    for (size_t p = 0; p < kc; p++, pa += GEMM_MR, pb += GEMM_NR_FLOAT)
+    {
+        __m256 b0 = _mm256_loadu_ps(pb), b1 = _mm256_loadu_ps(pb + 8);
+        __m256 a;
+
+        a = _mm256_broadcast_ss(pa);
+        c00 = _mm256_fmadd_ps(a, b0, c00);
+        c01 = _mm256_fmadd_ps(a, b1, c01);
+        a = _mm256_broadcast_ss(pa + 1);
+        c10 = _mm256_fmadd_ps(a, b0, c10);
+        c11 = _mm256_fmadd_ps(a, b1, c11);
+        a = _mm256_broadcast_ss(pa + 2);
+        c20 = _mm256_fmadd_ps(a, b0, c20);
+        c21 = _mm256_fmadd_ps(a, b1, c21);
+        a = _mm256_broadcast_ss(pa + 3);
+        c30 = _mm256_fmadd_ps(a, b0, c30);
+        c31 = _mm256_fmadd_ps(a, b1, c31);
+    }
+
+    _mm256_storeu_ps(ab, c00);
+    _mm256_storeu_ps(ab + 8, c01);
+    _mm256_storeu_ps(ab + 16, c10);
+    _mm256_storeu_ps(ab + 24, c11);
+    _mm256_storeu_ps(ab + 32, c20);
+    _mm256_storeu_ps(ab + 40, c21);
+    _mm256_storeu_ps(ab + 48, c30);
+    _mm256_storeu_ps(ab + 56, c31);
+}
+
+// one row of A against one packed sliver, two steps of the depth in flight so four accumulators
+__attribute__((target("avx2,fma"))) static void rowKernelAvx2Double(size_t k, const double *a, ptrdiff_t csa,
+                                                                    const double *sliver, double *ab)
+{
+    __m256d e0 = _mm256_setzero_pd(), e1 = _mm256_setzero_pd();
+    __m256d o0 = _mm256_setzero_pd(), o1 = _mm256_setzero_pd();
+    size_t p = 0;
+
+    for (; p + 2 <= k; p += 2, sliver += 2 * GEMM_NR)
+    {
+        __m256d x = _mm256_broadcast_sd(a + (ptrdiff_t)p * csa);
+        e0 = _mm256_fmadd_pd(x, _mm256_loadu_pd(sliver), e0);
+        e1 = _mm256_fmadd_pd(x, _mm256_loadu_pd(sliver + 4), e1);
+        x = _mm256_broadcast_sd(a + (ptrdiff_t)(p + 1) * csa);
+        o0 = _mm256_fmadd_pd(x, _mm256_loadu_pd(sliver + 8), o0);
+        o1 = _mm256_fmadd_pd(x, _mm256_loadu_pd(sliver + 12), o1);
+    }
+    if (p < k)
+    {
+        __m256d x = _mm256_broadcast_sd(a + (ptrdiff_t)p * csa);
+        e0 = _mm256_fmadd_pd(x, _mm256_loadu_pd(sliver), e0);
+        e1 = _mm256_fmadd_pd(x, _mm256_loadu_pd(sliver + 4), e1);
+    }
+
+    _mm256_storeu_pd(ab, _mm256_add_pd(e0, o0));
+    _mm256_storeu_pd(ab + 4, _mm256_add_pd(e1, o1));
+}
+
+__attribute__((target("avx2,fma"))) static void rowKernelAvx2Float(size_t k, const float *a, ptrdiff_t csa,
+                                                                   const float *sliver, float *ab)
+{
+    __m256 e0 = _mm256_setzero_ps(), e1 = _mm256_setzero_ps();
+    __m256 o0 = _mm256_setzero_ps(), o1 = _mm256_setzero_ps();
+    size_t p = 0;
+
+    for (; p + 2 <= k; p += 2, sliver += 2 * GEMM_NR_FLOAT)
+    {
+        __m256 x = _mm256_broadcast_ss(a + (ptrdiff_t)p * csa);
+        e0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(sliver), e0);
+        e1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(sliver + 8), e1);
+        x = _mm256_broadcast_ss(a + (ptrdiff_t)(p + 1) * csa);
+        o0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(sliver + 16), o0);
+        o1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(sliver + 24), o1);
+    }
+    if (p < k)
+    {
+        __m256 x = _mm256_broadcast_ss(a + (ptrdiff_t)p * csa);
+        e0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(sliver), e0);
+        e1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(sliver + 8), e1);
+    }
+
+    _mm256_storeu_ps(ab, _mm256_add_ps(e0, o0));
+    _mm256_storeu_ps(ab + 8, _mm256_add_ps(e1, o1));
+}
+#endif
+
+#define T double
+#define GEMM_NAME(name) name##Double
+#define GEMM_PUBLIC gemmDouble
+#define GEMM_STRIDED gemmDoubleStrided
+#define GEMM_BIAS_ACT gemmDoubleBiasAct
+#define GEMM_PACK_B gemmDoublePackB
+#define GEMM_PACKED_BIAS_ACT gemmDoublePackedBiasAct
+#define GEMM_LABEL "gemmDouble"
+#define GEMM_BIAS_LABEL "gemmDoubleBiasAct"
+#define GEMM_PACKED_LABEL "gemmDoublePackedBiasAct"
+#define GEMM_SIMD(name) name##Double
+#define MR GEMM_MR
+#define NR GEMM_NR
+#ifdef GEMM_X86
+#define GEMM_SIMD_KERNEL microKernelAvx2Double
+#define GEMM_SIMD_ROW rowKernelAvx2Double
+#endif
+#include "gemmKernels.inc"
+
+#define T float
+#define GEMM_NAME(name) name##Float
+#define GEMM_PUBLIC gemmFloat
+#define GEMM_STRIDED gemmFloatStrided
+#define GEMM_BIAS_ACT gemmFloatBiasAct
+#define GEMM_PACK_B gemmFloatPackB
+#define GEMM_PACKED_BIAS_ACT gemmFloatPackedBiasAct
+#define GEMM_LABEL "gemmFloat"
+#define GEMM_BIAS_LABEL "gemmFloatBiasAct"
+#define GEMM_PACKED_LABEL "gemmFloatPackedBiasAct"
+#define GEMM_SIMD(name) name##Float
+#define MR GEMM_MR
+#define NR GEMM_NR_FLOAT
+#ifdef GEMM_X86
+#define GEMM_SIMD_KERNEL microKernelAvx2Float
+#define GEMM_SIMD_ROW rowKernelAvx2Float
+#endif
+#include "gemmKernels.inc"
+
+size_t gemmPackedLength(size_t k, size_t n, Dtp dtype)
+{
+    size_t nr = dtype == FLOAT_TYPE ? GEMM_NR_FLOAT : GEMM_NR;
+
+    return (n + nr - 1) / nr * nr * k;
+}
+
+Sts gemmView(double alpha, const View *a, const View *b, double beta, View *c)
+{
+    if (!a || !b || !c || a->dimNum != 2 || b->dimNum != 2 || c->dimNum != 2 || a->dtype != c->dtype ||
+        b->dtype != c->dtype || a->shape[1] != b->shape[0] || c->shape[0] != a->shape[0] ||
+        c->shape[1] != b->shape[1] || (c->strides[0] == 0 && c->shape[0] > 1) ||
+        (c->strides[1] == 0 && c->shape[1] > 1))
+        return ERROR;
+
+    size_t m = c->shape[0], n = c->shape[1], k = a->shape[1];
+    if (c->dtype == FLOAT_TYPE)
+        return gemmFloatStrided(m, n, k, (float)alpha, viewData(a), a->strides[0], a->strides[1], viewData(b),
+                                b->strides[0], b->strides[1], (float)beta, viewData(c), c->strides[0], c->strides[1]);
+    if (c->dtype == DOUBLE_TYPE)
+        return gemmDoubleStrided(m, n, k, alpha, viewData(a), a->strides[0], a->strides[1], viewData(b),
+                                 b->strides[0], b->strides[1], beta, viewData(c), c->strides[0], c->strides[1]);
+
+    return ERROR;
+}
@@ -0,0 +1,424 @@
+#include "graph.h"
+#include "conv.h"
+#include "gemm.h"
+#include "profile.h"
+#include "simd.h"
+#include <string.h>
+
+// the node to the graph, reading what the graph outputs so far and giving its new output, which lives in data
+static Sts appendNode(Graph *graph, struct GRAPH_NODE node, char *data)
+{
+    node.input = graph->output;
+    node.output = graph->tensorNum;
+    node.rows = graph->batchSize;
+    graph->tensorData[graph->tensorNum] = data;
+    graph->tensorLengths[graph->tensorNum++] = node.rows * node.numOut;
+    graph->nodes[graph->nodeNum++] = node;
+    graph->output = node.output;
+
+    return OK;
+}
+
+Sts graphOfModel(Graph *graph, Model *model)
+{
+    if (!graph || !model || !model->buffers || model->layerNum == 0)
+        return ERROR;
+
+    // every fully connected layer makes 3 nodes and a flatten before it at most, the others 2
+    memset(graph, 0, sizeof(Graph));
+    graph->dtype = model->dtype;
+    graph->batchSize = model->batchSize;
+    graph->nodes = (struct GRAPH_NODE *)malloc(4 * model->layerNum * sizeof(struct GRAPH_NODE));
+    graph->tensorLengths = (size_t *)malloc((4 * model->layerNum + 1) * sizeof(size_t));
+    graph->tensorData = (char **)malloc((4 * model->layerNum + 1) * sizeof(char *));
+    if (!graph->nodes || !graph->tensorLengths || !graph->tensorData)
+    {
+        freeGraph(graph);
+        return ERROR;
+    }
+    graph->tensorData[graph->tensorNum] = model->input.array.charArray;
+    graph->tensorLengths[graph->tensorNum++] = model->input.length;
+
+    Sts rcode = OK;
+    for (size_t i = 0; i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        struct GRAPH_NODE node = {0};
+        if (i > 0 && (layer->type == FULLY_CONNECTED_LAYER) != (model->layers[i - 1].type == FULLY_CONNECTED_LAYER))
+        {
+            node.op = GRAPH_FLATTEN;
+            node.numIn = node.numOut = graph->tensorLengths[graph->output] / graph->batchSize;
+            rcode = appendNode(graph, node, graph->tensorData[graph->output]) || rcode;
+        }
+
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            // the product and its bias where the layer puts them, before the activation only if it's custom
+            struct FCL *fcl = &layer->layer.fcl;
+            char *linear = fcl->activation == ACTIVATION_CUSTOM ? fcl->linearTrans.array.charArray
+                                                                 : fcl->output.array.charArray;
+            node.op = GRAPH_GEMM;
+            node.weight = fcl->weight.array.charArray;
+            node.layer = fcl->packedWeight.array.charArray ? fcl : NULL;
+            node.numIn = fcl->neuronNumIn;
+            node.numOut = fcl->neuronNumOut;
+            rcode = appendNode(graph, node, linear) || rcode;
+
+            node.op = GRAPH_BIAS;
+            node.weight = NULL;
+            node.layer = NULL;
+            node.bias = fcl->bias.array.charArray;
+            node.numIn = node.numOut;
+            rcode = appendNode(graph, node, linear) || rcode;
+
+            node.op = GRAPH_ACTIVATE;
+            node.bias = NULL;
+            node.activation = fcl->activation;
+            node.activateFunction = fcl->activation == ACTIVATION_CUSTOM ? fcl->activateFunction : NULL;
+            rcode = appendNode(graph, node, fcl->output.array.charArray) || rcode;
+        }
+        else if (layer->type == CONVOLUTIONAL_LAYER)
+        {
+            struct CVL *cvl = &layer->layer.cvl;
+            node.op = GRAPH_CONV;
+            node.weight = cvl->kernels.array.charArray;
+            node.channel = cvl->inputs.channel;
+            node.height = cvl->inputs.height;
+            node.width = cvl->inputs.width;
+            node.multiplier = cvl->multiplier;
+            node.kernelSize = cvl->kernelSize;
+            node.stride = cvl->stride;
+            node.padding = cvl->padding;
+            node.algorithm = cvl->algorithm;
+            node.scratch = cvl->columns.array.charArray;
+            node.numIn = node.channel * node.height * node.width;
+            node.numOut = cvl->outputs.channel * cvl->outputs.height * cvl->outputs.width;
+            rcode = appendNode(graph, node, cvl->outputs.array.charArray) || rcode;
+        }
+        else
+        {
+            struct PL *pl = &layer->layer.pl;
+            node.op = GRAPH_POOL;
+            node.channel = pl->inputs.channel;
+            node.height = pl->inputs.height;
+            node.width = pl->inputs.width;
+            node.kernelSize = pl->kernelSize;
+            node.stride = pl->stride;
+            node.padding = pl->padding;
+            node.mode = pl->mode;
+            node.scratch = pl->rows.array.charArray;
+            node.numIn = node.channel * node.height * node.width;
+            node.numOut = pl->outputs.channel * pl->outputs.height * pl->outputs.width;
+            rcode = appendNode(graph, node, pl->outputs.array.charArray) || rcode;
+        }
+    }
+
+    return rcode;
+}
+
+static size_t readersOf(const Graph *graph, size_t tensor) // the caller reading the output counts as one
+{
+    size_t readers = tensor == graph->output;
+    for (size_t i = 0; i < graph->nodeNum; i++)
+        readers += graph->nodes[i].input == tensor;
+
+    return readers;
+}
+
+static struct GRAPH_NODE *producerOf(Graph *graph, size_t tensor)
+{
+    for (size_t i = 0; i < graph->nodeNum; i++)
+        if (graph->nodes[i].output == tensor)
+            return &graph->nodes[i];
+
+    return NULL;
+}
+
+static void dropNode(Graph *graph, size_t i) // whatever read its output reads its input instead
+{
+    size_t from = graph->nodes[i].output, to = graph->nodes[i].input;
+    for (size_t j = i + 1; j < graph->nodeNum; j++)
+        if (graph->nodes[j].input == from)
+            graph->nodes[j].input = to;
+    if (graph->output == from)
+        graph->output = to;
+
+    graph->nodeNum--;
+    memmove(&graph->nodes[i], &graph->nodes[i + 1], (graph->nodeNum - i) * sizeof(struct GRAPH_NODE));
+}
+
+Sts optimizeGraph(Graph *graph)
+{
+    if (!graph || !graph->nodes)
+        return ERROR;
+
+    // no work at all: a flatten is the same elements, ACTIVATION_NONE the same values
+    for (size_t i = 0; i < graph->nodeNum;)
+    {
+        struct GRAPH_NODE *node = &graph->nodes[i];
+        if (node->op == GRAPH_FLATTEN || (node->op == GRAPH_ACTIVATE && node->activation == ACTIVATION_NONE))
+            dropNode(graph, i);
+        else
+            i++;
+    }
+
+    /*
+    Into the epilogue of a gemm: a bias, then an activation, when the gemm is all that writes their input and
+    they are all that reads it. The order of the epilogue is bias then activation, so an activation folded
+    first keeps out a bias after it. A custom activation stays a node of its own.
+    */
+    for (size_t i = 0; i < graph->nodeNum;)
+    {
+        struct GRAPH_NODE *node = &graph->nodes[i], *producer = producerOf(graph, node->input);
+        int single = producer && readersOf(graph, node->input) == 1;
+        if (single && producer->op == GRAPH_GEMM && node->op == GRAPH_BIAS && !producer->bias &&
+            producer->activation == ACTIVATION_NONE)
+        {
+            producer->bias = node->bias;
+            dropNode(graph, i);
+        }
+        else if (single && producer->op == GRAPH_GEMM && node->op == GRAPH_ACTIVATE &&
+                 node->activation != ACTIVATION_CUSTOM && producer->activation == ACTIVATION_NONE)
+        {
+            producer->activation = node->activation;
+            dropNode(graph, i);
+        }
+        else
+            i++;
+    }
+
+    // an activation after a bias left alone, the row gets both while it's in cache
+    for (size_t i = 0; i < graph->nodeNum;)
+    {
+        struct GRAPH_NODE *node = &graph->nodes[i], *producer = producerOf(graph, node->input);
+        if (producer && readersOf(graph, node->input) == 1 && producer->op == GRAPH_BIAS &&
+            producer->activation == ACTIVATION_NONE && node->op == GRAPH_ACTIVATE &&
+            node->activation != ACTIVATION_CUSTOM)
+        {
+            producer->activation = node->activation;
+            dropNode(graph, i);
+        }
+        else
+            i++;
+    }
+
+    return OK;
+}
+
+Sts printGraph(const Graph *graph, FILE *file)
+{
+    if (!graph || !file)
+        return ERROR;
+
+    static const char *ops[] = {"gemm", "bias", "activate", "conv", "pool", "flatten"};
+    static const char *activations[] = {"none", "relu", "leaky relu", "sigmoid", "custom"};
+    static const char *algorithms[] = {"im2col", "winograd", "fft"};
+    fprintf(file, "%zu nodes, input t%zu, output t%zu\n", graph->nodeNum, graph->input, graph->output);
+    for (size_t i = 0; i < graph->nodeNum; i++)
+    {
+        const struct GRAPH_NODE *node = &graph->nodes[i];
+        fprintf(file, "%4zu  %-8s t%zu -> t%zu  %zu x %zu -> %zu", i, ops[node->op], node->input, node->output,
+                node->rows, node->numIn, node->numOut);
+        if (node->op == GRAPH_CONV || node->op == GRAPH_POOL)
+            fprintf(file, ", %zux%zu stride %zu padding %zu", node->kernelSize, node->kernelSize, node->stride,
+                    node->padding);
+        if (node->op == GRAPH_CONV)
+            fprintf(file, ", %s", algorithms[node->algorithm]);
+        if (node->op == GRAPH_POOL)
+            fprintf(file, ", %s", node->mode == POOLING_MAX ? "max" : "average");
+        if (node->op == GRAPH_GEMM && node->layer)
+            fprintf(file, ", packed");
+        if (node->op == GRAPH_GEMM && node->bias)
+            fprintf(file, ", bias");
+        if ((node->op == GRAPH_GEMM || node->op == GRAPH_BIAS || node->op == GRAPH_ACTIVATE) &&
+            (node->activation != ACTIVATION_NONE || node->op == GRAPH_ACTIVATE))
+            fprintf(file, ", %s", activations[node->activation]);
+        fprintf(file, "\n");
+    }
+
+    return OK;
+}
+
+Sts freeGraph(Graph *graph)
+{
+    if (!graph)
+        return ERROR;
+
+    free(graph->nodes);
+    free(graph->tensorLengths);
+    free(graph->tensorData);
+    memset(graph, 0, sizeof(Graph));
+
+    return OK;
+}
+
+Sts compilePlan(Plan *plan, const Graph *graph)
+{
+    if (!plan || !graph || !graph->nodes || !graph->tensorData)
+        return ERROR;
+
+    memset(plan, 0, sizeof(Plan));
+    plan->dtype = graph->dtype;
+    plan->batchSize = graph->batchSize;
+    plan->steps = (struct PLAN_STEP *)calloc(graph->nodeNum ? graph->nodeNum : 1, sizeof(struct PLAN_STEP));
+    if (!plan->steps)
+        return ERROR;
+
+    plan->stepNum = graph->nodeNum;
+    for (size_t s = 0; s < plan->stepNum; s++)
+    {
+        struct PLAN_STEP *step = &plan->steps[s];
+        step->node = graph->nodes[s];
+        step->input = graph->tensorData[step->node.input];
+        step->output = graph->tensorData[step->node.output];
+    }
+    plan->input = (Vec){.array.charArray = graph->tensorData[graph->input],
+                        .length = graph->tensorLengths[graph->input],
+                        .dtype = plan->dtype};
+    plan->output = (Vec){.array.charArray = graph->tensorData[graph->output],
+                         .length = graph->tensorLengths[graph->output],
+                         .dtype = plan->dtype};
+
+    return OK;
+}
+
+static void activateArray(Dtp dtype, Act activation, const char *x, char *y, size_t n)
+{
+    const Simd *simd = simdKernels();
+    double slope = activation == ACTIVATION_LEAKY_RELU ? LEAKY_RELU_SLOPE : 0;
+    if (activation == ACTIVATION_NONE)
+    {
+        if (x != y)
+            memcpy(y, x, n * sizeOfDataType(dtype));
+    }
+    else if (activation == ACTIVATION_SIGMOID && dtype == FLOAT_TYPE)
+        simd->sigmoidFloat((const float *)x, (float *)y, n);
+    else if (activation == ACTIVATION_SIGMOID)
+        simd->sigmoidDouble((const double *)x, (double *)y, n);
+    else if (dtype == FLOAT_TYPE)
+        simd->reluFloat((const float *)x, (float)slope, (float *)y, n);
+    else
+        simd->reluDouble((const double *)x, slope, (double *)y, n);
+}
+
+static Sts runStep(Dtp dtype, const struct PLAN_STEP *step)
+{
+    const struct GRAPH_NODE *node = &step->node;
+    const Simd *simd = simdKernels();
+    size_t size = sizeOfDataType(dtype);
+    int isFloat = dtype == FLOAT_TYPE;
+    Sts rcode = OK;
+
+    switch (node->op)
+    {
+    case GRAPH_GEMM: {
+        const void *packed = node->layer ? packedWeightFCL(node->layer) : NULL;
+        if (packed && isFloat)
+            rcode = gemmFloatPackedBiasAct(NO_TRANSPOSE, node->rows, node->numOut, node->numIn,
+                                           (const float *)step->input, node->numIn, (const float *)packed,
+                                           (const float *)node->bias, node->activation, (float *)step->output,
+                                           node->numOut, (float *)step->output, node->numOut);
+        else if (packed)
+            rcode = gemmDoublePackedBiasAct(NO_TRANSPOSE, node->rows, node->numOut, node->numIn,
+                                            (const double *)step->input, node->numIn, (const double *)packed,
+                                            (const double *)node->bias, node->activation, (double *)step->output,
+                                            node->numOut, (double *)step->output, node->numOut);
+        else if (isFloat)
+            rcode = gemmFloatBiasAct(NO_TRANSPOSE, TRANSPOSE, node->rows, node->numOut, node->numIn,
+                                     (const float *)step->input, node->numIn, (const float *)node->weight,
+                                     node->numIn, (const float *)node->bias, node->activation, (float *)step->output,
+                                     node->numOut, (float *)step->output, node->numOut);
+        else
+            rcode = gemmDoubleBiasAct(NO_TRANSPOSE, TRANSPOSE, node->rows, node->numOut, node->numIn,
+                                      (const double *)step->input, node->numIn, (const double *)node->weight,
+                                      node->numIn, (const double *)node->bias, node->activation,
+                                      (double *)step->output, node->numOut, (double *)step->output, node->numOut);
+        break;
+    }
+    case GRAPH_BIAS:
+        for (size_t r = 0; r < node->rows; r++)
+        {
+            const char *x = step->input + r * node->numOut * size;
+            char *y = step->output + r * node->numOut * size;
+            if (isFloat)
+                simd->addFloat((const float *)x, (const float *)node->bias, (float *)y, node->numOut);
+            else
+                simd->addDouble((const double *)x, (const double *)node->bias, (double *)y, node->numOut);
+            if (node->activation != ACTIVATION_NONE)
+                activateArray(dtype, node->activation, y, y, node->numOut);
+        }
+        break;
+    case GRAPH_ACTIVATE:
+        if (node->activation == ACTIVATION_CUSTOM)
+        {
+            // the one call through a pointer, the function the layer was built with
+            size_t n = node->rows * node->numOut;
+            Vec x = {.array.charArray = step->input, .length = n, .dtype = dtype};
+            Vec y = {.array.charArray = step->output, .length = n, .dtype = dtype};
+            rcode = node->activateFunction(&x, &y);
+        }
+        else
+            activateArray(dtype, node->activation, step->input, step->output, node->rows * node->numOut);
+        break;
+    case GRAPH_CONV:
+        // conv.h works on one image, the kernels are per channel so the batch can't be folded into the channels
+        for (size_t s = 0; rcode == OK && s < node->rows; s++)
+        {
+            const char *x = step->input + s * node->numIn * size;
+            char *y = step->output + s * node->numOut * size;
+            if (isFloat)
+                rcode = convolveFloat(node->algorithm, (const float *)x, node->channel, node->height, node->width,
+                                      (const float *)node->weight, node->multiplier, node->kernelSize, node->stride,
+                                      node->padding, (float *)node->scratch, (float *)y);
+            else
+                rcode = convolveDouble(node->algorithm, (const double *)x, node->channel, node->height, node->width,
+                                       (const double *)node->weight, node->multiplier, node->kernelSize,
+                                       node->stride, node->padding, (double *)node->scratch, (double *)y);
+        }
+        break;
+    case GRAPH_POOL:
+        if (isFloat)
+            rcode = poolingFloat((const float *)step->input, node->rows * node->channel, node->height, node->width,
+                                 node->kernelSize, node->stride, node->padding, node->mode, (float *)node->scratch,
+                                 (float *)step->output, NULL);
+        else
+            rcode = poolingDouble((const double *)step->input, node->rows * node->channel, node->height,
+                                  node->width, node->kernelSize, node->stride, node->padding, node->mode,
+                                  (double *)node->scratch, (double *)step->output, NULL);
+        break;
+    case GRAPH_FLATTEN:
+        break; // the same buffer, only the rows are read as samples after
+    }
+
+    return rcode;
+}
+
+Sts runPlan(Plan *plan)
+{
+    if (!plan || !plan->steps)
+        return ERROR;
+
+    PROFILE_BEGIN(profile, PROFILE_MODEL, __func__);
+    Sts rcode = OK;
+    for (size_t s = 0; rcode == OK && s < plan->stepNum; s++)
+        rcode = runStep(plan->dtype, &plan->steps[s]);
+    PROFILE_END(profile, 0, 0); // the kernels inside count the work
+
+    return rcode;
+}
+
+size_t planFootprint(const Plan *plan)
+{
+    return plan ? plan->stepNum * sizeof(struct PLAN_STEP) : 0;
+}
+
+Sts freePlan(Plan *plan)
+{
+    if (!plan)
+        return ERROR;
+
+    free(plan->steps);
+    memset(plan, 0, sizeof(Plan));
+
+    return OK;
+}
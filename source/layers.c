@@ -1,36 +1,84 @@
 #include "layers.h"
+#include "conv.h"
+#include "gemm.h"
+#include "profile.h"
+#include "simd.h"
 #include <stdio.h>
+#include <string.h>
 
-Sts initFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, Sts (*activateFunction)(Input *, Output *),
-            Sts (*activateFunction_derivative)(Input *, Derv *))
+// storage from the arena when there is one, from the heap otherwise
+static Sts initVecOfType(Arena *arena, Vec *vec, size_t length, Dtp dtype, double cell)
 {
+    if (arena)
+        return initArenaVec(arena, vec, length, dtype, cell);
 
-    if (!fcl)
+    if (dtype == CHAR_TYPE) // the base functions only make float and double vectors
+    {
+        *vec = (Vec){.array.charArray = (char *)malloc(length), .length = length, .dtype = CHAR_TYPE};
+        return vec->array.charArray ? resetVecValue(vec, cell) : ERROR;
+    }
+
+    return dtype == FLOAT_TYPE ? initFloatVec(vec, length, cell) : initDoubleVec(vec, length, cell);
+}
+
+static Sts initMatOfType(Arena *arena, Mat *mat, size_t row, size_t col, Dtp dtype, double cell)
+{
+    if (arena)
+        return initArenaMat(arena, mat, row, col, dtype, cell);
+
+    return dtype == FLOAT_TYPE ? initFloatMat(mat, row, col, cell) : initDoubleMat(mat, row, col, cell);
+}
+
+static Sts initMtsOfType(Arena *arena, Mts *mts, size_t channel, size_t height, size_t width, Dtp dtype, double cell)
+{
+    if (arena)
+        return initArenaMts(arena, mts, channel, height, width, dtype, cell);
+
+    return dtype == FLOAT_TYPE ? initFloatMts(mts, channel, height, width, cell)
+                               : initDoubleMts(mts, channel, height, width, cell);
+}
+
+// inference leaves out every gradient buffer, and linearTrans unless the activation needs it
+static Sts initFCLOfType(struct FCL *fcl, Arena *arena, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize,
+                         Dtp dtype, Sts (*activateFunction)(Input *, Output *),
+                         Sts (*activateFunction_derivative)(Input *, Derv *), int inference)
+{
+
+    if (!fcl || batchSize == 0 || (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
         return ERROR;
 
+    memset(fcl, 0, sizeof(struct FCL)); // so the error path only frees what was really allocated
+
+    fcl->batchSize = batchSize;
+    fcl->neuronNumIn = neuronNumIn;
+    fcl->neuronNumOut = neuronNumOut;
     fcl->activateFunction = activateFunction;
     fcl->activateFunction_derivative = activateFunction_derivative;
+    fcl->activation = activationOf(activateFunction, activateFunction_derivative);
+    fcl->inference = inference;
     Sts rcode = OK;
 
-    // init input neurons linearTrans and output neurons
-    rcode = initDoubleVec(&fcl->input, neuronNumIn, 0) || rcode;
-    rcode = initDoubleVec(&fcl->linearTrans, neuronNumOut, 0) || rcode;
-    rcode = initDoubleVec(&fcl->output, neuronNumOut, 0) || rcode;
-
-    // init the derivatives of activate function, i.e. dervOfActivateFunc
-    rcode = initDoubleVec(&fcl->dervOfActivateFunc, neuronNumOut, 0) || rcode;
+    // init input neurons linearTrans and output neurons, one row per sample
+    rcode = initVecOfType(arena, &fcl->input, batchSize * neuronNumIn, dtype, 0) || rcode;
+    if (!inference || fcl->activation == ACTIVATION_CUSTOM)
+        rcode = initVecOfType(arena, &fcl->linearTrans, batchSize * neuronNumOut, dtype, 0) || rcode;
+    rcode = initVecOfType(arena, &fcl->output, batchSize * neuronNumOut, dtype, 0) || rcode;
 
-    // init bias and it's derv
-    rcode = initDoubleVec(&fcl->bias, neuronNumOut, 0) || rcode;
-    rcode = initDoubleVec(&fcl->dervOfBias, neuronNumOut, 0) || rcode;
-    rcode = initDoubleVec(&fcl->dervFromLastLayer, neuronNumOut, 0) || rcode;
-    rcode = initDoubleVec(&fcl->dervToPreviousLayer, neuronNumIn, 0) || rcode;
+    // init bias and weight
+    rcode = initVecOfType(arena, &fcl->bias, neuronNumOut, dtype, 0) || rcode;
+    rcode = initMatOfType(arena, &fcl->weight, neuronNumOut, neuronNumIn, dtype, 1) || rcode;
 
-    // init weight and it's derv
-    rcode = initDoubleMat(&fcl->weight, neuronNumOut, neuronNumIn, 1) || rcode;
-    rcode = initDoubleMat(&fcl->dervOfWeight, neuronNumOut, neuronNumIn, 0) || rcode;
+    // init the derivatives of activate function, bias, weight, and the ones between the layers
+    if (!inference)
+    {
+        rcode = initVecOfType(arena, &fcl->dervOfActivateFunc, batchSize * neuronNumOut, dtype, 0) || rcode;
+        rcode = initVecOfType(arena, &fcl->dervOfBias, neuronNumOut, dtype, 0) || rcode;
+        rcode = initVecOfType(arena, &fcl->dervFromLastLayer, batchSize * neuronNumOut, dtype, 0) || rcode;
+        rcode = initVecOfType(arena, &fcl->dervToPreviousLayer, batchSize * neuronNumIn, dtype, 0) || rcode;
+        rcode = initMatOfType(arena, &fcl->dervOfWeight, neuronNumOut, neuronNumIn, dtype, 0) || rcode;
+    }
 
-    if (rcode == ERROR)
+    if (rcode == ERROR && !arena)
     {
         free(fcl->input.array.doubleArray);
         free(fcl->output.array.doubleArray);
@@ -41,10 +89,139 @@ Sts initFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, Sts (*acti
         free(fcl->dervFromLastLayer.array.doubleArray);
         free(fcl->linearTrans.array.doubleArray);
         free(fcl->dervToPreviousLayer.array.doubleArray);
+        free(fcl->dervOfActivateFunc.array.doubleArray);
+    }
+
+    return rcode;
+}
 
+Sts initFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, Sts (*activateFunction)(Input *, Output *),
+            Sts (*activateFunction_derivative)(Input *, Derv *))
+{
+    return initBatchFCL(fcl, neuronNumIn, neuronNumOut, 1, activateFunction, activateFunction_derivative);
+}
+
+Sts initBatchFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize,
+                 Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *))
+{
+    return initFCLOfType(fcl, NULL, neuronNumIn, neuronNumOut, batchSize, DOUBLE_TYPE, activateFunction,
+                         activateFunction_derivative, 0);
+}
+
+Sts initFloatFCL(struct FCL *fcl, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize,
+                 Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *))
+{
+    return initFCLOfType(fcl, NULL, neuronNumIn, neuronNumOut, batchSize, FLOAT_TYPE, activateFunction,
+                         activateFunction_derivative, 0);
+}
+
+Sts initArenaFCL(struct FCL *fcl, Arena *arena, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize, Dtp dtype,
+                 Sts (*activateFunction)(Input *, Output *), Sts (*activateFunction_derivative)(Input *, Derv *))
+{
+    if (!arena)
         return ERROR;
+
+    return initFCLOfType(fcl, arena, neuronNumIn, neuronNumOut, batchSize, dtype, activateFunction,
+                         activateFunction_derivative, 0);
+}
+
+Sts initInferenceFCL(struct FCL *fcl, Arena *arena, size_t neuronNumIn, size_t neuronNumOut, size_t batchSize,
+                     Dtp dtype, Sts (*activateFunction)(Input *, Output *),
+                     Sts (*activateFunction_derivative)(Input *, Derv *))
+{
+    return initFCLOfType(fcl, arena, neuronNumIn, neuronNumOut, batchSize, dtype, activateFunction,
+                         activateFunction_derivative, 1);
+}
+
+size_t sizeofFCL(size_t neuronNumIn, size_t neuronNumOut, size_t batchSize, Dtp dtype)
+{
+    size_t size = sizeOfDataType(dtype);
+
+    // the ten buffers of initFCLOfType, each padded to the arena alignment
+    return arenaAlignedSize(batchSize * neuronNumIn * size) * 2 +  // input, dervToPreviousLayer
+           arenaAlignedSize(batchSize * neuronNumOut * size) * 4 + // linearTrans, output and the two output grads
+           arenaAlignedSize(neuronNumOut * size) * 2 +             // bias, dervOfBias
+           arenaAlignedSize(neuronNumOut * neuronNumIn * size) * 2; // weight, dervOfWeight
+}
+
+size_t sizeofInferenceFCL(size_t neuronNumIn, size_t neuronNumOut, size_t batchSize, Act activation, Dtp dtype)
+{
+    size_t size = sizeOfDataType(dtype);
+    size_t outputs = activation == ACTIVATION_CUSTOM ? 2 : 1; // output, and linearTrans for a custom activation
+
+    return arenaAlignedSize(batchSize * neuronNumIn * size) +
+           arenaAlignedSize(batchSize * neuronNumOut * size) * outputs + arenaAlignedSize(neuronNumOut * size) +
+           arenaAlignedSize(neuronNumOut * neuronNumIn * size);
+}
+
+Sts prepareFCL(struct FCL *fcl, Arena *arena)
+{
+    if (!fcl || !fcl->weight.array.charArray)
+        return ERROR;
+
+    Dtp dtype = fcl->weight.dtype;
+    size_t length = gemmPackedLength(fcl->neuronNumIn, fcl->neuronNumOut, dtype);
+    if (!fcl->packedWeight.array.charArray || fcl->packedWeight.length != length ||
+        fcl->packedWeight.dtype != dtype)
+    {
+        if (initVecOfType(arena, &fcl->packedWeight, length, dtype, 0) == ERROR)
+        {
+            fcl->packedWeight = (Vec){0};
+            return ERROR;
+        }
+    }
+    fcl->packedVersion = fcl->weightVersion + 1; // stale, packed right below
+
+    return packedWeightFCL(fcl) ? OK : ERROR;
+}
+
+size_t sizeofPreparedFCL(size_t neuronNumIn, size_t neuronNumOut, Dtp dtype)
+{
+    return arenaAlignedSize(gemmPackedLength(neuronNumIn, neuronNumOut, dtype) * sizeOfDataType(dtype));
+}
+
+const void *packedWeightFCL(struct FCL *fcl)
+{
+    if (!fcl || !fcl->packedWeight.array.charArray)
+        return NULL;
+
+    // op(B) of the forward product is W^T, numIn x numOut
+    if (fcl->packedVersion != fcl->weightVersion)
+    {
+        size_t numIn = fcl->neuronNumIn, numOut = fcl->neuronNumOut;
+        Sts rcode = fcl->weight.dtype == FLOAT_TYPE
+                        ? gemmFloatPackB(TRANSPOSE, numIn, numOut, fcl->weight.array.floatArray, numIn,
+                                         fcl->packedWeight.array.floatArray)
+                        : gemmDoublePackB(TRANSPOSE, numIn, numOut, fcl->weight.array.doubleMatrix, numIn,
+                                          fcl->packedWeight.array.doubleArray);
+        if (rcode == ERROR)
+            return NULL;
+        fcl->packedVersion = fcl->weightVersion;
     }
 
+    return fcl->packedWeight.array.charArray;
+}
+
+Sts setWeightFCL(struct FCL *fcl, const Mat *weight)
+{
+    if (!fcl || !weight || !fcl->weight.array.charArray || !weight->array.charArray ||
+        weight->row != fcl->weight.row || weight->col != fcl->weight.col || weight->dtype != fcl->weight.dtype)
+        return ERROR;
+
+    memcpy(fcl->weight.array.charArray, weight->array.charArray,
+           weight->row * weight->col * sizeOfDataType(weight->dtype));
+    fcl->weightVersion++;
+
+    return OK;
+}
+
+Sts weightWrittenFCL(struct FCL *fcl)
+{
+    if (!fcl)
+        return ERROR;
+
+    fcl->weightVersion++;
+
     return OK;
 }
 
@@ -53,89 +230,338 @@ Sts forwardFCL(struct FCL *fcl)
     if (!fcl)
         return ERROR;
 
-    size_t numIn = fcl->input.length, numOut = fcl->output.length;
+    size_t batch = fcl->batchSize, numIn = fcl->neuronNumIn, numOut = fcl->neuronNumOut;
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
 
+    /*
+    Y = X W^T + b with every row getting the same bias, one sample per row.
+    A fused activation is applied while the tiles of Y are still in cache and writes straight to output,
+    a custom one needs Y in linearTrans first.
+    */
     Sts rcode = OK;
-    // bind input with m1, linearTrans with m2 for computes
-    rcode = vecTransMat(&fcl->input, &fcl->m1, numIn, 1) || rcode;
-    rcode = vecTransMat(&fcl->linearTrans, &fcl->m2, numOut, 1) || rcode;
-
-    // y = Wx + b
-    rcode = crossProductDoubleMatrix(&fcl->weight, &fcl->m1, &fcl->m2) || rcode;
-    rcode = addDoubleVector(&fcl->linearTrans, &fcl->bias, &fcl->linearTrans) || rcode;
+    Act activation = fcl->activation;
+    const void *packed = packedWeightFCL(fcl); // a prepared layer skips packing the weights
+    if (fcl->weight.dtype == FLOAT_TYPE)
+    {
+        float *y = activation == ACTIVATION_CUSTOM ? fcl->linearTrans.array.floatArray : fcl->output.array.floatArray;
+        if (packed)
+            rcode = gemmFloatPackedBiasAct(NO_TRANSPOSE, batch, numOut, numIn, fcl->input.array.floatArray, numIn,
+                                           (const float *)packed, fcl->bias.array.floatArray, activation, y, numOut,
+                                           fcl->output.array.floatArray, numOut) ||
+                    rcode;
+        else
+            rcode = gemmFloatBiasAct(NO_TRANSPOSE, TRANSPOSE, batch, numOut, numIn, fcl->input.array.floatArray,
+                                     numIn, fcl->weight.array.floatArray, numIn, fcl->bias.array.floatArray,
+                                     activation, y, numOut, fcl->output.array.floatArray, numOut) ||
+                    rcode;
+    }
+    else
+    {
+        double *y =
+            activation == ACTIVATION_CUSTOM ? fcl->linearTrans.array.doubleArray : fcl->output.array.doubleArray;
+        if (packed)
+            rcode = gemmDoublePackedBiasAct(NO_TRANSPOSE, batch, numOut, numIn, fcl->input.array.doubleArray, numIn,
+                                            (const double *)packed, fcl->bias.array.doubleArray, activation, y,
+                                            numOut, fcl->output.array.doubleArray, numOut) ||
+                    rcode;
+        else
+            rcode = gemmDoubleBiasAct(NO_TRANSPOSE, TRANSPOSE, batch, numOut, numIn, fcl->input.array.doubleArray,
+                                      numIn, fcl->weight.array.doubleMatrix, numIn, fcl->bias.array.doubleArray,
+                                      activation, y, numOut, fcl->output.array.doubleArray, numOut) ||
+                    rcode;
+    }
+    if (rcode == ERROR)
+        return ERROR;
 
-    // output = act(y)
-    rcode = fcl->activateFunction(&fcl->linearTrans, &fcl->output) || rcode;
+    // output = act(y), element-wise so the whole batch goes at once
+    if (activation == ACTIVATION_CUSTOM)
+        rcode = fcl->activateFunction(&fcl->linearTrans, &fcl->output) || rcode;
 
     if (rcode == ERROR)
         return ERROR;
 
+    PROFILE_END(profile, 2.0 * batch * numIn * numOut,
+                sizeOfDataType(fcl->weight.dtype) * (batch * numIn + numOut * numIn + numOut + batch * numOut));
     return OK;
 }
 
-Sts backwardFCL(struct FCL *fcl, double lr)
+// dL/dY = dervFromLastLayer * act'(Y), in one pass from the output for the fused activations
+static Sts deltaOfFCL(struct FCL *fcl, Derv **delta)
 {
-    if (!fcl)
+    const Simd *simd = simdKernels();
+    Derv *dy = &fcl->dervFromLastLayer, *dz = &fcl->dervOfActivateFunc;
+    int isFloat = fcl->weight.dtype == FLOAT_TYPE;
+    size_t n = dz->length;
+    Sts rcode = OK;
+
+    *delta = dz;
+    switch (fcl->activation)
+    {
+    case ACTIVATION_NONE:
+        *delta = dy; // nothing to multiply, dL/dY is what the next layer sent
+        break;
+    case ACTIVATION_RELU:
+    case ACTIVATION_LEAKY_RELU: // the output has the sign of Y, so it picks the branch as well
+        if (isFloat)
+            simd->reluBackwardFloat(fcl->output.array.floatArray, fcl->activation == ACTIVATION_RELU ? 0 : (float)LEAKY_RELU_SLOPE,
+                                    dy->array.floatArray, dz->array.floatArray, n);
+        else
+            simd->reluBackwardDouble(fcl->output.array.doubleArray, fcl->activation == ACTIVATION_RELU ? 0 : LEAKY_RELU_SLOPE,
+                                     dy->array.doubleArray, dz->array.doubleArray, n);
+        break;
+    case ACTIVATION_SIGMOID:
+        if (isFloat)
+            simd->sigmoidBackwardFloat(fcl->output.array.floatArray, dy->array.floatArray, dz->array.floatArray, n);
+        else
+            simd->sigmoidBackwardDouble(fcl->output.array.doubleArray, dy->array.doubleArray, dz->array.doubleArray,
+                                        n);
+        break;
+    default:
+        // get the derivatives of activate function, then multiple the derv from last layer in place
+        rcode = fcl->activateFunction_derivative(&fcl->linearTrans, dz) || rcode;
+        if (isFloat)
+            rcode = mulFloatVector(dy, dz, dz) || rcode;
+        else
+            rcode = mulDoubleVector(dy, dz, dz) || rcode;
+        break;
+    }
+
+    return rcode;
+}
+
+Sts gradFCL(struct FCL *fcl)
+{
+    if (!fcl || fcl->inference)
         return ERROR;
 
-    size_t numIn = fcl->input.length, numOut = fcl->output.length;
+    size_t batch = fcl->batchSize, numIn = fcl->neuronNumIn, numOut = fcl->neuronNumOut;
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
 
     Sts rcode = OK;
-    // get the derivatives of activate function
-    // multiple the derv from last layer and the derv of activate function and save in the dervOfBias
-    rcode = fcl->activateFunction_derivative(&fcl->linearTrans, &fcl->dervOfActivateFunc) || rcode;
-    rcode = mulDoubleVector(&fcl->dervFromLastLayer, &fcl->dervOfActivateFunc, &fcl->dervOfBias) || rcode;
-
-    // dervOfActivateFun put in to m1 and x^T put it in to m2 (dervOfWeight = dervOfActivateFun x X^T)
-    rcode = vecTransMat(&fcl->dervOfBias, &fcl->m1, numOut, 1) || rcode;
-    rcode = vecTransMat(&fcl->input, &fcl->m2, 1, numIn) || rcode;
-    rcode = crossProductDoubleMatrix(&fcl->m1, &fcl->m2, &fcl->dervOfWeight) || rcode;
-
-    // dervOfBias put into m1 and use dervOfBias left cross product weight
-    // put dervToPreviousLayer to m2 to be the result
-    rcode = vecTransMat(&fcl->dervOfBias, &fcl->m1, 1, numOut) || rcode;
-    rcode = vecTransMat(&fcl->dervToPreviousLayer, &fcl->m2, 1, numIn) || rcode;
-    rcode = crossProductDoubleMatrix(&fcl->m1, &fcl->weight, &fcl->m2) || rcode;
-
-    // start optimizing weight matrix and bias vector
-    rcode = optimizeDoubleVec(&fcl->bias, &fcl->dervOfBias, lr) || rcode;
-    rcode = optimizeDoubleMat(&fcl->weight, &fcl->dervOfWeight, lr) || rcode;
+    Derv *delta = NULL; // dL/dY
+    if (deltaOfFCL(fcl, &delta) == ERROR)
+        return ERROR;
+
+    // the batch as matrices, one sample per row, (dL/dY)^T reads the same storage down its columns
+    View dy, dyT, x, w, dw, dx;
+    rcode = viewOfVec(delta, 2, (size_t[]){batch, numOut}, &dy) || rcode;
+    rcode = viewTranspose(&dy, 0, 1, &dyT) || rcode;
+    rcode = viewOfVec(&fcl->input, 2, (size_t[]){batch, numIn}, &x) || rcode;
+    rcode = viewOfMat(&fcl->weight, &w) || rcode;
+    rcode = viewOfMat(&fcl->dervOfWeight, &dw) || rcode;
+    rcode = viewOfVec(&fcl->dervToPreviousLayer, 2, (size_t[]){batch, numIn}, &dx) || rcode;
+    if (rcode == ERROR)
+        return ERROR;
+
+    const Simd *simd = simdKernels();
+    if (fcl->weight.dtype == FLOAT_TYPE)
+    {
+        // dervOfBias = sum of the rows of dL/dY
+        float *dy = delta->array.floatArray, *dervOfBias = fcl->dervOfBias.array.floatArray;
+        simd->scaleFloat(1, dy, dervOfBias, numOut);
+        for (size_t i = 1; i < batch; i++)
+            simd->addFloat(dervOfBias, dy + i * numOut, dervOfBias, numOut);
+    }
+    else
+    {
+        double *dy = delta->array.doubleArray, *dervOfBias = fcl->dervOfBias.array.doubleArray;
+        simd->scaleDouble(1, dy, dervOfBias, numOut);
+        for (size_t i = 1; i < batch; i++)
+            simd->addDouble(dervOfBias, dy + i * numOut, dervOfBias, numOut);
+    }
+
+    // dervOfWeight = (dL/dY)^T X, the product sums over the batch, then dervToPreviousLayer = (dL/dY) W
+    rcode = gemmView(1, &dyT, &x, 0, &dw) || rcode;
+    rcode = gemmView(1, &dy, &w, 0, &dx) || rcode;
 
     if (rcode == ERROR)
         return ERROR;
 
+    // the two products and the bias, dL/dY and X are read, dL/dW, W and dL/dX go through
+    PROFILE_END(profile, 4.0 * batch * numIn * numOut + (double)batch * numOut,
+                sizeOfDataType(fcl->weight.dtype) * (batch * numOut + 2 * batch * numIn + 2 * numOut * numIn + numOut));
     return OK;
 }
 
-Sts initCVL(struct CVL *cvl, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize)
+Sts stepFCL(struct FCL *fcl, double lr)
 {
-    if (!cvl)
+    Optimizer sgd;
+    if (initOptimizer(&sgd, OPTIMIZER_SGD, lr) == ERROR)
+        return ERROR;
+
+    return optimizeFCL(fcl, &sgd);
+}
+
+Sts initOptimizerFCL(struct FCL *fcl, Arena *arena, const Optimizer *optimizer)
+{
+    if (!fcl || !arena || !optimizer || fcl->inference)
         return ERROR;
 
-    size_t rowOut = rowIn - kernelSize, colOut = colIn - kernelSize;
     Sts rcode = OK;
-    rcode = initDoubleMts(&cvl->inputs, channelIn, rowIn, colIn, 0) || rcode;
-    rcode = initDoubleMts(&cvl->outputs, channelIn, rowOut, colOut, 0) || rcode;
-    rcode = initDoubleMts(&cvl->kernels, channelIn, kernelSize, kernelSize, 1) || rcode;
-    rcode = initDoubleMts(&cvl->dervsFromLastLayer, channelIn, rowOut, colOut, 0) || rcode;
-    rcode = initDoubleMts(&cvl->dervsToPreviousLayer, channelIn, rowIn, colIn, 0) || rcode;
-    rcode = initDoubleMts(&cvl->dervsOfKernels, channelIn, kernelSize, kernelSize, 0) || rcode;
+    Dtp dtype = fcl->weight.dtype;
+    rcode = initOptimizerState(optimizer, arena, fcl->stateOfWeight, fcl->neuronNumOut * fcl->neuronNumIn, dtype) ||
+            rcode;
+    rcode = initOptimizerState(optimizer, arena, fcl->stateOfBias, fcl->neuronNumOut, dtype) || rcode;
+
+    return rcode;
+}
 
+size_t sizeofOptimizerFCL(size_t neuronNumIn, size_t neuronNumOut, const Optimizer *optimizer, Dtp dtype)
+{
+    return sizeofOptimizerState(optimizer, neuronNumOut * neuronNumIn, dtype) +
+           sizeofOptimizerState(optimizer, neuronNumOut, dtype);
+}
+
+Sts optimizeFCL(struct FCL *fcl, const Optimizer *optimizer)
+{
+    if (!fcl || fcl->batchSize == 0 || fcl->inference)
+        return ERROR;
+
+    Vec weight, dervOfWeight;
+    Sts rcode = OK;
+    rcode = matTransVec(&fcl->weight, &weight) || rcode;
+    rcode = matTransVec(&fcl->dervOfWeight, &dervOfWeight) || rcode;
     if (rcode == ERROR)
-    {
-        free(&cvl->inputs.array.doubelMatrixStack);
-        free(&cvl->outputs.array.doubelMatrixStack);
-        free(&cvl->kernels.array.doubelMatrixStack);
-        free(&cvl->dervsFromLastLayer.array.doubelMatrixStack);
-        free(&cvl->dervsToPreviousLayer.array.doubelMatrixStack);
-        free(&cvl->dervsOfKernels.array.doubelMatrixStack);
+        return ERROR;
+
+    // the gradients are summed over the batch, the optimizer takes their mean
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    double gradScale = 1.0 / fcl->batchSize;
+    rcode = optimizerUpdate(optimizer, &fcl->bias, &fcl->dervOfBias, fcl->stateOfBias, gradScale) || rcode;
+    rcode = optimizerUpdate(optimizer, &weight, &dervOfWeight, fcl->stateOfWeight, gradScale) || rcode;
+    fcl->weightVersion++;
+    PROFILE_END(profile, 0, 0); // optimizerUpdate counts the work
 
+    if (rcode == ERROR)
         return ERROR;
-    }
 
     return OK;
 }
 
+Sts backwardFCL(struct FCL *fcl, double lr)
+{
+    if (gradFCL(fcl) == ERROR)
+        return ERROR;
+
+    return stepFCL(fcl, lr);
+}
+
+static Sts initCVLOfType(struct CVL *cvl, Arena *arena, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize,
+                         size_t multiplier, size_t stride, size_t padding, Dtp dtype, int inference)
+{
+    size_t rowOut = convOutSize(rowIn, kernelSize, stride, padding);
+    size_t colOut = convOutSize(colIn, kernelSize, stride, padding);
+    if (!cvl || multiplier == 0 || rowOut == 0 || colOut == 0 || (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
+        return ERROR;
+
+    memset(cvl, 0, sizeof(struct CVL));
+
+    cvl->multiplier = multiplier;
+    cvl->kernelSize = kernelSize;
+    cvl->stride = stride;
+    cvl->padding = padding;
+    cvl->inference = inference;
+    cvl->algorithm =
+        convChooseAlgorithm(channelIn, rowIn, colIn, multiplier, kernelSize, stride, padding, dtype, inference);
+
+    size_t channelOut = channelIn * multiplier;
+    Sts rcode = OK;
+    rcode = initMtsOfType(arena, &cvl->inputs, channelIn, rowIn, colIn, dtype, 0) || rcode;
+    rcode = initMtsOfType(arena, &cvl->outputs, channelOut, rowOut, colOut, dtype, 0) || rcode;
+    rcode = initMtsOfType(arena, &cvl->kernels, channelOut, kernelSize, kernelSize, dtype, 1) || rcode;
+    if (!inference)
+    {
+        rcode = initMtsOfType(arena, &cvl->dervsFromLastLayer, channelOut, rowOut, colOut, dtype, 0) || rcode;
+        rcode = initMtsOfType(arena, &cvl->dervsToPreviousLayer, channelIn, rowIn, colIn, dtype, 0) || rcode;
+        rcode = initMtsOfType(arena, &cvl->dervsOfKernels, channelOut, kernelSize, kernelSize, dtype, 0) || rcode;
+    }
+    size_t columnsLength =
+        columnsLengthCVL(channelIn, rowIn, colIn, kernelSize, multiplier, stride, padding, dtype, inference);
+    rcode = initVecOfType(arena, &cvl->columns, columnsLength, dtype, 0) || rcode;
+
+    if (rcode == ERROR && !arena)
+    {
+        free(cvl->inputs.array.doubelMatrixStack);
+        free(cvl->outputs.array.doubelMatrixStack);
+        free(cvl->kernels.array.doubelMatrixStack);
+        free(cvl->dervsFromLastLayer.array.doubelMatrixStack);
+        free(cvl->dervsToPreviousLayer.array.doubelMatrixStack);
+        free(cvl->dervsOfKernels.array.doubelMatrixStack);
+        free(cvl->columns.array.doubleArray);
+    }
+
+    return rcode;
+}
+
+Sts initCVL(struct CVL *cvl, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize)
+{
+    return initCVLOfType(cvl, NULL, channelIn, rowIn, colIn, kernelSize, 1, 1, 0, DOUBLE_TYPE, 0);
+}
+
+Sts initFloatCVL(struct CVL *cvl, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize)
+{
+    return initCVLOfType(cvl, NULL, channelIn, rowIn, colIn, kernelSize, 1, 1, 0, FLOAT_TYPE, 0);
+}
+
+Sts initStridedCVL(struct CVL *cvl, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                   size_t stride, size_t padding, Dtp dtype)
+{
+    return initCVLOfType(cvl, NULL, channelIn, rowIn, colIn, kernelSize, multiplier, stride, padding, dtype, 0);
+}
+
+Sts initArenaCVL(struct CVL *cvl, Arena *arena, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize,
+                 size_t multiplier, size_t stride, size_t padding, Dtp dtype)
+{
+    if (!arena)
+        return ERROR;
+
+    return initCVLOfType(cvl, arena, channelIn, rowIn, colIn, kernelSize, multiplier, stride, padding, dtype, 0);
+}
+
+Sts initInferenceCVL(struct CVL *cvl, Arena *arena, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize,
+                     size_t multiplier, size_t stride, size_t padding, Dtp dtype)
+{
+    return initCVLOfType(cvl, arena, channelIn, rowIn, colIn, kernelSize, multiplier, stride, padding, dtype, 1);
+}
+
+size_t sizeofCVL(size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier, size_t stride,
+                 size_t padding, Dtp dtype)
+{
+    size_t size = sizeOfDataType(dtype), channelOut = channelIn * multiplier;
+    size_t outSize = convOutSize(rowIn, kernelSize, stride, padding) * convOutSize(colIn, kernelSize, stride, padding);
+    size_t columnsLength = columnsLengthCVL(channelIn, rowIn, colIn, kernelSize, multiplier, stride, padding, dtype, 0);
+
+    // the seven buffers of initCVLOfType, each padded to the arena alignment
+    return arenaAlignedSize(channelIn * rowIn * colIn * size) * 2 +            // inputs, dervsToPreviousLayer
+           arenaAlignedSize(channelOut * outSize * size) * 2 +                 // outputs, dervsFromLastLayer
+           arenaAlignedSize(channelOut * kernelSize * kernelSize * size) * 2 + // kernels, dervsOfKernels
+           arenaAlignedSize(columnsLength * size);                             // columns
+}
+
+size_t sizeofInferenceCVL(size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                          size_t stride, size_t padding, Dtp dtype)
+{
+    size_t size = sizeOfDataType(dtype), channelOut = channelIn * multiplier;
+    size_t outSize = convOutSize(rowIn, kernelSize, stride, padding) * convOutSize(colIn, kernelSize, stride, padding);
+    size_t columnsLength = columnsLengthCVL(channelIn, rowIn, colIn, kernelSize, multiplier, stride, padding, dtype, 1);
+
+    return arenaAlignedSize(channelIn * rowIn * colIn * size) + arenaAlignedSize(channelOut * outSize * size) +
+           arenaAlignedSize(channelOut * kernelSize * kernelSize * size) + arenaAlignedSize(columnsLength * size);
+}
+
+size_t columnsLengthCVL(size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                        size_t stride, size_t padding, Dtp dtype, int inference)
+{
+    Cva algorithm =
+        convChooseAlgorithm(channelIn, rowIn, colIn, multiplier, kernelSize, stride, padding, dtype, inference);
+    size_t workspace =
+        convWorkspaceLength(algorithm, channelIn, rowIn, colIn, multiplier, kernelSize, stride, padding);
+    size_t unfolded =
+        convWorkspaceLength(CONV_IM2COL, channelIn, rowIn, colIn, multiplier, kernelSize, stride, padding);
+
+    return inference || workspace > unfolded ? workspace : unfolded;
+}
+
 Sts forwardCVL(struct CVL *cvl)
 {
     if (!cvl)
@@ -143,36 +569,425 @@ Sts forwardCVL(struct CVL *cvl)
 
     Mts *inputs = &cvl->inputs, *outputs = &cvl->outputs, *kernels = &cvl->kernels;
 
+    if (inputs->dtype != outputs->dtype || inputs->dtype != kernels->dtype || inputs->dtype != cvl->columns.dtype)
+        return ERROR;
+
+    size_t workspace = convWorkspaceLength(cvl->algorithm, inputs->channel, inputs->height, inputs->width,
+                                           cvl->multiplier, cvl->kernelSize, cvl->stride, cvl->padding);
+    if (workspace == 0 || cvl->columns.length < workspace)
+        return ERROR;
+
+    // im2col unfolds every channel and multiplies it with its kernels in one gemm, the others leave no columns
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    Sts rcode;
+    if (inputs->dtype == FLOAT_TYPE)
+        rcode = convolveFloat(cvl->algorithm, inputs->array.floatArray, inputs->channel, inputs->height,
+                              inputs->width, kernels->array.floatArray, cvl->multiplier, cvl->kernelSize, cvl->stride,
+                              cvl->padding, cvl->columns.array.floatArray, outputs->array.floatArray);
+    else
+        rcode = convolveDouble(cvl->algorithm, inputs->array.doubelMatrixStack, inputs->channel, inputs->height,
+                               inputs->width, kernels->array.doubelMatrixStack, cvl->multiplier, cvl->kernelSize,
+                               cvl->stride, cvl->padding, cvl->columns.array.doubleArray,
+                               outputs->array.doubelMatrixStack);
+    PROFILE_END(profile, 0, 0); // the convolution kernel counts the work
+
+    return rcode;
+}
+
+Sts gradCVL(struct CVL *cvl)
+{
+    if (!cvl || cvl->inference)
+        return ERROR;
+
+    Mts *inputs = &cvl->inputs, *kernels = &cvl->kernels, *dervsOfKernels = &cvl->dervsOfKernels;
+    Mts *dervsFromLastLayer = &cvl->dervsFromLastLayer, *dervsToPreviousLayer = &cvl->dervsToPreviousLayer;
+
+    if (inputs->dtype != kernels->dtype || inputs->dtype != dervsFromLastLayer->dtype ||
+        inputs->dtype != dervsOfKernels->dtype || inputs->dtype != dervsToPreviousLayer->dtype ||
+        inputs->dtype != cvl->columns.dtype)
+        return ERROR;
+
+    // both gradients through the columns forwardCVL left behind, unfolded here if its algorithm left none
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
     Sts rcode = OK;
-    for (int i = 0; i < inputs->channel; i++)
-    {
-        rcode = mtsSliceMat(inputs, &cvl->m1, i) || rcode;
-        rcode = mtsSliceMat(outputs, &cvl->m2, i) || rcode;
-        rcode = mtsSliceMat(kernels, &cvl->m3, i) || rcode;
-        rcode = convolution(&cvl->m1, &cvl->m2, &cvl->m3) || rcode;
-    }
+    size_t imageSize = inputs->height * inputs->width;
+    size_t unfolded = cvl->kernelSize * cvl->kernelSize * cvl->outputs.height * cvl->outputs.width;
+    for (size_t c = 0; cvl->algorithm != CONV_IM2COL && c < inputs->channel; c++)
+        if (inputs->dtype == FLOAT_TYPE)
+            rcode = im2colFloat(inputs->array.floatArray + c * imageSize, inputs->height, inputs->width,
+                                cvl->kernelSize, cvl->stride, cvl->padding,
+                                cvl->columns.array.floatArray + c * unfolded) ||
+                    rcode;
+        else
+            rcode = im2colDouble(inputs->array.doubelMatrixStack + c * imageSize, inputs->height, inputs->width,
+                                 cvl->kernelSize, cvl->stride, cvl->padding,
+                                 cvl->columns.array.doubleArray + c * unfolded) ||
+                    rcode;
+    if (inputs->dtype == FLOAT_TYPE)
+        rcode = convolutionGemmBackwardFloat(dervsFromLastLayer->array.floatArray, inputs->channel, inputs->height,
+                                             inputs->width, kernels->array.floatArray, cvl->multiplier,
+                                             cvl->kernelSize, cvl->stride, cvl->padding,
+                                             cvl->columns.array.floatArray, dervsOfKernels->array.floatArray,
+                                             dervsToPreviousLayer->array.floatArray) ||
+                rcode;
+    else
+        rcode = convolutionGemmBackwardDouble(dervsFromLastLayer->array.doubelMatrixStack, inputs->channel,
+                                              inputs->height, inputs->width, kernels->array.doubelMatrixStack,
+                                              cvl->multiplier, cvl->kernelSize, cvl->stride, cvl->padding,
+                                              cvl->columns.array.doubleArray, dervsOfKernels->array.doubelMatrixStack,
+                                              dervsToPreviousLayer->array.doubelMatrixStack) ||
+                rcode;
+    PROFILE_END(profile, 0, 0);
+
+    return rcode;
+}
 
+Sts stepCVL(struct CVL *cvl, double lr)
+{
+    Optimizer sgd;
+    if (initOptimizer(&sgd, OPTIMIZER_SGD, lr) == ERROR)
+        return ERROR;
+
+    return optimizeCVL(cvl, &sgd);
+}
+
+Sts initOptimizerCVL(struct CVL *cvl, Arena *arena, const Optimizer *optimizer)
+{
+    if (!cvl || !arena || !optimizer || cvl->inference)
+        return ERROR;
+
+    Mts *kernels = &cvl->kernels;
+    size_t kernelLength = kernels->channel * kernels->height * kernels->width;
+
+    return initOptimizerState(optimizer, arena, cvl->stateOfKernels, kernelLength, kernels->dtype);
+}
+
+size_t sizeofOptimizerCVL(size_t channelOut, size_t kernelSize, const Optimizer *optimizer, Dtp dtype)
+{
+    return sizeofOptimizerState(optimizer, channelOut * kernelSize * kernelSize, dtype);
+}
+
+Sts optimizeCVL(struct CVL *cvl, const Optimizer *optimizer)
+{
+    if (!cvl || cvl->inference)
+        return ERROR;
+
+    Vec kernels, dervsOfKernels;
+    Sts rcode = OK;
+    rcode = mtsTransVec(&cvl->kernels, &kernels) || rcode;
+    rcode = mtsTransVec(&cvl->dervsOfKernels, &dervsOfKernels) || rcode;
     if (rcode == ERROR)
         return ERROR;
 
-    return OK;
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    rcode = optimizerUpdate(optimizer, &kernels, &dervsOfKernels, cvl->stateOfKernels, 1);
+    PROFILE_END(profile, 0, 0);
+
+    return rcode;
 }
 
 Sts backwardCVL(struct CVL *cvl, double lr)
 {
-    if (!cvl)
+    if (gradCVL(cvl) == ERROR)
         return ERROR;
 
-    Mts *dervsFromLastLayers = &cvl->dervsFromLastLayer, *dervsOfKernels = &cvl->dervsOfKernels;
+    return stepCVL(cvl, lr);
+}
+
+// inference leaves out the gradients and the argmax, average pooling needs no argmax either
+static Sts initPLOfType(struct PL *pl, Arena *arena, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize,
+                        size_t stride, size_t padding, Plm mode, Dtp dtype, int inference)
+{
+    if (!pl || poolCheck(rowIn, colIn, kernelSize, stride, padding) == ERROR ||
+        (mode != POOLING_MAX && mode != POOLING_AVERAGE) || (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
+        return ERROR;
+
+    memset(pl, 0, sizeof(struct PL));
 
-    for (int i = 0; i < dervsOfKernels->channel; i++)
+    pl->mode = mode;
+    pl->kernelSize = kernelSize;
+    pl->stride = stride;
+    pl->padding = padding;
+    pl->inference = inference;
+
+    size_t rowOut = convOutSize(rowIn, kernelSize, stride, padding);
+    size_t colOut = convOutSize(colIn, kernelSize, stride, padding);
+    size_t rowsSize = poolRowsSize(rowIn, colIn, kernelSize, stride, padding);
+    Sts rcode = OK;
+    rcode = initMtsOfType(arena, &pl->inputs, channel, rowIn, colIn, dtype, 0) || rcode;
+    rcode = initMtsOfType(arena, &pl->outputs, channel, rowOut, colOut, dtype, 0) || rcode;
+    if (!inference)
     {
-        mtsSliceMat(dervsFromLastLayers, &cvl->m1, i);
-        
+        rcode = initMtsOfType(arena, &pl->dervsFromLastLayer, channel, rowOut, colOut, dtype, 0) || rcode;
+        rcode = initMtsOfType(arena, &pl->dervsToPreviousLayer, channel, rowIn, colIn, dtype, 0) || rcode;
+        if (mode == POOLING_MAX)
+            rcode = initVecOfType(arena, &pl->argmax, channel * rowOut * colOut, CHAR_TYPE, 0) || rcode;
     }
-     
+    if (rowsSize)
+        rcode = initVecOfType(arena, &pl->rows, channel * rowsSize, dtype, 0) || rcode;
 
+    if (rcode == ERROR && !arena)
+    {
+        free(pl->inputs.array.doubelMatrixStack);
+        free(pl->outputs.array.doubelMatrixStack);
+        free(pl->dervsFromLastLayer.array.doubelMatrixStack);
+        free(pl->dervsToPreviousLayer.array.doubelMatrixStack);
+        free(pl->argmax.array.charArray);
+        free(pl->rows.array.doubleArray);
+    }
 
+    return rcode;
+}
 
+Sts initPL(struct PL *pl, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride, size_t padding,
+           Plm mode, Dtp dtype)
+{
+    return initPLOfType(pl, NULL, channel, rowIn, colIn, kernelSize, stride, padding, mode, dtype, 0);
+}
+
+Sts initArenaPL(struct PL *pl, Arena *arena, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize,
+                size_t stride, size_t padding, Plm mode, Dtp dtype)
+{
+    if (!arena)
+        return ERROR;
 
+    return initPLOfType(pl, arena, channel, rowIn, colIn, kernelSize, stride, padding, mode, dtype, 0);
+}
+
+Sts initInferencePL(struct PL *pl, Arena *arena, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize,
+                    size_t stride, size_t padding, Plm mode, Dtp dtype)
+{
+    return initPLOfType(pl, arena, channel, rowIn, colIn, kernelSize, stride, padding, mode, dtype, 1);
+}
+
+size_t sizeofPL(size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride, size_t padding, Plm mode,
+                Dtp dtype)
+{
+    size_t size = sizeOfDataType(dtype);
+    size_t outSize = convOutSize(rowIn, kernelSize, stride, padding) * convOutSize(colIn, kernelSize, stride, padding);
+    size_t rowsSize = poolRowsSize(rowIn, colIn, kernelSize, stride, padding);
+
+    // the six buffers of initPLOfType, each padded to the arena alignment
+    return arenaAlignedSize(channel * rowIn * colIn * size) * 2 +            // inputs, dervsToPreviousLayer
+           arenaAlignedSize(channel * outSize * size) * 2 +                  // outputs, dervsFromLastLayer
+           (mode == POOLING_MAX ? arenaAlignedSize(channel * outSize) : 0) + // argmax
+           (rowsSize ? arenaAlignedSize(channel * rowsSize * size) : 0);     // rows
+}
+
+size_t sizeofInferencePL(size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride, size_t padding,
+                         Dtp dtype)
+{
+    size_t size = sizeOfDataType(dtype);
+    size_t outSize = convOutSize(rowIn, kernelSize, stride, padding) * convOutSize(colIn, kernelSize, stride, padding);
+    size_t rowsSize = poolRowsSize(rowIn, colIn, kernelSize, stride, padding);
+
+    return arenaAlignedSize(channel * rowIn * colIn * size) + arenaAlignedSize(channel * outSize * size) +
+           (rowsSize ? arenaAlignedSize(channel * rowsSize * size) : 0);
+}
+
+Sts forwardPL(struct PL *pl)
+{
+    if (!pl)
+        return ERROR;
+
+    Mts *inputs = &pl->inputs, *outputs = &pl->outputs;
+    if (inputs->dtype != outputs->dtype || inputs->channel != outputs->channel ||
+        (pl->rows.array.charArray && pl->rows.dtype != inputs->dtype))
+        return ERROR;
+
+    // the argmax is only kept when a backward pass will read it
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    unsigned char *argmax = pl->inference ? NULL : (unsigned char *)pl->argmax.array.charArray;
+    Sts rcode;
+    if (inputs->dtype == FLOAT_TYPE)
+        rcode = poolingFloat(inputs->array.floatArray, inputs->channel, inputs->height, inputs->width,
+                             pl->kernelSize, pl->stride, pl->padding, pl->mode, pl->rows.array.floatArray,
+                             outputs->array.floatArray, argmax);
+    else
+        rcode = poolingDouble(inputs->array.doubelMatrixStack, inputs->channel, inputs->height, inputs->width,
+                              pl->kernelSize, pl->stride, pl->padding, pl->mode, pl->rows.array.doubleArray,
+                              outputs->array.doubelMatrixStack, argmax);
+    PROFILE_END(profile, 0, 0); // the pooling kernel counts the work
+
+    return rcode;
+}
+
+Sts gradPL(struct PL *pl)
+{
+    if (!pl || pl->inference)
+        return ERROR;
+
+    Mts *inputs = &pl->inputs, *dervsFromLastLayer = &pl->dervsFromLastLayer;
+    Mts *dervsToPreviousLayer = &pl->dervsToPreviousLayer;
+    if (inputs->dtype != dervsFromLastLayer->dtype || inputs->dtype != dervsToPreviousLayer->dtype)
+        return ERROR;
+
+    // one scatter through the argmax forwardPL left behind, or an even spread for average pooling
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    const unsigned char *argmax = (const unsigned char *)pl->argmax.array.charArray;
+    Sts rcode;
+    if (inputs->dtype == FLOAT_TYPE)
+        rcode = poolingBackwardFloat(dervsFromLastLayer->array.floatArray, inputs->channel, inputs->height,
+                                     inputs->width, pl->kernelSize, pl->stride, pl->padding, pl->mode, argmax,
+                                     dervsToPreviousLayer->array.floatArray);
+    else
+        rcode = poolingBackwardDouble(dervsFromLastLayer->array.doubelMatrixStack, inputs->channel, inputs->height,
+                                      inputs->width, pl->kernelSize, pl->stride, pl->padding, pl->mode, argmax,
+                                      dervsToPreviousLayer->array.doubelMatrixStack);
+    PROFILE_END(profile, 0, 0);
+
+    return rcode;
+}
+
+Sts initOL(struct OL *ol, Arena *arena, size_t classNum, size_t batchSize, Dtp dtype)
+{
+    if (!ol || classNum == 0 || batchSize == 0 || (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
+        return ERROR;
+
+    memset(ol, 0, sizeof(struct OL));
+    ol->batchSize = batchSize;
+    ol->classNum = classNum;
+
+    size_t length = batchSize * classNum;
+    Sts rcode = OK;
+    rcode = initVecOfType(arena, &ol->input, length, dtype, 0) || rcode;
+    rcode = initVecOfType(arena, &ol->output, length, dtype, 0) || rcode;
+    rcode = initVecOfType(arena, &ol->dervToPreviousLayer, length, dtype, 0) || rcode;
+
+    if (rcode == ERROR && !arena)
+    {
+        free(ol->input.array.doubleArray);
+        free(ol->output.array.doubleArray);
+        free(ol->dervToPreviousLayer.array.doubleArray);
+    }
+
+    return rcode;
+}
+
+size_t sizeofOL(size_t classNum, size_t batchSize, Dtp dtype)
+{
+    return arenaAlignedSize(batchSize * classNum * sizeOfDataType(dtype)) * 3; // input, output, dervToPreviousLayer
+}
+
+Sts bindOL(struct OL *ol, Vec *logits, Vec *dervOfLogits, size_t classNum)
+{
+    if (!ol || !logits || !dervOfLogits || classNum == 0 || logits->length % classNum ||
+        logits->length != dervOfLogits->length || logits->dtype != dervOfLogits->dtype)
+        return ERROR;
+
+    memset(ol, 0, sizeof(struct OL));
+    ol->batchSize = logits->length / classNum;
+    ol->classNum = classNum;
+    ol->input = *logits;
+    ol->output.dtype = logits->dtype;
+    ol->dervToPreviousLayer = *dervOfLogits;
+
+    return ol->batchSize ? OK : ERROR;
+}
+
+Sts forwardOL(struct OL *ol)
+{
+    if (!ol || !ol->output.array.doubleArray)
+        return ERROR;
+
+    // softmax row by row, one sample is one Vec view
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    size_t classNum = ol->classNum, size = sizeOfDataType(ol->input.dtype);
+    Sts rcode = OK;
+    for (size_t i = 0; i < ol->batchSize; i++)
+    {
+        Vec logits = {.array.charArray = ol->input.array.charArray + i * classNum * size, .length = classNum,
+                      .dtype = ol->input.dtype};
+        Vec probabilities = {.array.charArray = ol->output.array.charArray + i * classNum * size,
+                             .length = classNum, .dtype = ol->output.dtype};
+        rcode = softmax(&logits, &probabilities) || rcode;
+    }
+    PROFILE_END(profile, 4.0 * ol->batchSize * classNum, 2.0 * ol->batchSize * classNum * size);
+
+    return rcode;
+}
+
+/*
+The whole batch in four sweeps: every row shifted by its max into the gradient, one exp over the batch as a single
+array so a row of ten classes still fills the vectors, then each row summed and scaled into p, and y only touches
+the label. Returns the summed loss, log(sum) - (x[label] - max) a sample. grad may be x itself.
+*/
+static double softmaxCrossEntropyDouble(const Simd *simd, const double *x, const int *labels, double *grad,
+                                        size_t batchSize, size_t classNum)
+{
+    double loss = 0;
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        const double *row = x + i * classNum;
+        double *shifted = grad + i * classNum, max = simd->maxDouble(row, classNum);
+        for (size_t j = 0; j < classNum; j++)
+            shifted[j] = row[j] - max;
+        loss -= shifted[labels[i]];
+    }
+
+    simd->expShiftSumDouble(grad, 0, grad, batchSize * classNum);
+
+    for (size_t i = 0; i < batchSize; i++, grad += classNum)
+    {
+        double sum = simd->sumDouble(grad, classNum);
+        simd->scaleDouble(1 / sum, grad, grad, classNum);
+        grad[labels[i]] -= 1;
+        loss += log(sum);
+    }
+
+    return loss;
+}
+
+static double softmaxCrossEntropyFloat(const Simd *simd, const float *x, const int *labels, float *grad,
+                                       size_t batchSize, size_t classNum)
+{
+    double loss = 0;
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        const float *row = x + i * classNum;
+        float *shifted = grad + i * classNum, max = simd->maxFloat(row, classNum);
+        for (size_t j = 0; j < classNum; j++)
+            shifted[j] = row[j] - max;
+        loss -= shifted[labels[i]];
+    }
+
+    simd->expShiftSumFloat(grad, 0, grad, batchSize * classNum);
+
+    for (size_t i = 0; i < batchSize; i++, grad += classNum)
+    {
+        float sum = simd->sumFloat(grad, classNum);
+        simd->scaleFloat(1 / sum, grad, grad, classNum);
+        grad[labels[i]] -= 1;
+        loss += log(sum);
+    }
+
+    return loss;
+}
+
+Sts lossOL(struct OL *ol, const Label *labels, double *loss)
+{
+    Dtp dtype = ol ? ol->input.dtype : DOUBLE_TYPE;
+    if (!ol || !labels || !loss || labels->dtype != INT_TYPE || labels->length != ol->batchSize ||
+        (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE) || dtype != ol->dervToPreviousLayer.dtype ||
+        !ol->dervToPreviousLayer.array.doubleArray)
+        return ERROR;
+
+    for (size_t i = 0; i < ol->batchSize; i++)
+        if (labels->array.intArray[i] < 0 || (size_t)labels->array.intArray[i] >= ol->classNum)
+            return ERROR;
+
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    const Simd *simd = simdKernels();
+    double total = dtype == FLOAT_TYPE
+                       ? softmaxCrossEntropyFloat(simd, ol->input.array.floatArray, labels->array.intArray,
+                                                  ol->dervToPreviousLayer.array.floatArray, ol->batchSize,
+                                                  ol->classNum)
+                       : softmaxCrossEntropyDouble(simd, ol->input.array.doubleArray, labels->array.intArray,
+                                                   ol->dervToPreviousLayer.array.doubleArray, ol->batchSize,
+                                                   ol->classNum);
+    *loss = total / ol->batchSize;
+    PROFILE_END(profile, 5.0 * ol->batchSize * ol->classNum,
+                2.0 * ol->batchSize * ol->classNum * sizeOfDataType(dtype) + ol->batchSize * sizeof(int));
+
+    return OK;
 }
@@ -0,0 +1,96 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L // fstat, mmap
+#endif
+
+#include "mapfile.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the fallback, the whole file into aligned memory
+static Sts readFile(MappedFile *file, const char *path)
+{
+    FILE *stream = fopen(path, "rb");
+    if (!stream)
+        return ERROR;
+
+    long bytes = -1;
+    if (fseek(stream, 0, SEEK_END) == 0)
+        bytes = ftell(stream);
+    if (bytes <= 0 || fseek(stream, 0, SEEK_SET) != 0)
+    {
+        fclose(stream);
+        return ERROR;
+    }
+
+    file->data = (char *)alignedMalloc((size_t)bytes, 64);
+    if (!file->data || fread(file->data, 1, (size_t)bytes, stream) != (size_t)bytes)
+    {
+        alignedFree(file->data);
+        file->data = NULL;
+        fclose(stream);
+        return ERROR;
+    }
+    fclose(stream);
+
+    file->bytes = (size_t)bytes;
+    file->mapped = 0;
+
+    return OK;
+}
+
+Sts mapFile(MappedFile *file, const char *path)
+{
+    if (!file || !path)
+        return ERROR;
+
+    memset(file, 0, sizeof(MappedFile));
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return ERROR;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size <= 0)
+    {
+        close(fd);
+        return ERROR;
+    }
+
+    // private and writable, so a model trained further after loading never writes back to the file
+    void *data = mmap(NULL, (size_t)status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (data != MAP_FAILED)
+    {
+        file->data = (char *)data;
+        file->bytes = (size_t)status.st_size;
+        file->mapped = 1;
+        return OK;
+    }
+#endif
+
+    return readFile(file, path);
+}
+
+Sts unmapFile(MappedFile *file)
+{
+    if (!file || !file->data)
+        return OK;
+
+#ifndef _WIN32
+    if (file->mapped)
+        munmap(file->data, file->bytes);
+    else
+#endif
+        alignedFree(file->data);
+
+    memset(file, 0, sizeof(MappedFile));
+
+    return OK;
+}
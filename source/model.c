@@ -0,0 +1,543 @@
+#include "model.h"
+#include "conv.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+static Sts reserveLayer(Model *model)
+{
+    if (model->layerNum < model->layerCapacity)
+        return OK;
+
+    size_t capacity = model->layerCapacity ? model->layerCapacity * 2 : 4;
+    struct LAYER *layers = (struct LAYER *)realloc(model->layers, sizeof(struct LAYER) * capacity);
+    if (!layers)
+        return ERROR;
+
+    model->layers = layers;
+    model->layerCapacity = capacity;
+
+    return OK;
+}
+
+static size_t layerSizeIn(struct LAYER *layer) // elements of one sample
+{
+    if (layer->type == FULLY_CONNECTED_LAYER)
+        return layer->layer.fcl.neuronNumIn;
+
+    Mts *inputs = layer->type == POOLING_LAYER ? &layer->layer.pl.inputs : &layer->layer.cvl.inputs;
+    return inputs->channel * inputs->height * inputs->width;
+}
+
+static size_t layerSizeOut(struct LAYER *layer)
+{
+    if (layer->type == FULLY_CONNECTED_LAYER)
+        return layer->layer.fcl.neuronNumOut;
+
+    Mts *outputs = layer->type == POOLING_LAYER ? &layer->layer.pl.outputs : &layer->layer.cvl.outputs;
+    return outputs->channel * outputs->height * outputs->width;
+}
+
+static void bindVec(Vec *vec, char *storage, size_t length, Dtp dtype)
+{
+    vec->array.charArray = storage;
+    vec->length = length;
+    vec->dtype = dtype;
+}
+
+static char *plannedAt(char *base, const PlannedBuffer *buffer) // NULL for a buffer nobody needs
+{
+    return buffer->bytes ? base + buffer->offset : NULL;
+}
+
+static void bindMts(Mts *mts, char *storage, size_t channel, size_t height, size_t width, Dtp dtype)
+{
+    mts->array.charArray = storage;
+    mts->channel = channel;
+    mts->height = height;
+    mts->width = width;
+    mts->dtype = dtype;
+}
+
+Sts initModel(Model *model, size_t batchSize, Dtp dtype)
+{
+    if (!model || batchSize == 0 || (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
+        return ERROR;
+
+    memset(model, 0, sizeof(Model));
+    model->batchSize = batchSize;
+    model->dtype = dtype;
+
+    return initOptimizer(&model->optimizer, OPTIMIZER_SGD, .01);
+}
+
+Sts initInferenceModel(Model *model, size_t batchSize, Dtp dtype)
+{
+    if (initModel(model, batchSize, dtype) == ERROR)
+        return ERROR;
+
+    model->inference = 1;
+
+    return OK;
+}
+
+Sts modelAddFCL(Model *model, size_t neuronNumIn, size_t neuronNumOut, Sts (*activateFunction)(Input *, Output *),
+                Sts (*activateFunction_derivative)(Input *, Derv *))
+{
+    if (!model || model->buffers || !activateFunction || !activateFunction_derivative || reserveLayer(model))
+        return ERROR;
+
+    // only the shape for now, the storage comes at compileModel
+    struct LAYER *layer = &model->layers[model->layerNum++];
+    memset(layer, 0, sizeof(struct LAYER));
+    layer->type = FULLY_CONNECTED_LAYER;
+    layer->layer.fcl.batchSize = model->batchSize;
+    layer->layer.fcl.neuronNumIn = neuronNumIn;
+    layer->layer.fcl.neuronNumOut = neuronNumOut;
+    layer->layer.fcl.activateFunction = activateFunction;
+    layer->layer.fcl.activateFunction_derivative = activateFunction_derivative;
+    layer->layer.fcl.activation = activationOf(activateFunction, activateFunction_derivative);
+
+    return OK;
+}
+
+Sts modelAddCVL(Model *model, size_t channelIn, size_t rowIn, size_t colIn, size_t kernelSize, size_t multiplier,
+                size_t stride, size_t padding)
+{
+    size_t rowOut = convOutSize(rowIn, kernelSize, stride, padding);
+    size_t colOut = convOutSize(colIn, kernelSize, stride, padding);
+    if (!model || model->buffers || model->batchSize != 1 || multiplier == 0 || rowOut == 0 || colOut == 0 ||
+        reserveLayer(model))
+        return ERROR;
+
+    struct LAYER *layer = &model->layers[model->layerNum++];
+    memset(layer, 0, sizeof(struct LAYER));
+    layer->type = CONVOLUTIONAL_LAYER;
+
+    struct CVL *cvl = &layer->layer.cvl;
+    cvl->multiplier = multiplier;
+    cvl->kernelSize = kernelSize;
+    cvl->stride = stride;
+    cvl->padding = padding;
+    cvl->algorithm = convChooseAlgorithm(channelIn, rowIn, colIn, multiplier, kernelSize, stride, padding,
+                                         model->dtype, model->inference);
+    bindMts(&cvl->inputs, NULL, channelIn, rowIn, colIn, model->dtype);
+    bindMts(&cvl->outputs, NULL, channelIn * multiplier, rowOut, colOut, model->dtype);
+
+    return OK;
+}
+
+Sts modelAddPL(Model *model, size_t channel, size_t rowIn, size_t colIn, size_t kernelSize, size_t stride,
+               size_t padding, Plm mode)
+{
+    if (!model || model->buffers || model->batchSize != 1 || (mode != POOLING_MAX && mode != POOLING_AVERAGE) ||
+        poolCheck(rowIn, colIn, kernelSize, stride, padding) == ERROR || reserveLayer(model))
+        return ERROR;
+
+    struct LAYER *layer = &model->layers[model->layerNum++];
+    memset(layer, 0, sizeof(struct LAYER));
+    layer->type = POOLING_LAYER;
+
+    struct PL *pl = &layer->layer.pl;
+    pl->mode = mode;
+    pl->kernelSize = kernelSize;
+    pl->stride = stride;
+    pl->padding = padding;
+    bindMts(&pl->inputs, NULL, channel, rowIn, colIn, model->dtype);
+    bindMts(&pl->outputs, NULL, channel, convOutSize(rowIn, kernelSize, stride, padding),
+            convOutSize(colIn, kernelSize, stride, padding), model->dtype);
+
+    return OK;
+}
+
+Sts modelSetOptimizer(Model *model, const Optimizer *optimizer)
+{
+    if (!model || !optimizer || model->buffers)
+        return ERROR;
+
+    model->optimizer = *optimizer;
+
+    return OK;
+}
+
+/*
+The weights, the gradients every step writes and the optimizer state, from one arena.
+Weights, biases and kernels bound before compileModel (mapModel binds them into the checkpoint) stay where they are.
+*/
+static Sts initParameters(Model *model)
+{
+    size_t size = sizeOfDataType(model->dtype), bytes = 0;
+    for (size_t i = 0; i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            struct FCL *fcl = &layer->layer.fcl;
+            size_t weightBytes = arenaAlignedSize(fcl->neuronNumOut * fcl->neuronNumIn * size);
+            size_t biasBytes = arenaAlignedSize(fcl->neuronNumOut * size);
+            bytes += (fcl->weight.array.doubleMatrix ? 0 : weightBytes) + (fcl->bias.array.doubleArray ? 0 : biasBytes);
+            if (!model->inference)
+                bytes += weightBytes + biasBytes +
+                         sizeofOptimizerFCL(fcl->neuronNumIn, fcl->neuronNumOut, &model->optimizer, model->dtype);
+        }
+        else if (layer->type == CONVOLUTIONAL_LAYER) // a pooling layer has no parameters
+        {
+            struct CVL *cvl = &layer->layer.cvl;
+            size_t kernelBytes = arenaAlignedSize(cvl->outputs.channel * cvl->kernelSize * cvl->kernelSize * size);
+            bytes += cvl->kernels.array.doubelMatrixStack ? 0 : kernelBytes;
+            if (!model->inference)
+                bytes += kernelBytes +
+                         sizeofOptimizerCVL(cvl->outputs.channel, cvl->kernelSize, &model->optimizer, model->dtype);
+        }
+    }
+
+    if (bytes && initArena(&model->parameters, bytes) == ERROR) // none left for a mapped inference model
+        return ERROR;
+
+    Arena *arena = &model->parameters;
+    Dtp dtype = model->dtype;
+    Sts rcode = OK;
+    for (size_t i = 0; i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            struct FCL *fcl = &layer->layer.fcl;
+            if (!fcl->weight.array.doubleMatrix)
+                rcode = initArenaMat(arena, &fcl->weight, fcl->neuronNumOut, fcl->neuronNumIn, dtype, 1) || rcode;
+            if (!fcl->bias.array.doubleArray)
+                rcode = initArenaVec(arena, &fcl->bias, fcl->neuronNumOut, dtype, 0) || rcode;
+            if (!model->inference)
+            {
+                rcode = initArenaMat(arena, &fcl->dervOfWeight, fcl->neuronNumOut, fcl->neuronNumIn, dtype, 0) ||
+                        rcode;
+                rcode = initArenaVec(arena, &fcl->dervOfBias, fcl->neuronNumOut, dtype, 0) || rcode;
+                rcode = initOptimizerFCL(fcl, arena, &model->optimizer) || rcode;
+            }
+        }
+        else if (layer->type == CONVOLUTIONAL_LAYER)
+        {
+            struct CVL *cvl = &layer->layer.cvl;
+            size_t channelOut = cvl->outputs.channel, kernelSize = cvl->kernelSize;
+            if (!cvl->kernels.array.doubelMatrixStack)
+                rcode = initArenaMts(arena, &cvl->kernels, channelOut, kernelSize, kernelSize, dtype, 1) || rcode;
+            if (!model->inference)
+            {
+                rcode = initArenaMts(arena, &cvl->dervsOfKernels, channelOut, kernelSize, kernelSize, dtype, 0) ||
+                        rcode;
+                rcode = initOptimizerCVL(cvl, arena, &model->optimizer) || rcode;
+            }
+        }
+    }
+
+    return rcode;
+}
+
+// one training step as a timeline for L layers: forward of layer i at i, the loss at L, backward of layer i at 2L - i
+Sts compileModel(Model *model)
+{
+    if (!model || model->layerNum == 0 || model->buffers)
+        return ERROR;
+
+    size_t layerNum = model->layerNum, batch = model->batchSize, size = sizeOfDataType(model->dtype);
+    for (size_t i = 1; i < layerNum; i++)
+        if (layerSizeOut(&model->layers[i - 1]) != layerSizeIn(&model->layers[i]))
+            return ERROR;
+
+    /*
+    Buffer ids: activations[i] feeds layer i, activations[L] is the output, gradients[i] is dL/d(activations[i]),
+    then one private buffer per layer live from its forward to its backward (columns, the argmax of a max pooling,
+    or linearTrans of a custom activation), and one only live during its backward (dervOfActivateFunc
+    of an activation) or, for a pooling layer, only during its forward (the rows).
+    Layer i runs forward at step i and backward at step 2L - i, so activations[i + 1] lives through both
+    when the backward of layer i reads it.
+    Buffers a layer doesn't need take no bytes and are bound to NULL. An inference model stops at step L:
+    it has no gradients, and the activations ping-pong between two or three buffers.
+    */
+    size_t L = layerNum, num = 4 * L + 2;
+    PlannedBuffer *plan = (PlannedBuffer *)calloc(num, sizeof(PlannedBuffer));
+    if (!plan)
+        return ERROR;
+    PlannedBuffer *activations = plan, *gradients = plan + L + 1, *kept = plan + 2 * L + 2;
+    PlannedBuffer *scratch = kept + L;
+
+    int inference = model->inference;
+    for (size_t i = 0; i <= L; i++)
+    {
+        size_t length = batch * (i < L ? layerSizeIn(&model->layers[i]) : layerSizeOut(&model->layers[L - 1]));
+        size_t bytes = arenaAlignedSize(length * size);
+        activations[i] = (PlannedBuffer){.bytes = bytes, .first = i ? i - 1 : 0, .last = inference ? i : 2 * L - i};
+        gradients[i] = (PlannedBuffer){.bytes = inference ? 0 : bytes, .first = 2 * L - i, .last = 2 * L - i + 1};
+    }
+    activations[L].last = inference ? L : 2 * L; // the output stays readable through the whole step
+    for (size_t i = 1; i < L && !inference; i++)
+    {
+        // a fused activation takes its derivative from the output, read by the backward of the layer writing it
+        const struct LAYER *layer = &model->layers[i - 1];
+        if (layer->type == FULLY_CONNECTED_LAYER && layer->layer.fcl.activation != ACTIVATION_NONE &&
+            layer->layer.fcl.activation != ACTIVATION_CUSTOM)
+            activations[i].last = 2 * L - i + 1;
+    }
+    gradients[L].first = L;                      // written by the caller from the loss
+    gradients[0].last = 2 * L;
+
+    for (size_t i = 0; i < L; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        size_t keptLength, scratchLength = 0;
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            Act activation = layer->layer.fcl.activation;
+            keptLength = activation == ACTIVATION_CUSTOM ? batch * layer->layer.fcl.neuronNumOut : 0;
+            scratchLength = activation == ACTIVATION_NONE ? 0 : batch * layer->layer.fcl.neuronNumOut;
+        }
+        else if (layer->type == POOLING_LAYER)
+        {
+            // a byte of argmax per output, and the rows of every channel needed by the forward pass alone
+            struct PL *pl = &layer->layer.pl;
+            Mts *inputs = &pl->inputs;
+            size_t argmaxBytes = pl->mode == POOLING_MAX && !inference ? layerSizeOut(layer) : 0;
+            size_t rowsLength = inputs->channel * poolRowsSize(inputs->height, inputs->width, pl->kernelSize,
+                                                               pl->stride, pl->padding);
+            kept[i] = (PlannedBuffer){
+                .bytes = arenaAlignedSize(argmaxBytes), .first = i, .last = inference ? i : 2 * L - i};
+            scratch[i] = (PlannedBuffer){.bytes = arenaAlignedSize(rowsLength * size), .first = i, .last = i};
+            continue;
+        }
+        else
+        {
+            const struct CVL *cvl = &layer->layer.cvl;
+            keptLength = columnsLengthCVL(cvl->inputs.channel, cvl->inputs.height, cvl->inputs.width, cvl->kernelSize,
+                                          cvl->multiplier, cvl->stride, cvl->padding, model->dtype, inference);
+        }
+        kept[i] = (PlannedBuffer){
+            .bytes = arenaAlignedSize(keptLength * size), .first = i, .last = inference ? i : 2 * L - i};
+        scratch[i] = (PlannedBuffer){
+            .bytes = inference ? 0 : arenaAlignedSize(scratchLength * size), .first = 2 * L - i, .last = 2 * L - i};
+    }
+
+    model->bufferBytes = arenaPlanBuffers(plan, num);
+    model->buffers = model->bufferBytes ? (char *)alignedMalloc(model->bufferBytes, ARENA_ALIGNMENT) : NULL;
+    if (!model->buffers || initParameters(model) == ERROR)
+    {
+        free(plan);
+        alignedFree(model->buffers);
+        model->buffers = NULL;
+        freeArena(&model->parameters);
+        return ERROR;
+    }
+    memset(model->buffers, 0, model->bufferBytes);
+
+    // point every layer at its planned buffers, neighbours share the ones between them
+    char *base = model->buffers;
+    Dtp dtype = model->dtype;
+    for (size_t i = 0; i < L; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        char *in = plannedAt(base, &activations[i]), *out = plannedAt(base, &activations[i + 1]);
+        char *dervIn = plannedAt(base, &gradients[i]), *dervOut = plannedAt(base, &gradients[i + 1]);
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            struct FCL *fcl = &layer->layer.fcl;
+            size_t lengthIn = batch * fcl->neuronNumIn, lengthOut = batch * fcl->neuronNumOut;
+            fcl->inference = inference;
+            bindVec(&fcl->input, in, lengthIn, dtype);
+            bindVec(&fcl->linearTrans, plannedAt(base, &kept[i]), lengthOut, dtype);
+            bindVec(&fcl->output, out, lengthOut, dtype);
+            bindVec(&fcl->dervOfActivateFunc, plannedAt(base, &scratch[i]), lengthOut, dtype);
+            bindVec(&fcl->dervFromLastLayer, dervOut, lengthOut, dtype);
+            bindVec(&fcl->dervToPreviousLayer, dervIn, lengthIn, dtype);
+        }
+        else if (layer->type == POOLING_LAYER)
+        {
+            struct PL *pl = &layer->layer.pl;
+            pl->inference = inference;
+            Mts *inputs = &pl->inputs, *outputs = &pl->outputs;
+            bindMts(inputs, in, inputs->channel, inputs->height, inputs->width, dtype);
+            bindMts(outputs, out, outputs->channel, outputs->height, outputs->width, dtype);
+            bindMts(&pl->dervsToPreviousLayer, dervIn, inputs->channel, inputs->height, inputs->width, dtype);
+            bindMts(&pl->dervsFromLastLayer, dervOut, outputs->channel, outputs->height, outputs->width, dtype);
+            bindVec(&pl->argmax, plannedAt(base, &kept[i]), layerSizeOut(layer), CHAR_TYPE);
+            bindVec(&pl->rows, plannedAt(base, &scratch[i]),
+                    inputs->channel * poolRowsSize(inputs->height, inputs->width, pl->kernelSize, pl->stride,
+                                                   pl->padding),
+                    dtype);
+        }
+        else
+        {
+            struct CVL *cvl = &layer->layer.cvl;
+            cvl->inference = inference;
+            Mts *inputs = &cvl->inputs, *outputs = &cvl->outputs;
+            bindMts(inputs, in, inputs->channel, inputs->height, inputs->width, dtype);
+            bindMts(outputs, out, outputs->channel, outputs->height, outputs->width, dtype);
+            bindMts(&cvl->dervsToPreviousLayer, dervIn, inputs->channel, inputs->height, inputs->width, dtype);
+            bindMts(&cvl->dervsFromLastLayer, dervOut, outputs->channel, outputs->height, outputs->width, dtype);
+            bindVec(&cvl->columns, plannedAt(base, &kept[i]),
+                    columnsLengthCVL(inputs->channel, inputs->height, inputs->width, cvl->kernelSize, cvl->multiplier,
+                                     cvl->stride, cvl->padding, dtype, inference),
+                    dtype);
+        }
+    }
+
+    size_t lengthIn = batch * layerSizeIn(&model->layers[0]), lengthOut = batch * layerSizeOut(&model->layers[L - 1]);
+    bindVec(&model->input, plannedAt(base, &activations[0]), lengthIn, dtype);
+    bindVec(&model->output, plannedAt(base, &activations[L]), lengthOut, dtype);
+    bindVec(&model->dervOfOutput, plannedAt(base, &gradients[L]), lengthOut, dtype);
+    bindVec(&model->dervOfInput, plannedAt(base, &gradients[0]), lengthIn, dtype);
+
+    free(plan);
+
+    return OK;
+}
+
+Sts prepareModel(Model *model)
+{
+    if (!model || !model->buffers)
+        return ERROR;
+
+    // a second call packs everything again into a new arena, the layers lose the old buffers together
+    size_t bytes = 0;
+    for (size_t i = 0; i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            bytes += sizeofPreparedFCL(layer->layer.fcl.neuronNumIn, layer->layer.fcl.neuronNumOut, model->dtype);
+            layer->layer.fcl.packedWeight = (Vec){0};
+        }
+    }
+    freeArena(&model->prepared);
+    if (bytes == 0) // nothing to pack, convolutions read their kernels as they are
+        return OK;
+    if (initArena(&model->prepared, bytes) == ERROR)
+        return ERROR;
+
+    Sts rcode = OK;
+    for (size_t i = 0; i < model->layerNum; i++)
+        if (model->layers[i].type == FULLY_CONNECTED_LAYER)
+            rcode = prepareFCL(&model->layers[i].layer.fcl, &model->prepared) || rcode;
+
+    return rcode;
+}
+
+Sts forwardModel(Model *model)
+{
+    if (!model || !model->buffers)
+        return ERROR;
+
+    PROFILE_BEGIN(profile, PROFILE_MODEL, __func__);
+    Sts rcode = OK;
+    for (size_t i = 0; rcode == OK && i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        rcode = layer->type == FULLY_CONNECTED_LAYER ? forwardFCL(&layer->layer.fcl)
+                : layer->type == POOLING_LAYER      ? forwardPL(&layer->layer.pl)
+                                                    : forwardCVL(&layer->layer.cvl);
+    }
+    PROFILE_END(profile, 0, 0); // the layers inside count the work
+
+    return rcode;
+}
+
+Sts backwardModel(Model *model)
+{
+    if (!model || !model->buffers || model->inference)
+        return ERROR;
+
+    PROFILE_BEGIN(profile, PROFILE_MODEL, __func__);
+    Sts rcode = OK;
+    for (size_t i = model->layerNum; rcode == OK && i-- > 0;)
+    {
+        struct LAYER *layer = &model->layers[i];
+        rcode = layer->type == FULLY_CONNECTED_LAYER ? gradFCL(&layer->layer.fcl)
+                : layer->type == POOLING_LAYER      ? gradPL(&layer->layer.pl)
+                                                    : gradCVL(&layer->layer.cvl);
+    }
+    PROFILE_END(profile, 0, 0);
+
+    return rcode;
+}
+
+Sts stepModel(Model *model)
+{
+    if (!model || !model->buffers || model->inference || optimizerNextStep(&model->optimizer) == ERROR)
+        return ERROR;
+
+    PROFILE_BEGIN(profile, PROFILE_MODEL, __func__);
+    Sts rcode = OK;
+    for (size_t i = 0; i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+            rcode = optimizeFCL(&layer->layer.fcl, &model->optimizer) || rcode;
+        else if (layer->type == CONVOLUTIONAL_LAYER)
+            rcode = optimizeCVL(&layer->layer.cvl, &model->optimizer) || rcode;
+    }
+    PROFILE_END(profile, 0, 0);
+
+    return rcode;
+}
+
+size_t modelFootprint(Model *model)
+{
+    return model ? model->parameters.capacity + model->prepared.capacity + model->bufferBytes + model->checkpoint.bytes
+                 : 0;
+}
+
+size_t modelUnplannedBytes(Model *model)
+{
+    if (!model)
+        return 0;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            struct FCL *fcl = &layer->layer.fcl;
+            bytes += model->inference
+                         ? sizeofInferenceFCL(fcl->neuronNumIn, fcl->neuronNumOut, model->batchSize, fcl->activation,
+                                              model->dtype)
+                         : sizeofFCL(fcl->neuronNumIn, fcl->neuronNumOut, model->batchSize, model->dtype) +
+                               sizeofOptimizerFCL(fcl->neuronNumIn, fcl->neuronNumOut, &model->optimizer, model->dtype);
+        }
+        else if (layer->type == POOLING_LAYER)
+        {
+            struct PL *pl = &layer->layer.pl;
+            Mts *inputs = &pl->inputs;
+            bytes += model->inference ? sizeofInferencePL(inputs->channel, inputs->height, inputs->width,
+                                                          pl->kernelSize, pl->stride, pl->padding, model->dtype)
+                                      : sizeofPL(inputs->channel, inputs->height, inputs->width, pl->kernelSize,
+                                                 pl->stride, pl->padding, pl->mode, model->dtype);
+        }
+        else
+        {
+            struct CVL *cvl = &layer->layer.cvl;
+            if (model->inference)
+                bytes += sizeofInferenceCVL(cvl->inputs.channel, cvl->inputs.height, cvl->inputs.width,
+                                            cvl->kernelSize, cvl->multiplier, cvl->stride, cvl->padding, model->dtype);
+            else
+                bytes += sizeofCVL(cvl->inputs.channel, cvl->inputs.height, cvl->inputs.width, cvl->kernelSize,
+                                   cvl->multiplier, cvl->stride, cvl->padding, model->dtype) +
+                         sizeofOptimizerCVL(cvl->outputs.channel, cvl->kernelSize, &model->optimizer, model->dtype);
+        }
+    }
+
+    return bytes;
+}
+
+Sts freeModel(Model *model)
+{
+    if (!model)
+        return OK;
+
+    alignedFree(model->buffers);
+    freeArena(&model->parameters);
+    freeArena(&model->prepared);
+    unmapFile(&model->checkpoint);
+    free(model->layers);
+    memset(model, 0, sizeof(Model));
+
+    return OK;
+}
@@ -0,0 +1,141 @@
+#include "optimizer.h"
+#include "profile.h"
+#include "simd.h"
+
+Sts initOptimizer(Optimizer *optimizer, enum OptimizerType type, double lr)
+{
+    if (!optimizer || type > OPTIMIZER_ADAMW || lr < 0)
+        return ERROR;
+
+    optimizer->type = type;
+    optimizer->lr = lr;
+    optimizer->momentum = .9;
+    optimizer->decay = type == OPTIMIZER_RMSPROP ? .99 : .999;
+    optimizer->epsilon = 1e-8;
+    optimizer->weightDecay = type == OPTIMIZER_ADAMW ? .01 : 0;
+    optimizer->step = 0;
+
+    return OK;
+}
+
+size_t optimizerStateNum(const Optimizer *optimizer)
+{
+    if (!optimizer)
+        return 0;
+
+    switch (optimizer->type)
+    {
+    case OPTIMIZER_MOMENTUM:
+    case OPTIMIZER_NESTEROV:
+    case OPTIMIZER_RMSPROP:
+        return 1;
+    case OPTIMIZER_ADAM:
+    case OPTIMIZER_ADAMW:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+size_t sizeofOptimizerState(const Optimizer *optimizer, size_t length, Dtp dtype)
+{
+    return optimizerStateNum(optimizer) * arenaAlignedSize(length * sizeOfDataType(dtype));
+}
+
+Sts initOptimizerState(const Optimizer *optimizer, Arena *arena, Vec *state, size_t length, Dtp dtype)
+{
+    if (!optimizer || !arena || !state)
+        return ERROR;
+
+    Sts rcode = OK;
+    for (size_t i = 0; i < optimizerStateNum(optimizer); i++)
+        rcode = initArenaVec(arena, &state[i], length, dtype, 0) || rcode;
+
+    return rcode;
+}
+
+Sts optimizerNextStep(Optimizer *optimizer)
+{
+    if (!optimizer)
+        return ERROR;
+
+    optimizer->step++;
+
+    return OK;
+}
+
+/*
+The state is kept in the units of the unscaled gradient: the moments are linear in it and gradScale
+moves into the step size, and into epsilon where the update divides by the root of a second moment.
+*/
+Sts optimizerUpdate(const Optimizer *optimizer, Vec *param, const Vec *grad, Vec *state, double gradScale)
+{
+    if (!optimizer || !param || !grad || param->length != grad->length || param->dtype != grad->dtype ||
+        (param->dtype != DOUBLE_TYPE && param->dtype != FLOAT_TYPE) || gradScale <= 0)
+        return ERROR;
+
+    size_t stateNum = optimizerStateNum(optimizer), n = param->length;
+    if (stateNum && !state)
+        return ERROR;
+    for (size_t i = 0; i < stateNum; i++)
+        if (state[i].length != n || state[i].dtype != param->dtype)
+            return ERROR;
+
+    const Simd *simd = simdKernels();
+    double lr = optimizer->lr, eps = optimizer->epsilon / gradScale;
+    int isFloat = param->dtype == FLOAT_TYPE;
+    PROFILE_BEGIN(profile, PROFILE_KERNEL, __func__);
+    switch (optimizer->type)
+    {
+    case OPTIMIZER_SGD:
+        if (isFloat)
+            simd->axpyFloat(-lr * gradScale, grad->array.floatArray, param->array.floatArray, n);
+        else
+            simd->axpyDouble(-lr * gradScale, grad->array.doubleArray, param->array.doubleArray, n);
+        break;
+    case OPTIMIZER_MOMENTUM:
+    case OPTIMIZER_NESTEROV:
+    {
+        int nesterov = optimizer->type == OPTIMIZER_NESTEROV;
+        if (isFloat)
+            simd->momentumFloat(lr * gradScale, optimizer->momentum, nesterov, grad->array.floatArray,
+                                state[0].array.floatArray, param->array.floatArray, n);
+        else
+            simd->momentumDouble(lr * gradScale, optimizer->momentum, nesterov, grad->array.doubleArray,
+                                 state[0].array.doubleArray, param->array.doubleArray, n);
+        break;
+    }
+    case OPTIMIZER_RMSPROP:
+        if (isFloat)
+            simd->rmspropFloat(lr, optimizer->decay, eps, grad->array.floatArray, state[0].array.floatArray,
+                               param->array.floatArray, n);
+        else
+            simd->rmspropDouble(lr, optimizer->decay, eps, grad->array.doubleArray, state[0].array.doubleArray,
+                                param->array.doubleArray, n);
+        break;
+    case OPTIMIZER_ADAM:
+    case OPTIMIZER_ADAMW:
+    {
+        if (optimizer->step == 0) // the bias corrections would divide by zero
+            return ERROR;
+
+        // lr / (1 - beta1^t) and 1 / sqrt(1 - beta2^t) correct the moments for starting at zero
+        double t = (double)optimizer->step;
+        double step = lr / (1 - pow(optimizer->momentum, t)), vScale = 1 / sqrt(1 - pow(optimizer->decay, t));
+        double decay = optimizer->type == OPTIMIZER_ADAMW ? lr * optimizer->weightDecay : 0;
+        if (isFloat)
+            simd->adamFloat(step, optimizer->momentum, optimizer->decay, vScale, eps, decay, grad->array.floatArray,
+                            state[0].array.floatArray, state[1].array.floatArray, param->array.floatArray, n);
+        else
+            simd->adamDouble(step, optimizer->momentum, optimizer->decay, vScale, eps, decay, grad->array.doubleArray,
+                             state[0].array.doubleArray, state[1].array.doubleArray, param->array.doubleArray, n);
+        break;
+    }
+    default:
+        return ERROR;
+    }
+
+    // about four flops per moment on top of the step, every buffer read once and all but grad written back
+    PROFILE_END(profile, (2.0 + 4.0 * stateNum) * n, (3.0 + 2.0 * stateNum) * n * sizeOfDataType(param->dtype));
+    return OK;
+}
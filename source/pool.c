@@ -0,0 +1,37 @@
+#include "pool.h"
+#include "conv.h"
+#include "profile.h"
+#include "simd.h"
+#include "threadpool.h"
+#include <string.h>
+
+Sts poolCheck(size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding)
+{
+    if (kernelSize == 0 || kernelSize > POOL_MAX_KERNEL || padding > kernelSize / 2 ||
+        convOutSize(height, kernelSize, stride, padding) == 0 || convOutSize(width, kernelSize, stride, padding) == 0)
+        return ERROR;
+
+    return OK;
+}
+
+size_t poolRowsSize(size_t height, size_t width, size_t kernelSize, size_t stride, size_t padding)
+{
+    if (poolCheck(height, width, kernelSize, stride, padding) == ERROR || (stride == 1 && padding == 0))
+        return 0;
+
+    return height * stride * ((width + 2 * padding + stride - 1) / stride);
+}
+
+#define T double
+#define POOL_NAME(name) name##Double
+#define POOL_MAX poolMaxDouble
+#define POOL_AVG poolAvgDouble
+#define POOL_AXPY axpyDouble
+#include "poolKernels.inc"
+
+#define T float
+#define POOL_NAME(name) name##Float
+#define POOL_MAX poolMaxFloat
+#define POOL_AVG poolAvgFloat
+#define POOL_AXPY axpyFloat
+#include "poolKernels.inc"
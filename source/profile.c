@@ -0,0 +1,543 @@
+#if defined(__linux__)
+#define _GNU_SOURCE // syscall
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "profile.h"
+
+#ifdef CNN_PROFILE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define PROFILE_SITES 64 // region names one thread tells apart, the rest are left out of its table
+#define PROFILE_DEPTH 64 // regions open inside each other, deeper ones aren't recorded
+
+static const char *const kindNames[PROFILE_KINDS] = {"model", "layer", "kernel"};
+
+struct PROFILE_SITE // the totals of one region name on one thread
+{
+    const char *name;
+    Pfk kind;
+    size_t calls;
+    unsigned long long time, selfTime; // ns, self leaves out the regions opened inside it
+    double flops, bytes;
+    unsigned long long counters[2];
+};
+
+struct PROFILE_EVENT // one region as the trace shows it
+{
+    const char *name;
+    Pfk kind;
+    unsigned long long begin, time; // ns since profileStart
+    double flops, bytes;
+    unsigned long long counters[2];
+};
+
+struct PROFILE_THREAD // only its own thread writes it while recording
+{
+    size_t id; // in the order the threads recorded their first region
+    struct PROFILE_SITE sites[PROFILE_SITES];
+    size_t siteNum;
+    struct PROFILE_EVENT *events;
+    size_t eventNum;
+    size_t eventCapacity;
+    size_t dropped;                                 // events past the capacity, only counted in the table
+    unsigned long long children[PROFILE_DEPTH + 1]; // the time of the regions finished inside every open one
+    size_t depth;
+    int counterFd; // the group leader of the cycles and the cache misses, -1 without
+    int counterTried;
+    struct PROFILE_THREAD *next;
+};
+
+static struct PROFILE
+{
+    pthread_mutex_t lock; // guards the list of threads and the counter state
+    struct PROFILE_THREAD *threads;
+    size_t threadNum;
+    size_t generation; // bumped by profileFree, the threads drop the state they point to
+    int recording;
+    int counters;       // asked for by profileStart
+    int counterFailed;  // some thread couldn't open them
+    size_t eventCapacity;
+    unsigned long long origin;
+    unsigned long long time; // of the last profile, set by profileStop
+} profile = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static _Thread_local struct PROFILE_THREAD *current = NULL;
+static _Thread_local size_t currentGeneration = 0;
+
+static unsigned long long profileClock(void) // ns from an arbitrary monotonic origin
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+#ifdef __linux__
+static int openCounter(unsigned long long config, int leader)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP; // one read of the leader gets both
+    attr.exclude_kernel = 1;              // what the default perf_event_paranoid lets a user count
+    attr.exclude_hv = 1;
+
+    // this thread on any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+#endif
+
+// the counters of the calling thread, -1 when there are none
+static int openCounters(void)
+{
+#ifdef __linux__
+    int leader = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader < 0)
+        return -1;
+
+    if (openCounter(PERF_COUNT_HW_CACHE_MISSES, leader) < 0)
+    {
+        close(leader);
+        return -1;
+    }
+
+    return leader; // closing the leader later takes the member along with the group
+#else
+    return -1;
+#endif
+}
+
+static void closeCounters(struct PROFILE_THREAD *thread)
+{
+#ifdef __linux__
+    if (thread->counterFd >= 0)
+        close(thread->counterFd);
+#endif
+    thread->counterFd = -1;
+    thread->counterTried = 0;
+}
+
+static void readCounters(const struct PROFILE_THREAD *thread, unsigned long long *counters)
+{
+    counters[0] = counters[1] = 0;
+#ifdef __linux__
+    struct
+    {
+        unsigned long long nr, values[2];
+    } group;
+    if (thread->counterFd >= 0 && read(thread->counterFd, &group, sizeof(group)) == (ssize_t)sizeof(group))
+    {
+        counters[0] = group.values[0];
+        counters[1] = group.values[1];
+    }
+#else
+    (void)thread;
+#endif
+}
+
+// forget what a thread recorded, with the lock held
+static Sts resetThread(struct PROFILE_THREAD *thread, size_t eventCapacity, int counters)
+{
+    if (thread->eventCapacity != eventCapacity)
+    {
+        free(thread->events);
+        thread->events = eventCapacity ? malloc(sizeof(struct PROFILE_EVENT) * eventCapacity) : NULL;
+        thread->eventCapacity = thread->events ? eventCapacity : 0;
+        if (eventCapacity && !thread->events)
+            return ERROR;
+    }
+
+    thread->siteNum = thread->eventNum = thread->dropped = thread->depth = 0;
+    if (!counters)
+        closeCounters(thread);
+    else if (thread->counterFd < 0)
+        thread->counterTried = 0; // the kernel may let it through this time
+
+    return OK;
+}
+
+// the state of the calling thread, made on its first region
+static struct PROFILE_THREAD *currentThread(void)
+{
+    if (current && currentGeneration == profile.generation)
+        return current;
+
+    struct PROFILE_THREAD *thread = calloc(1, sizeof(struct PROFILE_THREAD));
+    if (!thread)
+        return NULL;
+
+    thread->counterFd = -1;
+    pthread_mutex_lock(&profile.lock);
+    if (resetThread(thread, profile.eventCapacity, profile.counters) == ERROR)
+    {
+        pthread_mutex_unlock(&profile.lock);
+        free(thread);
+        return NULL;
+    }
+    thread->id = profile.threadNum++;
+    thread->next = profile.threads;
+    profile.threads = thread;
+    currentGeneration = profile.generation;
+    pthread_mutex_unlock(&profile.lock);
+
+    current = thread;
+    return thread;
+}
+
+ProfileMark profileBegin(Pfk kind, const char *name)
+{
+    ProfileMark mark = {.name = NULL};
+    if (!profile.recording || !name || kind >= PROFILE_KINDS)
+        return mark;
+
+    struct PROFILE_THREAD *thread = currentThread();
+    if (!thread || thread->depth >= PROFILE_DEPTH)
+        return mark;
+
+    if (profile.counters && !thread->counterTried)
+    {
+        // perf_event_open counts the thread that opens it, so every thread opens its own
+        thread->counterTried = 1;
+        thread->counterFd = openCounters();
+        pthread_mutex_lock(&profile.lock);
+        profile.counterFailed = profile.counterFailed || thread->counterFd < 0;
+        pthread_mutex_unlock(&profile.lock);
+    }
+
+    thread->children[thread->depth] = 0;
+    mark.name = name;
+    mark.kind = kind;
+    mark.depth = thread->depth++;
+    readCounters(thread, mark.counters);
+    mark.begin = profileClock(); // last, so the bookkeeping above isn't timed
+
+    return mark;
+}
+
+static struct PROFILE_SITE *findSite(struct PROFILE_THREAD *thread, Pfk kind, const char *name)
+{
+    // the names are literals and __func__, the same region always brings the same pointer
+    for (size_t i = 0; i < thread->siteNum; i++)
+        if (thread->sites[i].name == name)
+            return &thread->sites[i];
+
+    if (thread->siteNum == PROFILE_SITES)
+        return NULL;
+
+    struct PROFILE_SITE *site = &thread->sites[thread->siteNum++];
+    memset(site, 0, sizeof(struct PROFILE_SITE));
+    site->name = name;
+    site->kind = kind;
+
+    return site;
+}
+
+void profileEnd(ProfileMark *mark, double flops, double bytes)
+{
+    unsigned long long end = profileClock(), counters[2];
+    struct PROFILE_THREAD *thread = current;
+    if (!mark || !mark->name || !profile.recording || !thread || currentGeneration != profile.generation ||
+        mark->depth >= thread->depth)
+        return;
+
+    readCounters(thread, counters);
+    counters[0] -= mark->counters[0];
+    counters[1] -= mark->counters[1];
+
+    unsigned long long time = end - mark->begin, children = thread->children[mark->depth];
+    thread->depth = mark->depth;
+    if (mark->depth > 0)
+        thread->children[mark->depth - 1] += time;
+
+    struct PROFILE_SITE *site = findSite(thread, mark->kind, mark->name);
+    if (site)
+    {
+        site->calls++;
+        site->time += time;
+        site->selfTime += time > children ? time - children : 0;
+        site->flops += flops;
+        site->bytes += bytes;
+        site->counters[0] += counters[0];
+        site->counters[1] += counters[1];
+    }
+
+    if (thread->eventNum == thread->eventCapacity)
+    {
+        thread->dropped += thread->eventCapacity > 0; // no capacity asks for the table alone
+        return;
+    }
+
+    unsigned long long begin = mark->begin > profile.origin ? mark->begin - profile.origin : 0;
+    thread->events[thread->eventNum++] = (struct PROFILE_EVENT){.name = mark->name, .kind = mark->kind,
+                                                                .begin = begin, .time = time, .flops = flops,
+                                                                .bytes = bytes,
+                                                                .counters = {counters[0], counters[1]}};
+}
+
+Sts profileStart(size_t eventCapacity, int counters)
+{
+    Sts rcode = OK;
+    pthread_mutex_lock(&profile.lock);
+    profile.recording = 0;
+    for (struct PROFILE_THREAD *thread = profile.threads; thread; thread = thread->next)
+        rcode = resetThread(thread, eventCapacity, counters) || rcode;
+
+    profile.eventCapacity = eventCapacity;
+    profile.counters = counters;
+    profile.counterFailed = 0;
+    profile.time = 0;
+    profile.origin = profileClock();
+    profile.recording = rcode == OK;
+    pthread_mutex_unlock(&profile.lock);
+
+    return rcode;
+}
+
+Sts profileStop(void)
+{
+    if (!profile.recording)
+        return ERROR;
+
+    profile.recording = 0;
+    profile.time = profileClock() - profile.origin;
+
+    return OK;
+}
+
+int profileCounters(void)
+{
+    return profile.counters && !profile.counterFailed;
+}
+
+static int compareSites(const void *a, const void *b)
+{
+    const struct PROFILE_SITE *siteA = (const struct PROFILE_SITE *)a, *siteB = (const struct PROFILE_SITE *)b;
+    return siteA->time < siteB->time ? 1 : siteA->time > siteB->time ? -1 : 0;
+}
+
+Sts profilePrint(FILE *file)
+{
+    if (!file)
+        return ERROR;
+
+    size_t siteNum = 0, dropped = 0;
+    for (struct PROFILE_THREAD *thread = profile.threads; thread; thread = thread->next)
+        siteNum += thread->siteNum;
+
+    // the tables of all threads folded by name, the same name may come from more than one pointer
+    struct PROFILE_SITE *sites = malloc(sizeof(struct PROFILE_SITE) * (siteNum ? siteNum : 1));
+    if (!sites)
+        return ERROR;
+
+    size_t merged = 0;
+    for (struct PROFILE_THREAD *thread = profile.threads; thread; thread = thread->next)
+    {
+        dropped += thread->dropped;
+        for (size_t i = 0; i < thread->siteNum; i++)
+        {
+            const struct PROFILE_SITE *site = &thread->sites[i];
+            size_t j = 0;
+            while (j < merged && (sites[j].kind != site->kind || strcmp(sites[j].name, site->name) != 0))
+                j++;
+
+            if (j == merged)
+            {
+                sites[merged++] = *site;
+                continue;
+            }
+            sites[j].calls += site->calls;
+            sites[j].time += site->time;
+            sites[j].selfTime += site->selfTime;
+            sites[j].flops += site->flops;
+            sites[j].bytes += site->bytes;
+            sites[j].counters[0] += site->counters[0];
+            sites[j].counters[1] += site->counters[1];
+        }
+    }
+    qsort(sites, merged, sizeof(struct PROFILE_SITE), compareSites);
+
+    unsigned long long time = profile.recording ? profileClock() - profile.origin : profile.time;
+    int counters = profileCounters();
+    fprintf(file, "profile of %.3f ms on %zu threads", time * 1e-6, profile.threadNum);
+    if (dropped)
+        fprintf(file, ", %zu events past the trace capacity", dropped);
+    if (profile.counters && !counters)
+        fprintf(file, ", perf_event_open refused the counters");
+    fprintf(file, "\n%-7s %-28s %9s %11s %11s %11s %9s %9s", "kind", "region", "calls", "total ms", "self ms",
+            "avg us", "GFLOP/s", "GB/s");
+    if (counters)
+        fprintf(file, " %11s %11s", "Mcycles", "Kmisses");
+    fprintf(file, "\n");
+
+    // times of the threads add up, a kernel running on every worker may take more than the wall time
+    for (size_t i = 0; i < merged; i++)
+    {
+        const struct PROFILE_SITE *site = &sites[i];
+        double ns = site->time ? (double)site->time : 1;
+        fprintf(file, "%-7s %-28s %9zu %11.3f %11.3f %11.3f", kindNames[site->kind], site->name, site->calls,
+                site->time * 1e-6, site->selfTime * 1e-6, site->time * 1e-3 / site->calls);
+        if (site->flops > 0)
+            fprintf(file, " %9.3f", site->flops / ns);
+        else
+            fprintf(file, " %9s", "-");
+        if (site->bytes > 0)
+            fprintf(file, " %9.3f", site->bytes / ns);
+        else
+            fprintf(file, " %9s", "-");
+        if (counters)
+            fprintf(file, " %11.3f %11.3f", site->counters[0] * 1e-6, site->counters[1] * 1e-3);
+        fprintf(file, "\n");
+    }
+
+    free(sites);
+    return OK;
+}
+
+static void writeString(FILE *stream, const char *string)
+{
+    fputc('"', stream);
+    for (; *string; string++)
+    {
+        if (*string == '"' || *string == '\\')
+            fputc('\\', stream);
+        fputc(*string, stream);
+    }
+    fputc('"', stream);
+}
+
+Sts profileWriteTrace(const char *path)
+{
+    if (!path)
+        return ERROR;
+
+    FILE *stream = fopen(path, "w");
+    if (!stream)
+        return ERROR;
+
+    // complete events, "ph": "X", in us; the viewer nests the regions of a thread by their times
+    int counters = profileCounters(), first = 1;
+    fprintf(stream, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (struct PROFILE_THREAD *thread = profile.threads; thread; thread = thread->next)
+    {
+        fprintf(stream, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, "
+                        "\"args\": {\"name\": \"thread %zu\"}}",
+                first ? "" : ",", thread->id, thread->id);
+        first = 0;
+
+        for (size_t i = 0; i < thread->eventNum; i++)
+        {
+            const struct PROFILE_EVENT *event = &thread->events[i];
+            fprintf(stream, ",\n{\"name\": ");
+            writeString(stream, event->name);
+            fprintf(stream, ", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f, "
+                            "\"args\": {\"flops\": %.0f, \"bytes\": %.0f",
+                    kindNames[event->kind], thread->id, event->begin * 1e-3, event->time * 1e-3, event->flops,
+                    event->bytes);
+            if (counters)
+                fprintf(stream, ", \"cycles\": %llu, \"cacheMisses\": %llu", event->counters[0], event->counters[1]);
+            fprintf(stream, "}}");
+        }
+    }
+    fprintf(stream, "\n]}\n");
+
+    if (fclose(stream) != 0)
+        return ERROR;
+
+    return OK;
+}
+
+Sts profileFree(void)
+{
+    pthread_mutex_lock(&profile.lock);
+    profile.recording = 0;
+    for (struct PROFILE_THREAD *thread = profile.threads, *next; thread; thread = next)
+    {
+        next = thread->next;
+        closeCounters(thread);
+        free(thread->events);
+        free(thread);
+    }
+    profile.threads = NULL;
+    profile.threadNum = 0;
+    profile.generation++;
+    pthread_mutex_unlock(&profile.lock);
+
+    return OK;
+}
+
+#else
+
+// built without CNN_PROFILE, the macros leave no call behind and these only answer that nothing is recorded
+
+ProfileMark profileBegin(Pfk kind, const char *name)
+{
+    (void)kind;
+    (void)name;
+    return (ProfileMark){.name = NULL};
+}
+
+void profileEnd(ProfileMark *mark, double flops, double bytes)
+{
+    (void)mark;
+    (void)flops;
+    (void)bytes;
+}
+
+Sts profileStart(size_t eventCapacity, int counters)
+{
+    (void)eventCapacity;
+    (void)counters;
+    return ERROR;
+}
+
+Sts profileStop(void)
+{
+    return ERROR;
+}
+
+int profileCounters(void)
+{
+    return 0;
+}
+
+Sts profilePrint(FILE *file)
+{
+    (void)file;
+    return ERROR;
+}
+
+Sts profileWriteTrace(const char *path)
+{
+    (void)path;
+    return ERROR;
+}
+
+Sts profileFree(void)
+{
+    return OK;
+}
+
+#endif
@@ -0,0 +1,663 @@
+#include "profile.h"
+#include "quant.h"
+#include "simd.h"
+#include "threadpool.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QUANT_X86
+#include <immintrin.h>
+#endif
+
+#define QUANT_SMALL 32768      // multiply-adds below which a task isn't worth handing to another thread
+#define QUANT_TILE_ROWS 4      // samples sharing the weight tile in registers, at most
+#define QUANT_CLAMP 512.0f     // real / scale is clamped to this first, so every level converts it the same way
+#define QUANT_ROUND_UP(x, a) (((x) + (a) - 1) / (a) * (a))
+
+/*
+Every level runs the same float operations in the same order, a separate multiply and add and never an fma,
+so the output is bitwise the same at every simd level and the scalar one is the reference.
+*/
+static inline int32_t loadQuad(const uint8_t *x) // four consecutive inputs as one int32 to broadcast
+{
+    int32_t quad;
+    memcpy(&quad, x, sizeof(quad));
+    return quad;
+}
+
+static inline float activateValue(Act activation, float value)
+{
+    switch (activation)
+    {
+    case ACTIVATION_RELU:
+        return value > 0 ? value : 0;
+    case ACTIVATION_LEAKY_RELU:
+        return value > 0 ? value : (float)LEAKY_RELU_SLOPE * value;
+    case ACTIVATION_SIGMOID:
+        return 1 / (1 + expf(-value));
+    default:
+        return value;
+    }
+}
+
+static inline uint8_t quantizeValue(float value, float inverseScale, int32_t zero)
+{
+    float scaled = value * inverseScale;
+    scaled = scaled < -QUANT_CLAMP ? -QUANT_CLAMP : scaled > QUANT_CLAMP ? QUANT_CLAMP : scaled;
+    long q = lrintf(scaled) + zero;
+    return (uint8_t)(q < 0 ? 0 : q > 255 ? 255 : q);
+}
+
+// bias, activation and the store of the channels [col, col + QUANT_TILE_COLS) of sample row
+static void epilogueScalar(const struct QFCL *qfcl, float inverseScale, size_t row, size_t col, const int32_t *acc)
+{
+    size_t cols = qfcl->neuronNumOut - col < QUANT_TILE_COLS ? qfcl->neuronNumOut - col : QUANT_TILE_COLS;
+    for (size_t c = 0; c < cols; c++)
+    {
+        float value = qfcl->scale[col + c] * (float)acc[c];
+        value = activateValue(qfcl->activation, value + qfcl->bias[col + c]);
+        if (qfcl->outputScale > 0)
+            qfcl->output[row * qfcl->outputDepth + col + c] = quantizeValue(value, inverseScale, qfcl->outputZero);
+        else
+            qfcl->outputFloat[row * qfcl->neuronNumOut + col + c] = value;
+    }
+}
+
+// the tiles [begin, end) of channels for every sample
+static void colsScalar(const struct QFCL *qfcl, float inverseScale, size_t begin, size_t end)
+{
+    size_t depth = qfcl->depth;
+    for (size_t t = begin; t < end; t++)
+        for (size_t row = 0; row < qfcl->batchSize; row++)
+        {
+            const int8_t *w = qfcl->weight + t * QUANT_TILE_COLS * depth;
+            const uint8_t *x = qfcl->input + row * depth;
+            int32_t acc[QUANT_TILE_COLS] = {0};
+            for (size_t p = 0; p < depth; p += 4, w += 4 * QUANT_TILE_COLS)
+                for (size_t c = 0; c < QUANT_TILE_COLS; c++)
+                    for (size_t b = 0; b < 4; b++)
+                        acc[c] += (int32_t)x[p + b] * w[4 * c + b];
+            epilogueScalar(qfcl, inverseScale, row, t * QUANT_TILE_COLS, acc);
+        }
+}
+
+static void quantizeScalar(const float *x, size_t n, float inverseScale, int32_t zero, uint8_t *q)
+{
+    for (size_t i = 0; i < n; i++)
+        q[i] = quantizeValue(x[i], inverseScale, zero);
+}
+
+#ifdef QUANT_X86
+// clamp, round, add the zero point and saturate to [0, 255], as quantizeValue does
+__attribute__((target("avx2"))) static inline __m256i quantizeAvx2(__m256 value, __m256 inverseScale, __m256i zero)
+{
+    __m256 scaled = _mm256_mul_ps(value, inverseScale);
+    scaled = _mm256_min_ps(_mm256_max_ps(scaled, _mm256_set1_ps(-QUANT_CLAMP)), _mm256_set1_ps(QUANT_CLAMP));
+    __m256i q = _mm256_add_epi32(_mm256_cvtps_epi32(scaled), zero);
+    return _mm256_min_epi32(_mm256_max_epi32(q, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+__attribute__((target("avx2"))) static inline __m256 activateAvx2(Act activation, __m256 value)
+{
+    if (activation == ACTIVATION_RELU)
+        return _mm256_max_ps(value, _mm256_setzero_ps());
+    if (activation == ACTIVATION_LEAKY_RELU)
+        return _mm256_blendv_ps(_mm256_mul_ps(value, _mm256_set1_ps((float)LEAKY_RELU_SLOPE)), value,
+                                _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_GT_OQ));
+    return value;
+}
+
+__attribute__((target("avx2"))) static void quantizeAvx2Row(const float *x, size_t n, float inverseScale,
+                                                            int32_t zero, uint8_t *q)
+{
+    __m256 inverse = _mm256_set1_ps(inverseScale);
+    __m256i zeros = _mm256_set1_epi32(zero);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i packed = _mm256_packs_epi32(quantizeAvx2(_mm256_loadu_ps(x + i), inverse, zeros),
+                                            quantizeAvx2(_mm256_loadu_ps(x + i + 8), inverse, zeros));
+        packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)(q + i),
+                         _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1)));
+    }
+    quantizeScalar(x + i, n - i, inverseScale, zero, q + i);
+}
+
+// one sample of the tile, the 16 channels in lo and hi
+__attribute__((target("avx2"))) static void epilogueAvx2(const struct QFCL *qfcl, float inverseScale, size_t row,
+                                                         size_t col, __m256i lo, __m256i hi)
+{
+    if (qfcl->activation == ACTIVATION_SIGMOID) // no vector exp here, and it has to match expf anyway
+    {
+        int32_t acc[QUANT_TILE_COLS];
+        _mm256_storeu_si256((__m256i *)acc, lo);
+        _mm256_storeu_si256((__m256i *)(acc + 8), hi);
+        epilogueScalar(qfcl, inverseScale, row, col, acc);
+        return;
+    }
+
+    __m256 v0 = _mm256_mul_ps(_mm256_loadu_ps(qfcl->scale + col), _mm256_cvtepi32_ps(lo));
+    __m256 v1 = _mm256_mul_ps(_mm256_loadu_ps(qfcl->scale + col + 8), _mm256_cvtepi32_ps(hi));
+    v0 = activateAvx2(qfcl->activation, _mm256_add_ps(v0, _mm256_loadu_ps(qfcl->bias + col)));
+    v1 = activateAvx2(qfcl->activation, _mm256_add_ps(v1, _mm256_loadu_ps(qfcl->bias + col + 8)));
+
+    if (qfcl->outputScale > 0)
+    {
+        __m256 inverse = _mm256_set1_ps(inverseScale);
+        __m256i zero = _mm256_set1_epi32(qfcl->outputZero);
+        __m256i q = _mm256_packs_epi32(quantizeAvx2(v0, inverse, zero), quantizeAvx2(v1, inverse, zero));
+        q = _mm256_permute4x64_epi64(q, _MM_SHUFFLE(3, 1, 2, 0)); // packs interleaves its operands by lane
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+        _mm_storeu_si128((__m128i *)(qfcl->output + row * qfcl->outputDepth + col), bytes);
+        return;
+    }
+
+    float values[QUANT_TILE_COLS];
+    size_t cols = qfcl->neuronNumOut - col < QUANT_TILE_COLS ? qfcl->neuronNumOut - col : QUANT_TILE_COLS;
+    float *out = qfcl->outputFloat + row * qfcl->neuronNumOut + col;
+    _mm256_storeu_ps(cols == QUANT_TILE_COLS ? out : values, v0);
+    _mm256_storeu_ps(cols == QUANT_TILE_COLS ? out + 8 : values + 8, v1);
+    if (cols < QUANT_TILE_COLS)
+        memcpy(out, values, cols * sizeof(float));
+}
+
+/*
+Both operands widened to int16 and multiplied with madd_epi16, exact for any byte values. maddubs would
+take the bytes as they are but adds its pairs of products into a saturating int16, and 255 * 127 * 2 doesn't fit.
+A ymm of products holds two partial sums for each of 4 channels, added pairwise once the depth is done.
+rows is 1 or 2 and a constant where this is inlined, so the accumulators stay in registers.
+*/
+__attribute__((target("avx2"), always_inline)) static inline void rowsAvx2(const struct QFCL *qfcl, float inverseScale,
+                                                                          size_t row, size_t rows, size_t t)
+{
+    size_t depth = qfcl->depth;
+    const int8_t *w = qfcl->weight + t * QUANT_TILE_COLS * depth;
+    const uint8_t *x0 = qfcl->input + row * depth, *x1 = rows > 1 ? x0 + depth : x0;
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c02 = _mm256_setzero_si256(), c03 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c12 = _mm256_setzero_si256(), c13 = _mm256_setzero_si256();
+
+    for (size_t p = 0; p < depth; p += 4, w += 4 * QUANT_TILE_COLS)
+    {
+        __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)w));
+        __m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w + 16)));
+        __m256i b2 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w + 32)));
+        __m256i b3 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w + 48)));
+
+        __m256i a = _mm256_broadcastq_epi64(_mm_cvtepu8_epi16(_mm_cvtsi32_si128(loadQuad(x0 + p))));
+        c00 = _mm256_add_epi32(c00, _mm256_madd_epi16(a, b0));
+        c01 = _mm256_add_epi32(c01, _mm256_madd_epi16(a, b1));
+        c02 = _mm256_add_epi32(c02, _mm256_madd_epi16(a, b2));
+        c03 = _mm256_add_epi32(c03, _mm256_madd_epi16(a, b3));
+        if (rows > 1)
+        {
+            a = _mm256_broadcastq_epi64(_mm_cvtepu8_epi16(_mm_cvtsi32_si128(loadQuad(x1 + p))));
+            c10 = _mm256_add_epi32(c10, _mm256_madd_epi16(a, b0));
+            c11 = _mm256_add_epi32(c11, _mm256_madd_epi16(a, b1));
+            c12 = _mm256_add_epi32(c12, _mm256_madd_epi16(a, b2));
+            c13 = _mm256_add_epi32(c13, _mm256_madd_epi16(a, b3));
+        }
+    }
+
+    // hadd pairs the partial sums within 128-bit lanes, the permute restores the channel order
+    size_t col = t * QUANT_TILE_COLS;
+    epilogueAvx2(qfcl, inverseScale, row, col,
+                 _mm256_permute4x64_epi64(_mm256_hadd_epi32(c00, c01), _MM_SHUFFLE(3, 1, 2, 0)),
+                 _mm256_permute4x64_epi64(_mm256_hadd_epi32(c02, c03), _MM_SHUFFLE(3, 1, 2, 0)));
+    if (rows > 1)
+        epilogueAvx2(qfcl, inverseScale, row + 1, col,
+                     _mm256_permute4x64_epi64(_mm256_hadd_epi32(c10, c11), _MM_SHUFFLE(3, 1, 2, 0)),
+                     _mm256_permute4x64_epi64(_mm256_hadd_epi32(c12, c13), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+__attribute__((target("avx2"))) static void colsAvx2(const struct QFCL *qfcl, float inverseScale, size_t begin,
+                                                     size_t end)
+{
+    for (size_t t = begin; t < end; t++)
+    {
+        size_t row = 0;
+        for (; row + 2 <= qfcl->batchSize; row += 2)
+            rowsAvx2(qfcl, inverseScale, row, 2, t);
+        if (row < qfcl->batchSize)
+            rowsAvx2(qfcl, inverseScale, row, 1, t);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw"))) static inline __m512 activateAvx512(Act activation, __m512 value)
+{
+    if (activation == ACTIVATION_RELU)
+        return _mm512_max_ps(value, _mm512_setzero_ps());
+    if (activation == ACTIVATION_LEAKY_RELU)
+        return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(value, _mm512_setzero_ps(), _CMP_GT_OQ),
+                                    _mm512_mul_ps(value, _mm512_set1_ps((float)LEAKY_RELU_SLOPE)), value);
+    return value;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static inline __m128i quantizeAvx512(__m512 value, __m512 inverseScale,
+                                                                                 __m512i zero)
+{
+    __m512 scaled = _mm512_mul_ps(value, inverseScale);
+    scaled = _mm512_min_ps(_mm512_max_ps(scaled, _mm512_set1_ps(-QUANT_CLAMP)), _mm512_set1_ps(QUANT_CLAMP));
+    __m512i q = _mm512_add_epi32(_mm512_cvtps_epi32(scaled), zero);
+    q = _mm512_min_epi32(_mm512_max_epi32(q, _mm512_setzero_si512()), _mm512_set1_epi32(255));
+    return _mm512_cvtepi32_epi8(q);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void quantizeAvx512Row(const float *x, size_t n, float inverseScale,
+                                                                          int32_t zero, uint8_t *q)
+{
+    __m512 inverse = _mm512_set1_ps(inverseScale);
+    __m512i zeros = _mm512_set1_epi32(zero);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i *)(q + i), quantizeAvx512(_mm512_loadu_ps(x + i), inverse, zeros));
+    quantizeScalar(x + i, n - i, inverseScale, zero, q + i);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void epilogueAvx512(const struct QFCL *qfcl, float inverseScale,
+                                                                       size_t row, size_t col, __m512i acc)
+{
+    if (qfcl->activation == ACTIVATION_SIGMOID)
+    {
+        int32_t values[QUANT_TILE_COLS];
+        _mm512_storeu_si512(values, acc);
+        epilogueScalar(qfcl, inverseScale, row, col, values);
+        return;
+    }
+
+    __m512 value = _mm512_mul_ps(_mm512_loadu_ps(qfcl->scale + col), _mm512_cvtepi32_ps(acc));
+    value = activateAvx512(qfcl->activation, _mm512_add_ps(value, _mm512_loadu_ps(qfcl->bias + col)));
+
+    if (qfcl->outputScale > 0)
+    {
+        __m128i q = quantizeAvx512(value, _mm512_set1_ps(inverseScale), _mm512_set1_epi32(qfcl->outputZero));
+        _mm_storeu_si128((__m128i *)(qfcl->output + row * qfcl->outputDepth + col), q);
+        return;
+    }
+
+    size_t cols = qfcl->neuronNumOut - col < QUANT_TILE_COLS ? qfcl->neuronNumOut - col : QUANT_TILE_COLS;
+    _mm512_mask_storeu_ps(qfcl->outputFloat + row * qfcl->neuronNumOut + col, (__mmask16)((1u << cols) - 1), value);
+}
+
+/*
+dpbusd multiplies 64 uint8 by 64 int8 and adds every 4 of them into an int32 lane, without saturating.
+rows is 1 to QUANT_TILE_ROWS and a constant where this is inlined, so the accumulators stay in registers.
+*/
+__attribute__((target("avx512f,avx512bw,avx512vnni"), always_inline)) static inline void rowsVnni(
+    const struct QFCL *qfcl, float inverseScale, size_t row, size_t rows, size_t t)
+{
+    size_t depth = qfcl->depth;
+    const int8_t *w = qfcl->weight + t * QUANT_TILE_COLS * depth;
+    const uint8_t *x0 = qfcl->input + row * depth, *x1 = rows > 1 ? x0 + depth : x0;
+    const uint8_t *x2 = rows > 2 ? x0 + 2 * depth : x0, *x3 = rows > 3 ? x0 + 3 * depth : x0;
+    __m512i c0 = _mm512_setzero_si512(), c1 = _mm512_setzero_si512();
+    __m512i c2 = _mm512_setzero_si512(), c3 = _mm512_setzero_si512();
+
+    for (size_t p = 0; p < depth; p += 4, w += 4 * QUANT_TILE_COLS)
+    {
+        __m512i b = _mm512_loadu_si512(w);
+        c0 = _mm512_dpbusd_epi32(c0, _mm512_set1_epi32(loadQuad(x0 + p)), b);
+        if (rows > 1)
+            c1 = _mm512_dpbusd_epi32(c1, _mm512_set1_epi32(loadQuad(x1 + p)), b);
+        if (rows > 2)
+            c2 = _mm512_dpbusd_epi32(c2, _mm512_set1_epi32(loadQuad(x2 + p)), b);
+        if (rows > 3)
+            c3 = _mm512_dpbusd_epi32(c3, _mm512_set1_epi32(loadQuad(x3 + p)), b);
+    }
+
+    size_t col = t * QUANT_TILE_COLS;
+    epilogueAvx512(qfcl, inverseScale, row, col, c0);
+    if (rows > 1)
+        epilogueAvx512(qfcl, inverseScale, row + 1, col, c1);
+    if (rows > 2)
+        epilogueAvx512(qfcl, inverseScale, row + 2, col, c2);
+    if (rows > 3)
+        epilogueAvx512(qfcl, inverseScale, row + 3, col, c3);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) static void colsVnni(const struct QFCL *qfcl,
+                                                                            float inverseScale, size_t begin,
+                                                                            size_t end)
+{
+    for (size_t t = begin; t < end; t++)
+    {
+        size_t row = 0;
+        for (; row + QUANT_TILE_ROWS <= qfcl->batchSize; row += QUANT_TILE_ROWS)
+            rowsVnni(qfcl, inverseScale, row, QUANT_TILE_ROWS, t);
+        switch (qfcl->batchSize - row) // the constant row counts let every loop over rows unroll
+        {
+        case 3:
+            rowsVnni(qfcl, inverseScale, row, 3, t);
+            break;
+        case 2:
+            rowsVnni(qfcl, inverseScale, row, 2, t);
+            break;
+        case 1:
+            rowsVnni(qfcl, inverseScale, row, 1, t);
+            break;
+        default:
+            break;
+        }
+    }
+}
+#endif
+
+struct QUANT_KERNELS
+{
+    void (*cols)(const struct QFCL *qfcl, float inverseScale, size_t begin, size_t end); // the tiles [begin, end)
+    void (*quantize)(const float *x, size_t n, float inverseScale, int32_t zero, uint8_t *q);
+};
+
+static const struct QUANT_KERNELS scalarQuant = {colsScalar, quantizeScalar};
+#ifdef QUANT_X86
+static const struct QUANT_KERNELS avx2Quant = {colsAvx2, quantizeAvx2Row};
+static const struct QUANT_KERNELS vnniQuant = {colsVnni, quantizeAvx512Row};
+#endif
+
+// the widest kernels the active simd level allows, so simdSetLevel(SIMD_SCALAR) gives the reference here too
+static const struct QUANT_KERNELS *quantKernels(void)
+{
+#ifdef QUANT_X86
+    __builtin_cpu_init();
+    if (simdLevel() >= SIMD_AVX512 && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni"))
+        return &vnniQuant;
+    if (simdLevel() >= SIMD_AVX2)
+        return &avx2Quant;
+#endif
+    return &scalarQuant;
+}
+
+Sts initQuantRange(QRange *range)
+{
+    if (!range)
+        return ERROR;
+
+    range->min = HUGE_VAL;
+    range->max = -HUGE_VAL;
+
+    return OK;
+}
+
+Sts observeQuantRange(QRange *range, const Vec *values)
+{
+    if (!range || !values || (values->dtype != DOUBLE_TYPE && values->dtype != FLOAT_TYPE))
+        return ERROR;
+
+    for (size_t i = 0; i < values->length; i++)
+    {
+        double value = values->dtype == FLOAT_TYPE ? values->array.floatArray[i] : values->array.doubleArray[i];
+        range->min = value < range->min ? value : range->min;
+        range->max = value > range->max ? value : range->max;
+    }
+
+    return OK;
+}
+
+Sts quantRangeParams(const QRange *range, float *scale, int32_t *zero)
+{
+    if (!range || !scale || !zero)
+        return ERROR;
+
+    double min = range->min < 0 ? range->min : 0, max = range->max > 0 ? range->max : 0;
+    if (!isfinite(min) || !isfinite(max))
+        return ERROR;
+
+    double step = (max - min) / 255;
+    if (step == 0) // nothing but zeros seen, any scale maps them to the zero point
+        step = 1;
+
+    long q = lrint(-min / step);
+    *scale = (float)step;
+    *zero = (int32_t)(q < 0 ? 0 : q > 255 ? 255 : q);
+
+    return OK;
+}
+
+
+size_t sizeofQFCL(size_t neuronNumIn, size_t neuronNumOut)
+{
+    size_t depth = QUANT_ROUND_UP(neuronNumIn, QUANT_DEPTH_ALIGN), cols = QUANT_ROUND_UP(neuronNumOut, QUANT_TILE_COLS);
+
+    // weight, scale and bias
+    return arenaAlignedSize(cols * depth) + arenaAlignedSize(cols * sizeof(float)) * 2;
+}
+
+Sts initQFCL(struct QFCL *qfcl, Arena *arena, const struct FCL *fcl, const QRange *inputRange,
+             const QRange *outputRange)
+{
+    if (!qfcl || !arena || !fcl || !inputRange || fcl->activation == ACTIVATION_CUSTOM ||
+        (fcl->weight.dtype != DOUBLE_TYPE && fcl->weight.dtype != FLOAT_TYPE))
+        return ERROR;
+
+    memset(qfcl, 0, sizeof(struct QFCL));
+    size_t numIn = fcl->neuronNumIn, numOut = fcl->neuronNumOut;
+    size_t depth = QUANT_ROUND_UP(numIn, QUANT_DEPTH_ALIGN), cols = QUANT_ROUND_UP(numOut, QUANT_TILE_COLS);
+    qfcl->batchSize = fcl->batchSize;
+    qfcl->neuronNumIn = numIn;
+    qfcl->neuronNumOut = numOut;
+    qfcl->depth = depth;
+    qfcl->activation = fcl->activation;
+
+    Sts rcode = quantRangeParams(inputRange, &qfcl->inputScale, &qfcl->inputZero);
+    if (outputRange)
+    {
+        rcode = quantRangeParams(outputRange, &qfcl->outputScale, &qfcl->outputZero) || rcode;
+        qfcl->outputDepth = QUANT_ROUND_UP(numOut, QUANT_DEPTH_ALIGN);
+    }
+
+    qfcl->weight = (int8_t *)arenaAlloc(arena, cols * depth);
+    qfcl->scale = (float *)arenaAlloc(arena, cols * sizeof(float));
+    qfcl->bias = (float *)arenaAlloc(arena, cols * sizeof(float));
+    if (rcode == ERROR || !qfcl->weight || !qfcl->scale || !qfcl->bias)
+        return ERROR;
+    memset(qfcl->weight, 0, cols * depth);
+    memset(qfcl->scale, 0, cols * sizeof(float));
+    memset(qfcl->bias, 0, cols * sizeof(float));
+
+    int isFloat = fcl->weight.dtype == FLOAT_TYPE;
+    const float *weightFloat = fcl->weight.array.floatArray;
+    const double *weightDouble = fcl->weight.array.doubleMatrix;
+    for (size_t j = 0; j < numOut; j++)
+    {
+        double absMax = 0;
+        for (size_t p = 0; p < numIn; p++)
+        {
+            double w = isFloat ? weightFloat[j * numIn + p] : weightDouble[j * numIn + p];
+            absMax = fabs(w) > absMax ? fabs(w) : absMax;
+        }
+
+        // input p of channel j sits in the tile of j, the group of p, the lane of j and the byte of p in it
+        int8_t *packed = qfcl->weight + j / QUANT_TILE_COLS * QUANT_TILE_COLS * depth + j % QUANT_TILE_COLS * 4;
+        double weightScale = absMax / 127;
+        long sum = 0;
+        for (size_t p = 0; p < numIn && weightScale > 0; p++)
+        {
+            double w = isFloat ? weightFloat[j * numIn + p] : weightDouble[j * numIn + p];
+            long q = lrint(w / weightScale);
+            q = q < -127 ? -127 : q > 127 ? 127 : q;
+            packed[p / 4 * 4 * QUANT_TILE_COLS + p % 4] = (int8_t)q;
+            sum += q;
+        }
+
+        // scale * (dot(x, w) - zero * sum(w)) + b, with the second term a constant of the channel
+        double scale = (double)qfcl->inputScale * weightScale;
+        double b = isFloat ? fcl->bias.array.floatArray[j] : fcl->bias.array.doubleArray[j];
+        qfcl->scale[j] = (float)scale;
+        qfcl->bias[j] = (float)(b - scale * qfcl->inputZero * sum);
+    }
+
+    return OK;
+}
+
+struct QUANT_ARGS // one forwardQFCL shared by the tasks of its parallel loop
+{
+    const struct QFCL *qfcl;
+    const struct QUANT_KERNELS *kernels;
+    float inverseScale; // of the output
+};
+
+static void quantColsTask(void *args, size_t begin, size_t end)
+{
+    struct QUANT_ARGS *q = (struct QUANT_ARGS *)args;
+    q->kernels->cols(q->qfcl, q->inverseScale, begin, end);
+}
+
+Sts forwardQFCL(struct QFCL *qfcl)
+{
+    if (!qfcl || !qfcl->weight || !qfcl->input || (qfcl->outputScale > 0 ? !qfcl->output : !qfcl->outputFloat))
+        return ERROR;
+
+    struct QUANT_ARGS args = {qfcl, quantKernels(), qfcl->outputScale > 0 ? 1 / qfcl->outputScale : 0};
+    size_t tiles = (qfcl->neuronNumOut + QUANT_TILE_COLS - 1) / QUANT_TILE_COLS;
+
+    PROFILE_BEGIN(profile, PROFILE_LAYER, __func__);
+    Sts rcode = parallelFor(tiles, QUANT_SMALL / (QUANT_TILE_COLS * qfcl->batchSize * qfcl->depth) + 1,
+                            quantColsTask, &args);
+    // int8 operands, the int32 accumulators never leave the registers
+    PROFILE_END(profile, 2.0 * qfcl->batchSize * qfcl->depth * qfcl->neuronNumOut,
+                (double)qfcl->depth * (qfcl->batchSize + qfcl->neuronNumOut) +
+                    (double)qfcl->batchSize * qfcl->neuronNumOut * (qfcl->outputScale > 0 ? 1 : sizeof(float)));
+
+    return rcode;
+}
+
+// the bytes of every parameter and activation of the chain, for one arena
+static size_t qmodelBytes(Model *model)
+{
+    size_t L = model->layerNum, batch = model->batchSize;
+    struct FCL *first = &model->layers[0].layer.fcl, *last = &model->layers[L - 1].layer.fcl;
+
+    size_t bytes = arenaAlignedSize(batch * first->neuronNumIn * sizeof(float)) + // input
+                   arenaAlignedSize(batch * QUANT_ROUND_UP(first->neuronNumIn, QUANT_DEPTH_ALIGN)) +
+                   arenaAlignedSize(batch * last->neuronNumOut * sizeof(float)); // output
+    for (size_t i = 0; i < L; i++)
+    {
+        struct FCL *fcl = &model->layers[i].layer.fcl;
+        bytes += sizeofQFCL(fcl->neuronNumIn, fcl->neuronNumOut);
+        if (i + 1 < L)
+            bytes += arenaAlignedSize(batch * QUANT_ROUND_UP(fcl->neuronNumOut, QUANT_DEPTH_ALIGN));
+    }
+
+    return bytes;
+}
+
+/*
+The range of the input of every layer over the calibration batches, seen right before the layer runs:
+the planner of an inference model lets a later activation take over the buffer of an earlier one.
+*/
+static Sts calibrate(Model *model, const Vec *samples, size_t sampleNum, QRange *ranges)
+{
+    Sts rcode = OK;
+    for (size_t i = 0; i < model->layerNum; i++)
+        rcode = initQuantRange(&ranges[i]) || rcode;
+
+    size_t bytes = model->input.length * sizeOfDataType(model->dtype);
+    for (size_t s = 0; s < sampleNum && rcode == OK; s++)
+    {
+        if (samples[s].length != model->input.length || samples[s].dtype != model->dtype)
+            return ERROR;
+
+        memcpy(model->input.array.charArray, samples[s].array.charArray, bytes);
+        for (size_t i = 0; i < model->layerNum; i++)
+        {
+            rcode = observeQuantRange(&ranges[i], &model->layers[i].layer.fcl.input) || rcode;
+            rcode = forwardFCL(&model->layers[i].layer.fcl) || rcode;
+        }
+    }
+
+    return rcode;
+}
+
+Sts quantizeModel(QModel *qmodel, Model *model, const Vec *samples, size_t sampleNum)
+{
+    if (!qmodel || !model || !model->buffers || !samples || sampleNum == 0)
+        return ERROR;
+
+    memset(qmodel, 0, sizeof(QModel)); // freeQModel is safe on it from here on
+    size_t L = model->layerNum, batch = model->batchSize;
+    for (size_t i = 0; i < L; i++)
+        if (model->layers[i].type != FULLY_CONNECTED_LAYER ||
+            model->layers[i].layer.fcl.activation == ACTIVATION_CUSTOM)
+            return ERROR;
+
+    QRange *ranges = (QRange *)malloc(sizeof(QRange) * L);
+    qmodel->layers = (struct QFCL *)calloc(L, sizeof(struct QFCL));
+    if (!ranges || !qmodel->layers || calibrate(model, samples, sampleNum, ranges) == ERROR ||
+        initArena(&qmodel->memory, qmodelBytes(model)) == ERROR)
+    {
+        free(ranges);
+        freeQModel(qmodel);
+        return ERROR;
+    }
+    memset(qmodel->memory.base, 0, qmodel->memory.capacity); // the padding of every row stays zero
+    qmodel->batchSize = batch;
+    qmodel->layerNum = L;
+
+    Sts rcode = OK;
+    Arena *arena = &qmodel->memory;
+    for (size_t i = 0; i < L; i++)
+        rcode = initQFCL(&qmodel->layers[i], arena, &model->layers[i].layer.fcl, &ranges[i],
+                         i + 1 < L ? &ranges[i + 1] : NULL) ||
+                rcode;
+    free(ranges);
+
+    // the output of a layer is the input of the next, only the first input and the last output are new
+    struct QFCL *first = &qmodel->layers[0], *last = &qmodel->layers[L - 1];
+    qmodel->input = (Vec){.array.floatArray = (float *)arenaAlloc(arena, batch * first->neuronNumIn * sizeof(float)),
+                          .length = batch * first->neuronNumIn, .dtype = FLOAT_TYPE};
+    first->input = (uint8_t *)arenaAlloc(arena, batch * first->depth);
+    for (size_t i = 0; i + 1 < L; i++)
+        qmodel->layers[i].output = qmodel->layers[i + 1].input =
+            (uint8_t *)arenaAlloc(arena, batch * qmodel->layers[i].outputDepth);
+    last->outputFloat = (float *)arenaAlloc(arena, batch * last->neuronNumOut * sizeof(float));
+    qmodel->output = (Vec){.array.floatArray = last->outputFloat, .length = batch * last->neuronNumOut,
+                           .dtype = FLOAT_TYPE};
+
+    if (rcode == ERROR || !qmodel->input.array.floatArray || !first->input || !last->outputFloat)
+    {
+        freeQModel(qmodel);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+Sts forwardQModel(QModel *qmodel)
+{
+    if (!qmodel || !qmodel->layers || !qmodel->input.array.floatArray)
+        return ERROR;
+
+    // quantize the input into the padded rows of the first layer
+    struct QFCL *first = &qmodel->layers[0];
+    const struct QUANT_KERNELS *kernels = quantKernels();
+    for (size_t i = 0; i < qmodel->batchSize; i++)
+        kernels->quantize(qmodel->input.array.floatArray + i * first->neuronNumIn, first->neuronNumIn,
+                          1 / first->inputScale, first->inputZero, first->input + i * first->depth);
+
+    PROFILE_BEGIN(profile, PROFILE_MODEL, __func__);
+    Sts rcode = OK;
+    for (size_t i = 0; i < qmodel->layerNum && rcode == OK; i++)
+        rcode = forwardQFCL(&qmodel->layers[i]);
+    PROFILE_END(profile, 0, 0);
+
+    return rcode;
+}
+
+size_t qmodelFootprint(QModel *qmodel)
+{
+    return qmodel ? qmodel->memory.capacity : 0;
+}
+
+Sts freeQModel(QModel *qmodel)
+{
+    if (!qmodel)
+        return OK;
+
+    freeArena(&qmodel->memory);
+    free(qmodel->layers);
+    memset(qmodel, 0, sizeof(QModel));
+
+    return OK;
+}
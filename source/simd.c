@@ -0,0 +1,243 @@
+#include "simd.h"
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// fill a table with the double and float kernels generated under one suffix
+#define SIMD_TABLE(levelName, suffix)                                                                                  \
+    {                                                                                                                  \
+        .name = levelName,                                                                                             \
+        .addDouble = addDouble##suffix, .mulDouble = mulDouble##suffix, .axpyDouble = axpyDouble##suffix,              \
+        .scaleDouble = scaleDouble##suffix, .reluDouble = reluDouble##suffix,                                          \
+        .reluDerivativeDouble = reluDerivativeDouble##suffix, .reluBackwardDouble = reluBackwardDouble##suffix,        \
+        .sigmoidDouble = sigmoidDouble##suffix, .sigmoidBackwardDouble = sigmoidBackwardDouble##suffix,                \
+        .expShiftSumDouble = expShiftSumDouble##suffix, .maxDouble = maxDouble##suffix,                                \
+        .sumDouble = sumDouble##suffix, .addFloat = addFloat##suffix, .mulFloat = mulFloat##suffix,                    \
+        .axpyFloat = axpyFloat##suffix, .scaleFloat = scaleFloat##suffix, .reluFloat = reluFloat##suffix,              \
+        .reluDerivativeFloat = reluDerivativeFloat##suffix, .reluBackwardFloat = reluBackwardFloat##suffix,            \
+        .sigmoidFloat = sigmoidFloat##suffix, .sigmoidBackwardFloat = sigmoidBackwardFloat##suffix,                    \
+        .expShiftSumFloat = expShiftSumFloat##suffix, .maxFloat = maxFloat##suffix, .sumFloat = sumFloat##suffix,      \
+        .momentumDouble = momentumDouble##suffix, .rmspropDouble = rmspropDouble##suffix,                              \
+        .adamDouble = adamDouble##suffix, .momentumFloat = momentumFloat##suffix,                                      \
+        .rmspropFloat = rmspropFloat##suffix, .adamFloat = adamFloat##suffix,                                          \
+        .poolMaxDouble = poolMaxDouble##suffix, .poolAvgDouble = poolAvgDouble##suffix,                                \
+        .poolMaxFloat = poolMaxFloat##suffix, .poolAvgFloat = poolAvgFloat##suffix,                                    \
+    }
+
+#define T double
+#define SIMD_NAME(name) name##DoubleScalar
+#define SCALAR_EXP exp
+#define SCALAR_SQRT sqrt
+#include "simdScalar.inc"
+
+#define T float
+#define SIMD_NAME(name) name##FloatScalar
+#define SCALAR_EXP expf
+#define SCALAR_SQRT sqrtf
+#include "simdScalar.inc"
+
+static const Simd scalarKernels = SIMD_TABLE("scalar", Scalar);
+
+#ifdef SIMD_X86
+
+#define SIMD_TARGET __attribute__((target("sse2")))
+
+#define T double
+#define SIMD_FLOAT 0
+#define SIMD_NAME(name) name##DoubleSse2
+#define VD __m128d
+#define VI __m128i
+#define W 2
+#define VOP(op) _mm_##op##_pd
+#define VFMA(a, b, c) _mm_add_pd(_mm_mul_pd(a, b), c)
+#define VSELECT_GT(x, y, a, b) _mm_or_pd(_mm_and_pd(_mm_cmpgt_pd(x, y), a), _mm_andnot_pd(_mm_cmpgt_pd(x, y), b))
+#define VCAST_I _mm_castpd_si128
+#define VCAST_D _mm_castsi128_pd
+#define VADD_I _mm_add_epi64
+#define VSLLI _mm_slli_epi64
+#define VSET_I(x) _mm_set1_epi64x(x)
+#include "simdKernels.inc"
+
+#define T float
+#define SIMD_FLOAT 1
+#define SIMD_NAME(name) name##FloatSse2
+#define VD __m128
+#define VI __m128i
+#define W 4
+#define VOP(op) _mm_##op##_ps
+#define VFMA(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#define VSELECT_GT(x, y, a, b) _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(x, y), a), _mm_andnot_ps(_mm_cmpgt_ps(x, y), b))
+#define VCAST_I _mm_castps_si128
+#define VCAST_D _mm_castsi128_ps
+#define VADD_I _mm_add_epi32
+#define VSLLI _mm_slli_epi32
+#define VSET_I(x) _mm_set1_epi32(x)
+#include "simdKernels.inc"
+
+#undef SIMD_TARGET
+static const Simd kernelsSse2 = SIMD_TABLE("sse2", Sse2);
+
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+
+#define T double
+#define SIMD_FLOAT 0
+#define SIMD_NAME(name) name##DoubleAvx2
+#define VD __m256d
+#define VI __m256i
+#define W 4
+#define VOP(op) _mm256_##op##_pd
+#define VFMA _mm256_fmadd_pd
+#define VSELECT_GT(x, y, a, b) _mm256_blendv_pd(b, a, _mm256_cmp_pd(x, y, _CMP_GT_OQ))
+#define VCAST_I _mm256_castpd_si256
+#define VCAST_D _mm256_castsi256_pd
+#define VADD_I _mm256_add_epi64
+#define VSLLI _mm256_slli_epi64
+#define VSET_I(x) _mm256_set1_epi64x(x)
+#include "simdKernels.inc"
+
+#define T float
+#define SIMD_FLOAT 1
+#define SIMD_NAME(name) name##FloatAvx2
+#define VD __m256
+#define VI __m256i
+#define W 8
+#define VOP(op) _mm256_##op##_ps
+#define VFMA _mm256_fmadd_ps
+#define VSELECT_GT(x, y, a, b) _mm256_blendv_ps(b, a, _mm256_cmp_ps(x, y, _CMP_GT_OQ))
+#define VCAST_I _mm256_castps_si256
+#define VCAST_D _mm256_castsi256_ps
+#define VADD_I _mm256_add_epi32
+#define VSLLI _mm256_slli_epi32
+#define VSET_I(x) _mm256_set1_epi32(x)
+#include "simdKernels.inc"
+
+#undef SIMD_TARGET
+static const Simd kernelsAvx2 = SIMD_TABLE("avx2", Avx2);
+
+#define SIMD_TARGET __attribute__((target("avx512f")))
+
+#define T double
+#define SIMD_FLOAT 0
+#define SIMD_NAME(name) name##DoubleAvx512
+#define VD __m512d
+#define VI __m512i
+#define W 8
+#define VOP(op) _mm512_##op##_pd
+#define VFMA _mm512_fmadd_pd
+#define VSELECT_GT(x, y, a, b) _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, y, _CMP_GT_OQ), b, a)
+#define VCAST_I _mm512_castpd_si512
+#define VCAST_D _mm512_castsi512_pd
+#define VADD_I _mm512_add_epi64
+#define VSLLI _mm512_slli_epi64
+#define VSET_I(x) _mm512_set1_epi64(x)
+#include "simdKernels.inc"
+
+#define T float
+#define SIMD_FLOAT 1
+#define SIMD_NAME(name) name##FloatAvx512
+#define VD __m512
+#define VI __m512i
+#define W 16
+#define VOP(op) _mm512_##op##_ps
+#define VFMA _mm512_fmadd_ps
+#define VSELECT_GT(x, y, a, b) _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, y, _CMP_GT_OQ), b, a)
+#define VCAST_I _mm512_castps_si512
+#define VCAST_D _mm512_castsi512_ps
+#define VADD_I _mm512_add_epi32
+#define VSLLI _mm512_slli_epi32
+#define VSET_I(x) _mm512_set1_epi32(x)
+#include "simdKernels.inc"
+
+#undef SIMD_TARGET
+static const Simd kernelsAvx512 = SIMD_TABLE("avx512", Avx512);
+
+#endif
+
+/*
+Pool workers take the table on their first kernel at the same time the caller may, so the CPU is probed once
+under probeOnce and the table is one atomic pointer, its level found from it rather than kept beside it.
+*/
+static pthread_once_t probeOnce = PTHREAD_ONCE_INIT;
+static Lvl detectedLevel = SIMD_SCALAR;
+static const Simd *_Atomic activeKernels = NULL;
+
+static const Simd *tableOf(Lvl level) // whether or not the CPU runs it
+{
+    switch (level)
+    {
+    case SIMD_SCALAR:
+        return &scalarKernels;
+#ifdef SIMD_X86
+    case SIMD_SSE2:
+        return &kernelsSse2;
+    case SIMD_AVX2:
+        return &kernelsAvx2;
+    case SIMD_AVX512:
+        return &kernelsAvx512;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static void probeLevel(void)
+{
+    Lvl level = SIMD_SCALAR;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        level = SIMD_AVX512;
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        level = SIMD_AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        level = SIMD_SSE2;
+#endif
+    detectedLevel = level;
+    activeKernels = tableOf(level);
+}
+
+Lvl simdDetectLevel(void)
+{
+    pthread_once(&probeOnce, probeLevel);
+
+    return detectedLevel;
+}
+
+const Simd *simdKernelsAt(Lvl level)
+{
+    return level > simdDetectLevel() ? NULL : tableOf(level);
+}
+
+Sts simdSetLevel(Lvl level)
+{
+    const Simd *kernels = simdKernelsAt(level);
+    if (!kernels)
+        return ERROR;
+
+    activeKernels = kernels;
+
+    return OK;
+}
+
+Lvl simdLevel(void)
+{
+    const Simd *kernels = simdKernels();
+    Lvl level = SIMD_SCALAR;
+    while (simdKernelsAt(level) != kernels)
+        level++;
+
+    return level;
+}
+
+const Simd *simdKernels(void)
+{
+    const Simd *kernels = activeKernels;
+    if (kernels)
+        return kernels;
+
+    simdDetectLevel();
+    return activeKernels;
+}
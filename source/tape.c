@@ -0,0 +1,725 @@
+#include "tape.h"
+#include "conv.h"
+#include "gemm.h"
+#include "layers.h"
+#include "profile.h"
+#include "simd.h"
+#include <string.h>
+
+Sts initTape(Tape *tape, size_t nodeCapacity, size_t valueBytes, Dtp dtype)
+{
+    if (!tape || nodeCapacity == 0 || (dtype != DOUBLE_TYPE && dtype != FLOAT_TYPE))
+        return ERROR;
+
+    memset(tape, 0, sizeof(Tape));
+    tape->dtype = dtype;
+    tape->nodes = (struct TAPE_NODE *)malloc(nodeCapacity * sizeof(struct TAPE_NODE));
+    if (!tape->nodes)
+        return ERROR;
+    tape->nodeCapacity = nodeCapacity;
+
+    if (initArena(&tape->values, valueBytes) == ERROR)
+    {
+        free(tape->nodes);
+        tape->nodes = NULL;
+        return ERROR;
+    }
+
+    return OK;
+}
+
+Sts tapeReset(Tape *tape)
+{
+    if (!tape)
+        return ERROR;
+
+    tape->nodeNum = 0;
+    tape->gradBytes = 0;
+    tape->scratchLength = 0;
+
+    return resetArena(&tape->values);
+}
+
+Sts freeTape(Tape *tape)
+{
+    if (!tape)
+        return ERROR;
+
+    free(tape->nodes);
+    freeArena(&tape->values);
+    freeArena(&tape->grads);
+    memset(tape, 0, sizeof(Tape));
+
+    return OK;
+}
+
+size_t tapeFootprint(const Tape *tape)
+{
+    return tape ? tape->values.offset + tape->grads.capacity : 0;
+}
+
+static struct TAPE_NODE *nodeOf(Tape *tape, Var var)
+{
+    return tape && var < tape->nodeNum ? &tape->nodes[var] : NULL;
+}
+
+// the next node, only kept once recordNode has run it
+static struct TAPE_NODE *newNode(Tape *tape, enum TapeOp op)
+{
+    if (!tape || tape->nodeNum == tape->nodeCapacity)
+        return NULL;
+
+    struct TAPE_NODE *node = &tape->nodes[tape->nodeNum];
+    memset(node, 0, sizeof(struct TAPE_NODE));
+    node->op = op;
+    node->value.dtype = node->grad.dtype = node->saved.dtype = node->rows.dtype = tape->dtype;
+
+    return node;
+}
+
+static Sts newVec(Tape *tape, Vec *vec, size_t length)
+{
+    vec->length = length;
+    vec->array.charArray = (char *)arenaAlloc(&tape->values, length * sizeOfDataType(tape->dtype));
+
+    return vec->array.charArray || length == 0 ? OK : ERROR;
+}
+
+static size_t featuresOf(const struct TAPE_NODE *node)
+{
+    return node->shape[1] * node->shape[2] * node->shape[3];
+}
+
+static void addArray(Dtp dtype, const char *x, char *y, size_t n) // y += x
+{
+    const Simd *simd = simdKernels();
+    if (dtype == FLOAT_TYPE)
+        simd->addFloat((const float *)x, (const float *)y, (float *)y, n);
+    else
+        simd->addDouble((const double *)x, (const double *)y, (double *)y, n);
+}
+
+static Sts forwardNode(Tape *tape, struct TAPE_NODE *node)
+{
+    const Simd *simd = simdKernels();
+    struct TAPE_NODE *x = &tape->nodes[node->inputs[0]];
+    int isFloat = tape->dtype == FLOAT_TYPE;
+    size_t n = node->value.length;
+    Sts rcode = OK;
+
+    switch (node->op)
+    {
+    case TAPE_LINEAR: {
+        struct TAPE_NODE *w = &tape->nodes[node->inputs[1]], *b = &tape->nodes[node->inputs[2]];
+        size_t batch = node->shape[0], numIn = featuresOf(x), numOut = node->shape[1];
+        if (isFloat)
+            rcode = gemmFloatBiasAct(NO_TRANSPOSE, TRANSPOSE, batch, numOut, numIn, x->value.array.floatArray, numIn,
+                                     w->value.array.floatArray, numIn, b->value.array.floatArray, node->activation,
+                                     node->value.array.floatArray, numOut, node->value.array.floatArray, numOut);
+        else
+            rcode = gemmDoubleBiasAct(NO_TRANSPOSE, TRANSPOSE, batch, numOut, numIn, x->value.array.doubleArray,
+                                      numIn, w->value.array.doubleArray, numIn, b->value.array.doubleArray,
+                                      node->activation, node->value.array.doubleArray, numOut,
+                                      node->value.array.doubleArray, numOut);
+        break;
+    }
+    case TAPE_ACTIVATE: {
+        double slope = node->activation == ACTIVATION_LEAKY_RELU ? LEAKY_RELU_SLOPE : 0;
+        if (node->activation == ACTIVATION_NONE)
+            memcpy(node->value.array.charArray, x->value.array.charArray, n * sizeOfDataType(tape->dtype));
+        else if (node->activation == ACTIVATION_SIGMOID && isFloat)
+            simd->sigmoidFloat(x->value.array.floatArray, node->value.array.floatArray, n);
+        else if (node->activation == ACTIVATION_SIGMOID)
+            simd->sigmoidDouble(x->value.array.doubleArray, node->value.array.doubleArray, n);
+        else if (isFloat)
+            simd->reluFloat(x->value.array.floatArray, (float)slope, node->value.array.floatArray, n);
+        else
+            simd->reluDouble(x->value.array.doubleArray, slope, node->value.array.doubleArray, n);
+        break;
+    }
+    case TAPE_ADD: {
+        struct TAPE_NODE *x1 = &tape->nodes[node->inputs[1]];
+        if (isFloat)
+            simd->addFloat(x->value.array.floatArray, x1->value.array.floatArray, node->value.array.floatArray, n);
+        else
+            simd->addDouble(x->value.array.doubleArray, x1->value.array.doubleArray, node->value.array.doubleArray,
+                            n);
+        break;
+    }
+    case TAPE_CONV: {
+        // conv.h works on one image, the kernels are per channel so the batch can't be folded into the channels
+        struct TAPE_NODE *k = &tape->nodes[node->inputs[1]];
+        size_t size = sizeOfDataType(tape->dtype), batch = node->shape[0], inLength = featuresOf(x);
+        size_t outLength = featuresOf(node), columnsLength = node->saved.length / batch;
+        for (size_t s = 0; s < batch && rcode == OK; s++)
+        {
+            char *input = x->value.array.charArray + s * inLength * size;
+            char *columns = node->saved.array.charArray + s * columnsLength * size;
+            char *output = node->value.array.charArray + s * outLength * size;
+            if (isFloat)
+                rcode = convolutionGemmFloat((const float *)input, x->shape[1], x->shape[2], x->shape[3],
+                                             k->value.array.floatArray, node->multiplier, node->kernelSize,
+                                             node->stride, node->padding, (float *)columns, (float *)output);
+            else
+                rcode = convolutionGemmDouble((const double *)input, x->shape[1], x->shape[2], x->shape[3],
+                                              k->value.array.doubleArray, node->multiplier, node->kernelSize,
+                                              node->stride, node->padding, (double *)columns, (double *)output);
+        }
+        break;
+    }
+    case TAPE_POOL: {
+        // every channel of every sample is pooled on its own, so the batch is just more channels
+        unsigned char *argmax = (unsigned char *)node->saved.array.charArray;
+        size_t channel = x->shape[0] * x->shape[1];
+        if (isFloat)
+            rcode = poolingFloat(x->value.array.floatArray, channel, x->shape[2], x->shape[3], node->kernelSize,
+                                 node->stride, node->padding, node->mode, node->rows.array.floatArray,
+                                 node->value.array.floatArray, argmax);
+        else
+            rcode = poolingDouble(x->value.array.doubleArray, channel, x->shape[2], x->shape[3], node->kernelSize,
+                                  node->stride, node->padding, node->mode, node->rows.array.doubleArray,
+                                  node->value.array.doubleArray, argmax);
+        break;
+    }
+    case TAPE_SOFTMAX_CROSS_ENTROPY: {
+        struct OL ol;
+        double loss = 0;
+        rcode = bindOL(&ol, &x->value, &node->saved, featuresOf(x)) || rcode;
+        rcode = rcode == OK ? lossOL(&ol, node->labels, &loss) : ERROR;
+        if (isFloat)
+            node->value.array.floatArray[0] = (float)loss;
+        else
+            node->value.array.doubleArray[0] = loss;
+        break;
+    }
+    default: // the leaves hold what the caller put there, a flattened value is the storage of its input
+        break;
+    }
+
+    return rcode;
+}
+
+// the node recorded and run, or forgotten when the op fails
+static Sts recordNode(Tape *tape, struct TAPE_NODE *node, size_t scratchLength, Var *var)
+{
+    for (size_t i = 0; i < node->inputNum; i++)
+        node->needsGrad = node->needsGrad || tape->nodes[node->inputs[i]].needsGrad;
+    node->grad.length = node->value.length;
+
+    if (forwardNode(tape, node) == ERROR)
+        return ERROR;
+
+    // the gradient arena holds the gradient of every node at once and one scratch
+    size_t size = sizeOfDataType(tape->dtype);
+    if (node->needsGrad && node->op != TAPE_PARAM) // a parameter's gradient is the caller's
+        tape->gradBytes += arenaAlignedSize(node->grad.length * size);
+    if (scratchLength > tape->scratchLength)
+    {
+        tape->gradBytes += arenaAlignedSize(scratchLength * size) - arenaAlignedSize(tape->scratchLength * size);
+        tape->scratchLength = scratchLength;
+    }
+
+    *var = tape->nodeNum++;
+    return OK;
+}
+
+Sts tapeInput(Tape *tape, Vec *value, size_t batch, size_t channel, size_t height, size_t width, Var *var)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_INPUT);
+    if (!node || !value || !var || value->dtype != tape->dtype || batch * channel * height * width == 0 ||
+        value->length != batch * channel * height * width)
+        return ERROR;
+
+    node->value = *value;
+    memcpy(node->shape, (size_t[]){batch, channel, height, width}, sizeof(node->shape));
+
+    return recordNode(tape, node, 0, var);
+}
+
+Sts tapeParam(Tape *tape, Vec *value, Vec *grad, Var *var)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_PARAM);
+    if (!node || !value || !grad || !var || value->dtype != tape->dtype || grad->dtype != tape->dtype ||
+        value->length == 0 || grad->length != value->length)
+        return ERROR;
+
+    node->value = *value;
+    node->grad = *grad;
+    node->needsGrad = 1;
+    memcpy(node->shape, (size_t[]){value->length, 1, 1, 1}, sizeof(node->shape));
+
+    return recordNode(tape, node, 0, var);
+}
+
+static int fusable(Act activation)
+{
+    return activation == ACTIVATION_NONE || activation == ACTIVATION_RELU || activation == ACTIVATION_LEAKY_RELU ||
+           activation == ACTIVATION_SIGMOID;
+}
+
+Sts tapeLinear(Tape *tape, Var x, Var w, Var b, Act activation, Var *y)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_LINEAR);
+    struct TAPE_NODE *xn = nodeOf(tape, x), *wn = nodeOf(tape, w), *bn = nodeOf(tape, b);
+    if (!node || !xn || !wn || !bn || !y || !fusable(activation))
+        return ERROR;
+
+    size_t batch = xn->shape[0], numIn = featuresOf(xn), numOut = bn->value.length;
+    if (wn->value.length != numOut * numIn)
+        return ERROR;
+
+    node->inputs[0] = x;
+    node->inputs[1] = w;
+    node->inputs[2] = b;
+    node->inputNum = 3;
+    node->activation = activation;
+    memcpy(node->shape, (size_t[]){batch, numOut, 1, 1}, sizeof(node->shape));
+    if (newVec(tape, &node->value, batch * numOut) == ERROR)
+        return ERROR;
+
+    // the scratch takes dL/dY through the activation
+    return recordNode(tape, node, activation == ACTIVATION_NONE ? 0 : batch * numOut, y);
+}
+
+Sts tapeActivate(Tape *tape, Var x, Act activation, Var *y)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_ACTIVATE), *xn = nodeOf(tape, x);
+    if (!node || !xn || !y || !fusable(activation))
+        return ERROR;
+
+    node->inputs[0] = x;
+    node->inputNum = 1;
+    node->activation = activation;
+    memcpy(node->shape, xn->shape, sizeof(node->shape));
+    if (newVec(tape, &node->value, xn->value.length) == ERROR)
+        return ERROR;
+
+    return recordNode(tape, node, xn->value.length, y);
+}
+
+Sts tapeAdd(Tape *tape, Var x0, Var x1, Var *y)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_ADD), *n0 = nodeOf(tape, x0), *n1 = nodeOf(tape, x1);
+    if (!node || !n0 || !n1 || !y || memcmp(n0->shape, n1->shape, sizeof(n0->shape)))
+        return ERROR;
+
+    node->inputs[0] = x0;
+    node->inputs[1] = x1;
+    node->inputNum = 2;
+    memcpy(node->shape, n0->shape, sizeof(node->shape));
+    if (newVec(tape, &node->value, n0->value.length) == ERROR)
+        return ERROR;
+
+    return recordNode(tape, node, 0, y);
+}
+
+Sts tapeConv(Tape *tape, Var x, Var kernels, size_t multiplier, size_t kernelSize, size_t stride, size_t padding,
+             Var *y)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_CONV), *xn = nodeOf(tape, x), *kn = nodeOf(tape, kernels);
+    if (!node || !xn || !kn || !y || multiplier == 0)
+        return ERROR;
+
+    size_t batch = xn->shape[0], channel = xn->shape[1];
+    size_t outH = convOutSize(xn->shape[2], kernelSize, stride, padding);
+    size_t outW = convOutSize(xn->shape[3], kernelSize, stride, padding);
+    if (outH == 0 || outW == 0 || kn->value.length != channel * multiplier * kernelSize * kernelSize)
+        return ERROR;
+
+    node->inputs[0] = x;
+    node->inputs[1] = kernels;
+    node->inputNum = 2;
+    node->multiplier = multiplier;
+    node->kernelSize = kernelSize;
+    node->stride = stride;
+    node->padding = padding;
+    memcpy(node->shape, (size_t[]){batch, channel * multiplier, outH, outW}, sizeof(node->shape));
+
+    // the columns of every sample stay until the backward pass
+    Sts rcode = OK;
+    rcode = newVec(tape, &node->value, batch * channel * multiplier * outH * outW) || rcode;
+    rcode = newVec(tape, &node->saved, batch * channel * kernelSize * kernelSize * outH * outW) || rcode;
+    if (rcode == ERROR)
+        return ERROR;
+
+    // the scratch takes the kernel gradient of one sample and, behind it, its input gradient
+    return recordNode(tape, node, kn->value.length + featuresOf(xn), y);
+}
+
+Sts tapePool(Tape *tape, Var x, size_t kernelSize, size_t stride, size_t padding, Plm mode, Var *y)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_POOL), *xn = nodeOf(tape, x);
+    if (!node || !xn || !y || (mode != POOLING_MAX && mode != POOLING_AVERAGE) ||
+        poolCheck(xn->shape[2], xn->shape[3], kernelSize, stride, padding) == ERROR)
+        return ERROR;
+
+    size_t channel = xn->shape[0] * xn->shape[1];
+    size_t outH = convOutSize(xn->shape[2], kernelSize, stride, padding);
+    size_t outW = convOutSize(xn->shape[3], kernelSize, stride, padding);
+    node->inputs[0] = x;
+    node->inputNum = 1;
+    node->kernelSize = kernelSize;
+    node->stride = stride;
+    node->padding = padding;
+    node->mode = mode;
+    memcpy(node->shape, (size_t[]){xn->shape[0], xn->shape[1], outH, outW}, sizeof(node->shape));
+
+    Sts rcode = OK;
+    rcode = newVec(tape, &node->value, channel * outH * outW) || rcode;
+    rcode = newVec(tape, &node->rows, channel * poolRowsSize(xn->shape[2], xn->shape[3], kernelSize, stride,
+                                                             padding)) ||
+            rcode;
+    if (mode == POOLING_MAX) // one byte per output
+    {
+        node->saved.dtype = CHAR_TYPE;
+        node->saved.length = channel * outH * outW;
+        node->saved.array.charArray = (char *)arenaAlloc(&tape->values, node->saved.length);
+        rcode = node->saved.array.charArray ? rcode : ERROR;
+    }
+    if (rcode == ERROR)
+        return ERROR;
+
+    return recordNode(tape, node, xn->value.length, y);
+}
+
+Sts tapeFlatten(Tape *tape, Var x, Var *y)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_FLATTEN), *xn = nodeOf(tape, x);
+    if (!node || !xn || !y)
+        return ERROR;
+
+    node->inputs[0] = x;
+    node->inputNum = 1;
+    node->value = xn->value;
+    memcpy(node->shape, (size_t[]){xn->shape[0], featuresOf(xn), 1, 1}, sizeof(node->shape));
+
+    return recordNode(tape, node, 0, y);
+}
+
+Sts tapeSoftmaxCrossEntropy(Tape *tape, Var logits, const Label *labels, Var *loss)
+{
+    struct TAPE_NODE *node = newNode(tape, TAPE_SOFTMAX_CROSS_ENTROPY), *xn = nodeOf(tape, logits);
+    if (!node || !xn || !labels || !loss || labels->dtype != INT_TYPE || labels->length != xn->shape[0])
+        return ERROR;
+
+    node->inputs[0] = logits;
+    node->inputNum = 1;
+    node->labels = labels;
+    memcpy(node->shape, (size_t[]){1, 1, 1, 1}, sizeof(node->shape));
+
+    // p - y of every sample, lossOL computes it along with the loss
+    Sts rcode = OK;
+    rcode = newVec(tape, &node->value, 1) || rcode;
+    rcode = newVec(tape, &node->saved, xn->value.length) || rcode;
+    if (rcode == ERROR)
+        return ERROR;
+
+    return recordNode(tape, node, 0, loss);
+}
+
+Vec *tapeValue(Tape *tape, Var var)
+{
+    struct TAPE_NODE *node = nodeOf(tape, var);
+    return node ? &node->value : NULL;
+}
+
+Vec *tapeGrad(Tape *tape, Var var)
+{
+    struct TAPE_NODE *node = nodeOf(tape, var);
+    return node && node->gradWritten ? &node->grad : NULL;
+}
+
+Sts tapeForward(Tape *tape)
+{
+    if (!tape)
+        return ERROR;
+
+    PROFILE_BEGIN(profile, PROFILE_MODEL, __func__);
+    Sts rcode = OK;
+    for (size_t i = 0; i < tape->nodeNum && rcode == OK; i++)
+        rcode = forwardNode(tape, &tape->nodes[i]);
+    PROFILE_END(profile, 0, 0); // the kernels count the work
+
+    return rcode;
+}
+
+// the gradient of node, carved from the arena when the first one arrives
+static char *gradOf(Tape *tape, struct TAPE_NODE *node)
+{
+    if (!node->grad.array.charArray)
+        node->grad.array.charArray =
+            (char *)arenaAlloc(&tape->grads, node->grad.length * sizeOfDataType(tape->dtype));
+
+    return node->grad.array.charArray;
+}
+
+/*
+Where a kernel that overwrites its result writes the gradient of node: the gradient itself when it's the first
+to arrive, scratch otherwise, which gradFold then adds to it.
+*/
+static char *gradTarget(Tape *tape, struct TAPE_NODE *node, char *scratch)
+{
+    return node->gradWritten ? scratch : gradOf(tape, node);
+}
+
+static void gradFold(Tape *tape, struct TAPE_NODE *node, const char *target, size_t n)
+{
+    if (node->gradWritten)
+        addArray(tape->dtype, target, node->grad.array.charArray, n);
+    node->gradWritten = 1;
+}
+
+static Sts gradAdd(Tape *tape, struct TAPE_NODE *node, const char *grad) // the gradient of the whole node
+{
+    if (node->gradWritten)
+        addArray(tape->dtype, grad, node->grad.array.charArray, node->grad.length);
+    else if (gradOf(tape, node))
+        memcpy(node->grad.array.charArray, grad, node->grad.length * sizeOfDataType(tape->dtype));
+    else
+        return ERROR;
+    node->gradWritten = 1;
+
+    return OK;
+}
+
+static Sts backwardLinear(Tape *tape, struct TAPE_NODE *node, char *scratch)
+{
+    const Simd *simd = simdKernels();
+    struct TAPE_NODE *x = &tape->nodes[node->inputs[0]], *w = &tape->nodes[node->inputs[1]];
+    struct TAPE_NODE *b = &tape->nodes[node->inputs[2]];
+    size_t batch = node->shape[0], numIn = featuresOf(x), numOut = node->shape[1], n = node->value.length;
+    int isFloat = tape->dtype == FLOAT_TYPE;
+    Sts rcode = OK;
+
+    // dL/dY through the activation, from the output like deltaOfFCL
+    char *delta = node->activation == ACTIVATION_NONE ? node->grad.array.charArray : scratch;
+    double slope = node->activation == ACTIVATION_LEAKY_RELU ? LEAKY_RELU_SLOPE : 0;
+    if (node->activation == ACTIVATION_SIGMOID && isFloat)
+        simd->sigmoidBackwardFloat(node->value.array.floatArray, node->grad.array.floatArray, (float *)delta, n);
+    else if (node->activation == ACTIVATION_SIGMOID)
+        simd->sigmoidBackwardDouble(node->value.array.doubleArray, node->grad.array.doubleArray, (double *)delta, n);
+    else if (node->activation != ACTIVATION_NONE && isFloat)
+        simd->reluBackwardFloat(node->value.array.floatArray, (float)slope, node->grad.array.floatArray,
+                                (float *)delta, n);
+    else if (node->activation != ACTIVATION_NONE)
+        simd->reluBackwardDouble(node->value.array.doubleArray, slope, node->grad.array.doubleArray, (double *)delta,
+                                 n);
+
+    // dL/dW = (dL/dY)^T X and dL/dX = (dL/dY) W accumulate in the gemm, dL/db sums the rows of dL/dY
+    if (w->needsGrad)
+    {
+        char *dw = gradOf(tape, w);
+        if (isFloat)
+            rcode = gemmFloat(TRANSPOSE, NO_TRANSPOSE, numOut, numIn, batch, 1, (const float *)delta, numOut,
+                              x->value.array.floatArray, numIn, w->gradWritten, (float *)dw, numIn) ||
+                    rcode;
+        else
+            rcode = gemmDouble(TRANSPOSE, NO_TRANSPOSE, numOut, numIn, batch, 1, (const double *)delta, numOut,
+                               x->value.array.doubleArray, numIn, w->gradWritten, (double *)dw, numIn) ||
+                    rcode;
+        w->gradWritten = 1;
+    }
+    if (b->needsGrad)
+    {
+        char *db = gradOf(tape, b);
+        size_t size = sizeOfDataType(tape->dtype);
+        if (!b->gradWritten)
+            memcpy(db, delta, numOut * size);
+        for (size_t i = b->gradWritten ? 0 : 1; i < batch; i++)
+            addArray(tape->dtype, delta + i * numOut * size, db, numOut);
+        b->gradWritten = 1;
+    }
+    if (x->needsGrad)
+    {
+        char *dx = gradOf(tape, x);
+        if (isFloat)
+            rcode = gemmFloat(NO_TRANSPOSE, NO_TRANSPOSE, batch, numIn, numOut, 1, (const float *)delta, numOut,
+                              w->value.array.floatArray, numIn, x->gradWritten, (float *)dx, numIn) ||
+                    rcode;
+        else
+            rcode = gemmDouble(NO_TRANSPOSE, NO_TRANSPOSE, batch, numIn, numOut, 1, (const double *)delta, numOut,
+                               w->value.array.doubleArray, numIn, x->gradWritten, (double *)dx, numIn) ||
+                    rcode;
+        x->gradWritten = 1;
+    }
+
+    return rcode;
+}
+
+static Sts backwardConv(Tape *tape, struct TAPE_NODE *node, char *scratch)
+{
+    struct TAPE_NODE *x = &tape->nodes[node->inputs[0]], *k = &tape->nodes[node->inputs[1]];
+    size_t size = sizeOfDataType(tape->dtype), batch = node->shape[0], inLength = featuresOf(x);
+    size_t outLength = featuresOf(node), columnsLength = node->saved.length / batch, kLength = k->value.length;
+    Sts rcode = OK;
+
+    // the kernel gradient of every sample goes to scratch and is summed, so is the input gradient unless it's the first
+    int xFirst = x->needsGrad && !x->gradWritten;
+    char *dx = xFirst ? gradOf(tape, x) : NULL;
+    for (size_t s = 0; s < batch && rcode == OK; s++)
+    {
+        const char *dOutput = node->grad.array.charArray + s * outLength * size;
+        char *columns = node->saved.array.charArray + s * columnsLength * size;
+        char *dk = scratch, *dInput = xFirst ? dx + s * inLength * size : scratch + kLength * size;
+        if (tape->dtype == FLOAT_TYPE)
+            rcode = convolutionGemmBackwardFloat((const float *)dOutput, x->shape[1], x->shape[2], x->shape[3],
+                                                 k->value.array.floatArray, node->multiplier, node->kernelSize,
+                                                 node->stride, node->padding, (float *)columns, (float *)dk,
+                                                 (float *)dInput);
+        else
+            rcode = convolutionGemmBackwardDouble((const double *)dOutput, x->shape[1], x->shape[2], x->shape[3],
+                                                  k->value.array.doubleArray, node->multiplier, node->kernelSize,
+                                                  node->stride, node->padding, (double *)columns, (double *)dk,
+                                                  (double *)dInput);
+
+        if (k->needsGrad && rcode == OK)
+        {
+            if (!k->gradWritten)
+                memcpy(gradOf(tape, k), dk, kLength * size);
+            gradFold(tape, k, dk, kLength);
+        }
+        if (x->needsGrad && !xFirst && rcode == OK)
+            addArray(tape->dtype, dInput, x->grad.array.charArray + s * inLength * size, inLength);
+    }
+    x->gradWritten = x->gradWritten || xFirst;
+
+    return rcode;
+}
+
+// the vector-Jacobian product of node, from its gradient to the gradients of its inputs
+static Sts backwardNode(Tape *tape, struct TAPE_NODE *node, char *scratch)
+{
+    const Simd *simd = simdKernels();
+    struct TAPE_NODE *x = &tape->nodes[node->inputs[0]];
+    int isFloat = tape->dtype == FLOAT_TYPE;
+    size_t n = node->value.length;
+    Sts rcode = OK;
+
+    switch (node->op)
+    {
+    case TAPE_LINEAR:
+        return backwardLinear(tape, node, scratch);
+    case TAPE_CONV:
+        return backwardConv(tape, node, scratch);
+    case TAPE_ACTIVATE: {
+        if (!x->needsGrad)
+            break;
+        char *dx = gradTarget(tape, x, scratch);
+        double slope = node->activation == ACTIVATION_LEAKY_RELU ? LEAKY_RELU_SLOPE : 0;
+        if (node->activation == ACTIVATION_NONE)
+            memcpy(dx, node->grad.array.charArray, n * sizeOfDataType(tape->dtype));
+        else if (node->activation == ACTIVATION_SIGMOID && isFloat)
+            simd->sigmoidBackwardFloat(node->value.array.floatArray, node->grad.array.floatArray, (float *)dx, n);
+        else if (node->activation == ACTIVATION_SIGMOID)
+            simd->sigmoidBackwardDouble(node->value.array.doubleArray, node->grad.array.doubleArray, (double *)dx, n);
+        else if (isFloat)
+            simd->reluBackwardFloat(node->value.array.floatArray, (float)slope, node->grad.array.floatArray,
+                                    (float *)dx, n);
+        else
+            simd->reluBackwardDouble(node->value.array.doubleArray, slope, node->grad.array.doubleArray,
+                                     (double *)dx, n);
+        gradFold(tape, x, dx, n);
+        break;
+    }
+    case TAPE_ADD:
+        for (size_t i = 0; i < 2; i++)
+            if (tape->nodes[node->inputs[i]].needsGrad)
+                rcode = gradAdd(tape, &tape->nodes[node->inputs[i]], node->grad.array.charArray) || rcode;
+        break;
+    case TAPE_POOL: {
+        if (!x->needsGrad)
+            break;
+        char *dx = gradTarget(tape, x, scratch);
+        const unsigned char *argmax = (const unsigned char *)node->saved.array.charArray;
+        size_t channel = x->shape[0] * x->shape[1];
+        if (isFloat)
+            rcode = poolingBackwardFloat(node->grad.array.floatArray, channel, x->shape[2], x->shape[3],
+                                         node->kernelSize, node->stride, node->padding, node->mode, argmax,
+                                         (float *)dx);
+        else
+            rcode = poolingBackwardDouble(node->grad.array.doubleArray, channel, x->shape[2], x->shape[3],
+                                          node->kernelSize, node->stride, node->padding, node->mode, argmax,
+                                          (double *)dx);
+        gradFold(tape, x, dx, x->value.length);
+        break;
+    }
+    case TAPE_FLATTEN:
+        if (!x->needsGrad)
+            break;
+        if (!x->gradWritten && x->op != TAPE_PARAM) // the same elements in the same order, the buffer is handed down
+        {
+            x->grad.array = node->grad.array;
+            x->gradWritten = 1;
+        }
+        else
+            rcode = gradAdd(tape, x, node->grad.array.charArray);
+        break;
+    case TAPE_SOFTMAX_CROSS_ENTROPY: {
+        // the loss is the mean of the batch, so p - y of every sample counts 1 / batch of it
+        if (!x->needsGrad)
+            break;
+        double scale = (isFloat ? node->grad.array.floatArray[0] : node->grad.array.doubleArray[0]) / x->shape[0];
+        char *dx = gradOf(tape, x);
+        if (isFloat && x->gradWritten)
+            simd->axpyFloat((float)scale, node->saved.array.floatArray, (float *)dx, x->value.length);
+        else if (isFloat)
+            simd->scaleFloat((float)scale, node->saved.array.floatArray, (float *)dx, x->value.length);
+        else if (x->gradWritten)
+            simd->axpyDouble(scale, node->saved.array.doubleArray, (double *)dx, x->value.length);
+        else
+            simd->scaleDouble(scale, node->saved.array.doubleArray, (double *)dx, x->value.length);
+        x->gradWritten = 1;
+        break;
+    }
+    default:
+        break;
+    }
+
+    return rcode;
+}
+
+Sts tapeBackward(Tape *tape, Var loss)
+{
+    struct TAPE_NODE *root = nodeOf(tape, loss);
+    if (!root || root->value.length != 1 || !root->needsGrad)
+        return ERROR;
+
+    // sized by the first pass over these nodes, every pass after it carves the same buffers again
+    if (tape->grads.capacity < tape->gradBytes)
+    {
+        freeArena(&tape->grads);
+        if (initArena(&tape->grads, tape->gradBytes) == ERROR)
+            return ERROR;
+    }
+    resetArena(&tape->grads);
+
+    PROFILE_BEGIN(profile, PROFILE_MODEL, __func__);
+    char *scratch = (char *)arenaAlloc(&tape->grads, tape->scratchLength * sizeOfDataType(tape->dtype));
+    for (size_t i = 0; i <= loss; i++)
+    {
+        tape->nodes[i].gradWritten = 0;
+        if (tape->nodes[i].op != TAPE_PARAM)
+            tape->nodes[i].grad.array.charArray = NULL;
+    }
+
+    Sts rcode = OK;
+    char *seed = gradOf(tape, root);
+    if (tape->dtype == FLOAT_TYPE)
+        *(float *)seed = 1;
+    else
+        *(double *)seed = 1;
+    root->gradWritten = 1;
+
+    // only the nodes a gradient reached send one on
+    for (size_t i = loss + 1; i-- > 0 && rcode == OK;)
+        if (tape->nodes[i].needsGrad && tape->nodes[i].gradWritten)
+            rcode = backwardNode(tape, &tape->nodes[i], scratch);
+
+    // a parameter the loss doesn't depend on has a gradient of 0
+    for (size_t i = 0; i <= loss && rcode == OK; i++)
+        if (tape->nodes[i].op == TAPE_PARAM && !tape->nodes[i].gradWritten)
+            memset(tape->nodes[i].grad.array.charArray, 0, tape->nodes[i].grad.length * sizeOfDataType(tape->dtype));
+    PROFILE_END(profile, 0, 0);
+
+    return rcode;
+}
@@ -0,0 +1,270 @@
+#if defined(__linux__)
+#define _GNU_SOURCE // pthread_setaffinity_np
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+struct THREAD_POOL
+{
+    pthread_t *workers;
+    size_t workerNum; // the caller is the extra thread
+    int started;
+    int stop;
+
+    pthread_mutex_t lock;    // guards everything below
+    pthread_cond_t wake;     // a new loop was posted
+    pthread_cond_t finished; // the last chunk of the loop is done
+    pthread_mutex_t submit;  // one loop at a time, other callers run theirs inline
+
+    size_t generation; // bumped for every loop
+    void (*task)(void *, size_t, size_t);
+    void (*combine)(void *, size_t, size_t); // folded by the workers when not deterministic
+    void *args;
+    size_t length;
+    size_t chunk;
+    size_t chunkNum;
+    size_t nextChunk; // the next chunk to claim
+    size_t doneChunk; // chunks whose task and combine are done
+};
+
+static struct THREAD_POOL pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                                  .wake = PTHREAD_COND_INITIALIZER,
+                                  .finished = PTHREAD_COND_INITIALIZER,
+                                  .submit = PTHREAD_MUTEX_INITIALIZER};
+static int deterministicMode = 0;
+static _Thread_local int insideTask = 0; // set on workers and on a caller while it runs a loop
+
+static size_t onlineCores(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+#endif
+}
+
+// claim chunks of the current loop until none is left, called with the lock held and returns with it held
+static void runChunks(void)
+{
+    while (pool.nextChunk < pool.chunkNum)
+    {
+        size_t index = pool.nextChunk++, begin = index * pool.chunk;
+        size_t end = begin + pool.chunk < pool.length ? begin + pool.chunk : pool.length;
+        void (*task)(void *, size_t, size_t) = pool.task, (*combine)(void *, size_t, size_t) = pool.combine;
+        void *args = pool.args;
+
+        pthread_mutex_unlock(&pool.lock);
+        task(args, begin, end);
+        pthread_mutex_lock(&pool.lock);
+
+        if (combine)
+            combine(args, begin, end); // under the lock, so one fold at a time
+        if (++pool.doneChunk == pool.chunkNum)
+            pthread_cond_signal(&pool.finished);
+    }
+}
+
+static void *workerMain(void *unused)
+{
+    (void)unused;
+    insideTask = 1;
+
+    pthread_mutex_lock(&pool.lock);
+    size_t seen = pool.generation;
+    while (1)
+    {
+        while (!pool.stop && pool.generation == seen)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        if (pool.stop)
+            break;
+
+        seen = pool.generation;
+        runChunks();
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return NULL;
+}
+
+Sts initThreadPool(size_t threadNum, int pinned)
+{
+    freeThreadPool();
+
+    if (threadNum == 0)
+        threadNum = onlineCores();
+
+    pool.workerNum = threadNum - 1;
+    pool.stop = 0;
+    pool.started = 1;
+    if (pool.workerNum == 0)
+        return OK;
+
+    pool.workers = (pthread_t *)malloc(sizeof(pthread_t) * pool.workerNum);
+    if (!pool.workers)
+    {
+        pool.workerNum = 0;
+        return ERROR;
+    }
+
+    Sts rcode = OK;
+    for (size_t i = 0; i < pool.workerNum; i++)
+    {
+        if (pthread_create(&pool.workers[i], NULL, workerMain, NULL) != 0)
+        {
+            pool.workerNum = i; // keep the ones that started
+            rcode = ERROR;
+            break;
+        }
+
+#ifdef __linux__
+        if (pinned)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((i + 1) % onlineCores(), &set); // core 0 is left to the caller
+            rcode = (pthread_setaffinity_np(pool.workers[i], sizeof(cpu_set_t), &set) != 0) || rcode;
+        }
+#else
+        (void)pinned;
+#endif
+    }
+
+    return rcode;
+}
+
+Sts freeThreadPool(void)
+{
+    if (!pool.started)
+        return OK;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (size_t i = 0; i < pool.workerNum; i++)
+        pthread_join(pool.workers[i], NULL);
+
+    free(pool.workers);
+    pool.workers = NULL;
+    pool.workerNum = 0;
+    pool.started = 0;
+
+    return OK;
+}
+
+size_t threadPoolSize(void)
+{
+    if (!pool.started)
+        initThreadPool(0, 0);
+
+    return pool.workerNum + 1;
+}
+
+Sts threadPoolSetDeterministic(int deterministic)
+{
+    deterministicMode = deterministic != 0;
+
+    return OK;
+}
+
+int threadPoolDeterministic(void)
+{
+    return deterministicMode;
+}
+
+// post one loop of chunkNum chunks and work on it until every chunk is done
+static void runLoop(size_t length, size_t chunk, void (*task)(void *, size_t, size_t),
+                    void (*combine)(void *, size_t, size_t), void *args)
+{
+    size_t chunkNum = (length + chunk - 1) / chunk;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.task = task;
+    pool.combine = combine;
+    pool.args = args;
+    pool.length = length;
+    pool.chunk = chunk;
+    pool.chunkNum = chunkNum;
+    pool.nextChunk = 0;
+    pool.doneChunk = 0;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+
+    insideTask = 1;
+    runChunks();
+    while (pool.doneChunk < chunkNum)
+        pthread_cond_wait(&pool.finished, &pool.lock);
+    insideTask = 0;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+Sts parallelFor(size_t length, size_t grain, void (*task)(void *args, size_t begin, size_t end), void *args)
+{
+    if (!task)
+        return ERROR;
+
+    if (length == 0)
+        return OK;
+
+    grain = grain ? grain : 1;
+    size_t threads = threadPoolSize();
+    if (insideTask || threads == 1 || length <= grain || pthread_mutex_trylock(&pool.submit) != 0)
+    {
+        task(args, 0, length);
+        return OK;
+    }
+
+    // a few chunks per thread so a slow thread doesn't hold up the loop
+    size_t chunk = (length + threads * 4 - 1) / (threads * 4);
+    runLoop(length, chunk > grain ? chunk : grain, task, NULL, args);
+    pthread_mutex_unlock(&pool.submit);
+
+    return OK;
+}
+
+Sts parallelReduce(size_t length, size_t chunk, void (*task)(void *args, size_t begin, size_t end),
+                   void (*combine)(void *args, size_t begin, size_t end), void *args)
+{
+    if (!task || !combine || chunk == 0)
+        return ERROR;
+
+    if (insideTask || threadPoolSize() == 1 || length <= chunk || pthread_mutex_trylock(&pool.submit) != 0)
+    {
+        // the same chunks folded in order, which is what the deterministic mode promises
+        for (size_t begin = 0; begin < length; begin += chunk)
+        {
+            size_t end = begin + chunk < length ? begin + chunk : length;
+            task(args, begin, end);
+            combine(args, begin, end);
+        }
+        return OK;
+    }
+
+    if (!deterministicMode)
+    {
+        runLoop(length, chunk, task, combine, args);
+    }
+    else
+    {
+        runLoop(length, chunk, task, NULL, args);
+        for (size_t begin = 0; begin < length; begin += chunk)
+            combine(args, begin, begin + chunk < length ? begin + chunk : length);
+    }
+    pthread_mutex_unlock(&pool.submit);
+
+    return OK;
+}
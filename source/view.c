@@ -0,0 +1,338 @@
+#include "view.h"
+#include "simd.h"
+#include <string.h>
+
+enum ViewOp
+{
+    VIEW_ADD,
+    VIEW_MUL,
+    VIEW_COPY
+};
+
+// the dimensions of a contiguous row-major block of shape
+static Sts rowMajor(View *view, size_t dimNum, const size_t *shape, size_t length)
+{
+    if (dimNum == 0 || dimNum > VIEW_MAX_DIMS || !shape)
+        return ERROR;
+
+    size_t product = 1;
+    for (size_t i = dimNum; i-- > 0;)
+    {
+        view->shape[i] = shape[i];
+        view->strides[i] = (ptrdiff_t)product;
+        product *= shape[i];
+    }
+    view->dimNum = dimNum;
+    view->offset = 0;
+
+    return product == length ? OK : ERROR;
+}
+
+Sts viewOfVec(const Vec *vec, size_t dimNum, const size_t *shape, View *view)
+{
+    if (!vec || !view)
+        return ERROR;
+
+    view->array.charArray = vec->array.charArray;
+    view->dtype = vec->dtype;
+
+    return rowMajor(view, dimNum, shape, vec->length);
+}
+
+Sts viewOfMat(const Mat *mat, View *view)
+{
+    if (!mat || !view)
+        return ERROR;
+
+    view->array.charArray = mat->array.charArray;
+    view->dtype = mat->dtype;
+
+    return rowMajor(view, 2, (size_t[]){mat->row, mat->col}, mat->row * mat->col);
+}
+
+Sts viewOfMts(const Mts *mts, View *view)
+{
+    if (!mts || !view)
+        return ERROR;
+
+    view->array.charArray = mts->array.charArray;
+    view->dtype = mts->dtype;
+
+    return rowMajor(view, 3, (size_t[]){mts->channel, mts->height, mts->width},
+                    mts->channel * mts->height * mts->width);
+}
+
+Sts viewTranspose(const View *view, size_t dim0, size_t dim1, View *result)
+{
+    if (!view || !result || dim0 >= view->dimNum || dim1 >= view->dimNum)
+        return ERROR;
+
+    *result = *view;
+    result->shape[dim0] = view->shape[dim1];
+    result->shape[dim1] = view->shape[dim0];
+    result->strides[dim0] = view->strides[dim1];
+    result->strides[dim1] = view->strides[dim0];
+
+    return OK;
+}
+
+Sts viewSlice(const View *view, size_t dim, size_t begin, size_t end, View *result)
+{
+    if (!view || !result || dim >= view->dimNum || begin > end || end > view->shape[dim])
+        return ERROR;
+
+    *result = *view;
+    result->offset = (size_t)((ptrdiff_t)view->offset + (ptrdiff_t)begin * view->strides[dim]);
+    result->shape[dim] = end - begin;
+
+    return OK;
+}
+
+Sts viewSelect(const View *view, size_t dim, size_t index, View *result)
+{
+    if (!view || !result || dim >= view->dimNum || index >= view->shape[dim])
+        return ERROR;
+
+    View selected = *view;
+    selected.offset = (size_t)((ptrdiff_t)view->offset + (ptrdiff_t)index * view->strides[dim]);
+    for (size_t i = dim; i + 1 < view->dimNum; i++)
+    {
+        selected.shape[i] = view->shape[i + 1];
+        selected.strides[i] = view->strides[i + 1];
+    }
+    selected.dimNum--;
+    *result = selected;
+
+    return OK;
+}
+
+/*
+The new dimensions are matched to runs of old ones holding the same number of elements, dimensions of 1 left out.
+A run has to be contiguous within itself, then the new dimensions split it row-major with its innermost stride.
+*/
+Sts viewReshape(const View *view, size_t dimNum, const size_t *shape, View *result)
+{
+    if (!view || !shape || !result || dimNum == 0 || dimNum > VIEW_MAX_DIMS)
+        return ERROR;
+
+    size_t length = 1, oldNum = 0, oldShape[VIEW_MAX_DIMS];
+    ptrdiff_t oldStrides[VIEW_MAX_DIMS], strides[VIEW_MAX_DIMS];
+    for (size_t i = 0; i < dimNum; i++)
+        length *= shape[i];
+    if (length == 0 || length != viewLength(view))
+        return ERROR;
+
+    for (size_t i = 0; i < view->dimNum; i++)
+        if (view->shape[i] != 1)
+        {
+            oldShape[oldNum] = view->shape[i];
+            oldStrides[oldNum++] = view->strides[i];
+        }
+
+    size_t ni = 0, nj = 1, oi = 0, oj = 1;
+    while (ni < dimNum && oi < oldNum)
+    {
+        size_t newRun = shape[ni], oldRun = oldShape[oi];
+        while (newRun != oldRun)
+        {
+            if (newRun < oldRun)
+                newRun *= shape[nj++];
+            else
+                oldRun *= oldShape[oj++];
+        }
+
+        for (size_t k = oi; k + 1 < oj; k++)
+            if (oldStrides[k] != (ptrdiff_t)oldShape[k + 1] * oldStrides[k + 1])
+                return ERROR;
+
+        strides[nj - 1] = oldStrides[oj - 1];
+        for (size_t k = nj - 1; k > ni; k--)
+            strides[k - 1] = strides[k] * (ptrdiff_t)shape[k];
+
+        ni = nj++;
+        oi = oj++;
+    }
+    for (; ni < dimNum; ni++) // trailing dimensions of 1, their stride is never stepped
+        strides[ni] = 1;
+
+    *result = *view;
+    result->dimNum = dimNum;
+    for (size_t i = 0; i < dimNum; i++)
+    {
+        result->shape[i] = shape[i];
+        result->strides[i] = strides[i];
+    }
+
+    return OK;
+}
+
+Sts viewBroadcast(const View *view, size_t dimNum, const size_t *shape, View *result)
+{
+    if (!view || !result || (dimNum && !shape) || dimNum > VIEW_MAX_DIMS || dimNum < view->dimNum)
+        return ERROR;
+
+    View broadcast = *view;
+    broadcast.dimNum = dimNum;
+    for (size_t i = dimNum; i-- > 0;)
+    {
+        size_t lead = dimNum - view->dimNum; // the dimensions view doesn't have come first
+        broadcast.shape[i] = shape[i];
+        if (i < lead)
+            broadcast.strides[i] = 0;
+        else if (view->shape[i - lead] == shape[i])
+            broadcast.strides[i] = view->strides[i - lead];
+        else if (view->shape[i - lead] == 1)
+            broadcast.strides[i] = 0;
+        else
+            return ERROR;
+    }
+    *result = broadcast;
+
+    return OK;
+}
+
+size_t viewLength(const View *view)
+{
+    if (!view)
+        return 0;
+
+    size_t length = 1;
+    for (size_t i = 0; i < view->dimNum; i++)
+        length *= view->shape[i];
+
+    return length;
+}
+
+int viewIsContiguous(const View *view)
+{
+    if (!view)
+        return 0;
+
+    ptrdiff_t expected = 1;
+    for (size_t i = view->dimNum; i-- > 0;)
+    {
+        if (view->shape[i] != 1 && view->strides[i] != expected)
+            return 0;
+        expected *= (ptrdiff_t)view->shape[i];
+    }
+
+    return 1;
+}
+
+void *viewData(const View *view)
+{
+    return view ? view->array.charArray + view->offset * sizeOfDataType(view->dtype) : NULL;
+}
+
+// one row of n elements, strides in elements
+static void viewRow(enum ViewOp op, Dtp dtype, const char *x, ptrdiff_t xs, const char *y, ptrdiff_t ys, char *r,
+                    ptrdiff_t rs, size_t n)
+{
+    const Simd *simd = simdKernels();
+    if (op == VIEW_COPY)
+    {
+        size_t size = sizeOfDataType(dtype);
+        if (xs == 1 && rs == 1)
+            memmove(r, x, n * size);
+        else if (size == sizeof(double))
+            for (size_t i = 0; i < n; i++)
+                ((double *)r)[(ptrdiff_t)i * rs] = ((const double *)x)[(ptrdiff_t)i * xs];
+        else if (size == sizeof(float))
+            for (size_t i = 0; i < n; i++)
+                ((float *)r)[(ptrdiff_t)i * rs] = ((const float *)x)[(ptrdiff_t)i * xs];
+        else
+            for (size_t i = 0; i < n; i++)
+                memcpy(r + (ptrdiff_t)i * rs * (ptrdiff_t)size, x + (ptrdiff_t)i * xs * (ptrdiff_t)size, size);
+        return;
+    }
+
+    if (dtype == FLOAT_TYPE)
+    {
+        const float *fx = (const float *)x, *fy = (const float *)y;
+        float *fr = (float *)r;
+        if (xs == 1 && ys == 1 && rs == 1)
+            (op == VIEW_ADD ? simd->addFloat : simd->mulFloat)(fx, fy, fr, n);
+        else if (op == VIEW_ADD)
+            for (size_t i = 0; i < n; i++)
+                fr[(ptrdiff_t)i * rs] = fx[(ptrdiff_t)i * xs] + fy[(ptrdiff_t)i * ys];
+        else
+            for (size_t i = 0; i < n; i++)
+                fr[(ptrdiff_t)i * rs] = fx[(ptrdiff_t)i * xs] * fy[(ptrdiff_t)i * ys];
+        return;
+    }
+
+    const double *dx = (const double *)x, *dy = (const double *)y;
+    double *dr = (double *)r;
+    if (xs == 1 && ys == 1 && rs == 1)
+        (op == VIEW_ADD ? simd->addDouble : simd->mulDouble)(dx, dy, dr, n);
+    else if (op == VIEW_ADD)
+        for (size_t i = 0; i < n; i++)
+            dr[(ptrdiff_t)i * rs] = dx[(ptrdiff_t)i * xs] + dy[(ptrdiff_t)i * ys];
+    else
+        for (size_t i = 0; i < n; i++)
+            dr[(ptrdiff_t)i * rs] = dx[(ptrdiff_t)i * xs] * dy[(ptrdiff_t)i * ys];
+}
+
+// every row along the last dimension of result, the outer indexes counted like an odometer
+static Sts viewWalk(enum ViewOp op, const View *x, const View *y, View *result)
+{
+    View bx, by;
+    if (!x || !result || (op != VIEW_COPY && !y) || x->dtype != result->dtype || (y && y->dtype != result->dtype) ||
+        (op != VIEW_COPY && result->dtype != DOUBLE_TYPE && result->dtype != FLOAT_TYPE) ||
+        viewBroadcast(x, result->dimNum, result->shape, &bx) == ERROR ||
+        (op != VIEW_COPY && viewBroadcast(y, result->dimNum, result->shape, &by) == ERROR))
+        return ERROR;
+
+    size_t d = result->dimNum;
+    for (size_t i = 0; i < d; i++)
+        if (result->strides[i] == 0 && result->shape[i] > 1) // every element written more than once
+            return ERROR;
+
+    size_t length = viewLength(result);
+    if (length == 0)
+        return OK;
+
+    size_t n = d ? result->shape[d - 1] : 1, size = sizeOfDataType(result->dtype);
+    ptrdiff_t xs = d ? bx.strides[d - 1] : 0, ys = d && op != VIEW_COPY ? by.strides[d - 1] : 0;
+    ptrdiff_t rs = d ? result->strides[d - 1] : 0;
+    size_t index[VIEW_MAX_DIMS] = {0};
+    for (size_t row = 0; row < length / n; row++)
+    {
+        ptrdiff_t xo = (ptrdiff_t)bx.offset, yo = op != VIEW_COPY ? (ptrdiff_t)by.offset : 0;
+        ptrdiff_t ro = (ptrdiff_t)result->offset;
+        for (size_t k = 0; k + 1 < d; k++)
+        {
+            xo += (ptrdiff_t)index[k] * bx.strides[k];
+            yo += op != VIEW_COPY ? (ptrdiff_t)index[k] * by.strides[k] : 0;
+            ro += (ptrdiff_t)index[k] * result->strides[k];
+        }
+
+        viewRow(op, result->dtype, bx.array.charArray + xo * (ptrdiff_t)size,
+                xs, op != VIEW_COPY ? by.array.charArray + yo * (ptrdiff_t)size : NULL, ys,
+                result->array.charArray + ro * (ptrdiff_t)size, rs, n);
+
+        for (size_t k = d > 0 ? d - 1 : 0; k-- > 0;)
+        {
+            if (++index[k] < result->shape[k])
+                break;
+            index[k] = 0;
+        }
+    }
+
+    return OK;
+}
+
+Sts viewAdd(const View *x, const View *y, View *result)
+{
+    return viewWalk(VIEW_ADD, x, y, result);
+}
+
+Sts viewMul(const View *x, const View *y, View *result)
+{
+    return viewWalk(VIEW_MUL, x, y, result);
+}
+
+Sts viewCopy(const View *x, View *result)
+{
+    return viewWalk(VIEW_COPY, x, NULL, result);
+}
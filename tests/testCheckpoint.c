@@ -0,0 +1,277 @@
+#include "cnn.h"
+#include "testUtil.h"
+#include <string.h>
+
+#define CHECKPOINT "testCheckpoint.ckpt"
+#define DAMAGED "testCheckpoint.damaged.ckpt"
+#define STEPS 3 // of training before the save, so no parameter is still what the model was initialized with
+
+/*
+The convolution strides by 2, which only im2col takes: a mapped model is built for inference and could
+otherwise pick another algorithm than the trained one, and sum in another order.
+*/
+static Sts buildCNN(Model *model, Dtp dtype)
+{
+    Sts rcode = initModel(model, 1, dtype);
+    rcode = rcode == OK ? modelAddCVL(model, 2, 9, 9, 3, 2, 2, 1) : ERROR;
+    rcode = rcode == OK ? modelAddPL(model, 4, 5, 5, 3, 2, 1, POOLING_MAX) : ERROR;
+    rcode = rcode == OK ? modelAddFCL(model, 4 * 3 * 3, 10, leakyReLU, leakyReLU_derivative) : ERROR;
+    rcode = rcode == OK ? modelAddFCL(model, 10, 3, sigmoid, sigmoid_derivative) : ERROR;
+
+    return rcode == OK ? compileModel(model) : ERROR;
+}
+
+static Sts buildMLP(Model *model, Dtp dtype)
+{
+    Sts rcode = initModel(model, 3, dtype);
+    rcode = rcode == OK ? modelAddFCL(model, 12, 20, ReLU, ReLU_derivative) : ERROR;
+    rcode = rcode == OK ? modelAddFCL(model, 20, 5, noActivation, noActivation_derivative) : ERROR;
+
+    return rcode == OK ? compileModel(model) : ERROR;
+}
+
+// random weights and kernels, then a few steps on random gradients of the output
+static Sts train(Model *model)
+{
+    Sts rcode = OK;
+    for (size_t i = 0; i < model->layerNum; i++)
+    {
+        struct LAYER *layer = &model->layers[i];
+        if (layer->type == FULLY_CONNECTED_LAYER)
+        {
+            struct FCL *fcl = &layer->layer.fcl;
+            testFillRandom(fcl->weight.array.charArray, fcl->weight.row * fcl->weight.col, model->dtype);
+            rcode = weightWrittenFCL(fcl) || rcode;
+        }
+        else if (layer->type == CONVOLUTIONAL_LAYER)
+        {
+            struct CVL *cvl = &layer->layer.cvl;
+            testFillRandom(cvl->kernels.array.charArray,
+                           cvl->kernels.channel * cvl->kernels.height * cvl->kernels.width, model->dtype);
+        }
+    }
+    for (int step = 0; step < STEPS && rcode == OK; step++)
+    {
+        testFillRandom(model->input.array.charArray, model->input.length, model->dtype);
+        testFillRandom(model->dervOfOutput.array.charArray, model->dervOfOutput.length, model->dtype);
+        rcode = forwardModel(model) || backwardModel(model) || stepModel(model);
+    }
+
+    return rcode;
+}
+
+// the output of model on input, bit for bit the one expected
+static int sameForward(const char *what, Model *model, const char *input, const char *expected)
+{
+    size_t size = sizeOfDataType(model->dtype);
+    memcpy(model->input.array.charArray, input, model->input.length * size);
+    if (forwardModel(model) == ERROR)
+    {
+        printf("%s: the forward failed\n", what);
+        return 0;
+    }
+    if (memcmp(model->output.array.charArray, expected, model->output.length * size))
+    {
+        printf("%s: another output than the saved model's, error %.3e\n", what,
+               testRelativeError(model->output.array.charArray, expected, model->output.length, model->dtype));
+        return 0;
+    }
+
+    return 1;
+}
+
+// saved, then loaded and mapped: both have to compute what the trained model does
+static int checkRoundTrip(const char *name, Model *trained)
+{
+    Dtp dtype = trained->dtype;
+    size_t size = sizeOfDataType(dtype);
+    char *input = (char *)malloc(trained->input.length * size);
+    char *expected = (char *)malloc(trained->output.length * size);
+    Model loaded, mapped;
+    int failures = 0;
+    if (!input || !expected)
+    {
+        printf("out of memory\n");
+        free(input);
+        free(expected);
+        return 1;
+    }
+    testFillRandom(input, trained->input.length, dtype);
+    memcpy(trained->input.array.charArray, input, trained->input.length * size);
+    if (forwardModel(trained) == ERROR || saveModel(trained, CHECKPOINT) == ERROR)
+    {
+        printf("%s: can't save the model\n", name);
+        failures++;
+        goto done;
+    }
+    memcpy(expected, trained->output.array.charArray, trained->output.length * size);
+
+    if (loadModel(&loaded, CHECKPOINT, trained->batchSize) == ERROR)
+    {
+        printf("%s: loadModel failed\n", name);
+        failures++;
+    }
+    else
+    {
+        failures += !sameForward("loadModel", &loaded, input, expected);
+        freeModel(&loaded);
+    }
+    if (mapModel(&mapped, CHECKPOINT, trained->batchSize) == ERROR)
+    {
+        printf("%s: mapModel failed\n", name);
+        failures++;
+    }
+    else
+    {
+        failures += !sameForward("mapModel", &mapped, input, expected);
+        freeModel(&mapped);
+    }
+
+done:
+    free(input);
+    free(expected);
+    return failures;
+}
+
+static char *readFile(const char *path, size_t *bytes)
+{
+    FILE *stream = fopen(path, "rb");
+    if (!stream)
+        return NULL;
+
+    char *data = NULL;
+    if (fseek(stream, 0, SEEK_END) == 0 && (*bytes = (size_t)ftell(stream)) > 0 && fseek(stream, 0, SEEK_SET) == 0)
+        data = (char *)malloc(*bytes);
+    if (data && fread(data, 1, *bytes, stream) != *bytes)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(stream);
+
+    return data;
+}
+
+// how many of loadModel and mapModel take a copy of the checkpoint made of data, -1 if it can't be written
+static int takers(const char *data, size_t bytes)
+{
+    FILE *stream = fopen(DAMAGED, "wb");
+    if (!stream || fwrite(data, 1, bytes, stream) != bytes || fclose(stream) != 0)
+        return -1;
+
+    Model model;
+    int taken = 0;
+    if (loadModel(&model, DAMAGED, 1) == OK)
+    {
+        freeModel(&model);
+        taken++;
+    }
+    if (mapModel(&model, DAMAGED, 1) == OK)
+    {
+        freeModel(&model);
+        taken++;
+    }
+    remove(DAMAGED);
+
+    return taken;
+}
+
+static int refused(const char *what, const char *data, size_t bytes) // by both
+{
+    int taken = takers(data, bytes);
+    if (taken)
+        printf("%s: %s\n", what, taken < 0 ? "can't write the damaged copy" : "taken by a loader");
+
+    return !taken;
+}
+
+// the checkpoint of the CNN damaged in one way at a time
+static int checkDamaged(void)
+{
+    size_t bytes = 0;
+    char *saved = readFile(CHECKPOINT, &bytes), *data = saved ? (char *)malloc(bytes) : NULL;
+    if (!data)
+    {
+        printf("can't read the checkpoint back\n");
+        free(saved);
+        return 1;
+    }
+    struct CHECKPOINT_HEADER *header = (struct CHECKPOINT_HEADER *)data;
+    struct CHECKPOINT_LAYER *records = (struct CHECKPOINT_LAYER *)(header + 1);
+    // a fully connected layer, its bias the blob at the end of the file
+    size_t last = ((const struct CHECKPOINT_HEADER *)saved)->layerNum - 1;
+    int failures = 0;
+
+    // cut anywhere, with the header as written or telling the size that's left
+    size_t cuts[] = {sizeof(struct CHECKPOINT_HEADER) - 1, sizeof(struct CHECKPOINT_HEADER) + 1, bytes / 2, bytes - 1};
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++)
+    {
+        memcpy(data, saved, bytes);
+        failures += !refused("truncated", data, cuts[i]);
+        if (cuts[i] < sizeof(struct CHECKPOINT_HEADER))
+            continue;
+        header->fileBytes = cuts[i];
+        failures += !refused("truncated, the size in the header too", data, cuts[i]);
+    }
+
+    memcpy(data, saved, bytes);
+    header->magic[0] ^= 1;
+    failures += !refused("bad magic", data, bytes);
+
+    memcpy(data, saved, bytes);
+    header->version = CHECKPOINT_VERSION + 1;
+    failures += !refused("bad version", data, bytes);
+
+    memcpy(data, saved, bytes);
+    header->endian = 0x04030201;
+    failures += !refused("bad endian marker", data, bytes);
+
+    // a blob starting past the end, and one starting inside the file that runs past it
+    memcpy(data, saved, bytes);
+    records[last].biasOffset = (bytes + CHECKPOINT_ALIGNMENT) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+    failures += !refused("bias offset past the end", data, bytes);
+
+    memcpy(data, saved, bytes);
+    records[last].weightOffset = (bytes - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+    failures += !refused("weights running past the end", data, bytes);
+
+    memcpy(data, saved, bytes);
+    records[last].biasBytes = bytes;
+    failures += !refused("bias size past the end", data, bytes);
+
+    // the untouched copy has to load, or the refusals above prove nothing
+    if (takers(saved, bytes) != 2)
+    {
+        printf("the untouched checkpoint doesn't load\n");
+        failures++;
+    }
+
+    free(saved);
+    free(data);
+    return failures;
+}
+
+int main(void)
+{
+    srand(1);
+    int failures = 0;
+    for (Dtp dtype = DOUBLE_TYPE; dtype <= FLOAT_TYPE; dtype++)
+    {
+        const char *type = dtype == FLOAT_TYPE ? "f32" : "f64";
+        Model cnn, mlp;
+        if (buildCNN(&cnn, dtype) || train(&cnn) || buildMLP(&mlp, dtype) || train(&mlp))
+        {
+            printf("%s: can't build and train the models\n", type);
+            return 1;
+        }
+        failures += checkRoundTrip("mlp", &mlp);
+        failures += checkRoundTrip("cnn", &cnn); // the last saved, checkDamaged works on its file
+        failures += checkDamaged();
+        freeModel(&cnn);
+        freeModel(&mlp);
+    }
+    remove(CHECKPOINT);
+    printf("%d checkpoints didn't load back as saved or loaded damaged\n", failures);
+
+    return failures ? 1 : 0;
+}
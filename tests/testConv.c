@@ -0,0 +1,357 @@
+#include "cnn.h"
+#include "conv.h"
+#include "testUtil.h"
+#include <string.h>
+
+/*
+Errors are relative to the largest sum of |pixel x kernel cell| over an output's window, the scale the rounding of
+any order of summation grows with. FFT rounds once per butterfly level on top, its bound holds for the sizes here.
+*/
+#define DOUBLE_BOUND 1e-13
+#define FLOAT_BOUND 2e-6
+#define GRADIENT_STEP .5     // of the central differences of the layer's gradients, any is exact but for rounding
+#define GRADIENT_BOUND 1e-12 // relative to the largest gradient
+
+struct CASE
+{
+    size_t channel, height, width, kernelSize, multiplier, stride, padding;
+};
+
+// odd, even and unequal sides, 1x1 outputs, kernels of 1 to 11, and strides the fast paths refuse
+static const struct CASE cases[] = {
+    {1, 5, 5, 3, 1, 1, 0},   {3, 7, 9, 3, 2, 1, 1},   {2, 13, 11, 3, 3, 1, 2}, {2, 8, 6, 3, 1, 1, 0},
+    {1, 3, 3, 3, 1, 1, 0},   {3, 31, 29, 3, 4, 1, 1}, {4, 17, 15, 5, 1, 1, 2}, {2, 9, 21, 7, 2, 1, 3},
+    {3, 33, 31, 11, 1, 1, 5}, {2, 6, 7, 1, 3, 1, 0},  {3, 15, 13, 3, 2, 2, 1}, {2, 16, 19, 5, 1, 3, 2},
+};
+
+static const char *names[] = {"im2col", "winograd", "fft"};
+
+// the definition, one window at a time in long double, and the scale of every output's rounding
+static void direct(const struct CASE *c, const char *input, const char *kernels, Dtp dtype, double *output,
+                   double *scale)
+{
+    size_t outH = convOutSize(c->height, c->kernelSize, c->stride, c->padding);
+    size_t outW = convOutSize(c->width, c->kernelSize, c->stride, c->padding), k = c->kernelSize;
+    *scale = 0;
+    for (size_t ch = 0; ch < c->channel; ch++)
+        for (size_t m = 0; m < c->multiplier; m++)
+            for (size_t y = 0; y < outH; y++)
+                for (size_t x = 0; x < outW; x++)
+                {
+                    long double sum = 0, magnitude = 0;
+                    size_t kernel = (ch * c->multiplier + m) * k * k;
+                    for (size_t p = 0; p < k; p++)
+                        for (size_t q = 0; q < k; q++)
+                        {
+                            long row = (long)(y * c->stride + p) - (long)c->padding;
+                            long col = (long)(x * c->stride + q) - (long)c->padding;
+                            if (row < 0 || col < 0 || row >= (long)c->height || col >= (long)c->width)
+                                continue;
+                            long double term =
+                                (long double)testValueAt(input, (ch * c->height + row) * c->width + col, dtype) *
+                                testValueAt(kernels, kernel + p * k + q, dtype);
+                            sum += term;
+                            magnitude += term < 0 ? -term : term;
+                        }
+                    output[((ch * c->multiplier + m) * outH + y) * outW + x] = (double)sum;
+                    *scale = fmax(*scale, (double)magnitude);
+                }
+}
+
+// every algorithm against the definition, the ones that don't take the shape have to refuse it
+static int checkAlgorithms(const struct CASE *c, Dtp dtype)
+{
+    size_t size = sizeOfDataType(dtype);
+    size_t outLength = c->channel * c->multiplier * convOutSize(c->height, c->kernelSize, c->stride, c->padding) *
+                       convOutSize(c->width, c->kernelSize, c->stride, c->padding);
+    size_t inLength = c->channel * c->height * c->width;
+    size_t kernelLength = c->channel * c->multiplier * c->kernelSize * c->kernelSize;
+    char *input = (char *)malloc(inLength * size), *kernels = (char *)malloc(kernelLength * size);
+    char *output = (char *)malloc(outLength * size);
+    double *expected = (double *)malloc(outLength * sizeof(double)), scale;
+    int failures = 0;
+    if (!input || !kernels || !output || !expected)
+    {
+        printf("out of memory\n");
+        failures = 1;
+        goto done;
+    }
+
+    testFillRandom(input, inLength, dtype);
+    testFillRandom(kernels, kernelLength, dtype);
+    direct(c, input, kernels, dtype, expected, &scale);
+    for (Cva algorithm = CONV_IM2COL; algorithm <= CONV_FFT; algorithm++)
+    {
+        size_t length = convWorkspaceLength(algorithm, c->channel, c->height, c->width, c->multiplier,
+                                            c->kernelSize, c->stride, c->padding);
+        char *workspace = (char *)malloc((length ? length : 1) * size);
+        if (!workspace)
+        {
+            failures++;
+            continue;
+        }
+        memset(output, 0, outLength * size);
+        Sts rcode = dtype == FLOAT_TYPE
+                        ? convolveFloat(algorithm, (const float *)input, c->channel, c->height, c->width,
+                                        (const float *)kernels, c->multiplier, c->kernelSize, c->stride,
+                                        c->padding, (float *)workspace, (float *)output)
+                        : convolveDouble(algorithm, (const double *)input, c->channel, c->height, c->width,
+                                         (const double *)kernels, c->multiplier, c->kernelSize, c->stride,
+                                         c->padding, (double *)workspace, (double *)output);
+        free(workspace);
+
+        int supported = convSupports(algorithm, c->kernelSize, c->stride);
+        double error = 0, bound = dtype == FLOAT_TYPE ? FLOAT_BOUND : DOUBLE_BOUND;
+        for (size_t i = 0; supported && rcode == OK && i < outLength; i++)
+            error = fmax(error, fabs(testValueAt(output, i, dtype) - expected[i]) / fmax(scale, 1e-30));
+        if (supported != (rcode == OK) || error > bound)
+        {
+            printf("%s %zu x %zu x %zu k %zu multiplier %zu stride %zu padding %zu %s: ",
+                   dtype == FLOAT_TYPE ? "f32" : "f64", c->channel, c->height, c->width, c->kernelSize,
+                   c->multiplier, c->stride, c->padding, names[algorithm]);
+            if (supported != (rcode == OK))
+                printf("%s\n", supported ? "failed" : "took a shape it doesn't support");
+            else
+                printf("error %.3e past %.0e\n", error, bound);
+            failures++;
+        }
+    }
+
+done:
+    free(input);
+    free(kernels);
+    free(output);
+    free(expected);
+    return failures;
+}
+
+/*
+A training CVL forced onto every algorithm its shape takes: the forward and, through the unfolding gradCVL does
+again, both gradients have to match the ones of im2col.
+*/
+static int checkLayer(const struct CASE *c, Dtp dtype)
+{
+    struct CVL cvl;
+    Arena arena;
+    size_t size = sizeOfDataType(dtype), columnsLength = 0;
+    if (initArena(&arena, sizeofCVL(c->channel, c->height, c->width, c->kernelSize, c->multiplier, c->stride,
+                                    c->padding, dtype)) ||
+        initArenaCVL(&cvl, &arena, c->channel, c->height, c->width, c->kernelSize, c->multiplier, c->stride,
+                     c->padding, dtype))
+    {
+        printf("can't build the layer\n");
+        freeArena(&arena);
+        return 1;
+    }
+    for (Cva algorithm = CONV_IM2COL; algorithm <= CONV_FFT; algorithm++)
+    {
+        size_t length = convWorkspaceLength(algorithm, c->channel, c->height, c->width, c->multiplier,
+                                            c->kernelSize, c->stride, c->padding);
+        columnsLength = length > columnsLength ? length : columnsLength;
+    }
+
+    size_t inLength = cvl.inputs.channel * cvl.inputs.height * cvl.inputs.width;
+    size_t outLength = cvl.outputs.channel * cvl.outputs.height * cvl.outputs.width;
+    size_t kernelLength = cvl.kernels.channel * cvl.kernels.height * cvl.kernels.width;
+    char *columns = (char *)malloc(columnsLength * size), *reference = (char *)malloc(
+                                                              (outLength + inLength + kernelLength) * size);
+    int failures = 0;
+    if (!columns || !reference)
+    {
+        printf("out of memory\n");
+        failures = 1;
+        goto done;
+    }
+    cvl.columns = (Vec){.array.charArray = columns, .length = columnsLength, .dtype = dtype};
+    testFillRandom(cvl.inputs.array.charArray, inLength, dtype);
+    testFillRandom(cvl.kernels.array.charArray, kernelLength, dtype);
+    testFillRandom(cvl.dervsFromLastLayer.array.charArray, outLength, dtype);
+
+    for (Cva algorithm = CONV_IM2COL; algorithm <= CONV_FFT; algorithm++)
+    {
+        if (!convSupports(algorithm, c->kernelSize, c->stride))
+            continue;
+        cvl.algorithm = algorithm;
+        memset(columns, 0xff, columnsLength * size); // nothing of a pass before may be read as the unfolding
+        if (forwardCVL(&cvl) == ERROR || gradCVL(&cvl) == ERROR)
+        {
+            printf("%s: a layer pass failed\n", names[algorithm]);
+            failures++;
+            continue;
+        }
+
+        // im2col goes first and leaves what the others are checked against
+        const char *got[] = {cvl.outputs.array.charArray, cvl.dervsToPreviousLayer.array.charArray,
+                             cvl.dervsOfKernels.array.charArray};
+        size_t lengths[] = {outLength, inLength, kernelLength}, offset = 0;
+        static const char *what[] = {"outputs", "dervsToPreviousLayer", "dervsOfKernels"};
+        for (size_t i = 0; i < 3; offset += lengths[i++] * size)
+        {
+            if (algorithm == CONV_IM2COL)
+            {
+                memcpy(reference + offset, got[i], lengths[i] * size);
+                continue;
+            }
+            // the gradients only differ if the unfolding does, the outputs by the rounding of both passes
+            double error = testRelativeError(got[i], reference + offset, lengths[i], dtype);
+            double bound = dtype == FLOAT_TYPE ? FLOAT_BOUND : DOUBLE_BOUND;
+            if (error > bound)
+            {
+                printf("%s layer %zu x %zu x %zu k %zu %s %s: error %.3e past %.0e\n",
+                       dtype == FLOAT_TYPE ? "f32" : "f64", c->channel, c->height, c->width, c->kernelSize,
+                       names[algorithm], what[i], error, bound);
+                failures++;
+            }
+        }
+    }
+
+done:
+    free(columns);
+    free(reference);
+    freeArena(&arena);
+    return failures;
+}
+
+// the outputs along one side whose windows cover position pos of the input, [*first, *last)
+static void coveringOutputs(size_t pos, const struct CASE *c, size_t outSize, size_t *first, size_t *last)
+{
+    long padded = (long)(pos + c->padding), low = padded - (long)c->kernelSize + 1;
+    *first = low <= 0 ? 0 : (size_t)((low + (long)c->stride - 1) / (long)c->stride);
+    *last = (size_t)(padded / (long)c->stride) + 1;
+    *last = *last < outSize ? *last : outSize;
+    *first = *first < *last ? *first : *last;
+}
+
+/*
+Sum of dervs x the convolution by the definition over input channel ch and the outputs of box, {first row,
+last row, first column, last column}: the part of the loss gradCVL differentiates that an element can change.
+*/
+static double lossOf(const struct CASE *c, const double *input, const double *kernels, const double *dervs,
+                     size_t ch, const size_t box[4])
+{
+    size_t outH = convOutSize(c->height, c->kernelSize, c->stride, c->padding);
+    size_t outW = convOutSize(c->width, c->kernelSize, c->stride, c->padding), k = c->kernelSize;
+    double loss = 0;
+    for (size_t m = 0; m < c->multiplier; m++)
+        for (size_t y = box[0]; y < box[1]; y++)
+            for (size_t x = box[2]; x < box[3]; x++)
+            {
+                double sum = 0;
+                const double *kernel = kernels + (ch * c->multiplier + m) * k * k;
+                for (size_t p = 0; p < k; p++)
+                    for (size_t q = 0; q < k; q++)
+                    {
+                        long row = (long)(y * c->stride + p) - (long)c->padding;
+                        long col = (long)(x * c->stride + q) - (long)c->padding;
+                        if (row >= 0 && col >= 0 && row < (long)c->height && col < (long)c->width)
+                            sum += input[(ch * c->height + row) * c->width + col] * kernel[p * k + q];
+                    }
+                loss += dervs[((ch * c->multiplier + m) * outH + y) * outW + x] * sum;
+            }
+
+    return loss;
+}
+
+/*
+Both gradients of a training CVL of a strided or padded shape against central differences of lossOf, which
+shares no unfolding with the layer. The loss is linear in the inputs and in the kernels, so the step leaves
+no truncation, only the rounding of the two sums.
+*/
+static int checkGradients(const struct CASE *c)
+{
+    struct CVL cvl;
+    Arena arena;
+    if (initArena(&arena, sizeofCVL(c->channel, c->height, c->width, c->kernelSize, c->multiplier, c->stride,
+                                    c->padding, DOUBLE_TYPE)) ||
+        initArenaCVL(&cvl, &arena, c->channel, c->height, c->width, c->kernelSize, c->multiplier, c->stride,
+                     c->padding, DOUBLE_TYPE))
+    {
+        printf("can't build the layer\n");
+        freeArena(&arena);
+        return 1;
+    }
+    size_t inLength = cvl.inputs.channel * cvl.inputs.height * cvl.inputs.width;
+    size_t outLength = cvl.outputs.channel * cvl.outputs.height * cvl.outputs.width;
+    size_t kernelLength = cvl.kernels.channel * cvl.kernels.height * cvl.kernels.width;
+    double *input = cvl.inputs.array.doubelMatrixStack, *kernels = cvl.kernels.array.doubelMatrixStack;
+    double *differences = (double *)malloc((inLength > kernelLength ? inLength : kernelLength) * sizeof(double));
+    int failures = 0;
+    if (!differences)
+    {
+        printf("out of memory\n");
+        freeArena(&arena);
+        return 1;
+    }
+    testFillRandom(cvl.inputs.array.charArray, inLength, DOUBLE_TYPE);
+    testFillRandom(cvl.kernels.array.charArray, kernelLength, DOUBLE_TYPE);
+    testFillRandom(cvl.dervsFromLastLayer.array.charArray, outLength, DOUBLE_TYPE);
+    if (forwardCVL(&cvl) == ERROR || gradCVL(&cvl) == ERROR)
+    {
+        printf("%zu x %zu x %zu k %zu stride %zu padding %zu: a layer pass failed\n", c->channel, c->height,
+               c->width, c->kernelSize, c->stride, c->padding);
+        failures++;
+        goto done;
+    }
+
+    const double *dervs = cvl.dervsFromLastLayer.array.doubelMatrixStack;
+    double *of[] = {kernels, input};
+    size_t lengths[] = {kernelLength, inLength};
+    const char *grads[] = {cvl.dervsOfKernels.array.charArray, cvl.dervsToPreviousLayer.array.charArray};
+    static const char *what[] = {"dervsOfKernels", "dervsToPreviousLayer"};
+    size_t outH = cvl.outputs.height, outW = cvl.outputs.width, imageSize = c->height * c->width;
+    for (size_t i = 0; i < 2; i++)
+    {
+        for (size_t j = 0; j < lengths[i]; j++)
+        {
+            // a kernel reaches every output of its channel, an input element the windows over it
+            size_t ch = i ? j / imageSize : j / (c->multiplier * c->kernelSize * c->kernelSize);
+            size_t box[4] = {0, outH, 0, outW};
+            if (i)
+            {
+                coveringOutputs(j % imageSize / c->width, c, outH, &box[0], &box[1]);
+                coveringOutputs(j % c->width, c, outW, &box[2], &box[3]);
+            }
+            double value = of[i][j];
+            of[i][j] = value + GRADIENT_STEP;
+            double above = lossOf(c, input, kernels, dervs, ch, box);
+            of[i][j] = value - GRADIENT_STEP;
+            double below = lossOf(c, input, kernels, dervs, ch, box);
+            of[i][j] = value;
+            differences[j] = (above - below) / (2 * GRADIENT_STEP);
+        }
+        double error = testRelativeError(grads[i], (const char *)differences, lengths[i], DOUBLE_TYPE);
+        if (!(error <= GRADIENT_BOUND))
+        {
+            printf("%zu x %zu x %zu k %zu multiplier %zu stride %zu padding %zu %s: error %.3e past %.0e against "
+                   "the central differences\n",
+                   c->channel, c->height, c->width, c->kernelSize, c->multiplier, c->stride, c->padding, what[i],
+                   error, GRADIENT_BOUND);
+            failures++;
+        }
+    }
+
+done:
+    free(differences);
+    freeArena(&arena);
+    return failures;
+}
+
+int main(void)
+{
+    srand(1);
+    int failures = 0;
+    size_t caseNum = sizeof(cases) / sizeof(cases[0]);
+    for (size_t i = 0; i < caseNum; i++)
+        for (int f = 0; f < 2; f++)
+        {
+            Dtp dtype = f ? FLOAT_TYPE : DOUBLE_TYPE;
+            failures += checkAlgorithms(&cases[i], dtype);
+            failures += checkLayer(&cases[i], dtype);
+        }
+    for (size_t i = 0; i < caseNum; i++)
+        if (cases[i].stride > 1 || cases[i].padding > 0)
+            failures += checkGradients(&cases[i]);
+    printf("%d failed checks over %zu shapes of f32 and f64\n", failures, caseNum);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+#include "cnn.h"
+#include "testUtil.h"
+#include <string.h>
+
+#define DOUBLE_BOUND 1e-12 // the packed and the unpacked product sum in the same order up to the kernel's lanes
+#define FLOAT_BOUND 1e-5
+#define CHECKPOINT "testPrepared.ckpt"
+
+static const size_t neurons[] = {37, 64, 19, 10};
+#define LAYERS (sizeof(neurons) / sizeof(neurons[0]) - 1)
+
+static Sts buildModel(Model *model, size_t batch, Dtp dtype, int inference)
+{
+    Sts rcode = inference ? initInferenceModel(model, batch, dtype) : initModel(model, batch, dtype);
+    for (size_t i = 0; i < LAYERS; i++)
+        rcode = modelAddFCL(model, neurons[i], neurons[i + 1], i + 1 < LAYERS ? ReLU : noActivation,
+                            i + 1 < LAYERS ? ReLU_derivative : noActivation_derivative) ||
+                rcode;
+
+    return compileModel(model) || rcode;
+}
+
+// the prepared model against the same weights forwarded unpacked, on one random input
+static int agree(const char *when, Model *prepared, Model *plain)
+{
+    Dtp dtype = prepared->dtype;
+    size_t bytes = prepared->input.length * sizeOfDataType(dtype);
+    testFillRandom(plain->input.array.charArray, plain->input.length, dtype);
+    memcpy(prepared->input.array.charArray, plain->input.array.charArray, bytes);
+    if (forwardModel(prepared) == ERROR || forwardModel(plain) == ERROR)
+    {
+        printf("%s: a forward failed\n", when);
+        return 1;
+    }
+
+    double error = testRelativeError(prepared->output.array.charArray, plain->output.array.charArray,
+                                     plain->output.length, dtype);
+    double bound = dtype == FLOAT_TYPE ? FLOAT_BOUND : DOUBLE_BOUND;
+    if (error <= bound)
+        return 0;
+
+    printf("%s, %s batch %zu: error %.3e past %.0e, the packed weights are stale\n", when,
+           dtype == FLOAT_TYPE ? "f32" : "f64", plain->batchSize, error, bound);
+    return 1;
+}
+
+// both models given the same random weight of layer i through setWeightFCL
+static Sts setBoth(Model *prepared, Model *plain, size_t i)
+{
+    struct FCL *fcl = &plain->layers[i].layer.fcl;
+    size_t length = fcl->weight.row * fcl->weight.col, size = sizeOfDataType(fcl->weight.dtype);
+    Mat weight = {.array.charArray = (char *)malloc(length * size), .row = fcl->weight.row, .col = fcl->weight.col,
+                  .dtype = fcl->weight.dtype};
+    if (!weight.array.charArray)
+        return ERROR;
+
+    testFillRandom(weight.array.charArray, length, weight.dtype);
+    Sts rcode = setWeightFCL(&prepared->layers[i].layer.fcl, &weight) || setWeightFCL(fcl, &weight);
+    free(weight.array.charArray);
+
+    return rcode;
+}
+
+// the weights and biases of plain copied into prepared, which is prepared then
+static Sts twins(Model *prepared, Model *plain)
+{
+    Sts rcode = OK;
+    for (size_t i = 0; i < LAYERS; i++)
+    {
+        rcode = setBoth(prepared, plain, i) || rcode;
+        memcpy(prepared->layers[i].layer.fcl.bias.array.charArray, plain->layers[i].layer.fcl.bias.array.charArray,
+               neurons[i + 1] * sizeOfDataType(plain->dtype));
+    }
+
+    return prepareModel(prepared) || rcode;
+}
+
+/*
+A prepared model and an unprepared twin with the same weights, written to in every way the library tracks:
+after each the prepared forward has to pack again and agree with the twin.
+*/
+static int checkWrites(size_t batch, Dtp dtype)
+{
+    Model prepared, plain, loaded = {0};
+    if (buildModel(&prepared, batch, dtype, 1) || buildModel(&plain, batch, dtype, 1))
+    {
+        printf("can't build the models\n");
+        return 1;
+    }
+
+    int failures = 0;
+    Sts rcode = twins(&prepared, &plain);
+    failures += rcode == ERROR || agree("prepared", &prepared, &plain);
+
+    rcode = setBoth(&prepared, &plain, 1);
+    failures += rcode == ERROR || agree("setWeightFCL", &prepared, &plain);
+
+    // an optimizer step on a view of the weights, not through optimizeFCL, then declared
+    Optimizer sgd;
+    rcode = initOptimizer(&sgd, OPTIMIZER_SGD, .5);
+    for (size_t i = 0; i < LAYERS && rcode == OK; i++)
+    {
+        Vec weight, twin;
+        Mat *mat = &prepared.layers[i].layer.fcl.weight;
+        Vec grad = {.array.charArray = (char *)malloc(mat->row * mat->col * sizeOfDataType(dtype)),
+                    .length = mat->row * mat->col, .dtype = dtype};
+        if (!grad.array.charArray)
+            return failures + 1;
+        testFillRandom(grad.array.charArray, grad.length, dtype);
+        rcode = matTransVec(mat, &weight) ||
+                matTransVec(&plain.layers[i].layer.fcl.weight, &twin) ||
+                optimizerUpdate(&sgd, &weight, &grad, NULL, 1) || optimizerUpdate(&sgd, &twin, &grad, NULL, 1) ||
+                weightWrittenFCL(&prepared.layers[i].layer.fcl);
+        free(grad.array.charArray);
+    }
+    failures += rcode == ERROR || agree("optimizerUpdate", &prepared, &plain);
+
+    // written in place, then declared
+    struct FCL *fcl = &prepared.layers[0].layer.fcl;
+    size_t length = fcl->weight.row * fcl->weight.col;
+    testFillRandom(fcl->weight.array.charArray, length, dtype);
+    memcpy(plain.layers[0].layer.fcl.weight.array.charArray, fcl->weight.array.charArray,
+           length * sizeOfDataType(dtype));
+    weightWrittenFCL(fcl);
+    failures += agree("weightWrittenFCL", &prepared, &plain);
+
+    // the twin through a checkpoint, prepared, then written again
+    rcode = saveModel(&plain, CHECKPOINT) || loadModel(&loaded, CHECKPOINT, batch) || prepareModel(&loaded);
+    failures += rcode == ERROR || agree("loadModel", &loaded, &plain);
+    rcode = setBoth(&loaded, &plain, 2);
+    failures += rcode == ERROR || agree("loadModel then setWeightFCL", &loaded, &plain);
+    remove(CHECKPOINT);
+
+    freeModel(&prepared);
+    freeModel(&plain);
+    freeModel(&loaded);
+    return failures;
+}
+
+/*
+Training twins, one prepared: after every stepModel its layers have to pack again. A write to another model's
+parameters, or to any Vec, must leave them packed.
+*/
+static int checkTraining(size_t batch, Dtp dtype)
+{
+    Model prepared, plain;
+    if (buildModel(&prepared, batch, dtype, 0) || buildModel(&plain, batch, dtype, 0))
+    {
+        printf("can't build the models\n");
+        return 1;
+    }
+
+    int failures = 0;
+    Sts rcode = twins(&prepared, &plain);
+    for (int step = 0; step < 3 && rcode == OK; step++)
+    {
+        testFillRandom(plain.dervOfOutput.array.charArray, plain.dervOfOutput.length, dtype);
+        memcpy(prepared.dervOfOutput.array.charArray, plain.dervOfOutput.array.charArray,
+               plain.dervOfOutput.length * sizeOfDataType(dtype));
+        failures += agree("stepModel", &prepared, &plain);
+        rcode = backwardModel(&prepared) || backwardModel(&plain) || stepModel(&prepared) || stepModel(&plain);
+    }
+    failures += rcode == ERROR || agree("stepModel", &prepared, &plain);
+
+    // the twin trains on, the prepared model stays packed
+    rcode = backwardModel(&plain) || stepModel(&plain);
+    for (size_t i = 0; i < LAYERS; i++)
+    {
+        struct FCL *fcl = &prepared.layers[i].layer.fcl;
+        if (fcl->packedVersion != fcl->weightVersion)
+        {
+            printf("layer %zu packs again after a step of another model\n", i);
+            failures++;
+        }
+    }
+
+    freeModel(&prepared);
+    freeModel(&plain);
+    return failures + (rcode == ERROR);
+}
+
+int main(void)
+{
+    srand(1);
+    int failures = 0;
+    for (size_t batch = 1; batch <= 5; batch += 4)
+    {
+        failures += checkWrites(batch, DOUBLE_TYPE);
+        failures += checkWrites(batch, FLOAT_TYPE);
+        failures += checkTraining(batch, DOUBLE_TYPE);
+        failures += checkTraining(batch, FLOAT_TYPE);
+    }
+    printf("%d stale forwards of prepared models\n", failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,62 @@
+#include "cnn.h"
+#include "simd.h"
+#include "testUtil.h"
+#include <float.h>
+#include <string.h>
+
+enum DATA // what the inputs of a check hold
+{
+    DATA_RANDOM,
+    DATA_EDGES, // and both infinities
+    DATA_NAN,
+    DATA_SETS
+};
+
+static const char *sets[] = {"random", "edges", "NaN"};
+
+#define T double
+#define KERNEL(name) name##Double
+#define CHECK(name) name##Double
+#define BOUND 1e-13
+#define TINY DBL_MIN
+#define EDGES -708, -708.5, -745, -746, 708, 709.7, 709.8, 710, 711
+#include "testSimdKernels.inc"
+
+#define T float
+#define KERNEL(name) name##Float
+#define CHECK(name) name##Float
+#define BOUND 1e-6
+#define TINY FLT_MIN
+#define EDGES -86.5f, -87.5f, -103.9f, -104.5f, 86.5f, 88.7f, 88.8f, 89, 90
+#include "testSimdKernels.inc"
+
+// lengths a vector of 2, 4, 8 and 16 lanes doesn't divide, and some it does
+static const size_t lengths[] = {0, 1, 3, 7, 15, 16, 17, 31, 33, 64, 67, 130};
+
+int main(void)
+{
+    srand(1);
+    const Simd *scalar = simdKernelsAt(SIMD_SCALAR);
+    int failures = 0, checked = 0;
+    for (Lvl level = SIMD_SSE2; level < SIMD_LEVELS; level++)
+    {
+        const Simd *simd = simdKernelsAt(level);
+        if (!simd)
+        {
+            printf("level %d: not supported here, skipped\n", level);
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+            for (enum DATA set = DATA_RANDOM; set < DATA_SETS; set++)
+            {
+                int failed = kernelsDouble(simd, scalar, lengths[i], set) + kernelsFloat(simd, scalar, lengths[i], set);
+                if (failed)
+                    printf("  %s on %s data\n", simd->name, sets[set]);
+                failures += failed;
+            }
+        checked++;
+    }
+    printf("%d kernels differ from the scalar ones over %d levels\n", failures, checked);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+#include "cnn.h"
+#include "testUtil.h"
+#include <string.h>
+
+#define BATCH 2
+#define CHANNEL 2
+#define SIDE 6
+#define MULTIPLIER 2
+#define HIDDEN 5
+#define CLASSES 3
+#define PARAMS 5     // the kernels, then the weight and bias of both linear ops
+#define STEP 1e-5    // of the central differences, where their truncation and rounding balance
+#define BOUND 1e-9   // relative to the largest gradient of a parameter, they come out within 1e-10
+#define STEPS 4      // replayed after the recording
+
+static const size_t pooled = CHANNEL * MULTIPLIER * (SIDE / 2) * (SIDE / 2);
+static const size_t lengths[PARAMS] = {CHANNEL * MULTIPLIER * 9, HIDDEN * pooled, HIDDEN, CLASSES * HIDDEN, CLASSES};
+static const char *paramNames[PARAMS] = {"kernels", "hidden weight", "hidden bias", "output weight", "output bias"};
+
+// what the tape is recorded over, the caller's storage the ops read by address
+struct NET
+{
+    Vec images;
+    Label labels;
+    Vec params[PARAMS];
+    Vec grads[PARAMS];
+    Plm mode;
+};
+
+static Sts initNet(struct NET *net, Plm mode)
+{
+    memset(net, 0, sizeof(struct NET));
+    net->mode = mode;
+    net->images = (Vec){.array.charArray = (char *)malloc(BATCH * CHANNEL * SIDE * SIDE * sizeof(double)),
+                        .length = BATCH * CHANNEL * SIDE * SIDE, .dtype = DOUBLE_TYPE};
+    net->labels = (Label){.array.intArray = (int *)malloc(BATCH * sizeof(int)), .length = BATCH, .dtype = INT_TYPE};
+    Sts rcode = net->images.array.charArray && net->labels.array.intArray ? OK : ERROR;
+    for (size_t i = 0; i < PARAMS; i++)
+    {
+        net->params[i] = (Vec){.array.charArray = (char *)malloc(lengths[i] * sizeof(double)),
+                               .length = lengths[i], .dtype = DOUBLE_TYPE};
+        net->grads[i] = (Vec){.array.charArray = (char *)malloc(lengths[i] * sizeof(double)),
+                              .length = lengths[i], .dtype = DOUBLE_TYPE};
+        rcode = net->params[i].array.charArray && net->grads[i].array.charArray ? rcode : ERROR;
+    }
+
+    return rcode;
+}
+
+static void fillNet(struct NET *net) // a new batch and new parameters, in place
+{
+    testFillRandom(net->images.array.charArray, net->images.length, DOUBLE_TYPE);
+    for (size_t i = 0; i < BATCH; i++)
+        net->labels.array.intArray[i] = rand() % CLASSES;
+    for (size_t i = 0; i < PARAMS; i++)
+        testFillRandom(net->params[i].array.charArray, lengths[i], DOUBLE_TYPE);
+}
+
+static void freeNet(struct NET *net)
+{
+    free(net->images.array.charArray);
+    free(net->labels.array.intArray);
+    for (size_t i = 0; i < PARAMS; i++)
+    {
+        free(net->params[i].array.charArray);
+        free(net->grads[i].array.charArray);
+    }
+}
+
+// conv -> sigmoid -> pool -> flatten -> linear, leaky ReLU -> linear -> softmax cross-entropy
+static Sts record(Tape *tape, struct NET *net, Var *loss)
+{
+    Var x, p[PARAMS], conv, sigmoid, pool, flat, hidden, logits;
+    Sts rcode = tapeInput(tape, &net->images, BATCH, CHANNEL, SIDE, SIDE, &x);
+    for (size_t i = 0; i < PARAMS; i++)
+        rcode = rcode == OK ? tapeParam(tape, &net->params[i], &net->grads[i], &p[i]) : ERROR;
+    rcode = rcode == OK ? tapeConv(tape, x, p[0], MULTIPLIER, 3, 1, 1, &conv) : ERROR;
+    rcode = rcode == OK ? tapeActivate(tape, conv, ACTIVATION_SIGMOID, &sigmoid) : ERROR;
+    rcode = rcode == OK ? tapePool(tape, sigmoid, 2, 2, 0, net->mode, &pool) : ERROR;
+    rcode = rcode == OK ? tapeFlatten(tape, pool, &flat) : ERROR;
+    rcode = rcode == OK ? tapeLinear(tape, flat, p[1], p[2], ACTIVATION_LEAKY_RELU, &hidden) : ERROR;
+    rcode = rcode == OK ? tapeLinear(tape, hidden, p[3], p[4], ACTIVATION_NONE, &logits) : ERROR;
+
+    return rcode == OK ? tapeSoftmaxCrossEntropy(tape, logits, &net->labels, loss) : ERROR;
+}
+
+static double lossOf(struct NET *net) // a recording of its own, NAN if it fails
+{
+    Tape tape;
+    Var loss;
+    double value = NAN;
+    if (initTape(&tape, 16, 1 << 16, DOUBLE_TYPE) == OK && record(&tape, net, &loss) == OK)
+        value = tapeValue(&tape, loss)->array.doubleArray[0];
+    freeTape(&tape);
+
+    return value;
+}
+
+// the gradient of every parameter element against the central difference of two fresh recordings
+static int checkGradients(Plm mode)
+{
+    struct NET net;
+    Tape tape;
+    Var loss;
+    int failures = 0;
+    double *differences = (double *)malloc(lengths[1] * sizeof(double)); // the longest parameter
+    if (initNet(&net, mode) || !differences || initTape(&tape, 16, 1 << 16, DOUBLE_TYPE))
+    {
+        printf("out of memory\n");
+        freeNet(&net);
+        free(differences);
+        return 1;
+    }
+    fillNet(&net);
+    if (record(&tape, &net, &loss) || tapeBackward(&tape, loss))
+    {
+        printf("%s pooling: can't record and differentiate\n", mode == POOLING_MAX ? "max" : "average");
+        failures++;
+        goto done;
+    }
+
+    for (size_t i = 0; i < PARAMS; i++)
+    {
+        double *param = net.params[i].array.doubleArray;
+        for (size_t j = 0; j < lengths[i]; j++)
+        {
+            double value = param[j];
+            param[j] = value + STEP;
+            double above = lossOf(&net);
+            param[j] = value - STEP;
+            double below = lossOf(&net);
+            param[j] = value;
+            differences[j] = (above - below) / (2 * STEP);
+        }
+        double error = testRelativeError(net.grads[i].array.charArray, (const char *)differences, lengths[i],
+                                         DOUBLE_TYPE);
+        if (!(error <= BOUND))
+        {
+            printf("%s pooling, %s: error %.3e past %.0e against the central differences\n",
+                   mode == POOLING_MAX ? "max" : "average", paramNames[i], error, BOUND);
+            failures++;
+        }
+    }
+
+done:
+    freeTape(&tape);
+    freeNet(&net);
+    free(differences);
+    return failures;
+}
+
+/*
+Recorded once, then replayed on new batches and parameters filled in place: every step has to give the loss and
+gradients of a fresh recording bit for bit, and none may grow the tape's arenas after the first.
+*/
+static int checkReplay(Plm mode)
+{
+    const char *name = mode == POOLING_MAX ? "max" : "average";
+    struct NET net;
+    Tape tape = {0}, fresh = {0};
+    Var loss, freshLoss;
+    size_t footprint = 0;
+    int failures = 0;
+    double *replayed[PARAMS] = {0};
+    Sts rcode = initNet(&net, mode);
+    for (size_t i = 0; i < PARAMS; i++)
+    {
+        replayed[i] = (double *)malloc(lengths[i] * sizeof(double));
+        rcode = replayed[i] ? rcode : ERROR;
+    }
+    if (rcode == OK)
+        fillNet(&net);
+    rcode = rcode == OK ? initTape(&tape, 16, 1 << 16, DOUBLE_TYPE) : ERROR;
+    rcode = rcode == OK ? record(&tape, &net, &loss) : ERROR;
+    for (int step = 0; step < STEPS && rcode == OK; step++)
+    {
+        fillNet(&net);
+        rcode = tapeForward(&tape) || tapeBackward(&tape, loss);
+        if (rcode == ERROR)
+            break;
+        if (step == 0)
+            footprint = tapeFootprint(&tape);
+        else if (tapeFootprint(&tape) != footprint)
+        {
+            printf("%s pooling, step %d: the tape grew from %zu to %zu bytes\n", name, step, footprint,
+                   tapeFootprint(&tape));
+            failures++;
+        }
+        double replayedLoss = tapeValue(&tape, loss)->array.doubleArray[0];
+        for (size_t i = 0; i < PARAMS; i++)
+            memcpy(replayed[i], net.grads[i].array.charArray, lengths[i] * sizeof(double));
+
+        rcode = initTape(&fresh, 16, 1 << 16, DOUBLE_TYPE);
+        rcode = rcode == OK ? record(&fresh, &net, &freshLoss) || tapeBackward(&fresh, freshLoss) : ERROR;
+        if (rcode == OK && replayedLoss != tapeValue(&fresh, freshLoss)->array.doubleArray[0])
+        {
+            printf("%s pooling, step %d: replayed loss %.17g, recorded %.17g\n", name, step, replayedLoss,
+                   tapeValue(&fresh, freshLoss)->array.doubleArray[0]);
+            failures++;
+        }
+        for (size_t i = 0; i < PARAMS && rcode == OK; i++)
+            if (memcmp(replayed[i], net.grads[i].array.charArray, lengths[i] * sizeof(double)))
+            {
+                printf("%s pooling, step %d: the replayed gradient of the %s isn't the recorded one\n", name, step,
+                       paramNames[i]);
+                failures++;
+            }
+        freeTape(&fresh);
+    }
+    if (rcode == ERROR)
+    {
+        printf("%s pooling: can't record or replay\n", name);
+        failures++;
+    }
+
+    freeTape(&tape);
+    freeNet(&net);
+    for (size_t i = 0; i < PARAMS; i++)
+        free(replayed[i]);
+    return failures;
+}
+
+int main(void)
+{
+    srand(1);
+    int failures = 0;
+    for (Plm mode = POOLING_MAX; mode <= POOLING_AVERAGE; mode++)
+    {
+        failures += checkGradients(mode);
+        failures += checkReplay(mode);
+    }
+    printf("%d gradients or replays of the tape are off\n", failures);
+
+    return failures ? 1 : 0;
+}
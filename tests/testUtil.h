@@ -0,0 +1,49 @@
+/**
+ * @file testUtil.h
+ * @author luwangguerde@163.com
+ * @brief Random fills and comparisons shared by the tests, every test is a program ctest runs and exits 1 on failure
+ * @version 0.1
+ * @date 2024-12-28
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include "base.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static inline double testValueAt(const char *array, size_t i, Dtp dtype)
+{
+    return dtype == FLOAT_TYPE ? ((const float *)array)[i] : ((const double *)array)[i];
+}
+
+static inline void testFillRandom(char *array, size_t length, Dtp dtype) // uniform in [-1, 1]
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        double x = 2.0 * rand() / RAND_MAX - 1.0;
+        if (dtype == FLOAT_TYPE)
+            ((float *)array)[i] = (float)x;
+        else
+            ((double *)array)[i] = x;
+    }
+}
+
+// max |x - y| / max(1, max |y|), the error of x against the reference y relative to its scale
+static inline double testRelativeError(const char *x, const char *y, size_t length, Dtp dtype)
+{
+    double diff = 0, scale = 1;
+    for (size_t i = 0; i < length; i++)
+    {
+        diff = fmax(diff, fabs(testValueAt(x, i, dtype) - testValueAt(y, i, dtype)));
+        scale = fmax(scale, fabs(testValueAt(y, i, dtype)));
+    }
+
+    return diff / scale;
+}
+
+#endif